@@ -185,8 +185,31 @@ struct CAddressIndexKey {
         spending = false;
     }
 
+    friend bool operator==(const CAddressIndexKey& a, const CAddressIndexKey& b) {
+        return a.type == b.type && a.hashBytes == b.hashBytes && a.token == b.token && a.blockHeight == b.blockHeight &&
+               a.txindex == b.txindex && a.txhash == b.txhash && a.index == b.index && a.spending == b.spending;
+    }
 };
 
+/** Order of the address index entries of several addresses merged together: by height, then transaction */
+inline bool AddressIndexMergeLess(const CAddressIndexKey& a, const CAddressIndexKey& b) {
+    if (a.blockHeight != b.blockHeight)
+        return a.blockHeight < b.blockHeight;
+    if (a.txindex != b.txindex)
+        return a.txindex < b.txindex;
+    if (a.txhash != b.txhash)
+        return a.txhash < b.txhash;
+    if (a.type != b.type)
+        return a.type < b.type;
+    if (a.hashBytes != b.hashBytes)
+        return a.hashBytes < b.hashBytes;
+    if (a.token != b.token)
+        return a.token < b.token;
+    if (a.index != b.index)
+        return a.index < b.index;
+    return a.spending < b.spending;
+}
+
 struct CAddressIndexIteratorKey {
     unsigned int type;
     uint160 hashBytes;
@@ -314,6 +337,37 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** The balance index is keyed like the address index entries of one token */
+typedef CAddressIndexIteratorTokenKey CAddressBalanceKey;
+
+/** Sum of the address index entries of one address and token */
+struct CAddressBalanceValue {
+    CAmount balance;
+    //! Sum of the entries that received, change included
+    CAmount received;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+    }
+
+    bool IsNull() const {
+        return balance == 0 && received == 0;
+    }
+};
+
 struct CMempoolAddressDelta
 {
     int64_t time;
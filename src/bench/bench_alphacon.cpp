@@ -5,6 +5,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "crypto/groestl512.h"
 #include "crypto/sha256.h"
 #include "key.h"
 #include "validation.h"
@@ -15,6 +16,7 @@ int
 main(int argc, char **argv)
 {
     SHA256AutoDetect();
+    Groestl512AutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -16,6 +16,7 @@
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
+#include "crypto/groestl512.h"
 
 /* Number of bytes to hash per iteration */
 static const uint64_t BUFFER_SIZE = 1000*1000;
@@ -62,6 +63,25 @@ static void SHA512(benchmark::State& state)
         CSHA512().Write(in.data(), in.size()).Finalize(hash);
 }
 
+static void GROESTL512(benchmark::State& state)
+{
+    uint8_t hash[GROESTL512_OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE,0);
+    while (state.KeepRunning())
+        Groestl512(in.data(), in.size(), hash);
+}
+
+static void GROESTL_80b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(80,0);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 10000; i++) {
+            uint256 hash = groestlhash(in.begin(), in.end());
+            std::copy(hash.begin(), hash.end(), in.begin());
+        }
+    }
+}
+
 static void SipHash_32b(benchmark::State& state)
 {
     uint256 x;
@@ -98,8 +118,10 @@ BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
+BENCHMARK(GROESTL512);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(GROESTL_80b);
 BENCHMARK(SipHash_32b);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
@@ -0,0 +1,98 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "coins.h"
+#include "random.h"
+#include "txmempool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Transactions with two inputs and two outputs, paying between a small set of
+// addresses so that the address index has many deltas for each of them. Each
+// iteration adds all of them to an empty mempool, so txs/second = NUM_TXS / average iteration time.
+static const int NUM_TXS = 1000;
+static const int NUM_ADDRESSES = 100;
+
+static CScript AddressScript(const uint160& hash)
+{
+    return CScript() << OP_DUP << OP_HASH160 << ToByteVector(hash) << OP_EQUALVERIFY << OP_CHECKSIG;
+}
+
+static void MempoolAccept(benchmark::State& state, bool fIndexes, bool fReaders)
+{
+    std::vector<uint160> vAddresses;
+    for (int i = 0; i < NUM_ADDRESSES; i++) {
+        uint256 hash = GetRandHash();
+        vAddresses.push_back(uint160(std::vector<unsigned char>(hash.begin(), hash.begin() + 20)));
+    }
+
+    CCoinsView coinsDummy;
+    CCoinsViewCache view(&coinsDummy);
+    std::vector<CTransactionRef> vtx;
+    for (int i = 0; i < NUM_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(2);
+        tx.vout.resize(2);
+        for (int j = 0; j < 2; j++) {
+            tx.vin[j].prevout = COutPoint(GetRandHash(), j);
+            view.AddCoin(tx.vin[j].prevout, Coin(CTxOut(COIN, AddressScript(vAddresses[(i + j) % NUM_ADDRESSES])), 1, false, false, 0), false);
+            tx.vout[j] = CTxOut(COIN, AddressScript(vAddresses[(i * 7 + j) % NUM_ADDRESSES]));
+        }
+        vtx.push_back(MakeTransactionRef(tx));
+    }
+
+    while (state.KeepRunning()) {
+        CTxMemPool pool;
+
+        // Explorers asking for the mempool deltas of addresses while transactions come in
+        std::atomic<bool> fStop(false);
+        std::vector<std::thread> vReaders;
+        for (int i = 0; fReaders && i < 2; i++) {
+            vReaders.emplace_back([&pool, &vAddresses, &fStop, i] {
+                for (int n = i; !fStop; n++) {
+                    std::vector<std::pair<uint160, int> > addresses(1, std::make_pair(vAddresses[n % NUM_ADDRESSES], 1));
+                    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > results;
+                    pool.getAddressIndex(addresses, results);
+                }
+            });
+        }
+
+        LockPoints lp;
+        for (const auto& tx : vtx) {
+            CTxMemPoolEntry entry(tx, 1000, 0, 1, false, 4, lp);
+            LOCK(pool.cs);
+            pool.addUnchecked(tx->GetHash(), entry);
+            if (fIndexes) {
+                pool.addAddressIndex(entry, view);
+                pool.addSpentIndex(entry, view);
+            }
+        }
+
+        fStop = true;
+        for (auto& reader : vReaders)
+            reader.join();
+    }
+}
+
+static void MempoolAcceptNoIndex(benchmark::State& state)
+{
+    MempoolAccept(state, false, false);
+}
+
+static void MempoolAcceptAddressIndex(benchmark::State& state)
+{
+    MempoolAccept(state, true, false);
+}
+
+static void MempoolAcceptAddressIndexReaders(benchmark::State& state)
+{
+    MempoolAccept(state, true, true);
+}
+
+BENCHMARK(MempoolAcceptNoIndex);
+BENCHMARK(MempoolAcceptAddressIndex);
+BENCHMARK(MempoolAcceptAddressIndexReaders);
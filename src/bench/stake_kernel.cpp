@@ -0,0 +1,64 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "pos.h"
+#include "random.h"
+
+// Each iteration checks KERNELS_PER_ITER prevouts against a mainnet-like
+// target, so kernels/second = KERNELS_PER_ITER / average iteration time.
+static const size_t KERNELS_PER_ITER = 1000;
+static const unsigned int KERNEL_BITS = 0x1d00ffff;
+
+static std::vector<std::pair<COutPoint, CStakeCache> > MakeKernels(const CBlockIndex& tip)
+{
+    FastRandomContext rng(true);
+    std::vector<std::pair<COutPoint, CStakeCache> > vKernels;
+    for (size_t i = 0; i < KERNELS_PER_ITER; i++) {
+        COutPoint prevout(rng.rand256(), rng.randrange(4));
+        vKernels.emplace_back(prevout, CStakeCache(tip.nTime - 86400, (1 + rng.randrange(10000)) * COIN, 1));
+    }
+    return vKernels;
+}
+
+// One CheckStakeKernelHash per prevout, as CreateCoinStake used to do
+static void StakeKernelCheck(benchmark::State& state)
+{
+    CBlockIndex tip;
+    tip.nHeight = 100000;
+    tip.nTime = 1560000000;
+    tip.nStakeModifier = GetRandHash();
+    std::vector<std::pair<COutPoint, CStakeCache> > vKernels = MakeKernels(tip);
+
+    uint32_t nTimeBlock = tip.nTime;
+    while (state.KeepRunning()) {
+        nTimeBlock += STAKE_TIMESTAMP_MASK + 1;
+        for (const auto& kernel : vKernels)
+            CheckStakeKernelHash(&tip, KERNEL_BITS, kernel.second.amount, kernel.first, nTimeBlock, kernel.second.nTime);
+    }
+}
+
+// The same prevouts through CStakeKernelSearch::Find
+static void StakeKernelSearch(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    CBlockIndex tip;
+    tip.nHeight = 100000;
+    tip.nTime = 1560000000;
+    tip.nStakeModifier = GetRandHash();
+    std::vector<std::pair<COutPoint, CStakeCache> > vKernels = MakeKernels(tip);
+
+    uint32_t nTimeBlock = tip.nTime;
+    while (state.KeepRunning()) {
+        nTimeBlock += STAKE_TIMESTAMP_MASK + 1;
+        CStakeKernelSearch kernelSearch(&tip, KERNEL_BITS, chainParams->GetConsensus());
+        for (int i = kernelSearch.Find(vKernels, nTimeBlock); i >= 0; i = kernelSearch.Find(vKernels, nTimeBlock, i + 1));
+    }
+}
+
+BENCHMARK(StakeKernelCheck);
+BENCHMARK(StakeKernelSearch);
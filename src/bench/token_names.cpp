@@ -0,0 +1,27 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "tokens/tokens.h"
+
+// A mix of the names seen in transfer outputs, valid and not. Each iteration
+// validates all of them, so names/second = size / average iteration time.
+static const std::vector<std::string> TOKEN_NAMES = {
+    "ALPHA", "MAX_TOKEN_IS_30_CHARACTERS_LNG", "ALPHA/SUB", "ALPHA/SUB/DEEPER.NAME", "ALPHA#Serial_0001",
+    "ALPHA/SUB#{tag}", "ALPHA~CHANNEL", "ALPHA!", "ALPHA/SUB!", "ALPHA^VOTE_1",
+    "alpha", "ALPHA..BETA", "_ALPHA", "ALPHA/", "ALP", "TOO_LONG_NAME_FOR_A_TOKEN_THAT_IS_31",
+};
+
+static void TokenNameValidation(benchmark::State& state)
+{
+    TokenType type;
+    std::string error;
+    while (state.KeepRunning()) {
+        for (const auto& name : TOKEN_NAMES)
+            IsTokenNameValid(name, type, error);
+    }
+}
+
+BENCHMARK(TokenNameValidation);
@@ -201,6 +201,12 @@ public:
             }
         };
 
+        snapshotData = (CSnapshotData) {
+            {
+                // Height -> "snapshot_hash" reported by dumptxoutset on a trusted node
+            }
+        };
+
         chainTxData = ChainTxData{
             // Update as we know more about the contents of the Alphacon chain
             // Stats as of 000000000000a72545994ce72b25042ea63707fca169ca4deb7f9dab4f1b1798 window size 43200
@@ -322,6 +328,12 @@ public:
             }
         };
 
+        snapshotData = (CSnapshotData) {
+            {
+                // Height -> "snapshot_hash" reported by dumptxoutset on a trusted node
+            }
+        };
+
         chainTxData = ChainTxData{
             // Update as we know more about the contents of the Alphacon chain
             // Stats as of 000000000000a72545994ce72b25042ea63707fca169ca4deb7f9dab4f1b1798 window size 43200
@@ -404,6 +416,11 @@ public:
             }
         };
 
+        snapshotData = (CSnapshotData) {
+            {
+            }
+        };
+
         chainTxData = ChainTxData{
             0,
             0,
@@ -33,6 +33,12 @@ struct CCheckpointData {
     MapCheckpoints mapCheckpoints;
 };
 
+typedef std::map<int, uint256> MapSnapshotHashes;
+
+struct CSnapshotData {
+    MapSnapshotHashes mapSnapshotHashes;
+};
+
 struct ChainTxData {
     int64_t nTime;
     int64_t nTxCount;
@@ -79,6 +85,8 @@ public:
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
     const ChainTxData& TxData() const { return chainTxData; }
+    /** Known hashes of UTXO snapshots, checked by loadtxoutset when asked to */
+    const CSnapshotData& Snapshots() const { return snapshotData; }
     void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout);
     void TurnOffSegwit();
     void TurnOffCSV();
@@ -123,6 +131,7 @@ protected:
     bool fMiningRequiresPeers;
     CCheckpointData checkpointData;
     ChainTxData chainTxData;
+    CSnapshotData snapshotData;
 
     /** TOKENS START **/
     // Burn Amounts
@@ -148,13 +148,11 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, uint2
                 }
             } else if (tx.IsNewUniqueToken()) {
                 for (int n = 0; n < (int)tx.vout.size(); n++) {
-                    auto out = tx.vout[n];
-
                     CNewToken token;
                     std::string strAddress;
 
-                    if (IsScriptNewUniqueToken(out.scriptPubKey)) {
-                        TokenFromScript(out.scriptPubKey, token, strAddress);
+                    if (IsNewUniqueTokenOutput(tx, n)) {
+                        TokenFromTransaction(tx, n, token, strAddress);
 
                         // Add the new token to cache
                         if (!tokensCache->AddNewToken(token, strAddress, nHeight, blockHash))
@@ -179,7 +177,7 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, uint2
                 if (tx.vout[i].scriptPubKey.IsTransferToken() && !tx.vout[i].scriptPubKey.IsUnspendable()) {
                     CTokenTransfer tokenTransfer;
                     std::string address;
-                    if (!TransferTokenFromScript(tx.vout[i].scriptPubKey, tokenTransfer, address))
+                    if (!TransferTokenFromTransaction(tx, i, tokenTransfer, address))
                         LogPrintf(
                                 "%s : ERROR - Received a coin that was a Transfer Token but failed to get the transfer object from the scriptPubKey. CTxOut: %s\n",
                                 __func__, tx.vout[i].ToString());
@@ -176,8 +176,9 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, CTokensCa
 
     // Check for negative or overflow output values
     CAmount nValueOut = 0;
-    for (const auto& txout : tx.vout)
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
     {
+        const CTxOut& txout = tx.vout[i];
         if (txout.IsEmpty() && !tx.IsCoinBase() && !tx.IsCoinStake())
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-vout-empty");
 
@@ -212,7 +213,7 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, CTokensCa
                 if ( nType == TX_TRANSFER_TOKEN) {
                     CTokenTransfer transfer;
                     std::string address;
-                    if (!TransferTokenFromScript(txout.scriptPubKey, transfer, address))
+                    if (!TransferTokenFromTransaction(tx, i, transfer, address))
                         return state.DoS(100, false, REJECT_INVALID, "bad-txns-transfer-token-bad-deserialize");
 
                     // Check token name validity and get type
@@ -309,13 +310,13 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, CTokensCa
                     return state.DoS(100, false, REJECT_INVALID, strError);
                 }
 
-                for (auto out : tx.vout)
+                for (unsigned int i = 0; i < tx.vout.size(); i++)
                 {
-                    if (IsScriptNewUniqueToken(out.scriptPubKey))
+                    if (IsNewUniqueTokenOutput(tx, i))
                     {
                         CNewToken token;
                         std::string strAddress;
-                        if (!TokenFromScript(out.scriptPubKey, token, strAddress))
+                        if (!TokenFromTransaction(tx, i, token, strAddress))
                             return state.DoS(100, false, REJECT_INVALID, "bad-txns-check-transaction-issue-unique-token-serialization");
 
                         if (!token.IsValid(strError, *tokenCache, fMemPoolCheck, fCheckTokenDuplicate, fForceDuplicateCheck))
@@ -325,7 +326,7 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, CTokensCa
             } else {
                 // Fail if transaction contains any non-transfer token scripts and hasn't conformed to one of the
                 // above transaction types.  Also fail if it contains OP_ALP_TOKEN opcode but wasn't a valid script.
-                for (auto out : tx.vout) {
+                for (const auto& out : tx.vout) {
                     int nType;
                     bool _isOwner;
                     if (out.scriptPubKey.IsTokenScript(nType, _isOwner)) {
@@ -420,44 +421,56 @@ bool Consensus::CheckTxTokens(const CTransaction& tx, CValidationState& state, c
                          strprintf("%s: inputs missing/spent", __func__));
     }
 
-    // Create map that stores the amount of an token transaction input. Used to verify no tokens are burned
-    std::map<std::string, CAmount> totalInputs;
-
+    std::vector<Coin> vTokenCoins;
     for (unsigned int i = 0; i < tx.vin.size(); ++i) {
-        const COutPoint &prevout = tx.vin[i].prevout;
-        const Coin& coin = inputs.AccessCoin(prevout);
+        const Coin& coin = inputs.AccessCoin(tx.vin[i].prevout);
         assert(!coin.IsSpent());
 
-        if (coin.IsToken()) {
-            std::string strName;
-            CAmount nAmount;
-            uint32_t nTokenLockTime;
+        if (coin.IsToken())
+            vTokenCoins.push_back(coin);
+    }
+
+    if (!CheckTxTokenTransfers(tx, state, vTokenCoins, nSpendHeight, nSpendTime, fRunningUnitTests))
+        return false;
 
-            if (!GetTokenInfoFromCoin(coin, strName, nAmount, nTokenLockTime))
-                return state.DoS(100, false, REJECT_INVALID, "bad-txns-failed-to-get-token-from-script");
+    return CheckTxTokenReissues(tx, state, vPairReissueTokens, fRunningUnitTests);
+}
 
-            // Add to the total value of tokens in the inputs
-            if (totalInputs.count(strName))
-                totalInputs.at(strName) += nAmount;
-            else
-                totalInputs.insert(make_pair(strName, nAmount));
+bool Consensus::CheckTxTokenTransfers(const CTransaction& tx, CValidationState& state, const std::vector<Coin>& vTokenCoins, int nSpendHeight, int64_t nSpendTime, const bool fRunningUnitTests)
+{
+    // Create map that stores the amount of an token transaction input. Used to verify no tokens are burned
+    std::map<std::string, CAmount> totalInputs;
 
-            if ((int64_t)nTokenLockTime > ((int64_t)nTokenLockTime < LOCKTIME_THRESHOLD ? (int64_t)nSpendHeight : nSpendTime)) {
-                std::string errorMsg = strprintf("Tried to spend token before %d", nTokenLockTime);
-                return state.DoS(100, false,
-                    REJECT_INVALID, "bad-tx-token-premature-spend-of-token " + errorMsg);
-            }
+    for (const Coin& coin : vTokenCoins) {
+        std::string strName;
+        CAmount nAmount;
+        uint32_t nTokenLockTime;
+
+        if (!GetTokenInfoFromCoin(coin, strName, nAmount, nTokenLockTime))
+            return state.DoS(100, false, REJECT_INVALID, "bad-txns-failed-to-get-token-from-script");
+
+        // Add to the total value of tokens in the inputs
+        if (totalInputs.count(strName))
+            totalInputs.at(strName) += nAmount;
+        else
+            totalInputs.insert(make_pair(strName, nAmount));
+
+        if ((int64_t)nTokenLockTime > ((int64_t)nTokenLockTime < LOCKTIME_THRESHOLD ? (int64_t)nSpendHeight : nSpendTime)) {
+            std::string errorMsg = strprintf("Tried to spend token before %d", nTokenLockTime);
+            return state.DoS(100, false,
+                REJECT_INVALID, "bad-tx-token-premature-spend-of-token " + errorMsg);
         }
     }
 
     // Create map that stores the amount of an token transaction output. Used to verify no tokens are burned
     std::map<std::string, CAmount> totalOutputs;
 
-    for (const auto& txout : tx.vout) {
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const CTxOut& txout = tx.vout[i];
         if (txout.scriptPubKey.IsTransferToken()) {
             CTokenTransfer transfer;
             std::string address;
-            if (!TransferTokenFromScript(txout.scriptPubKey, transfer, address))
+            if (!TransferTokenFromTransaction(tx, i, transfer, address))
                 return state.DoS(100, false, REJECT_INVALID, "bad-tx-token-transfer-bad-deserialize");
 
             // Add to the total value of tokens in the outputs
@@ -484,27 +497,6 @@ bool Consensus::CheckTxTokens(const CTransaction& tx, CValidationState& state, c
                         return state.DoS(100, false, REJECT_INVALID, "bad-txns-transfer-token-amount-not-match-units");
                 }
             }
-        } else if (txout.scriptPubKey.IsReissueToken()) {
-            CReissueToken reissue;
-            std::string address;
-            if (!ReissueTokenFromScript(txout.scriptPubKey, reissue, address))
-                return state.DoS(100, false, REJECT_INVALID, "bad-tx-token-reissue-bad-deserialize");
-
-            if (!fRunningUnitTests) {
-                auto currentActiveTokenCache = GetCurrentTokenCache();
-                std::string strError;
-                if (!reissue.IsValid(strError, *currentActiveTokenCache)) {
-                    return state.DoS(100, false, REJECT_INVALID,
-                                     "bad-txns" + strError);
-                }
-            }
-
-            if (mapReissuedTokens.count(reissue.strName)) {
-                if (mapReissuedTokens.at(reissue.strName) != tx.GetHash())
-                    return state.DoS(100, false, REJECT_INVALID, "bad-tx-reissue-chaining-not-allowed");
-            } else {
-                vPairReissueTokens.emplace_back(std::make_pair(reissue.strName, tx.GetHash()));
-            }
         }
     }
 
@@ -529,3 +521,34 @@ bool Consensus::CheckTxTokens(const CTransaction& tx, CValidationState& state, c
 
     return true;
 }
+
+bool Consensus::CheckTxTokenReissues(const CTransaction& tx, CValidationState& state, std::vector<std::pair<std::string, uint256> >& vPairReissueTokens, const bool fRunningUnitTests)
+{
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const CTxOut& txout = tx.vout[i];
+        if (txout.scriptPubKey.IsReissueToken()) {
+            CReissueToken reissue;
+            std::string address;
+            if (!ReissueTokenFromTransaction(tx, i, reissue, address))
+                return state.DoS(100, false, REJECT_INVALID, "bad-tx-token-reissue-bad-deserialize");
+
+            if (!fRunningUnitTests) {
+                auto currentActiveTokenCache = GetCurrentTokenCache();
+                std::string strError;
+                if (!reissue.IsValid(strError, *currentActiveTokenCache)) {
+                    return state.DoS(100, false, REJECT_INVALID,
+                                     "bad-txns" + strError);
+                }
+            }
+
+            if (mapReissuedTokens.count(reissue.strName)) {
+                if (mapReissuedTokens.at(reissue.strName) != tx.GetHash())
+                    return state.DoS(100, false, REJECT_INVALID, "bad-tx-reissue-chaining-not-allowed");
+            } else {
+                vPairReissueTokens.emplace_back(std::make_pair(reissue.strName, tx.GetHash()));
+            }
+        }
+    }
+
+    return true;
+}
@@ -15,6 +15,7 @@
 
 class CBlockIndex;
 class CCoinsViewCache;
+class Coin;
 class CTransaction;
 class CValidationState;
 class CTokensCache;
@@ -37,6 +38,17 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 
 /** TOKENS START */
 bool CheckTxTokens(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, int64_t nSpendTime, std::vector<std::pair<std::string, uint256> >& vPairReissueTokens, const bool fRunningUnitTests = false);
+
+/**
+ * The part of CheckTxTokens that only needs the token coins the transaction spends: the token
+ * amounts in and out match, no token is spent before its lock time, owner tokens are moved
+ * whole and other amounts fit the units of their token. Reads no coins view, so it can run
+ * on the check queue threads while the block is being connected.
+ */
+bool CheckTxTokenTransfers(const CTransaction& tx, CValidationState& state, const std::vector<Coin>& vTokenCoins, int nSpendHeight, int64_t nSpendTime, const bool fRunningUnitTests = false);
+
+//! The reissue part of CheckTxTokens, which also looks at the reissues in the mempool
+bool CheckTxTokenReissues(const CTransaction& tx, CValidationState& state, std::vector<std::pair<std::string, uint256> >& vPairReissueTokens, const bool fRunningUnitTests = false);
 /** TOKENS END */
 } // namespace Consensus
 
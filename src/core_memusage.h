@@ -32,7 +32,8 @@ static inline size_t RecursiveDynamicUsage(const CTxOut& out) {
 }
 
 static inline size_t RecursiveDynamicUsage(const CTransaction& tx) {
-    size_t mem = memusage::DynamicUsage(tx.vin) + memusage::DynamicUsage(tx.vout);
+    // The token outputs get read here if they were not, so the usage of a transaction doesn't change later
+    size_t mem = memusage::DynamicUsage(tx.vin) + memusage::DynamicUsage(tx.vout) + tx.TokenOutputsDynamicUsage();
     for (std::vector<CTxIn>::const_iterator it = tx.vin.begin(); it != tx.vin.end(); it++) {
         mem += RecursiveDynamicUsage(*it);
     }
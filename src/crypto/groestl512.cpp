@@ -0,0 +1,72 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/groestl512.h"
+#include "crypto/sph_groestl.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(ENABLE_AESNI)
+#include <cpuid.h>
+namespace groestl_aesni
+{
+void Groestl512(const unsigned char* data, size_t len, unsigned char* hash);
+}
+#endif
+
+namespace
+{
+/** Portable reference implementation. */
+void Groestl512Sph(const unsigned char* data, size_t len, unsigned char* hash)
+{
+    sph_groestl512_context ctx;
+    sph_groestl512_init(&ctx);
+    sph_groestl512(&ctx, data, len);
+    sph_groestl512_close(&ctx, hash);
+}
+
+typedef void (*Groestl512Type)(const unsigned char*, size_t, unsigned char*);
+
+/** Compare an implementation against the reference one, across every padding case. */
+bool SelfTest(Groestl512Type impl)
+{
+    unsigned char data[300];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = (i * 7 + 3) & 0xff;
+
+    for (size_t len = 0; len <= sizeof(data); len++) {
+        unsigned char out1[GROESTL512_OUTPUT_SIZE], out2[GROESTL512_OUTPUT_SIZE];
+        Groestl512Sph(data, len, out1);
+        impl(data, len, out2);
+        if (memcmp(out1, out2, sizeof(out1)))
+            return false;
+    }
+    return true;
+}
+
+Groestl512Type Implementation = Groestl512Sph;
+
+} // namespace
+
+void Groestl512(const unsigned char* data, size_t len, unsigned char hash[GROESTL512_OUTPUT_SIZE])
+{
+    Implementation(data, len, hash);
+}
+
+std::string Groestl512AutoDetect()
+{
+#if defined(ENABLE_AESNI)
+    uint32_t eax, ebx, ecx, edx;
+    // SSSE3 and AES-NI
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && ((ecx >> 9) & 1) && ((ecx >> 25) & 1)) {
+        Implementation = groestl_aesni::Groestl512;
+        assert(SelfTest(Implementation));
+        return "aesni";
+    }
+#endif
+
+    Implementation = Groestl512Sph;
+    return "standard";
+}
@@ -0,0 +1,22 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ALPHACON_CRYPTO_GROESTL512_H
+#define ALPHACON_CRYPTO_GROESTL512_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+static const size_t GROESTL512_OUTPUT_SIZE = 64;
+
+/** Compute the Groestl-512 hash of data with the implementation selected by Groestl512AutoDetect(). */
+void Groestl512(const unsigned char* data, size_t len, unsigned char hash[GROESTL512_OUTPUT_SIZE]);
+
+/** Autodetect the best available Groestl-512 implementation.
+ *  Returns the name of the implementation.
+ */
+std::string Groestl512AutoDetect();
+
+#endif // ALPHACON_CRYPTO_GROESTL512_H
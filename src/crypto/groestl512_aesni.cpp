@@ -0,0 +1,247 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Groestl-512 using AES-NI for SubBytes and SSSE3 byte shuffles for
+// ShiftBytes and the state transposition.
+//
+// The 8x16 byte state is kept one row per register, so ShiftBytes is a
+// rotation inside each register. AESENCLAST with a zero key applies the AES
+// S-box followed by AES ShiftRows, and the shuffle after it undoes ShiftRows
+// and applies the Groestl row rotation in one step. MixBytes is computed on
+// whole rows with a vectorised multiplication by 2 in GF(2^8).
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ENABLE_AESNI)
+
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+namespace groestl_aesni
+{
+namespace
+{
+
+// Shuffle masks applied after AESENCLAST. Entry t of the mask for a row
+// rotated by s is the position AES ShiftRows moved byte (t + s) mod 16 to.
+alignas(16) static const uint8_t SHIFT_P[8][16] = {
+    {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3},
+    {13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0},
+    {10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13},
+    {7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10},
+    {4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7},
+    {1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4},
+    {14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1},
+    {15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2},
+};
+
+alignas(16) static const uint8_t SHIFT_Q[8][16] = {
+    {13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0},
+    {7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10},
+    {1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4},
+    {15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2},
+    {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3},
+    {10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13},
+    {4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7},
+    {14, 11, 8, 5, 2, 15, 12, 9, 6, 3, 0, 13, 10, 7, 4, 1},
+};
+
+// Column numbers shifted into the high nibble, as used by the round constants
+alignas(16) static const uint8_t COLUMNS[16] = {
+    0x00, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90, 0xa0, 0xb0, 0xc0, 0xd0, 0xe0, 0xf0
+};
+
+// Interleaves the two 8-byte columns of a message register row by row
+alignas(16) static const uint8_t INTERLEAVE[16] = {0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15};
+alignas(16) static const uint8_t DEINTERLEAVE[16] = {0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15};
+
+static const int ROUNDS = 14;
+
+inline __m128i Load(const uint8_t* p) { return _mm_load_si128((const __m128i*)p); }
+
+/** Multiply every byte by 2 in GF(2^8) modulo the AES polynomial. */
+inline __m128i Double(__m128i x)
+{
+    __m128i carry = _mm_cmpgt_epi8(_mm_setzero_si128(), x);
+    return _mm_xor_si128(_mm_add_epi8(x, x), _mm_and_si128(carry, _mm_set1_epi8(0x1b)));
+}
+
+/** 8x8 transposition of 16-bit words, its own inverse. */
+inline void Transpose(__m128i s[8])
+{
+    __m128i t0 = _mm_unpacklo_epi16(s[0], s[1]);
+    __m128i t1 = _mm_unpackhi_epi16(s[0], s[1]);
+    __m128i t2 = _mm_unpacklo_epi16(s[2], s[3]);
+    __m128i t3 = _mm_unpackhi_epi16(s[2], s[3]);
+    __m128i t4 = _mm_unpacklo_epi16(s[4], s[5]);
+    __m128i t5 = _mm_unpackhi_epi16(s[4], s[5]);
+    __m128i t6 = _mm_unpacklo_epi16(s[6], s[7]);
+    __m128i t7 = _mm_unpackhi_epi16(s[6], s[7]);
+
+    __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+    __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+    __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+    __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+    __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+    __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+    __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+    __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+
+    s[0] = _mm_unpacklo_epi64(u0, u4);
+    s[1] = _mm_unpackhi_epi64(u0, u4);
+    s[2] = _mm_unpacklo_epi64(u1, u5);
+    s[3] = _mm_unpackhi_epi64(u1, u5);
+    s[4] = _mm_unpacklo_epi64(u2, u6);
+    s[5] = _mm_unpackhi_epi64(u2, u6);
+    s[6] = _mm_unpacklo_epi64(u3, u7);
+    s[7] = _mm_unpackhi_epi64(u3, u7);
+}
+
+/** Load a 128-byte block, stored column by column, into one register per row. */
+inline void LoadRows(__m128i s[8], const unsigned char* block)
+{
+    const __m128i interleave = Load(INTERLEAVE);
+    for (int i = 0; i < 8; i++)
+        s[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(block + 16 * i)), interleave);
+    Transpose(s);
+}
+
+/** Inverse of LoadRows, in place. */
+inline void StoreColumns(__m128i s[8])
+{
+    const __m128i deinterleave = Load(DEINTERLEAVE);
+    Transpose(s);
+    for (int i = 0; i < 8; i++)
+        s[i] = _mm_shuffle_epi8(s[i], deinterleave);
+}
+
+// The round functions are unrolled by hand so that the state stays in
+// registers at -O2, where loops over the rows would not be unrolled.
+#define SUB_SHIFT(i) a##i = _mm_shuffle_epi8(_mm_aesenclast_si128(s[i], zero), Load(shift[i]))
+#define MIX_ROW(i, i1, i2, i3, i4, i5, i6, i7) \
+    s[i] = _mm_xor_si128(_mm_xor_si128(a##i2, _mm_xor_si128(t##i4, t##i6)), \
+           Double(_mm_xor_si128(_mm_xor_si128(_mm_xor_si128(t##i, a##i2), _mm_xor_si128(a##i5, a##i7)), \
+                                Double(_mm_xor_si128(t##i3, t##i6)))))
+
+/** SubBytes and ShiftBytes, then MixBytes. */
+inline void SubShiftMix(__m128i s[8], const uint8_t shift[8][16])
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a0, a1, a2, a3, a4, a5, a6, a7;
+    SUB_SHIFT(0); SUB_SHIFT(1); SUB_SHIFT(2); SUB_SHIFT(3);
+    SUB_SHIFT(4); SUB_SHIFT(5); SUB_SHIFT(6); SUB_SHIFT(7);
+
+    // Row i of MixBytes is 2 2 3 4 5 3 5 7 applied to rows i .. i+7 (mod 8).
+    // Split by coefficient bit into x1 + 2 * (x2 + 2 * x4), with
+    //   x1 = a[i+2] + t[i+4] + t[i+6]
+    //   x2 = t[i] + a[i+2] + a[i+5] + a[i+7]
+    //   x4 = t[i+3] + t[i+6]
+    // where t[i] = a[i] + a[i+1] is shared between rows.
+    __m128i t0 = _mm_xor_si128(a0, a1);
+    __m128i t1 = _mm_xor_si128(a1, a2);
+    __m128i t2 = _mm_xor_si128(a2, a3);
+    __m128i t3 = _mm_xor_si128(a3, a4);
+    __m128i t4 = _mm_xor_si128(a4, a5);
+    __m128i t5 = _mm_xor_si128(a5, a6);
+    __m128i t6 = _mm_xor_si128(a6, a7);
+    __m128i t7 = _mm_xor_si128(a7, a0);
+    MIX_ROW(0, 1, 2, 3, 4, 5, 6, 7);
+    MIX_ROW(1, 2, 3, 4, 5, 6, 7, 0);
+    MIX_ROW(2, 3, 4, 5, 6, 7, 0, 1);
+    MIX_ROW(3, 4, 5, 6, 7, 0, 1, 2);
+    MIX_ROW(4, 5, 6, 7, 0, 1, 2, 3);
+    MIX_ROW(5, 6, 7, 0, 1, 2, 3, 4);
+    MIX_ROW(6, 7, 0, 1, 2, 3, 4, 5);
+    MIX_ROW(7, 0, 1, 2, 3, 4, 5, 6);
+}
+
+#undef SUB_SHIFT
+#undef MIX_ROW
+
+inline void RoundP(__m128i s[8], int round)
+{
+    s[0] = _mm_xor_si128(s[0], _mm_xor_si128(Load(COLUMNS), _mm_set1_epi8(round)));
+    SubShiftMix(s, SHIFT_P);
+}
+
+inline void RoundQ(__m128i s[8], int round)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+    s[0] = _mm_xor_si128(s[0], ones);
+    s[1] = _mm_xor_si128(s[1], ones);
+    s[2] = _mm_xor_si128(s[2], ones);
+    s[3] = _mm_xor_si128(s[3], ones);
+    s[4] = _mm_xor_si128(s[4], ones);
+    s[5] = _mm_xor_si128(s[5], ones);
+    s[6] = _mm_xor_si128(s[6], ones);
+    s[7] = _mm_xor_si128(s[7], _mm_xor_si128(ones, _mm_xor_si128(Load(COLUMNS), _mm_set1_epi8(round))));
+    SubShiftMix(s, SHIFT_Q);
+}
+
+void PermutationP(__m128i s[8])
+{
+    for (int round = 0; round < ROUNDS; round++)
+        RoundP(s, round);
+}
+
+/** h = P(h ^ m) ^ Q(m) ^ h */
+void Compress(__m128i h[8], const unsigned char* block)
+{
+    __m128i m[8], p[8];
+    LoadRows(m, block);
+    for (int i = 0; i < 8; i++)
+        p[i] = _mm_xor_si128(h[i], m[i]);
+    // P and Q are independent, alternating their rounds keeps more
+    // AESENCLASTs in flight
+    for (int round = 0; round < ROUNDS; round++) {
+        RoundP(p, round);
+        RoundQ(m, round);
+    }
+    for (int i = 0; i < 8; i++)
+        h[i] = _mm_xor_si128(h[i], _mm_xor_si128(p[i], m[i]));
+}
+
+} // namespace
+
+void Groestl512(const unsigned char* data, size_t len, unsigned char* hash)
+{
+    // The initial value is the output size in bits, big endian, in the last
+    // column: byte 126 of the state is row 6 of column 15
+    __m128i h[8];
+    for (int i = 0; i < 8; i++)
+        h[i] = _mm_setzero_si128();
+    h[6] = _mm_insert_epi16(h[6], 0x0200, 7);
+
+    uint64_t blocks = 0;
+    for (; len >= 128; len -= 128, data += 128, blocks++)
+        Compress(h, data);
+
+    // Pad with 0x80, zeroes and the 64-bit big endian number of blocks
+    unsigned char buf[256] = {};
+    memcpy(buf, data, len);
+    buf[len] = 0x80;
+    size_t padlen = len + 9 <= 128 ? 128 : 256;
+    blocks += padlen / 128;
+    for (int i = 0; i < 8; i++)
+        buf[padlen - 1 - i] = blocks >> (8 * i);
+    for (size_t i = 0; i < padlen; i += 128)
+        Compress(h, buf + i);
+
+    // Output transformation, truncated to the last 512 bits
+    __m128i p[8];
+    for (int i = 0; i < 8; i++)
+        p[i] = h[i];
+    PermutationP(p);
+    for (int i = 0; i < 8; i++)
+        h[i] = _mm_xor_si128(h[i], p[i]);
+    StoreColumns(h);
+    for (int i = 0; i < 4; i++)
+        _mm_storeu_si128((__m128i*)(hash + 16 * i), h[4 + i]);
+}
+
+} // namespace groestl_aesni
+
+#endif
@@ -217,6 +217,9 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+CDBSnapshot::CDBSnapshot(const CDBWrapper& db) : pdb(db.pdb), psnapshot(db.pdb->GetSnapshot()) {}
+CDBSnapshot::~CDBSnapshot() { pdb->ReleaseSnapshot(psnapshot); }
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
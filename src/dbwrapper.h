@@ -175,9 +175,26 @@ public:
 
 };
 
+/** A consistent read-only view of a CDBWrapper as of the time it was taken */
+class CDBSnapshot
+{
+    friend class CDBWrapper;
+private:
+    leveldb::DB* pdb;
+    const leveldb::Snapshot* psnapshot;
+
+public:
+    explicit CDBSnapshot(const CDBWrapper& db);
+    ~CDBSnapshot();
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+};
+
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be nullptr in case of default environment)
     leveldb::Env* penv;
@@ -225,6 +242,22 @@ public:
 
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
+    {
+        return Read(key, value, readoptions);
+    }
+
+    /** Read the value as it was when snapshot was taken */
+    template <typename K, typename V>
+    bool Read(const K& key, V& value, const CDBSnapshot& snapshot) const
+    {
+        leveldb::ReadOptions options = readoptions;
+        options.snapshot = snapshot.psnapshot;
+        return Read(key, value, options);
+    }
+
+private:
+    template <typename K, typename V>
+    bool Read(const K& key, V& value, const leveldb::ReadOptions& options) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -232,7 +265,7 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -249,6 +282,7 @@ public:
         return true;
     }
 
+public:
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -303,6 +337,14 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    /** Iterate over the database as it was when snapshot was taken */
+    CDBIterator *NewIterator(const CDBSnapshot& snapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot.psnapshot;
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
@@ -16,6 +16,7 @@
 #include "uint256.h"
 #include "version.h"
 
+#include "crypto/groestl512.h"
 #include "crypto/sph_groestl.h"
 #include <vector>
 
@@ -305,18 +306,14 @@ template <typename T1>
 inline uint256 groestlhash(const T1 pbegin, const T1 pend)
 {
     static unsigned char pblank[1];
-    sph_groestl512_context ctx_groestl;
-    uint256 hash[2];
+    unsigned char hash[2][GROESTL512_OUTPUT_SIZE];
 
-    sph_groestl512_init(&ctx_groestl);
-    sph_groestl512(&ctx_groestl, (pbegin == pend ? pblank : static_cast<const void*>(&pbegin[0])), (pend - pbegin) * sizeof(pbegin[0]));
-    sph_groestl512_close(&ctx_groestl, static_cast<void*>(&hash[0]));
+    Groestl512((pbegin == pend ? pblank : (const unsigned char*)&pbegin[0]), (pend - pbegin) * sizeof(pbegin[0]), hash[0]);
+    Groestl512(hash[0], sizeof(hash[0]), hash[1]);
 
-    sph_groestl512_init(&ctx_groestl);
-    sph_groestl512 (&ctx_groestl, static_cast<const void*>(&hash[0]), 64);
-    sph_groestl512_close(&ctx_groestl, static_cast<void*>(&hash[1]));
-
-    return hash[1];
+    uint256 result;
+    std::copy(hash[1], hash[1] + result.size(), result.begin());
+    return result;
 }
 
 
@@ -384,9 +384,12 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
 
-    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
-    strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
-    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses, built in the background when turned on for an existing chain (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-addressbalanceindex", strprintf(_("Keep the balance of each address next to the address index, so that the getaddressbalance rpc call doesn't read the whole address history. Requires -addressindex (default: %u)"), DEFAULT_ADDRESSBALANCEINDEX));
+    strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps, built in the background when turned on for an existing chain (default: %u)"), DEFAULT_TIMESTAMPINDEX));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint, built in the background when turned on for an existing chain (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-tokennamefilter=<n>", strprintf(_("Keep a filter of all token names in memory, so that looking up a token that doesn't exist reads the token database for only 1 in <n> of them, 0 to disable (default: %u)"), DEFAULT_TOKEN_NAME_FILTER_RATE));
+    strUsage += HelpMessageOpt("-tokenrichindex", strprintf(_("Keep the holders of each token sorted by quantity, used by the listtopaddressesbytoken rpc call. Requires -tokenindex (default: %u)"), DEFAULT_TOKENRICHINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info)"));
@@ -446,6 +449,7 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
+        strUsage += HelpMessageOpt("-checkblockhashes", strprintf("Recompute the hash of every block header in the block index in the background after startup (default: %u)", DEFAULT_CHECK_BLOCK_HASHES));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", defaultChainParams->DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
@@ -916,6 +920,21 @@ bool AppInitParameterInteraction()
             return InitError(_("Prune mode is incompatible with -txindex."));
     }
 
+    int64_t nNameFilterRate = gArgs.GetArg("-tokennamefilter", DEFAULT_TOKEN_NAME_FILTER_RATE);
+    if (nNameFilterRate < 0 || nNameFilterRate > std::numeric_limits<unsigned int>::max())
+        return InitError(strprintf(_("Invalid -tokennamefilter value: %d"), nNameFilterRate));
+    nTokenNameFilterRate = nNameFilterRate;
+
+    // the rich list index is kept next to the token address quantities
+    fTokenRichIndex = gArgs.GetBoolArg("-tokenrichindex", DEFAULT_TOKENRICHINDEX);
+    if (fTokenRichIndex && !gArgs.GetBoolArg("-tokenindex", DEFAULT_TOKENINDEX))
+        return InitError(_("-tokenrichindex requires -tokenindex."));
+
+    // the address balances are kept up to date together with the address index
+    fAddressBalanceIndex = gArgs.GetBoolArg("-addressbalanceindex", DEFAULT_ADDRESSBALANCEINDEX);
+    if (fAddressBalanceIndex && !gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+        return InitError(_("-addressbalanceindex requires -addressindex."));
+
     // -bind and -whitebind can't be set when not listening
     size_t nUserBind = gArgs.GetArgs("-bind").size() + gArgs.GetArgs("-whitebind").size();
     if (nUserBind != 0 && !gArgs.GetBoolArg("-listen", DEFAULT_LISTEN)) {
@@ -1197,6 +1216,8 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string groestl_algo = Groestl512AutoDetect();
+    LogPrintf("Using the '%s' Groestl-512 implementation\n", groestl_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1249,10 +1270,12 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     InitSignatureCache();
     InitScriptExecutionCache();
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and token verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadTokenCheck);
     }
 
     // Start the lightweight task scheduler thread
@@ -1448,7 +1471,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete ptokensCache;
                 ptokensdb = new CTokensDB(nBlockTreeDBCache, false, fReset);
                 ptokens = new CTokensCache();
-                ptokensCache = new CLRUCache<std::string, CDatabasedTokenData>(MAX_CACHE_TOKENS_SIZE);
+                ptokensCache = new CShardedLRUCache<std::string, CDatabasedTokenData>(MAX_CACHE_TOKENS_SIZE);
 
                 // Read for fTokenIndex to make sure that we only load token address balances if it if true
                 pblocktree->ReadFlag("tokenindex", fTokenIndex);
@@ -1499,31 +1522,66 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
-                // Check for changed -addressindex state
-                if (fAddressIndex != gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -addressindex");
+                // Check for changed -addressindex state, an index that is turned on is built in the background
+                if (fAddressIndex && !gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to turn off -addressindex");
                     break;
                 }
+                if (!fAddressIndex && gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+                    if (!StartIndexBuild("addressindex")) {
+                        strLoadError = _("Error starting to build the address index");
+                        break;
+                    }
+                    fAddressIndex = true;
+                }
 
                 // Check for changed -spentindex state
-                if (fSpentIndex != gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -spentindex");
+                if (fSpentIndex && !gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to turn off -spentindex");
                     break;
                 }
+                if (!fSpentIndex && gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+                    if (!StartIndexBuild("spentindex")) {
+                        strLoadError = _("Error starting to build the spent index");
+                        break;
+                    }
+                    fSpentIndex = true;
+                }
 
                 // Check for changed -timestampindex state
-                if (fTimestampIndex != gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -timestampindex");
+                if (fTimestampIndex && !gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to turn off -timestampindex");
+                    break;
+                }
+                if (!fTimestampIndex && gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+                    if (!StartIndexBuild("timestampindex")) {
+                        strLoadError = _("Error starting to build the timestamp index");
+                        break;
+                    }
+                    fTimestampIndex = true;
+                }
+
+                // The address balance index is built from the address index, or dropped, without a reindex
+                if (!pblocktree->SetAddressBalanceIndex(fAddressIndex && fAddressBalanceIndex)) {
+                    strLoadError = _("Error building the address balance index");
                     break;
                 }
 
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
-                if (fHavePruned && !fPruneMode) {
+                if (fHavePruned && !fPruneMode && !fSnapshotChainstate) {
                     strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
 
+                // A UTXO snapshot that was only partly written leaves the coins and token databases unusable
+                bool fSnapshotLoading = false;
+                pblocktree->ReadFlag("snapshotloading", fSnapshotLoading);
+                if (fSnapshotLoading) {
+                    strLoadError = _("Loading a UTXO snapshot was interrupted. You need to rebuild the database using -reindex");
+                    break;
+                }
+
                 // At this point blocktree args are consistent with what's on disk.
                 // If we're not mid-reindex (based on disk + args), add a genesis block on disk
                 // (otherwise we use the one already on disk).
@@ -1696,6 +1754,15 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
+    if (gArgs.GetBoolArg("-checkblockhashes", DEFAULT_CHECK_BLOCK_HASHES))
+        threadGroup.create_thread(&ThreadCheckBlockIndexHashes);
+
+    // Finish building the indexes that were turned on, also after a restart in the middle of it
+    int nIndexBuildHeight;
+    if (GetIndexBuildHeight("addressindex", nIndexBuildHeight) || GetIndexBuildHeight("spentindex", nIndexBuildHeight) ||
+            GetIndexBuildHeight("timestampindex", nIndexBuildHeight))
+        threadGroup.create_thread(&ThreadIndexBuilder);
+
     // Wait for genesis block to be processed
     {
         boost::unique_lock<boost::mutex> lock(cs_GenesisWait);
@@ -79,7 +79,7 @@ bool CheckFirstCoinstakeOutput(const CBlock& block)
 
 #ifdef ENABLE_WALLET
 // novacoin: attempt to generate suitable proof-of-stake
-bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& nTotalFees)
+bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& nTotalFees, const CStakeShard* pshard)
 {
     // if we are trying to sign
     //    something except proof-of-stake block template
@@ -97,7 +97,7 @@ bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& n
 
     int64_t nSearchTime = txCoinStake.nTime; // search to current time
 
-    if (wallet.CreateCoinStake(wallet, pblock->nBits, nTotalFees, pblock->nTime, txCoinStake, key))
+    if (wallet.CreateCoinStake(wallet, pblock->nBits, nTotalFees, pblock->nTime, txCoinStake, key, pshard))
     {
         if (txCoinStake.nTime >= chainActive.Tip()->GetMedianTimePast()+1)
         {
@@ -762,7 +762,66 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlockAlp(const CScript&
 }
 
 
-void ThreadStakeMiner(CWallet *pwallet)
+/** Block template shared by the stake workers of a wallet */
+struct CStakeTemplate
+{
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    int64_t nTotalFees = 0;
+    uint256 hashPrevBlock;
+    uint32_t nTime = 0;
+    unsigned int nTransactionsUpdated = 0;
+    std::atomic<bool> fKernelFound{false};
+    CStakeCoins coins;
+};
+
+/** State shared by the stake workers of a wallet */
+struct CStakeWorkers
+{
+    CCriticalSection cs;
+    std::shared_ptr<CStakeTemplate> ptemplate;
+    unsigned int nThreads;
+
+    explicit CStakeWorkers(unsigned int nThreadsIn) : nThreads(nThreadsIn) {}
+};
+
+// The template, and the coins the workers stake with it, are rebuilt only when
+// the tip, the staking time slot or the mempool changes, instead of once per
+// worker and attempt
+static std::shared_ptr<CStakeTemplate> GetStakeTemplate(CWallet* pwallet, CStakeWorkers& workers, CReserveKey& reservekey)
+{
+    CStakeStats& stats = pwallet->stakeStats;
+    LOCK(workers.cs);
+
+    uint32_t nTime = GetAdjustedTime() & ~STAKE_TIMESTAMP_MASK;
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    uint256 hashPrevBlock;
+    {
+        LOCK(cs_main);
+        hashPrevBlock = chainActive.Tip()->GetBlockHash();
+    }
+
+    std::shared_ptr<CStakeTemplate> ptemplate = workers.ptemplate;
+    if (ptemplate && ptemplate->hashPrevBlock == hashPrevBlock && ptemplate->nTime == nTime &&
+            ptemplate->nTransactionsUpdated == nTransactionsUpdated)
+        return ptemplate;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::shared_ptr<CStakeTemplate> pnew = std::make_shared<CStakeTemplate>();
+    pnew->pblocktemplate = BlockAssembler(Params()).CreateNewBlockAlp(reservekey.reserveScript, false, true, &pnew->nTotalFees, 0);
+    stats.nTemplates++;
+    stats.nTemplateMicros += GetTimeMicros() - nTimeStart;
+    if (!pnew->pblocktemplate)
+        return nullptr;
+    pnew->hashPrevBlock = pnew->pblocktemplate->block.hashPrevBlock;
+    pnew->nTime = pnew->pblocktemplate->block.nTime;
+    pnew->nTransactionsUpdated = nTransactionsUpdated;
+    pwallet->SelectCoinsForStaking(pnew->coins, workers.nThreads);
+
+    workers.ptemplate = pnew;
+    return pnew;
+}
+
+void ThreadStakeMiner(CWallet *pwallet, std::shared_ptr<CStakeWorkers> workers, unsigned int nThread, unsigned int nThreads)
 {
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
 
@@ -772,6 +831,10 @@ void ThreadStakeMiner(CWallet *pwallet)
     {
         threadName = threadName + "-" + pwallet->GetName();
     }
+    if (nThreads > 1)
+    {
+        threadName = strprintf("%s-%u", threadName, nThread);
+    }
     RenameThread(threadName.c_str());
 
     CReserveKey reservekey(pwallet);
@@ -803,52 +866,134 @@ void ThreadStakeMiner(CWallet *pwallet)
             }
         }
 
-        // Create new block
-        if (pwallet->HaveAvailableCoinsForStaking()) {
-            int64_t nTotalFees = 0;
-            std::unique_ptr<CBlockTemplate> pblocktemplate(
-                        BlockAssembler(Params()).CreateNewBlockAlp(
-                            reservekey.reserveScript,
-                                false, true, &nTotalFees, 0));
+        // Check for a kernel at the current slot first, there is none without
+        // coins to stake. The block template is kept up to date by
+        // ThreadStakeTemplate in the meantime
+        CBlockIndex* pindexPrev;
+        CBlockHeader header;
+        {
+            LOCK(cs_main);
+            pindexPrev = chainActive.Tip();
+            header.nTime = GetAdjustedTime() & ~STAKE_TIMESTAMP_MASK;
+            header.nBits = GetNextTargetRequired(pindexPrev, &header, true, Params().GetConsensus());
+        }
+        // Searched up to this slot, used by getstakinginfo to tell whether we are staking
+        int64_t nLastSearchTime = pwallet->m_last_coin_stake_search_time;
+        if (nThread == 0 && header.nTime > nLastSearchTime) {
+            if (nLastSearchTime)
+                pwallet->m_last_coin_stake_search_interval = header.nTime - nLastSearchTime;
+            pwallet->m_last_coin_stake_search_time = header.nTime;
+        }
 
-            if (!pblocktemplate.get())
-                return;
+        CStakeShard kernelShard(nThread, nThreads, nullptr);
+        if (header.GetBlockTime() <= pindexPrev->GetBlockTime() ||
+                !pwallet->HaveStakeKernel(header.nBits, header.nTime, &kernelShard)) {
+            // Wait till next stake
+            MilliSleep(nMinerSleep);
+            continue;
+        }
 
-            CBlockIndex* pindexPrev = chainActive.Tip();
+        std::shared_ptr<CStakeTemplate> ptemplate = GetStakeTemplate(pwallet, *workers, reservekey);
+        if (!ptemplate)
+            return;
 
-            // Try to sign a block (this also checks for a PoS stake)
-            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(pblocktemplate->block);
-            if (SignBlock(pblock, *pwallet, nTotalFees)) {
+        // Try to sign a block (this also checks for a PoS stake), searching
+        // only this worker's share of the staking candidates
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(ptemplate->pblocktemplate->block);
+        CStakeShard shard(nThread, nThreads, &ptemplate->fKernelFound, &ptemplate->coins);
+        int64_t nTimeSign = GetTimeMicros();
+        bool fSigned = SignBlock(pblock, *pwallet, ptemplate->nTotalFees, &shard);
+        pwallet->stakeStats.nSignAttempts++;
+        pwallet->stakeStats.nSignMicros += GetTimeMicros() - nTimeSign;
+        if (fSigned) {
+            pwallet->stakeStats.nBlocksSigned++;
+            LogPrint(BCLog::COINSTAKE, "ThreadStakeMiner(): Successfully signed block, now trying to check it: %s\n", pblock->GetBlockHash().ToString());
+
+            // Another block was received while building ours, scrap progress
+            if (chainActive.Tip()->GetBlockHash() != pblock->hashPrevBlock) {
+                pwallet->stakeStats.nBlocksOrphaned++;
+                LogPrintf("ThreadStakeMiner(): Valid future PoS block was orphaned before becoming valid");
+                continue;
+            }
 
-                std::cout << "\n\nSuccessfully signed block, now trying to check it: " << pblock->GetBlockHash().ToString() << "\n\n" << std::endl;
+            // Check timestamps
+            if (pblock->GetBlockTime() <= pindexPrev->GetBlockTime() ||
+                FutureDrift(pblock->GetBlockTime()) < pindexPrev->GetBlockTime()) {
+                pwallet->stakeStats.nBlocksExpired++;
+                LogPrintf("ThreadStakeMiner(): Valid PoS block took too long to create and has expired");
+                continue; //timestamp too late, so ignore
+            }
 
-                // Another block was received while building ours, scrap progress
-                if (chainActive.Tip()->GetBlockHash() != pblock->hashPrevBlock) {
-                    LogPrintf("ThreadStakeMiner(): Valid future PoS block was orphaned before becoming valid");
-                    continue;
-                }
+            // Only one worker submits a block for this template, the others
+            // get another go if it is not accepted
+            if (!shard.ClaimKernel())
+                continue;
+            if (CheckStake(pblock, *pwallet))
+                pwallet->stakeStats.nBlocksAccepted++;
+            else
+                shard.ReleaseKernel();
+            // Update the search time when new valid block is created, needed for status bar icon
+        } else {
+            // Wait till next stake
+            MilliSleep(nMinerSleep);
+        }
+    }
+}
 
-                // Check timestamps
-                if (pblock->GetBlockTime() <= pindexPrev->GetBlockTime() ||
-                    FutureDrift(pblock->GetBlockTime()) < pindexPrev->GetBlockTime()) {
-                    LogPrintf("ThreadStakeMiner(): Valid PoS block took too long to create and has expired");
-                    continue; //timestamp too late, so ignore
-                }
+// Rebuild the shared block template in the background, so a worker that
+// finds a kernel only has to sign and submit the block
+void ThreadStakeTemplate(CWallet *pwallet, std::shared_ptr<CStakeWorkers> workers)
+{
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
 
-                CheckStake(pblock, *pwallet);
-                // Update the search time when new valid block is created, needed for status bar icon
-            } else {
-                // Wait till next stake
-                MilliSleep(nMinerSleep);
-            }
+    std::string threadName = "alphacon-stake-template";
+    if(pwallet && pwallet->GetName() != "")
+    {
+        threadName = threadName + "-" + pwallet->GetName();
+    }
+    RenameThread(threadName.c_str());
+
+    CReserveKey reservekey(pwallet);
+
+    uint256 hashLastTip;
+    bool fHaveCoins = false;
+    while (true) {
+        // Woken up by a new tip, otherwise every nMinerSleep to pick up a new
+        // staking time slot or mempool change
+        {
+            boost::unique_lock<boost::mutex> lock(csBestBlock);
+            cvBlockChange.timed_wait(lock, boost::posix_time::milliseconds(nMinerSleep));
+        }
+        boost::this_thread::interruption_point();
+
+        if (pwallet->IsLocked() || !AreTokensDeployed() || IsInitialBlockDownload())
+            continue;
+
+        // Outputs only mature or get spent as the tip moves, so only look for
+        // coins to stake once per tip
+        uint256 hashTip;
+        {
+            LOCK(cs_main);
+            hashTip = chainActive.Tip()->GetBlockHash();
         }
+        if (hashTip != hashLastTip) {
+            fHaveCoins = pwallet->HaveAvailableCoinsForStaking();
+            hashLastTip = hashTip;
+        }
+
+        if (fHaveCoins && !GetStakeTemplate(pwallet, *workers, reservekey))
+            return;
     }
 }
 
 void StakeCoins(bool fStake, CWallet *pwallet, boost::thread_group*& stakeThread)
 {
+    int nThreads = gArgs.GetArg("-stakethreads", DEFAULT_STAKE_THREADS);
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+
     if (fStake) {
-        LogPrintf("Start staking thread\n");
+        LogPrintf("Start staking thread (%d workers)\n", nThreads);
     } else {
         LogPrintf("Stop staking thread\n");
     }
@@ -862,8 +1007,15 @@ void StakeCoins(bool fStake, CWallet *pwallet, boost::thread_group*& stakeThread
 
     if(fStake)
     {
+        pwallet->stakeStats.nStartTime = GetTime();
+
+        // The workers split the wallet's staking candidates between them and
+        // share one block template, which another thread keeps current
+        std::shared_ptr<CStakeWorkers> workers = std::make_shared<CStakeWorkers>(nThreads);
         stakeThread = new boost::thread_group();
-        stakeThread->create_thread(boost::bind(&ThreadStakeMiner, pwallet));
+        stakeThread->create_thread(boost::bind(&ThreadStakeTemplate, pwallet, workers));
+        for (int i = 0; i < nThreads; i++)
+            stakeThread->create_thread(boost::bind(&ThreadStakeMiner, pwallet, workers, i, nThreads));
     }
 }
 
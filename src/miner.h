@@ -21,6 +21,7 @@
 class CBlockIndex;
 class CChainParams;
 class CScript;
+struct CStakeShard;
 
 namespace Consensus { struct Params; };
 
@@ -30,6 +31,9 @@ static const bool DEFAULT_STAKE = false;
 
 static const bool DEFAULT_STAKE_CACHE = true;
 
+// Number of threads searching for stake kernels per wallet
+static const int DEFAULT_STAKE_THREADS = 1;
+
 // How many seconds to look ahead and prepare a block for staking
 // Look ahead up to 3 "timeslots" in the future, 48 seconds
 // Reduce this to reduce computational waste for stakers, increase this to increase the amount of time available to construct full blocks
@@ -237,6 +241,6 @@ void StakeCoins(bool fStake, CWallet *pwallet, boost::thread_group*& stakeThread
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
-bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& nTotalFees);
+bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& nTotalFees, const CStakeShard* pshard = nullptr);
 
 #endif // ALPHACON_MINER_H
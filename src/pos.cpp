@@ -13,6 +13,7 @@
 #include <chainparams.h>
 #include <script/sign.h>
 #include <consensus/consensus.h>
+#include <crypto/common.h>
 
 using namespace std;
 
@@ -119,22 +120,110 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBloc
 
         return CheckStakeKernelHash(pindexPrev, nBits, coinPrev.out.nValue, prevout,
                                     nTimeBlock, coinPrev.nTime);
-    } else {
-        Coin coinPrev;
-        if(!view.GetCoin(prevout, coinPrev)){
-            return false;
-        }
+    }
 
-        //found in cache
-        const CStakeCache& stake = it->second;
-        if (CheckStakeKernelHash(pindexPrev, nBits, stake.amount, prevout,
-                                    nTimeBlock, coinPrev.nTime)) {
-            //Cache could potentially cause false positive stakes in the event of deep reorgs, so check without cache also
-            return CheckKernel(pindexPrev, nBits, nTimeBlock, prevout, view);
-        }
+    //found in cache, the caller keeps it in sync with the chain but may lag
+    //behind it, so check it against the view when the kernel hits
+    return CheckKernel(pindexPrev, nBits, nTimeBlock, prevout, it->second) && CheckStakeCache(pindexPrev, prevout, it->second, view);
+}
+
+bool CheckKernel(const CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, const CStakeCache& stake)
+{
+    if (pindexPrev->nHeight + 1 - stake.nHeight < Params().GetConsensus().nStakeMaturity) {
+        return false;
+    }
+
+    return CheckStakeKernelHash(pindexPrev, nBits, stake.amount, prevout, nTimeBlock, stake.nTime);
+}
+
+bool CheckStakeCache(const CBlockIndex* pindexPrev, const COutPoint& prevout, const CStakeCache& stake, const CCoinsViewCache& view)
+{
+    // A reorg can spend the prevout or confirm it again at another height
+    // before the wallet notifications that update the cache catch up
+    Coin coinPrev;
+    if (!view.GetCoin(prevout, coinPrev) || coinPrev.IsSpent()) {
+        return false;
     }
 
-    return false;
+    if ((int)coinPrev.nHeight != stake.nHeight || coinPrev.nTime != stake.nTime || coinPrev.out.nValue != stake.amount) {
+        return false;
+    }
+
+    return pindexPrev->GetAncestor(coinPrev.nHeight) != nullptr;
+}
+
+CStakeKernelSearch::CStakeKernelSearch(const CBlockIndex* pindexPrev, unsigned int nBits, const Consensus::Params& params)
+{
+    nMaxHeightFrom = pindexPrev->nHeight + 1 - params.nStakeMaturity;
+    bnTarget.SetCompact(nBits);
+    bnTargetNext = bnTarget + 1;
+
+    // The kernel starts with the stake modifier of the tip for every prevout
+    hasherModifier.Write(pindexPrev->nStakeModifier.begin(), pindexPrev->nStakeModifier.size());
+}
+
+CSHA256 CStakeKernelSearch::KernelPrefix(const COutPoint& prevout, const CStakeCache& stake) const
+{
+    // Same serialization as CheckStakeKernelHash, up to the block timestamp
+    unsigned char buf[4];
+    CSHA256 hasher(hasherModifier);
+    WriteLE32(buf, stake.nTime);
+    hasher.Write(buf, sizeof(buf));
+    hasher.Write(prevout.hash.begin(), prevout.hash.size());
+    WriteLE32(buf, prevout.n);
+    hasher.Write(buf, sizeof(buf));
+    return hasher;
+}
+
+bool CStakeKernelSearch::MeetsTarget(const CSHA256& hasherPrefix, uint32_t nTimeBlock, CAmount nValueIn) const
+{
+    if (nValueIn <= 0)
+        return false;
+
+    unsigned char buf[CSHA256::OUTPUT_SIZE];
+    CSHA256 hasher(hasherPrefix);
+    WriteLE32(buf, nTimeBlock);
+    hasher.Write(buf, 4).Finalize(buf);
+    uint256 hashProofOfStake;
+    CSHA256().Write(buf, sizeof(buf)).Finalize(hashProofOfStake.begin());
+
+    // hash / nValueIn <= bnTarget is the same as hash < (bnTarget + 1) * nValueIn,
+    // fall back to the division when the product might not fit in 256 bits
+    arith_uint256 bnValueIn((uint64_t)nValueIn);
+    if (bnTargetNext == 0 || bnTargetNext.bits() + bnValueIn.bits() > 256)
+        return !(UintToArith256(hashProofOfStake) / bnValueIn > bnTarget);
+
+    return UintToArith256(hashProofOfStake) < bnTargetNext * bnValueIn;
+}
+
+bool CStakeKernelSearch::Check(const COutPoint& prevout, const CStakeCache& stake, uint32_t nTimeBlock) const
+{
+    if (!IsMature(stake))
+        return false;
+
+    return MeetsTarget(KernelPrefix(prevout, stake), nTimeBlock, stake.amount);
+}
+
+int CStakeKernelSearch::Find(const std::vector<std::pair<COutPoint, CStakeCache> >& vKernels, uint32_t nTimeBlock, size_t nStart) const
+{
+    for (size_t i = nStart; i < vKernels.size(); i++) {
+        if (Check(vKernels[i].first, vKernels[i].second, nTimeBlock))
+            return i;
+    }
+    return -1;
+}
+
+uint32_t CStakeKernelSearch::FindTime(const COutPoint& prevout, const CStakeCache& stake, const std::vector<uint32_t>& vTimes) const
+{
+    if (!IsMature(stake))
+        return 0;
+
+    CSHA256 hasherPrefix = KernelPrefix(prevout, stake);
+    for (uint32_t nTimeBlock : vTimes) {
+        if (MeetsTarget(hasherPrefix, nTimeBlock, stake.amount))
+            return nTimeBlock;
+    }
+    return 0;
 }
 
 // Check kernel hash target and coinstake signature
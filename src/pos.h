@@ -16,16 +16,80 @@
 #include <chainparams.h>
 #include <script/sign.h>
 #include <consensus/consensus.h>
+#include <crypto/sha256.h>
+
+#include <atomic>
 
 // To decrease granularity of timestamp
 // Supposed to be 2^n-1
 static const uint32_t STAKE_TIMESTAMP_MASK = 15;
 
+// Everything the kernel hash needs to know about a staked prevout, so a
+// stake attempt does not have to go back to the coins view
 struct CStakeCache{
-    CStakeCache(uint32_t blockFromTime_, CAmount amount_) : blockFromTime(blockFromTime_), amount(amount_){
+    CStakeCache(uint32_t nTime_, CAmount amount_, int nHeight_) : nTime(nTime_), amount(amount_), nHeight(nHeight_){
     }
-    uint32_t blockFromTime;
+    uint32_t nTime;
     CAmount amount;
+    int nHeight;
+};
+
+/**
+ * Kernel search against a single staking tip. The stake modifier, base target
+ * and maturity limit are the same for every candidate, so they are set up
+ * once. Instead of dividing each kernel hash by the prevout value, the hash
+ * is compared against the target scaled by that value, and the SHA256 state
+ * over the part of a kernel that does not depend on the timestamp is reused
+ * when a prevout is checked for several timestamps.
+ */
+class CStakeKernelSearch
+{
+public:
+    CStakeKernelSearch(const CBlockIndex* pindexPrev, unsigned int nBits, const Consensus::Params& params);
+
+    // Same result as CheckKernel() with a CStakeCache
+    bool Check(const COutPoint& prevout, const CStakeCache& stake, uint32_t nTimeBlock) const;
+    // Index of the first kernel from nStart on that meets the target at nTimeBlock, or -1
+    int Find(const std::vector<std::pair<COutPoint, CStakeCache> >& vKernels, uint32_t nTimeBlock, size_t nStart = 0) const;
+    // First of vTimes at which the kernel meets the target, or 0
+    uint32_t FindTime(const COutPoint& prevout, const CStakeCache& stake, const std::vector<uint32_t>& vTimes) const;
+
+private:
+    int nMaxHeightFrom;
+    arith_uint256 bnTarget;
+    arith_uint256 bnTargetNext;
+    CSHA256 hasherModifier;
+
+    bool IsMature(const CStakeCache& stake) const { return stake.nHeight <= nMaxHeightFrom; }
+    CSHA256 KernelPrefix(const COutPoint& prevout, const CStakeCache& stake) const;
+    bool MeetsTarget(const CSHA256& hasherPrefix, uint32_t nTimeBlock, CAmount nValueIn) const;
+};
+
+struct CStakeCoins;
+
+/**
+ * Part of the staking candidates searched by one of several stake workers.
+ * Candidates are split by outpoint, so every worker gets a stable share
+ * whatever order the wallet hands them out in. Workers searching the same
+ * block share fKernelFound, which the worker that submits a block sets so
+ * that the others stop, and the coins selected once for that block.
+ */
+struct CStakeShard
+{
+    unsigned int nIndex;
+    unsigned int nCount;
+    std::atomic<bool>* pfKernelFound;
+    const CStakeCoins* pcoins;
+
+    CStakeShard(unsigned int nIndex_, unsigned int nCount_, std::atomic<bool>* pfKernelFound_, const CStakeCoins* pcoins_ = nullptr) :
+        nIndex(nIndex_), nCount(nCount_), pfKernelFound(pfKernelFound_), pcoins(pcoins_) {}
+
+    static unsigned int IndexOf(const COutPoint& prevout, unsigned int nCount) { return nCount <= 1 ? 0 : (prevout.hash.GetCheapHash() + prevout.n) % nCount; }
+    bool Contains(const COutPoint& prevout) const { return IndexOf(prevout, nCount) == (nCount <= 1 ? 0 : nIndex); }
+    bool IsKernelFound() const { return pfKernelFound && pfKernelFound->load(); }
+    // True for exactly one of the workers sharing pfKernelFound, until it releases it again
+    bool ClaimKernel() const { return !pfKernelFound || !pfKernelFound->exchange(true); }
+    void ReleaseKernel() const { if (pfKernelFound) *pfKernelFound = false; }
 };
 
 // Compute the hash modifier for proof-of-stake
@@ -35,5 +99,8 @@ bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx);
 bool CheckStakeBlockTimestamp(int64_t nTimeBlock);
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, CCoinsViewCache& view);
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, CCoinsViewCache& view, const std::map<COutPoint, CStakeCache>& cache);
+bool CheckKernel(const CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, const CStakeCache& stake);
+// Whether a cached kernel input still describes the unspent prevout in view, confirmed at or below pindexPrev
+bool CheckStakeCache(const CBlockIndex* pindexPrev, const COutPoint& prevout, const CStakeCache& stake, const CCoinsViewCache& view);
 bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const CTransaction& tx, unsigned int nBits, uint32_t nTimeBlock, uint256& hashProofOfStake, uint256& targetProofOfStake, CCoinsViewCache& view);
 #endif // ALPHACON_POS_H
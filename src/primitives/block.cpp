@@ -13,9 +13,83 @@
 #include "utilstrencodings.h"
 #include "crypto/common.h"
 
+namespace {
+/** Guards the hash cache of a header, which is only held for a few copies */
+class CHashCacheLock
+{
+public:
+    explicit CHashCacheLock(std::atomic<bool>& fLockIn) : fLock(fLockIn)
+    {
+        while (fLock.exchange(true, std::memory_order_acquire)) {}
+    }
+
+    ~CHashCacheLock()
+    {
+        fLock.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool>& fLock;
+};
+}
+
+CBlockHeader::CBlockHeader(const CBlockHeader& header)
+{
+    *this = header;
+}
+
+CBlockHeader& CBlockHeader::operator=(const CBlockHeader& header)
+{
+    if (this == &header)
+        return *this;
+
+    nVersion = header.nVersion;
+    hashPrevBlock = header.hashPrevBlock;
+    hashMerkleRoot = header.hashMerkleRoot;
+    nTime = header.nTime;
+    nBits = header.nBits;
+    nNonce = header.nNonce;
+
+    // Take the cache along, so copies of a block do not hash it again
+    bool fCached;
+    unsigned char vchHeader[sizeof(vchHashedHeader)];
+    uint256 hash;
+    {
+        CHashCacheLock lock(header.fHashLock);
+        fCached = header.fHashCached;
+        if (fCached) {
+            memcpy(vchHeader, header.vchHashedHeader, sizeof(vchHeader));
+            hash = header.hashCached;
+        }
+    }
+
+    CHashCacheLock lock(fHashLock);
+    fHashCached = fCached;
+    if (fCached) {
+        memcpy(vchHashedHeader, vchHeader, sizeof(vchHashedHeader));
+        hashCached = hash;
+    }
+    return *this;
+}
+
 uint256 CBlockHeader::GetBlockHash() const
 {
-    return groestlhash(BEGIN(nVersion), END(nNonce));
+    unsigned char vchHeader[sizeof(vchHashedHeader)];
+    memcpy(vchHeader, BEGIN(nVersion), sizeof(vchHeader));
+
+    {
+        CHashCacheLock lock(fHashLock);
+        if (fHashCached && memcmp(vchHashedHeader, vchHeader, sizeof(vchHeader)) == 0)
+            return hashCached;
+    }
+
+    uint256 hash = groestlhash(vchHeader, vchHeader + sizeof(vchHeader));
+
+    CHashCacheLock lock(fHashLock);
+    memcpy(vchHashedHeader, vchHeader, sizeof(vchHashedHeader));
+    hashCached = hash;
+    fHashCached = true;
+    return hash;
 }
 
 std::string CBlock::ToString() const
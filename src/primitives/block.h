@@ -13,6 +13,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <atomic>
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -36,6 +38,9 @@ public:
         SetNull();
     }
 
+    CBlockHeader(const CBlockHeader& header);
+    CBlockHeader& operator=(const CBlockHeader& header);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -69,6 +74,15 @@ public:
     {
         return (int64_t)nTime;
     }
+
+private:
+    // memory only: the last hash computed and the header fields it was
+    // computed from. The fields are public and get changed in place, so
+    // the cached hash is only used while they are still the same.
+    mutable std::atomic<bool> fHashLock{false};
+    mutable bool fHashCached{false};
+    mutable unsigned char vchHashedHeader[80];
+    mutable uint256 hashCached;
 };
 
 
@@ -125,14 +139,7 @@ public:
 
     CBlockHeader GetBlockHeader() const
     {
-        CBlockHeader block;
-        block.nVersion       = nVersion;
-        block.hashPrevBlock  = hashPrevBlock;
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.nTime          = nTime;
-        block.nBits          = nBits;
-        block.nNonce         = nNonce;
-        return block;
+        return *this;
     }
 
     // void SetPrevBlockHash(uint256 prevHash) 
@@ -16,10 +16,12 @@
 #include "uint256.h"
 
 #include <iostream>
+#include <memory>
 
 static const int SERIALIZE_TRANSACTION_NO_WITNESS = 0x40000000;
 
 class CCoinsViewCache;
+struct CTxTokenOutputs;
 
 /** An outpoint - a combination of a transaction hash and an index n into its vout */
 class COutPoint
@@ -311,6 +313,8 @@ public:
 private:
     /** Memory only. */
     const uint256 hash;
+    /** Memory only, set by the first GetTokenOutputs() */
+    mutable std::shared_ptr<const CTxTokenOutputs> tokenOutputs;
 
     uint256 ComputeHash() const;
 
@@ -355,6 +359,11 @@ public:
     bool VerifyNewUniqueToken(std::string& strError) const;
     bool IsReissueToken() const;
     bool VerifyReissueToken(std::string& strError) const;
+
+    /** The token payloads of the outputs, read from the scripts once per transaction */
+    const CTxTokenOutputs& GetTokenOutputs() const;
+    /** Memory used by GetTokenOutputs(), which it reads first if it has not yet */
+    size_t TokenOutputsDynamicUsage() const;
     /** TOKENS END */
 
     /**
@@ -21,6 +21,7 @@
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
+#include "snapshot.h"
 #include "script/script.h"
 #include "script/script_error.h"
 #include "script/sign.h"
@@ -835,6 +836,10 @@ UniValue getblockhashes(const JSONRPCRequest& request)
 
     std::vector<std::pair<uint256, unsigned int> > blockHashes;
 
+    std::string strError;
+    if (!CheckIndexCoverage("timestampindex", 0, 0, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
     if (fActiveOnly)
         LOCK(cs_main);
 
@@ -1840,6 +1845,107 @@ UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static fs::path SnapshotPath(const std::string& strPath)
+{
+    return fs::absolute(strPath, GetDataDir());
+}
+
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set and the token database at the current tip to a UTXO snapshot file.\n"
+            "With -tokenindex the quantity of each token held by each address is included.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"            (string, required) The file to write, relative to the data directory if not absolute. It must not exist yet\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"path\",            (string) The file written\n"
+            "  \"bestblock\": \"hex\",        (string) The hash of the block the snapshot was taken at\n"
+            "  \"height\": n,                (numeric) The height of that block\n"
+            "  \"coins\": n,                 (numeric) The number of unspent transaction outputs\n"
+            "  \"tokens\": n,                (numeric) The number of tokens\n"
+            "  \"token_quantities\": n,      (numeric) The number of token address quantities\n"
+            "  \"snapshot_hash\": \"hash\",   (string) The hash of the snapshot contents\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = SnapshotPath(request.params[0].get_str());
+    CSnapshotMetadata metadata;
+    CSnapshotStats stats;
+    std::string strError;
+    if (!DumpSnapshot(path, metadata, stats, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write UTXO snapshot: " + strError);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("bestblock", metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("height", metadata.nHeight));
+    ret.push_back(Pair("coins", stats.nCoins));
+    ret.push_back(Pair("tokens", stats.nTokens));
+    ret.push_back(Pair("token_quantities", stats.nTokenQuantities));
+    ret.push_back(Pair("snapshot_hash", stats.hashSnapshot.GetHex()));
+    return ret;
+}
+
+UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "loadtxoutset \"path\" ( verify )\n"
+            "\nLoads a UTXO snapshot written by dumptxoutset, and continues validating from the block it was taken at.\n"
+            "The node must not have connected any block after genesis, and must already know the headers up to the snapshot block.\n"
+            "Every chunk of the file is checked before anything is written. A snapshot hash known to the chain parameters\n"
+            "for the snapshot height is always checked. Blocks before the snapshot are treated like pruned blocks.\n"
+            "Can't be used with -txindex, -addressindex, -spentindex or -timestampindex.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"            (string, required) The file to read, relative to the data directory if not absolute\n"
+            "2. verify              (boolean, optional, default=false) Require the chain parameters to know the snapshot hash at its height\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"bestblock\": \"hex\",        (string) The hash of the block the snapshot was taken at, now the tip\n"
+            "  \"height\": n,                (numeric) The height of that block\n"
+            "  \"coins\": n,                 (numeric) The number of unspent transaction outputs loaded\n"
+            "  \"tokens\": n,                (numeric) The number of tokens loaded\n"
+            "  \"token_quantities\": n,      (numeric) The number of token address quantities in the snapshot\n"
+            "  \"snapshot_hash\": \"hash\",   (string) The hash of the snapshot contents\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\"")
+            + HelpExampleCli("loadtxoutset", "\"utxo.dat\" true")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\", true")
+        );
+
+    bool fVerify = false;
+    if (!request.params[1].isNull())
+        fVerify = request.params[1].get_bool();
+
+    CSnapshotMetadata metadata;
+    CSnapshotStats stats;
+    std::string strError;
+    if (!LoadSnapshot(SnapshotPath(request.params[0].get_str()), fVerify, metadata, stats, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to load UTXO snapshot: " + strError);
+
+    // Connect any blocks after the snapshot that are already here
+    CValidationState state;
+    ActivateBestChain(state, Params());
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("bestblock", metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("height", metadata.nHeight));
+    ret.push_back(Pair("coins", stats.nCoins));
+    ret.push_back(Pair("tokens", stats.nTokens));
+    ret.push_back(Pair("token_quantities", stats.nTokenQuantities));
+    ret.push_back(Pair("snapshot_hash", stats.hashSnapshot.GetHex()));
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1861,6 +1967,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           {"path","verify"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -131,6 +131,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "importpubkey", 2, "rescan" },
     { "importmulti", 0, "requests" },
     { "importmulti", 1, "options" },
+    { "loadtxoutset", 1, "verify" },
     { "verifychain", 0, "checklevel" },
     { "verifychain", 1, "nblocks" },
     { "pruneblockchain", 0, "height" },
@@ -179,6 +180,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listaddressesbytoken", 1, "totalonly"},
     { "listaddressesbytoken", 2, "count"},
     { "listaddressesbytoken", 3, "start"},
+    { "listtopaddressesbytoken", 1, "count"},
     { "listtokenbalancesbyaddress", 1, "totalonly"},
     { "listtokenbalancesbyaddress", 2, "count"},
     { "listtokenbalancesbyaddress", 3, "start"},
@@ -246,7 +246,30 @@ static UniValue getstakinginfo(const JSONRPCRequest& request)
     if (request.fHelp || request.params.size() != 0)
         throw std::runtime_error(
             "getstakinginfo\n"
-            "Returns an object containing staking-related information.");
+            "Returns an object containing staking-related information.\n"
+            "\nResult:\n"
+            "{\n"
+            "  ...\n"
+            "  \"stats\": {             (json object) counters of this wallet's stake threads since staking was started\n"
+            "    \"uptime\": n,            (numeric) seconds since staking was started\n"
+            "    \"kernels\": n,           (numeric) stake kernels checked\n"
+            "    \"kernelspersec\": x.xxx, (numeric) stake kernels checked per second of uptime\n"
+            "    \"kerneltime\": x.xxx,    (numeric) milliseconds spent checking stake kernels\n"
+            "    \"coinstime\": x.xxx,     (numeric) milliseconds spent listing coins available for staking\n"
+            "    \"templates\": n,         (numeric) block templates built\n"
+            "    \"templatetime\": x.xxx,  (numeric) milliseconds spent building block templates\n"
+            "    \"signs\": n,             (numeric) attempts to sign a block with a found kernel\n"
+            "    \"signtime\": x.xxx,      (numeric) milliseconds spent signing blocks\n"
+            "    \"signed\": n,            (numeric) blocks signed\n"
+            "    \"accepted\": n,          (numeric) signed blocks accepted by this node\n"
+            "    \"orphaned\": n,          (numeric) signed blocks dropped because the tip moved on\n"
+            "    \"expired\": n            (numeric) signed blocks dropped because their timestamp was too late\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakinginfo", "")
+            + HelpExampleRpc("getstakinginfo", "")
+        );
 
     LOCK(cs_main);
 
@@ -286,6 +309,30 @@ static UniValue getstakinginfo(const JSONRPCRequest& request)
 
     obj.pushKV("expectedtime", nExpectedTime);
 
+#ifdef ENABLE_WALLET
+    if (pwallet)
+    {
+        const CStakeStats& stats = pwallet->stakeStats;
+        int64_t nUptime = stats.nStartTime ? GetTime() - stats.nStartTime : 0;
+
+        UniValue objStats(UniValue::VOBJ);
+        objStats.pushKV("uptime", nUptime);
+        objStats.pushKV("kernels", (uint64_t)stats.nKernelsChecked);
+        objStats.pushKV("kernelspersec", nUptime > 0 ? (double)stats.nKernelsChecked / nUptime : 0.0);
+        objStats.pushKV("kerneltime", 0.001 * stats.nKernelMicros);
+        objStats.pushKV("coinstime", 0.001 * stats.nAvailableCoinsMicros);
+        objStats.pushKV("templates", (uint64_t)stats.nTemplates);
+        objStats.pushKV("templatetime", 0.001 * stats.nTemplateMicros);
+        objStats.pushKV("signs", (uint64_t)stats.nSignAttempts);
+        objStats.pushKV("signtime", 0.001 * stats.nSignMicros);
+        objStats.pushKV("signed", (uint64_t)stats.nBlocksSigned);
+        objStats.pushKV("accepted", (uint64_t)stats.nBlocksAccepted);
+        objStats.pushKV("orphaned", (uint64_t)stats.nBlocksOrphaned);
+        objStats.pushKV("expired", (uint64_t)stats.nBlocksExpired);
+        obj.pushKV("stats", objStats);
+    }
+#endif
+
     return obj;
 }
 
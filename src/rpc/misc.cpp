@@ -712,6 +712,77 @@ bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
     return a.second.time < b.second.time;
 }
 
+/** A page of an address index query continues after the last entry of the previous one, passed around as hex */
+static std::string EncodeAddressIndexCursor(const CAddressIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+static CAddressIndexKey DecodeAddressIndexCursor(const UniValue& value)
+{
+    if (!value.isStr() || !IsHex(value.get_str()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+
+    std::vector<unsigned char> data(ParseHex(value.get_str()));
+    CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+    CAddressIndexKey key;
+    try {
+        ss >> key;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (!ss.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    return key;
+}
+
+static void getPageFromParams(const UniValue& params, int& limit, UniValue& cursor)
+{
+    limit = 0;
+    cursor.setNull();
+    if (!params[0].isObject())
+        return;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (!limitValue.isNull()) {
+        limit = limitValue.get_int();
+        if (limit <= 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+    }
+    cursor = find_value(params[0].get_obj(), "cursor");
+}
+
+/** Refuse a query the index can't answer completely, it needs every block from height start to end (0 for the tip) */
+static void CheckIndexComplete(const std::string& name, int start = 0, int end = 0)
+{
+    std::string strError;
+    if (!CheckIndexCoverage(name, start, end, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+}
+
+/**
+ * Visit the address index entries of all the addresses merged in height
+ * order, until fn returns false. With a cursor, continue after it.
+ */
+static void ForEachAddressIndexEntry(const std::vector<std::pair<uint160, int> >& addresses, const std::string& tokenName,
+                                     int start, int end, const UniValue& cursor,
+                                     std::function<bool(const CAddressIndexKey&, const CAmount&)> fn)
+{
+    CAddressIndexKey after;
+    if (!cursor.isNull()) {
+        after = DecodeAddressIndexCursor(cursor);
+        if (!std::count(addresses.begin(), addresses.end(), std::make_pair(after.hashBytes, (int)after.type))
+                || (!tokenName.empty() && after.token != tokenName))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor doesn't belong to these addresses");
+    }
+
+    if (!ForEachAddressIndex(addresses, tokenName, start, end, cursor.isNull() ? nullptr : &after, fn)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+}
+
 UniValue getaddressmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 2)
@@ -859,6 +930,8 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    CheckIndexComplete("addressindex");
+
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -933,6 +1006,8 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
             "  \"tokenName\"   (string, optional) Get deltas for a particular token instead of ALP.\n"
+            "  \"limit\"   (number, optional) Return at most this many deltas, and a cursor for the next page\n"
+            "  \"cursor\"   (string, optional) Continue after the previous page, from its \"next\" cursor\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -945,11 +1020,14 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nWith a limit, or with chainInfo, the deltas are returned in an object, with the cursor of the next page\n"
+            "in \"next\", or null after the last page. The deltas of all the addresses are merged in height order.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"],\"tokenName\":\"MY_TOKEN\"}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"],\"tokenName\":\"MY_TOKEN\"}")
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"],\"limit\":1000}'")
         );
 
 
@@ -990,38 +1068,40 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    CheckIndexComplete("addressindex", start, end);
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, tokenName, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, tokenName, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
-    }
+    int limit;
+    UniValue cursor;
+    getPageFromParams(request.params, limit, cursor);
 
+    // The deltas are added as they are read, only a page of them is ever held with a limit
     UniValue deltas(UniValue::VARR);
+    UniValue next(UniValue::VNULL);
+    CAddressIndexKey last;
+
+    ForEachAddressIndexEntry(addresses, tokenName, start, end, cursor, [&](const CAddressIndexKey& key, const CAmount& nValue) {
+        if (limit > 0 && deltas.size() == (size_t)limit) {
+            next = EncodeAddressIndexCursor(last);
+            return false;
+        }
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
         std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
+        if (!getAddressFromIndex(key.type, key.hashBytes, address)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
         }
 
         UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("tokenName", it->first.token));
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
+        delta.push_back(Pair("tokenName", key.token));
+        delta.push_back(Pair("satoshis", nValue));
+        delta.push_back(Pair("txid", key.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)key.index));
+        delta.push_back(Pair("blockindex", (int)key.txindex));
+        delta.push_back(Pair("height", key.blockHeight));
         delta.push_back(Pair("address", address));
         deltas.push_back(delta);
-    }
+        last = key;
+        return true;
+    });
 
     UniValue result(UniValue::VOBJ);
 
@@ -1047,6 +1127,13 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         result.push_back(Pair("deltas", deltas));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
+        if (limit > 0)
+            result.push_back(Pair("next", next));
+
+        return result;
+    } else if (limit > 0) {
+        result.push_back(Pair("deltas", deltas));
+        result.push_back(Pair("next", next));
 
         return result;
     } else {
@@ -1060,6 +1147,7 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         throw std::runtime_error(
             "getaddressbalance\n"
             "\nReturns the balance for an address(es) (requires addressindex to be enabled).\n"
+            "With -addressbalanceindex the balances are read from the balance index instead of being summed over the address history.\n"
             "\nArguments:\n"
             "{\n"
             "  \"addresses:\"\n"
@@ -1096,6 +1184,8 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    CheckIndexComplete("addressindex");
+
     bool includeTokens = false;
     if (request.params.size() > 1) {
         includeTokens = request.params[1].get_bool();
@@ -1105,17 +1195,30 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         if (!AreTokensDeployed())
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Tokens aren't active.  includeTokens can't be true.");
 
+        //tokenName -> (received, balance)
+        std::map<std::string, std::pair<CAmount, CAmount>> balances;
+
+        if (fAddressBalanceIndex) {
+            for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+                std::vector<std::pair<std::string, CAddressBalanceValue> > addressBalances;
+                if (!GetAddressBalance((*it).first, (*it).second, "", addressBalances)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+                for (const auto& item : addressBalances) {
+                    balances[item.first].first += item.second.received;
+                    balances[item.first].second += item.second.balance;
+                }
+            }
+        }
+
         std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end() && !fAddressBalanceIndex; it++) {
             if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
         }
 
-        //tokenName -> (received, balance)
-        std::map<std::string, std::pair<CAmount, CAmount>> balances;
-
         for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin();
              it != addressIndex.end(); it++) {
             std::string tokenName = it->first.token;
@@ -1142,17 +1245,30 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         return result;
 
     } else {
+        CAmount balance = 0;
+        CAmount received = 0;
+
+        if (fAddressBalanceIndex) {
+            for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+                std::vector<std::pair<std::string, CAddressBalanceValue> > addressBalances;
+                if (!GetAddressBalance((*it).first, (*it).second, ALP, addressBalances)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+                for (const auto& item : addressBalances) {
+                    received += item.second.received;
+                    balance += item.second.balance;
+                }
+            }
+        }
+
         std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end() && !fAddressBalanceIndex; it++) {
             if (!GetAddressIndex((*it).first, (*it).second, ALP, addressIndex)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
         }
 
-        CAmount balance = 0;
-        CAmount received = 0;
-
         for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin();
              it != addressIndex.end(); it++) {
             if (it->second > 0) {
@@ -1185,6 +1301,8 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
             "    ]\n"
             "  \"start\" (number, optional) The start block height\n"
             "  \"end\" (number, optional) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids, and a cursor for the next page\n"
+            "  \"cursor\" (string, optional) Continue after the previous page, from its \"next\" cursor\n"
             "},\n"
             "\"includeTokens\" (boolean, optional, default false)  If true this will return an expanded result which includes token transactions\n"
             "\nResult:\n"
@@ -1192,11 +1310,14 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nThe txids of all the addresses are merged in height order. With a limit the result is an object with\n"
+            "the txids, and the cursor of the next page in \"next\", or null after the last page.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}', true")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}, true")
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"],\"limit\":1000}'")
         );
 
     std::vector<std::pair<uint160, int> > addresses;
@@ -1210,12 +1331,14 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
     if (request.params[0].isObject()) {
         UniValue startValue = find_value(request.params[0].get_obj(), "start");
         UniValue endValue = find_value(request.params[0].get_obj(), "end");
-        if (startValue.isNum() && endValue.isNum()) {
+        if (startValue.isNum() && endValue.isNum() && startValue.get_int() > 0 && endValue.get_int() > 0) {
             start = startValue.get_int();
             end = endValue.get_int();
         }
     }
 
+    CheckIndexComplete("addressindex", start, end);
+
     bool includeTokens = false;
     if (request.params.size() > 1) {
         includeTokens = request.params[1].get_bool();
@@ -1225,56 +1348,39 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         if (!AreTokensDeployed())
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Tokens aren't active.  includeTokens can't be true.");
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (includeTokens) {
-            if (start > 0 && end > 0) {
-                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-                }
-            } else {
-                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-                }
-            }
-        } else {
-            if (start > 0 && end > 0) {
-                if (!GetAddressIndex((*it).first, (*it).second, ALP, addressIndex, start, end)) {
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-                }
-            } else {
-                if (!GetAddressIndex((*it).first, (*it).second, ALP, addressIndex)) {
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-                }
-            }
-        }
-    }
+    int limit;
+    UniValue cursor;
+    getPageFromParams(request.params, limit, cursor);
 
-    std::set<std::pair<int, std::string> > txids;
+    // The entries of one transaction come next to each other, so each txid is added once as it is read
     UniValue result(UniValue::VARR);
-
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        int height = it->first.blockHeight;
-        std::string txid = it->first.txhash.GetHex();
-
-        if (addresses.size() > 1) {
-            txids.insert(std::make_pair(height, txid));
-        } else {
-            if (txids.insert(std::make_pair(height, txid)).second) {
-                result.push_back(txid);
+    UniValue next(UniValue::VNULL);
+    CAddressIndexKey last;
+    bool fLast = !cursor.isNull();
+    if (fLast)
+        last = DecodeAddressIndexCursor(cursor);
+
+    ForEachAddressIndexEntry(addresses, includeTokens ? "" : ALP, start, end, cursor,
+                             [&](const CAddressIndexKey& key, const CAmount& nValue) {
+        if (!fLast || key.txhash != last.txhash) {
+            if (limit > 0 && result.size() == (size_t)limit) {
+                next = EncodeAddressIndexCursor(last);
+                return false;
             }
+            result.push_back(key.txhash.GetHex());
         }
-    }
+        last = key;
+        fLast = true;
+        return true;
+    });
 
-    if (addresses.size() > 1) {
-        for (std::set<std::pair<int, std::string> >::const_iterator it=txids.begin(); it!=txids.end(); it++) {
-            result.push_back(it->second);
-        }
-    }
-
-    return result;
+    if (limit == 0)
+        return result;
 
+    UniValue page(UniValue::VOBJ);
+    page.push_back(Pair("txids", result));
+    page.push_back(Pair("next", next));
+    return page;
 }
 
 UniValue getspentinfo(const JSONRPCRequest& request)
@@ -1314,6 +1420,10 @@ UniValue getspentinfo(const JSONRPCRequest& request)
     CSpentIndexValue value;
 
     if (!GetSpentIndex(key, value)) {
+        // The output may be spent in a block the index doesn't have
+        std::string strError;
+        if (fSpentIndex && !CheckIndexCoverage("spentindex", 0, 0, strError))
+            throw JSONRPCError(RPC_MISC_ERROR, "Unable to get spent info, " + strError);
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
     }
 
@@ -1325,6 +1435,52 @@ UniValue getspentinfo(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getindexinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getindexinfo\n"
+            "\nReturns the state of the address, spent and timestamp indexes.\n"
+            "An index that is turned on for an existing chain is built in the background, and only\n"
+            "has the blocks from the genesis block up to builtheight and the blocks connected since.\n"
+            "Blocks without data, below a UTXO snapshot or pruned, are left out of it, and it then only\n"
+            "has every block from startheight. Queries that need blocks an index doesn't have are refused.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {            (object) addressindex, spentindex or timestampindex\n"
+            "    \"enabled\": true|false,   (boolean) Whether the index is kept\n"
+            "    \"synced\": true|false,    (boolean) Whether the index has every block of the chain\n"
+            "    \"builtheight\": n,        (numeric) Height of the last block built so far, while it is being built\n"
+            "    \"startheight\": n         (numeric) Height from which the index has every block, when blocks were left out\n"
+            "  }\n"
+            "  ,...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getindexinfo", "")
+            + HelpExampleRpc("getindexinfo", "")
+        );
+
+    LOCK(cs_main);
+
+    UniValue result(UniValue::VOBJ);
+    for (const auto& index : std::vector<std::pair<std::string, bool> >{{"addressindex", fAddressIndex}, {"spentindex", fSpentIndex}, {"timestampindex", fTimestampIndex}}) {
+        UniValue obj(UniValue::VOBJ);
+        int nHeight;
+        bool fBuilding = index.second && GetIndexBuildHeight(index.first, nHeight);
+        int nStartHeight;
+        bool fPartial = index.second && GetIndexStartHeight(index.first, nStartHeight);
+        obj.push_back(Pair("enabled", index.second));
+        obj.push_back(Pair("synced", index.second && !fBuilding && !fPartial));
+        if (fBuilding)
+            obj.push_back(Pair("builtheight", nHeight - 1));
+        if (fPartial)
+            obj.push_back(Pair("startheight", nStartHeight));
+        result.push_back(Pair(index.first, obj));
+    }
+
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1344,6 +1500,7 @@ static const CRPCCommand commands[] =
 
     /* Blockchain */
     { "blockchain",         "getspentinfo",           &getspentinfo,           {} },
+    { "blockchain",         "getindexinfo",           &getindexinfo,           {} },
 
     /* Not shown in help */
     { "hidden",             "setmocktime",            &setmocktime,            {"timestamp"}},
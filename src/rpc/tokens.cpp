@@ -346,7 +346,7 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
 
     if (request.fHelp || !AreTokensDeployed() || request.params.size() < 1)
         throw std::runtime_error(
-            "listtokenbalancesbyaddress \"address\" (onlytotal) (count) (start)\n"
+            "listtokenbalancesbyaddress \"address\" (onlytotal) (count) (start) (after)\n"
             + TokenActivationWarning() +
             "\nReturns a list of all token balances for an address.\n"
 
@@ -355,6 +355,7 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
             "2. \"onlytotal\"                (boolean, optional, default=false) when false result is just a list of tokens balances -- when true the result is just a single number representing the number of tokens\n"
             "3. \"count\"                    (integer, optional, default=50000, MAX=50000) truncates results to include only the first _count_ tokens found\n"
             "4. \"start\"                    (integer, optional, default=0) results skip over the first _start_ tokens found (if negative it skips back from the end)\n"
+            "5. \"after\"                    (string, optional) results start after this token name, the last one of the previous page -- start is ignored. It is the plain name, so pages stay in step when tokens change between calls\n"
 
             "\nResult:\n"
             "{\n"
@@ -367,6 +368,7 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
             + HelpExampleCli("listtokenbalancesbyaddress", "\"myaddress\" false 2 0")
             + HelpExampleCli("listtokenbalancesbyaddress", "\"myaddress\" true")
             + HelpExampleCli("listtokenbalancesbyaddress", "\"myaddress\"")
+            + HelpExampleCli("listtokenbalancesbyaddress", "\"myaddress\" false 100 0 \"LAST_TOKEN\"")
         );
 
     ObserveSafeMode();
@@ -396,12 +398,15 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
     if (!ptokensdb)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "token db unavailable.");
 
-    
-    LOCK(cs_main);
     std::vector<std::pair<std::string, CAmount> > vecTokenAmounts;
     int nTotalEntries = 0;
 
-    if (!ptokensdb->AddressDir(vecTokenAmounts, nTotalEntries, fOnlyTotal, address, count, start))
+    bool ret;
+    if (request.params.size() > 4 && !fOnlyTotal)
+        ret = ptokensdb->AddressDir(vecTokenAmounts, address, count, request.params[4].get_str());
+    else
+        ret = ptokensdb->AddressDir(vecTokenAmounts, nTotalEntries, fOnlyTotal, address, count, start);
+    if (!ret)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve address token directory.");
 
     // If only the number of addresses is wanted return it
@@ -409,6 +414,8 @@ UniValue listtokenbalancesbyaddress(const JSONRPCRequest& request)
         return nTotalEntries;
     }
 
+    // Only the units come from the token cache, the directory is read without holding cs_main
+    LOCK(cs_main);
     UniValue result(UniValue::VOBJ);
     for (auto& pair : vecTokenAmounts) {
         result.push_back(Pair(pair.first, UnitValueFromAmount(pair.second, pair.first)));
@@ -824,9 +831,9 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
         return "_This rpc call is not functional unless -tokenindex is enabled. To enable, please run the wallet with -tokenindex, this will require a reindex to occur";
     }
 
-    if (request.fHelp || !AreTokensDeployed() || request.params.size() > 4 || request.params.size() < 1)
+    if (request.fHelp || !AreTokensDeployed() || request.params.size() > 5 || request.params.size() < 1)
         throw std::runtime_error(
-                "listaddressesbytoken \"token_name\" (onlytotal) (count) (start)\n"
+                "listaddressesbytoken \"token_name\" (onlytotal) (count) (start) (after)\n"
                 + TokenActivationWarning() +
                 "\nReturns a list of all address that own the given token (with balances)"
                 "\nOr returns the total size of how many address own the given token"
@@ -836,6 +843,7 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
                 "2. \"onlytotal\"                (boolean, optional, default=false) when false result is just a list of addresses with balances -- when true the result is just a single number representing the number of addresses\n"
                 "3. \"count\"                    (integer, optional, default=50000, MAX=50000) truncates results to include only the first _count_ tokens found\n"
                 "4. \"start\"                    (integer, optional, default=0) results skip over the first _start_ tokens found (if negative it skips back from the end)\n"
+                "5. \"after\"                    (string, optional) results start after this address, the last one of the previous page -- start is ignored. It is the plain address, so pages stay in step when holders change between calls\n"
 
                 "\nResult:\n"
                 "[ "
@@ -847,10 +855,9 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
                 + HelpExampleCli("listaddressesbytoken", "\"TOKEN_NAME\" false 2 0")
                 + HelpExampleCli("listaddressesbytoken", "\"TOKEN_NAME\" true")
                 + HelpExampleCli("listaddressesbytoken", "\"TOKEN_NAME\"")
+                + HelpExampleCli("listaddressesbytoken", "\"TOKEN_NAME\" false 1000 0 \"LAST_ADDRESS\"")
         );
 
-    LOCK(cs_main);
-
     std::string token_name = request.params[0].get_str();
     bool fOnlyTotal = false;
     if (request.params.size() > 1)
@@ -871,10 +878,14 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
     if (!IsTokenNameValid(token_name))
         return "_Not a valid token name";
 
-    LOCK(cs_main);
     std::vector<std::pair<std::string, CAmount> > vecAddressAmounts;
     int nTotalEntries = 0;
-    if (!ptokensdb->TokenAddressDir(vecAddressAmounts, nTotalEntries, fOnlyTotal, token_name, count, start))
+    bool ret;
+    if (request.params.size() > 4 && !fOnlyTotal)
+        ret = ptokensdb->TokenAddressDir(vecAddressAmounts, token_name, count, request.params[4].get_str());
+    else
+        ret = ptokensdb->TokenAddressDir(vecAddressAmounts, nTotalEntries, fOnlyTotal, token_name, count, start);
+    if (!ret)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve address token directory.");
 
     // If only the number of addresses is wanted return it
@@ -882,6 +893,7 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
         return nTotalEntries;
     }
 
+    LOCK(cs_main);
     UniValue result(UniValue::VOBJ);
     for (auto& pair : vecAddressAmounts) {
         result.push_back(Pair(pair.first, UnitValueFromAmount(pair.second, token_name)));
@@ -891,6 +903,65 @@ UniValue listaddressesbytoken(const JSONRPCRequest &request)
     return result;
 }
 
+UniValue listtopaddressesbytoken(const JSONRPCRequest &request)
+{
+    if (!fTokenRichIndex) {
+        return "_This rpc call is not functional unless -tokenrichindex is enabled. To enable, please run the wallet with -tokenindex and -tokenrichindex";
+    }
+
+    if (request.fHelp || !AreTokensDeployed() || request.params.size() > 2 || request.params.size() < 1)
+        throw std::runtime_error(
+                "listtopaddressesbytoken \"token_name\" (count)\n"
+                + TokenActivationWarning() +
+                "\nReturns the addresses that hold the most of the given token, biggest holder first"
+
+                "\nArguments:\n"
+                "1. \"token_name\"               (string, required) name of token\n"
+                "2. \"count\"                    (integer, optional, default=100, MAX=50000) number of addresses to return\n"
+
+                "\nResult:\n"
+                "[\n"
+                "  {\n"
+                "    \"address\": \"address\",   (string) the address\n"
+                "    \"balance\": n             (numeric) the quantity of the token it holds\n"
+                "  },\n"
+                "  ...\n"
+                "]\n"
+
+                "\nExamples:\n"
+                + HelpExampleCli("listtopaddressesbytoken", "\"TOKEN_NAME\"")
+                + HelpExampleCli("listtopaddressesbytoken", "\"TOKEN_NAME\" 10")
+                + HelpExampleRpc("listtopaddressesbytoken", "\"TOKEN_NAME\", 10")
+        );
+
+    std::string token_name = request.params[0].get_str();
+
+    size_t count = 100;
+    if (request.params.size() > 1) {
+        if (request.params[1].get_int() < 1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be greater than 1.");
+        count = request.params[1].get_int();
+    }
+
+    if (!IsTokenNameValid(token_name))
+        return "_Not a valid token name";
+
+    std::vector<std::pair<std::string, CAmount> > vecAddressAmounts;
+    if (!ptokensdb->TopTokenAddresses(vecAddressAmounts, token_name, count))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve the biggest holders of the token.");
+
+    LOCK(cs_main);
+    UniValue result(UniValue::VARR);
+    for (auto& pair : vecAddressAmounts) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("address", pair.first));
+        entry.push_back(Pair("balance", UnitValueFromAmount(pair.second, token_name)));
+        result.push_back(entry);
+    }
+
+    return result;
+}
+
 UniValue transfer(const JSONRPCRequest& request)
 {
     if (request.fHelp || !AreTokensDeployed() || request.params.size() < 3 || request.params.size() > 4)
@@ -1046,9 +1117,9 @@ UniValue reissue(const JSONRPCRequest& request)
 
 UniValue listtokens(const JSONRPCRequest& request)
 {
-    if (request.fHelp || !AreTokensDeployed() || request.params.size() > 4)
+    if (request.fHelp || !AreTokensDeployed() || request.params.size() > 5)
         throw std::runtime_error(
-                "listtokens \"( token )\" ( verbose ) ( count ) ( start )\n"
+                "listtokens \"( token )\" ( verbose ) ( count ) ( start ) ( after )\n"
                 + TokenActivationWarning() +
                 "\nReturns a list of all tokens\n"
                 "\nThis could be a slow/expensive operation as it reads from the database\n"
@@ -1058,6 +1129,7 @@ UniValue listtokens(const JSONRPCRequest& request)
                 "2. \"verbose\"                  (boolean, optional, default=false) when false result is just a list of token names -- when true results are token name mapped to metadata\n"
                 "3. \"count\"                    (integer, optional, default=ALL) truncates results to include only the first _count_ tokens found\n"
                 "4. \"start\"                    (integer, optional, default=0) results skip over the first _start_ tokens found (if negative it skips back from the end)\n"
+                "5. \"after\"                    (string, optional) results start after this token name, the last one of the previous page -- start is ignored. It is the plain name, so pages stay in step when tokens change between calls\n"
 
                 "\nResult (verbose=false):\n"
                 "[\n"
@@ -1080,6 +1152,7 @@ UniValue listtokens(const JSONRPCRequest& request)
                 + HelpExampleRpc("listtokens", "")
                 + HelpExampleCli("listtokens", "TOKEN")
                 + HelpExampleCli("listtokens", "\"TOKEN*\" true 10 20")
+                + HelpExampleCli("listtokens", "\"TOKEN*\" false 1000 0 \"LAST_TOKEN\"")
         );
 
     ObserveSafeMode();
@@ -1111,9 +1184,15 @@ UniValue listtokens(const JSONRPCRequest& request)
     }
 
     std::vector<CDatabasedTokenData> tokens;
-    if (!ptokensdb->TokenDir(tokens, filter, count, start))
+    bool ret;
+    if (request.params.size() > 4)
+        ret = ptokensdb->TokenDir(tokens, filter, count, request.params[4].get_str());
+    else
+        ret = ptokensdb->TokenDir(tokens, filter, count, start);
+    if (!ret)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "couldn't retrieve token directory.");
 
+    LOCK(cs_main);
     UniValue result;
     result = verbose ? UniValue(UniValue::VOBJ) : UniValue(UniValue::VARR);
 
@@ -1151,8 +1230,12 @@ UniValue getcacheinfo(const JSONRPCRequest& request)
                 "  token address balance:\n"
                 "  my unspent token:\n"
                 "  reissue data:\n"
-                "  token metadata map:\n"
-                "  token metadata list (est):\n"
+                "  token metadata cache:\n"
+                "    memory, entries, max entries, shards:\n"
+                "    hits, misses, evictions: lookups since startup\n"
+                "  token name filter (unless -tokennamefilter=0):\n"
+                "    memory, names, capacity, false positive rate, hash functions:\n"
+                "    reads avoided, reads passed: database reads of a token it was asked about\n"
                 "  dirty cache (est):\n"
 
 
@@ -1181,13 +1264,34 @@ UniValue getcacheinfo(const JSONRPCRequest& request)
 
     UniValue descendants(UniValue::VOBJ);
 
-    descendants.push_back(Pair("token address balance",   (int)memusage::DynamicUsage(currentActiveTokenCache->mapTokensAddressAmount)));
+    descendants.push_back(Pair("token address balance",   (int)currentActiveTokenCache->mapTokensAddressAmount.DynamicMemoryUsage()));
     descendants.push_back(Pair("reissue data",   (int)memusage::DynamicUsage(currentActiveTokenCache->mapReissuedTokenData)));
 
     info.push_back(Pair("reissue tracking (memory only)", (int)memusage::DynamicUsage(mapReissuedTokens) + (int)memusage::DynamicUsage(mapReissuedTx)));
     info.push_back(Pair("token data", descendants));
-    info.push_back(Pair("token metadata map",  (int)memusage::DynamicUsage(ptokensCache->GetItemsMap())));
-    info.push_back(Pair("token metadata list (est)",  (int)ptokensCache->GetItemsList().size() * (32 + 80))); // Max 32 bytes for token name, 80 bytes max for token data
+    CShardedLRUCache<std::string, CDatabasedTokenData>::Stats metadataStats;
+    ptokensCache->GetStats(metadataStats);
+    UniValue metadata(UniValue::VOBJ);
+    metadata.push_back(Pair("memory", (int)metadataStats.nMemoryUsage));
+    metadata.push_back(Pair("entries", (int)metadataStats.nEntries));
+    metadata.push_back(Pair("max entries", (int)metadataStats.nMaxEntries));
+    metadata.push_back(Pair("shards", (int)metadataStats.nShards));
+    metadata.push_back(Pair("hits", (uint64_t)metadataStats.nHits));
+    metadata.push_back(Pair("misses", (uint64_t)metadataStats.nMisses));
+    metadata.push_back(Pair("evictions", (uint64_t)metadataStats.nEvictions));
+    info.push_back(Pair("token metadata cache", metadata));
+    CTokenNameFilter::Stats filterStats;
+    if (ptokensdb && ptokensdb->GetNameFilterStats(filterStats)) {
+        UniValue filter(UniValue::VOBJ);
+        filter.push_back(Pair("memory", (int)filterStats.nMemoryUsage));
+        filter.push_back(Pair("names", (int)filterStats.nNames));
+        filter.push_back(Pair("capacity", (int)filterStats.nCapacity));
+        filter.push_back(Pair("false positive rate", strprintf("1/%u", filterStats.nRate)));
+        filter.push_back(Pair("hash functions", (int)filterStats.nHashFuncs));
+        filter.push_back(Pair("reads avoided", (uint64_t)filterStats.nRejected));
+        filter.push_back(Pair("reads passed", (uint64_t)filterStats.nPassed));
+        info.push_back(Pair("token name filter", filter));
+    }
     info.push_back(Pair("dirty cache (est)",  (int)currentActiveTokenCache->GetCacheSize()));
     info.push_back(Pair("dirty cache V2 (est)",  (int)currentActiveTokenCache->GetCacheSizeV2()));
 
@@ -1200,14 +1304,15 @@ static const CRPCCommand commands[] =
   //  ----------- ------------------------      -----------------------      ----------
     { "tokens",   "issue",                      &issue,                      {"token_name","qty","to_address","change_address","units","reissuable"} },
     { "tokens",   "issueunique",                &issueunique,                {"root_name", "token_tags", "to_address", "change_address"}},
-    { "tokens",   "listtokenbalancesbyaddress", &listtokenbalancesbyaddress, {"address", "onlytotal", "count", "start"} },
+    { "tokens",   "listtokenbalancesbyaddress", &listtokenbalancesbyaddress, {"address", "onlytotal", "count", "start", "after"} },
     { "tokens",   "gettokendata",               &gettokendata,               {"token_name"}},
     { "tokens",   "listmytokens",               &listmytokens,               {"token", "verbose", "count", "start"}},
     { "tokens",   "listmylockedtokens",         &listmylockedtokens,         {"token", "verbose", "count", "start"}},
-    { "tokens",   "listaddressesbytoken",       &listaddressesbytoken,       {"token_name", "onlytotal", "count", "start"}},
+    { "tokens",   "listaddressesbytoken",       &listaddressesbytoken,       {"token_name", "onlytotal", "count", "start", "after"}},
+    { "tokens",   "listtopaddressesbytoken",    &listtopaddressesbytoken,    {"token_name", "count"}},
     { "tokens",   "transfer",                   &transfer,                   {"token_name", "qty", "to_address", "token_lock_time"}},
     { "tokens",   "reissue",                    &reissue,                    {"token_name", "qty", "to_address", "change_address", "reissuable", "new_unit"}},
-    { "tokens",   "listtokens",                 &listtokens,                 {"token", "verbose", "count", "start"}},
+    { "tokens",   "listtokens",                 &listtokens,                 {"token", "verbose", "count", "start", "after"}},
     { "tokens",   "getcacheinfo",               &getcacheinfo,               {}}
 };
 
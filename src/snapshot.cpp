@@ -0,0 +1,317 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "tokens/tokendb.h"
+#include "tokens/tokens.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <string.h>
+
+#include <boost/thread.hpp>
+
+static const char SNAPSHOT_MAGIC[4] = {'u', 't', 'x', 'o'};
+
+static uint256 ChunkChecksum(uint8_t nType, uint32_t nRecords, const CDataStream& chunk)
+{
+    CHashWriter checksum(SER_GETHASH, 0);
+    checksum << nType << nRecords;
+    checksum.write(chunk.data(), chunk.size());
+    return checksum.GetHash();
+}
+
+void CSnapshotStats::Count(uint8_t nType, uint64_t nRecords)
+{
+    if (nType == SNAPSHOT_COINS)
+        nCoins += nRecords;
+    else if (nType == SNAPSHOT_TOKENS)
+        nTokens += nRecords;
+    else if (nType == SNAPSHOT_TOKEN_QUANTITIES)
+        nTokenQuantities += nRecords;
+}
+
+CSnapshotWriter::CSnapshotWriter(CAutoFile& fileIn, const CMessageHeader::MessageStartChars& pchMessageStart, const CSnapshotMetadata& metadata)
+    : file(fileIn), hasher(SER_GETHASH, 0), chunk(SER_DISK, CLIENT_VERSION), nChunkType(SNAPSHOT_COINS), nChunkRecords(0), nLastType(SNAPSHOT_END)
+{
+    file.write((const char*)pchMessageStart, CMessageHeader::MESSAGE_START_SIZE);
+    file.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    file << SNAPSHOT_VERSION << metadata;
+    hasher << metadata;
+}
+
+void CSnapshotWriter::WriteChunk()
+{
+    if (nChunkType != SNAPSHOT_END) {
+        if (!nChunkRecords)
+            return;
+
+        // The type goes into the hash where it changes, so the hash doesn't depend on the chunk size
+        if (nChunkType != nLastType)
+            hasher << nChunkType;
+        nLastType = nChunkType;
+        hasher.write(chunk.data(), chunk.size());
+        stats.Count(nChunkType, nChunkRecords);
+    }
+
+    file << nChunkType << nChunkRecords << (uint32_t)chunk.size();
+    file.write(chunk.data(), chunk.size());
+    file << ChunkChecksum(nChunkType, nChunkRecords, chunk);
+
+    chunk.clear();
+    nChunkRecords = 0;
+}
+
+const CSnapshotStats& CSnapshotWriter::Finish()
+{
+    WriteChunk();
+    nChunkType = SNAPSHOT_END;
+    WriteChunk();
+
+    stats.hashSnapshot = hasher.GetHash();
+    file << stats;
+    return stats;
+}
+
+CSnapshotReader::CSnapshotReader(CAutoFile& fileIn, const CMessageHeader::MessageStartChars& pchMessageStart)
+    : file(fileIn), hasher(SER_GETHASH, 0), chunk(SER_DISK, CLIENT_VERSION), nChunkType(SNAPSHOT_END), nChunkRecords(0), nLastType(SNAPSHOT_END)
+{
+    unsigned char pchFileStart[CMessageHeader::MESSAGE_START_SIZE];
+    char pchMagic[sizeof(SNAPSHOT_MAGIC)];
+    uint32_t nVersion;
+
+    file.read((char*)pchFileStart, sizeof(pchFileStart));
+    file.read(pchMagic, sizeof(pchMagic));
+    if (memcmp(pchMagic, SNAPSHOT_MAGIC, sizeof(pchMagic)) != 0)
+        throw std::runtime_error("not a UTXO snapshot");
+    if (memcmp(pchFileStart, pchMessageStart, sizeof(pchFileStart)) != 0)
+        throw std::runtime_error("the snapshot is for a different network");
+    file >> nVersion;
+    if (nVersion != SNAPSHOT_VERSION)
+        throw std::runtime_error(strprintf("unsupported snapshot version %u", nVersion));
+
+    file >> metadata;
+    hasher << metadata;
+}
+
+bool CSnapshotReader::NextChunk()
+{
+    uint32_t nSize;
+    uint256 checksum;
+
+    file >> nChunkType >> nChunkRecords >> nSize;
+    if (nChunkType > SNAPSHOT_TOKEN_QUANTITIES || nSize > MAX_SIZE)
+        throw std::runtime_error("bad snapshot chunk header");
+    chunk.clear();
+    chunk.resize(nSize);
+    file.read(chunk.data(), nSize);
+    file >> checksum;
+    if (checksum != ChunkChecksum(nChunkType, nChunkRecords, chunk))
+        throw std::runtime_error(strprintf("snapshot chunk checksum mismatch after %u coins, %u tokens and %u token quantities",
+                                           stats.nCoins, stats.nTokens, stats.nTokenQuantities));
+
+    if (nChunkType == SNAPSHOT_END) {
+        CSnapshotStats expected;
+        file >> expected;
+        stats.hashSnapshot = hasher.GetHash();
+        if (expected.nCoins != stats.nCoins || expected.nTokens != stats.nTokens || expected.nTokenQuantities != stats.nTokenQuantities)
+            throw std::runtime_error("snapshot record counts don't match its chunks");
+        if (expected.hashSnapshot != stats.hashSnapshot)
+            throw std::runtime_error("snapshot hash doesn't match its records");
+        return false;
+    }
+
+    if (nChunkType != nLastType)
+        hasher << nChunkType;
+    nLastType = nChunkType;
+    hasher.write(chunk.data(), chunk.size());
+    stats.Count(nChunkType, nChunkRecords);
+    return true;
+}
+
+bool DumpSnapshot(const fs::path& path, CSnapshotMetadata& metadata, CSnapshotStats& stats, std::string& strError)
+{
+    if (fs::exists(path)) {
+        strError = path.string() + " already exists";
+        return false;
+    }
+    fs::path pathTmp = path.string() + ".incomplete";
+
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::unique_ptr<CDBSnapshot> ptokensSnapshot;
+    {
+        // Write the caches out, then read both databases as they are now while blocks keep connecting
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pcursor.reset(pcoinsdbview->Cursor());
+        ptokensSnapshot.reset(new CDBSnapshot(*ptokensdb));
+
+        const CBlockIndex* pindex = chainActive.Tip();
+        if (pcursor->GetBestBlock() != pindex->GetBlockHash()) {
+            strError = "the coins database is not at the tip";
+            return false;
+        }
+        metadata.hashBlock = pindex->GetBlockHash();
+        metadata.nHeight = pindex->nHeight;
+        metadata.nChainTx = pindex->nChainTx;
+        metadata.nStakeModifier = pindex->nStakeModifier;
+        metadata.fTokenIndex = fTokenIndex;
+    }
+
+    try {
+        CAutoFile file(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            throw std::runtime_error("unable to open " + pathTmp.string());
+
+        CSnapshotWriter writer(file, Params().MessageStart(), metadata);
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<COutPoint, Coin> record;
+            if (!pcursor->GetKey(record.first) || !pcursor->GetValue(record.second))
+                throw std::runtime_error("unable to read the coins database");
+            writer.Add(SNAPSHOT_COINS, record);
+            pcursor->Next();
+        }
+
+        if (!ptokensdb->ForEachToken(*ptokensSnapshot, [&writer](const CDatabasedTokenData& data) {
+                writer.Add(SNAPSHOT_TOKENS, data);
+            }))
+            throw std::runtime_error("unable to read the token database");
+
+        if (metadata.fTokenIndex && !ptokensdb->ForEachTokenAddressQuantity(*ptokensSnapshot, [&writer](const std::string& tokenName, const std::string& address, const CAmount& quantity) {
+                writer.Add(SNAPSHOT_TOKEN_QUANTITIES, std::make_pair(std::make_pair(tokenName, address), quantity));
+            }))
+            throw std::runtime_error("unable to read the token address quantities");
+
+        stats = writer.Finish();
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(pathTmp, path))
+            throw std::runtime_error("unable to rename " + pathTmp.string());
+    } catch (const std::exception& e) {
+        boost::system::error_code ec;
+        fs::remove(pathTmp, ec);
+        strError = e.what();
+        return false;
+    }
+
+    LogPrintf("Wrote UTXO snapshot at height %d with %u coins, %u tokens and %u token quantities, hash %s\n", metadata.nHeight,
+              stats.nCoins, stats.nTokens, stats.nTokenQuantities, stats.hashSnapshot.ToString());
+    return true;
+}
+
+bool LoadSnapshot(const fs::path& path, bool fRequireKnownHash, CSnapshotMetadata& metadata, CSnapshotStats& stats, std::string& strError)
+{
+    if (fTxIndex || fAddressIndex || fSpentIndex || fTimestampIndex) {
+        strError = "the transaction, address, spent and timestamp indexes can't be built from a UTXO snapshot";
+        return false;
+    }
+
+    bool fWriting = false;
+    try {
+        // Check the whole file before anything gets written
+        {
+            CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+            if (file.IsNull())
+                throw std::runtime_error("unable to open " + path.string());
+            CSnapshotReader reader(file, Params().MessageStart());
+            while (reader.NextChunk())
+                boost::this_thread::interruption_point();
+            metadata = reader.metadata;
+            stats = reader.GetStats();
+        }
+
+        if (fTokenIndex && !metadata.fTokenIndex)
+            throw std::runtime_error("the snapshot has no token address quantities, which -tokenindex needs");
+
+        // A known hash is always checked, fRequireKnownHash only makes it required
+        const MapSnapshotHashes& mapHashes = Params().Snapshots().mapSnapshotHashes;
+        MapSnapshotHashes::const_iterator it = mapHashes.find(metadata.nHeight);
+        if (it != mapHashes.end() && it->second != stats.hashSnapshot)
+            throw std::runtime_error(strprintf("snapshot hash %s doesn't match the known hash %s at height %d",
+                                               stats.hashSnapshot.ToString(), it->second.ToString(), metadata.nHeight));
+        if (fRequireKnownHash && it == mapHashes.end())
+            throw std::runtime_error(strprintf("there is no known snapshot hash at height %d", metadata.nHeight));
+
+        LOCK(cs_main);
+        if (chainActive.Height() != 0 || pcoinsTip->GetBestBlock() != chainActive.Genesis()->GetBlockHash())
+            throw std::runtime_error("a snapshot can only be loaded before any block after genesis is connected");
+        BlockMap::iterator mi = mapBlockIndex.find(metadata.hashBlock);
+        if (mi == mapBlockIndex.end())
+            throw std::runtime_error(strprintf("the header of snapshot block %s is not known yet, wait for the headers to sync", metadata.hashBlock.ToString()));
+        CBlockIndex* pindexBase = mi->second;
+        if (pindexBase->nHeight != metadata.nHeight || !pindexBase->pprev)
+            throw std::runtime_error("the snapshot has to be taken at a block after genesis");
+
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            throw std::runtime_error("unable to open " + path.string());
+        CSnapshotReader reader(file, Params().MessageStart());
+
+        fWriting = true;
+        if (!pblocktree->WriteFlag("snapshotloading", true))
+            throw std::runtime_error("unable to write to the block tree");
+
+        pcoinsTip->SetBestBlock(metadata.hashBlock);
+        while (reader.NextChunk()) {
+            boost::this_thread::interruption_point();
+            CDataStream& chunk = reader.GetChunk();
+            if (reader.GetChunkType() == SNAPSHOT_COINS) {
+                for (uint32_t i = 0; i < reader.GetChunkRecords(); i++) {
+                    std::pair<COutPoint, Coin> record;
+                    chunk >> record;
+                    pcoinsTip->AddCoin(record.first, std::move(record.second), false);
+                }
+                if (pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage && !pcoinsTip->Flush())
+                    throw std::runtime_error("unable to write to the coins database");
+                continue;
+            }
+
+            CTokensDBChanges changes;
+            if (reader.GetChunkType() == SNAPSHOT_TOKENS) {
+                for (uint32_t i = 0; i < reader.GetChunkRecords(); i++) {
+                    CDatabasedTokenData data;
+                    chunk >> data;
+                    changes.mapTokenData[data.token.strName] = data;
+                }
+            } else if (fTokenIndex) {
+                for (uint32_t i = 0; i < reader.GetChunkRecords(); i++) {
+                    std::pair<std::pair<std::string, std::string>, CAmount> record;
+                    chunk >> record;
+                    changes.mapTokenAddressQuantity.insert(record);
+                }
+            }
+            size_t nBatchSize;
+            if (!ptokensdb->WriteDatabaseChanges(changes, false, nBatchSize))
+                throw std::runtime_error("unable to write to the token database");
+        }
+
+        if (reader.GetStats().hashSnapshot != stats.hashSnapshot)
+            throw std::runtime_error("the snapshot changed while it was loaded");
+        if (!pcoinsTip->Flush())
+            throw std::runtime_error("unable to write to the coins database");
+        ptokensCache->Clear();
+
+        if (!ActivateSnapshotTip(pindexBase, metadata.nChainTx, metadata.nStakeModifier))
+            throw std::runtime_error("unable to make the snapshot block the tip");
+        FlushStateToDisk();
+        if (!pblocktree->WriteFlag("snapshotloading", false))
+            throw std::runtime_error("unable to write to the block tree");
+    } catch (const std::exception& e) {
+        strError = e.what();
+        if (fWriting)
+            strError += ". The snapshot was partly written, restart with -reindex";
+        return false;
+    }
+
+    LogPrintf("Loaded UTXO snapshot at height %d with %u coins, %u tokens and %u token quantities, hash %s\n", metadata.nHeight,
+              stats.nCoins, stats.nTokens, stats.nTokenQuantities, stats.hashSnapshot.ToString());
+    return true;
+}
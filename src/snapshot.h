@@ -0,0 +1,192 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef ALPHACON_SNAPSHOT_H
+#define ALPHACON_SNAPSHOT_H
+
+#include "fs.h"
+#include "hash.h"
+#include "protocol.h"
+#include "serialize.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+
+/**
+ * A UTXO snapshot holds the coins database and the token database state
+ * (tokens with their latest reissue, and with -tokenindex the quantity held
+ * by each address) at one block, so that a new node can start validating
+ * from that block instead of replaying the chain before it.
+ *
+ * File layout:
+ * - network magic, "utxo", format version
+ * - CSnapshotMetadata
+ * - chunks of records of one type, each with its type, record count, payload
+ *   and a checksum, ending with an empty SNAPSHOT_END chunk
+ * - CSnapshotStats, with the record counts and the snapshot hash
+ *
+ * The snapshot hash covers the metadata and every record in order, not the
+ * way they are split into chunks.
+ */
+
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+//! A chunk is closed once its payload grows past this many bytes
+static const size_t SNAPSHOT_CHUNK_SIZE = 1 << 20;
+
+enum SnapshotRecordType : uint8_t {
+    SNAPSHOT_END = 0,
+    SNAPSHOT_COINS = 1,             //!< COutPoint, Coin
+    SNAPSHOT_TOKENS = 2,            //!< CDatabasedTokenData
+    SNAPSHOT_TOKEN_QUANTITIES = 3,  //!< Token name, address, quantity
+};
+
+/** The block a snapshot was taken at, and what a node needs to continue from it */
+class CSnapshotMetadata
+{
+public:
+    uint256 hashBlock;
+    int nHeight;
+    unsigned int nChainTx;
+    uint256 nStakeModifier;
+    //! Whether the token address quantities are included
+    bool fTokenIndex;
+
+    CSnapshotMetadata()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        hashBlock.SetNull();
+        nHeight = -1;
+        nChainTx = 0;
+        nStakeModifier.SetNull();
+        fTokenIndex = false;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nChainTx);
+        READWRITE(nStakeModifier);
+        READWRITE(fTokenIndex);
+    }
+};
+
+/** Record counts and hash of a snapshot, written after its last chunk */
+class CSnapshotStats
+{
+public:
+    uint64_t nCoins;
+    uint64_t nTokens;
+    uint64_t nTokenQuantities;
+    uint256 hashSnapshot;
+
+    CSnapshotStats()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nCoins = 0;
+        nTokens = 0;
+        nTokenQuantities = 0;
+        hashSnapshot.SetNull();
+    }
+
+    void Count(uint8_t nType, uint64_t nRecords);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nCoins);
+        READWRITE(nTokens);
+        READWRITE(nTokenQuantities);
+        READWRITE(hashSnapshot);
+    }
+};
+
+/** Writes records to a snapshot file in checksummed chunks */
+class CSnapshotWriter
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+    CDataStream chunk;
+    uint8_t nChunkType;
+    uint32_t nChunkRecords;
+    uint8_t nLastType;
+    CSnapshotStats stats;
+
+    void WriteChunk();
+
+public:
+    CSnapshotWriter(CAutoFile& fileIn, const CMessageHeader::MessageStartChars& pchMessageStart, const CSnapshotMetadata& metadata);
+
+    template <typename T>
+    void Add(uint8_t nType, const T& record)
+    {
+        if (nType != nChunkType || chunk.size() >= SNAPSHOT_CHUNK_SIZE) {
+            WriteChunk();
+            nChunkType = nType;
+        }
+        chunk << record;
+        nChunkRecords++;
+    }
+
+    //! Write the last chunk and the stats. The writer can't be used after this
+    const CSnapshotStats& Finish();
+};
+
+/** Reads the chunks of a snapshot file, checking them as it goes. Throws on a damaged file */
+class CSnapshotReader
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+    CDataStream chunk;
+    uint8_t nChunkType;
+    uint32_t nChunkRecords;
+    uint8_t nLastType;
+    CSnapshotStats stats;
+
+public:
+    CSnapshotMetadata metadata;
+
+    CSnapshotReader(CAutoFile& fileIn, const CMessageHeader::MessageStartChars& pchMessageStart);
+
+    //! Read the next chunk, or check the stats and return false after the last one
+    bool NextChunk();
+
+    uint8_t GetChunkType() const { return nChunkType; }
+    uint32_t GetChunkRecords() const { return nChunkRecords; }
+    CDataStream& GetChunk() { return chunk; }
+
+    //! Counts and hash of the records read so far, and of the whole file once NextChunk() returned false
+    const CSnapshotStats& GetStats() const { return stats; }
+};
+
+/** Write the chainstate and token database at the active tip to a new snapshot file */
+bool DumpSnapshot(const fs::path& path, CSnapshotMetadata& metadata, CSnapshotStats& stats, std::string& strError);
+
+/**
+ * Load a snapshot into a node that has not connected any block after genesis
+ * yet, and make its block the tip. The headers up to that block must be
+ * known. With fRequireKnownHash, the snapshot hash has to match the one in
+ * the chain parameters for its height.
+ */
+bool LoadSnapshot(const fs::path& path, bool fRequireKnownHash, CSnapshotMetadata& metadata, CSnapshotStats& stats, std::string& strError);
+
+#endif // ALPHACON_SNAPSHOT_H
@@ -0,0 +1,308 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "hash.h"
+#include "key.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "timestampindex.h"
+#include "txdb.h"
+#include "validation.h"
+#include "test/test_alphacon.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestingSetup)
+
+static CAddressBalanceValue ReadBalance(CBlockTreeDB& db, const uint160& hash, const std::string& tokenName)
+{
+    std::vector<std::pair<std::string, CAddressBalanceValue> > balances;
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, tokenName, balances));
+    return balances.empty() ? CAddressBalanceValue() : balances[0].second;
+}
+
+BOOST_AUTO_TEST_CASE(address_balance_index_test)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hash = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 txid1 = InsecureRand256();
+    uint256 txid2 = InsecureRand256();
+
+    // Built from the entries already in the address index
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock1;
+    vBlock1.push_back(std::make_pair(CAddressIndexKey(1, hash, 1, 1, txid1, 0, false), 50 * COIN));
+    vBlock1.push_back(std::make_pair(CAddressIndexKey(1, hash, "TOKEN", 1, 1, txid1, 1, false), 10 * COIN));
+    BOOST_CHECK(db.WriteAddressIndex(vBlock1));
+    BOOST_CHECK(db.SetAddressBalanceIndex(true));
+    BOOST_CHECK_EQUAL(ReadBalance(db, hash, ALP).balance, 50 * COIN);
+    BOOST_CHECK_EQUAL(ReadBalance(db, hash, "TOKEN").balance, 10 * COIN);
+
+    // Kept up to date as blocks are connected
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock2;
+    vBlock2.push_back(std::make_pair(CAddressIndexKey(1, hash, 2, 1, txid2, 0, true), -50 * COIN));
+    vBlock2.push_back(std::make_pair(CAddressIndexKey(1, hash, 2, 1, txid2, 1, false), 20 * COIN));
+    BOOST_CHECK(db.WriteAddressIndex(vBlock2));
+    // An entry that may be written twice, by the background build or by a block
+    // replayed at the next start, counts once
+    BOOST_CHECK(db.WriteAddressIndex(vBlock2, true));
+    BOOST_CHECK(db.SetAddressBalanceIndex(true));
+    BOOST_CHECK(db.WriteAddressIndex(vBlock2));
+    CAddressBalanceValue value = ReadBalance(db, hash, ALP);
+    BOOST_CHECK_EQUAL(value.balance, 20 * COIN);
+    BOOST_CHECK_EQUAL(value.received, 70 * COIN);
+
+    std::vector<std::pair<std::string, CAddressBalanceValue> > balances;
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, "", balances));
+    BOOST_CHECK_EQUAL(balances.size(), 2U);
+
+    // Disconnecting undoes the block, and a balance that goes back to nothing is removed
+    BOOST_CHECK(db.EraseAddressIndex(vBlock2));
+    BOOST_CHECK(db.EraseAddressIndex(vBlock2));
+    value = ReadBalance(db, hash, ALP);
+    BOOST_CHECK_EQUAL(value.balance, 50 * COIN);
+    BOOST_CHECK_EQUAL(value.received, 50 * COIN);
+    BOOST_CHECK(db.EraseAddressIndex(vBlock1));
+    balances.clear();
+    BOOST_CHECK(db.ReadAddressBalance(hash, 1, "", balances));
+    BOOST_CHECK(balances.empty());
+
+    // Dropped when the option is turned off
+    BOOST_CHECK(db.WriteAddressIndex(vBlock1));
+    BOOST_CHECK(db.SetAddressBalanceIndex(false));
+    BOOST_CHECK(ReadBalance(db, hash, ALP).IsNull());
+}
+
+BOOST_AUTO_TEST_CASE(address_index_range_test)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hash = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 hashOther = uint160(ParseHex("1111111111111111111111111111111111111111"));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    for (int nHeight = 1; nHeight <= 10; nHeight++) {
+        vEntries.push_back(std::make_pair(CAddressIndexKey(1, hash, nHeight, 1, InsecureRand256(), 0, false), COIN));
+        vEntries.push_back(std::make_pair(CAddressIndexKey(1, hash, "TOKEN", nHeight, 1, InsecureRand256(), 0, false), COIN));
+        vEntries.push_back(std::make_pair(CAddressIndexKey(1, hashOther, nHeight, 1, InsecureRand256(), 0, false), COIN));
+    }
+    BOOST_CHECK(db.WriteAddressIndex(vEntries));
+
+    // Heights 4 to 6 of each token, without a token name too
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    BOOST_CHECK(db.ReadAddressIndex(hash, 1, ALP, addressIndex, 4, 6));
+    BOOST_CHECK_EQUAL(addressIndex.size(), 3U);
+    addressIndex.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hash, 1, addressIndex, 4, 6));
+    BOOST_CHECK_EQUAL(addressIndex.size(), 6U);
+    for (const auto& entry : addressIndex) {
+        BOOST_CHECK(entry.first.hashBytes == hash);
+        BOOST_CHECK(entry.first.blockHeight >= 4 && entry.first.blockHeight <= 6);
+    }
+
+    // Pages of two entries, each continuing after the last entry of the one before
+    std::vector<CAddressIndexKey> vPaged;
+    CAddressIndexKey after;
+    const CAddressIndexKey* pafter = nullptr;
+    while (true) {
+        size_t nPage = 0;
+        BOOST_CHECK(db.ForEachAddressIndex(hash, 1, "", 4, 6, pafter, [&](const CAddressIndexKey& key, const CAmount& nValue) {
+            vPaged.push_back(key);
+            return ++nPage < 2;
+        }));
+        if (nPage == 0)
+            break;
+        after = vPaged.back();
+        pafter = &after;
+    }
+    BOOST_CHECK_EQUAL(vPaged.size(), addressIndex.size());
+    for (size_t i = 0; i < vPaged.size() && i < addressIndex.size(); i++)
+        BOOST_CHECK(vPaged[i] == addressIndex[i].first);
+}
+
+BOOST_AUTO_TEST_CASE(address_index_merge_test)
+{
+    CBlockTreeDB db(1 << 20, true);
+    std::vector<std::pair<uint160, int> > addresses;
+    for (int i = 0; i < 3; i++) {
+        uint256 hash = InsecureRand256();
+        addresses.push_back(std::make_pair(uint160(std::vector<unsigned char>(hash.begin(), hash.begin() + 20)), 1));
+    }
+
+    // Every address and token gets entries at random heights, some of them in the same transaction
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    for (int i = 0; i < 60; i++) {
+        int nHeight = 1 + InsecureRandRange(20);
+        uint256 txid = InsecureRand256();
+        for (const auto& address : addresses) {
+            if (InsecureRandBool())
+                vEntries.push_back(std::make_pair(CAddressIndexKey(address.second, address.first, nHeight, 1, txid, 0, false), COIN));
+            if (InsecureRandBool())
+                vEntries.push_back(std::make_pair(CAddressIndexKey(address.second, address.first, "TOKEN", nHeight, 1, txid, 1, false), COIN));
+        }
+    }
+    BOOST_CHECK(db.WriteAddressIndex(vEntries));
+
+    std::vector<CAddressIndexKey> vMerged;
+    BOOST_CHECK(db.ForEachAddressIndex(addresses, "", 5, 15, nullptr, [&](const CAddressIndexKey& key, const CAmount& nValue) {
+        vMerged.push_back(key);
+        return true;
+    }));
+    size_t nExpected = 0;
+    for (const auto& entry : vEntries)
+        if (entry.first.blockHeight >= 5 && entry.first.blockHeight <= 15)
+            nExpected++;
+    BOOST_CHECK_EQUAL(vMerged.size(), nExpected);
+    for (size_t i = 1; i < vMerged.size(); i++)
+        BOOST_CHECK(AddressIndexMergeLess(vMerged[i - 1], vMerged[i]));
+
+    // Continuing after any entry gives the rest of them
+    BOOST_REQUIRE(!vMerged.empty());
+    size_t nAfter = InsecureRandRange(vMerged.size());
+    std::vector<CAddressIndexKey> vRest;
+    BOOST_CHECK(db.ForEachAddressIndex(addresses, "", 5, 15, &vMerged[nAfter], [&](const CAddressIndexKey& key, const CAmount& nValue) {
+        vRest.push_back(key);
+        return true;
+    }));
+    BOOST_CHECK_EQUAL(vRest.size(), vMerged.size() - nAfter - 1);
+    for (size_t i = 0; i < vRest.size() && nAfter + 1 + i < vMerged.size(); i++)
+        BOOST_CHECK(vRest[i] == vMerged[nAfter + 1 + i]);
+
+    // Entries written while the index is being read aren't visited, however late a stream is opened
+    size_t nVisited = 0;
+    BOOST_CHECK(db.ForEachAddressIndex(addresses, "", 5, 15, nullptr, [&](const CAddressIndexKey& key, const CAmount& nValue) {
+        if (nVisited++ == 0) {
+            std::vector<std::pair<CAddressIndexKey, CAmount> > vLate;
+            for (const auto& address : addresses)
+                vLate.push_back(std::make_pair(CAddressIndexKey(address.second, address.first, 15, 1, InsecureRand256(), 0, false), COIN));
+            BOOST_CHECK(db.WriteAddressIndex(vLate));
+        }
+        return true;
+    }));
+    BOOST_CHECK_EQUAL(nVisited, vMerged.size());
+}
+
+BOOST_AUTO_TEST_CASE(index_build_height_test)
+{
+    CBlockTreeDB db(1 << 20, true);
+    int nHeight;
+    BOOST_CHECK(!db.ReadIndexBuildHeight("addressindex", nHeight));
+
+    // Each index keeps its own progress until it is built
+    BOOST_CHECK(db.WriteIndexBuildHeight("addressindex", 17));
+    BOOST_CHECK(db.WriteIndexBuildHeight("spentindex", 1));
+    BOOST_CHECK(db.ReadIndexBuildHeight("addressindex", nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 17);
+    BOOST_CHECK(db.ReadIndexBuildHeight("spentindex", nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 1);
+
+    BOOST_CHECK(db.EraseIndexBuildHeight("addressindex"));
+    BOOST_CHECK(!db.ReadIndexBuildHeight("addressindex", nHeight));
+    BOOST_CHECK(db.ReadIndexBuildHeight("spentindex", nHeight));
+}
+
+//! Turns the address, spent and timestamp indexes on before the chain of TestChain100Setup is connected
+struct IndexFlagsSetup
+{
+    bool fAddressIndexOld, fSpentIndexOld, fTimestampIndexOld;
+
+    IndexFlagsSetup() : fAddressIndexOld(fAddressIndex), fSpentIndexOld(fSpentIndex), fTimestampIndexOld(fTimestampIndex)
+    {
+        fAddressIndex = fSpentIndex = fTimestampIndex = true;
+    }
+
+    ~IndexFlagsSetup()
+    {
+        fAddressIndex = fAddressIndexOld;
+        fSpentIndex = fSpentIndexOld;
+        fTimestampIndex = fTimestampIndexOld;
+    }
+};
+
+struct IndexChainSetup : public IndexFlagsSetup, public TestChain100Setup {};
+
+//! Everything the indexes have of the coinbase key, serialized so that it can be compared
+static uint256 HashIndexes(const uint160& hashBytes, const std::vector<CSpentIndexKey>& vSpentKeys)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddress;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    std::vector<std::pair<uint256, unsigned int> > vTimestamps;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(hashBytes, 1, vAddress));
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(hashBytes, 1, vUnspent));
+    BOOST_CHECK(pblocktree->ReadTimestampIndex(std::numeric_limits<unsigned int>::max(), 0, false, vTimestamps));
+    BOOST_CHECK(!vAddress.empty() && !vUnspent.empty());
+    BOOST_CHECK_EQUAL(vTimestamps.size(), (size_t)chainActive.Height());
+
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    for (CSpentIndexKey key : vSpentKeys) {
+        CSpentIndexValue value;
+        BOOST_CHECK(pblocktree->ReadSpentIndex(key, value));
+        vSpent.push_back(std::make_pair(key, value));
+    }
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << vAddress << vUnspent << vTimestamps << vSpent;
+    return ss.GetHash();
+}
+
+BOOST_FIXTURE_TEST_CASE(index_build_test, IndexChainSetup)
+{
+    // Blocks that spend a coinbase and the output of the block before, so that some outputs are spent again
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    uint160 hashBytes(coinbaseKey.GetPubKey().GetID());
+    std::vector<CSpentIndexKey> vSpentKeys;
+    uint256 hashPrev;
+    for (int i = 0; i < 3; i++) {
+        CMutableTransaction spend;
+        spend.nVersion = 1;
+        spend.vin.push_back(CTxIn(COutPoint(coinbaseTxns[i].GetHash(), 0)));
+        if (i > 0)
+            spend.vin.push_back(CTxIn(COutPoint(hashPrev, 1)));
+        spend.vout.push_back(CTxOut(11 * CENT, GetScriptForDestination(coinbaseKey.GetPubKey().GetID())));
+        spend.vout.push_back(CTxOut(22 * CENT, scriptPubKey));
+        for (unsigned int j = 0; j < spend.vin.size(); j++) {
+            std::vector<unsigned char> vchSig;
+            uint256 hash = SignatureHash(scriptPubKey, spend, j, SIGHASH_ALL, 0, SIGVERSION_BASE);
+            BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+            vchSig.push_back((unsigned char)SIGHASH_ALL);
+            spend.vin[j].scriptSig << vchSig;
+            vSpentKeys.push_back(CSpentIndexKey(spend.vin[j].prevout.hash, spend.vin[j].prevout.n));
+        }
+        CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, spend), scriptPubKey);
+        BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetBlockHash());
+        hashPrev = spend.GetHash();
+    }
+    uint256 hashConnected = HashIndexes(hashBytes, vSpentKeys);
+
+    // Built in the background from the same blocks, into an empty database, the indexes are the same
+    CBlockTreeDB* pblocktreeConnected = pblocktree;
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    for (const char* name : {"addressindex", "spentindex", "timestampindex"})
+        BOOST_CHECK(StartIndexBuild(name));
+    ThreadIndexBuilder();
+    BOOST_CHECK(hashConnected == HashIndexes(hashBytes, vSpentKeys));
+    std::string strError;
+    int nHeight;
+    BOOST_CHECK(!GetIndexBuildHeight("addressindex", nHeight));
+    BOOST_CHECK(CheckIndexCoverage("addressindex", 0, 0, strError));
+
+    // A block without data is left out, and the index then only covers the blocks after it
+    delete pblocktree;
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    CBlockIndex* pindexMissing = chainActive[50];
+    unsigned int nStatus = pindexMissing->nStatus;
+    pindexMissing->nStatus &= ~BLOCK_HAVE_DATA;
+    BOOST_CHECK(StartIndexBuild("addressindex"));
+    ThreadIndexBuilder();
+    pindexMissing->nStatus = nStatus;
+    BOOST_CHECK(GetIndexStartHeight("addressindex", nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 51);
+    BOOST_CHECK(!CheckIndexCoverage("addressindex", 0, 0, strError));
+    BOOST_CHECK(CheckIndexCoverage("addressindex", 51, 0, strError));
+    BOOST_CHECK(CheckIndexCoverage("spentindex", 0, 0, strError));
+
+    delete pblocktree;
+    pblocktree = pblocktreeConnected;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
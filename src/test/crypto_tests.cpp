@@ -6,6 +6,8 @@
 
 #include "crypto/aes.h"
 #include "crypto/chacha20.h"
+#include "crypto/groestl512.h"
+#include "crypto/sph_groestl.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
@@ -107,6 +109,16 @@ BOOST_FIXTURE_TEST_SUITE(crypto_tests, BasicTestingSetup)
     void TestSHA512(const std::string &in, const std::string &hexout)
     { TestVector(CSHA512(), in, ParseHex(hexout)); }
 
+    void TestGroestl512(const std::vector<unsigned char> &in, const std::string &hexout)
+    {
+        std::vector<unsigned char> hash(GROESTL512_OUTPUT_SIZE);
+        Groestl512(in.data(), in.size(), hash.data());
+        BOOST_CHECK_EQUAL(HexStr(hash), hexout);
+    }
+
+    void TestGroestl512(const std::string &in, const std::string &hexout)
+    { TestGroestl512(std::vector<unsigned char>(in.begin(), in.end()), hexout); }
+
     void TestRIPEMD160(const std::string &in, const std::string &hexout)
     { TestVector(CRIPEMD160(), in, ParseHex(hexout)); }
 
@@ -375,6 +387,64 @@ BOOST_FIXTURE_TEST_SUITE(crypto_tests, BasicTestingSetup)
                    "37de8c3ef5459d76a52cedc02dc499a3c9ed9dedbfb3281afd9653b8a112fafc");
     }
 
+    BOOST_AUTO_TEST_CASE(groestl512_testvectors_test)
+    {
+        BOOST_TEST_MESSAGE("Running groestl512 TestVectors Test");
+
+        std::vector<unsigned char> counting(300);
+        for (size_t i = 0; i < counting.size(); i++)
+            counting[i] = i & 0xff;
+
+        TestGroestl512("",
+                       "6d3ad29d279110eef3adbd66de2a0345a77baede1557f5d099fce0c03d6dc2ba"
+                       "8e6d4a6633dfbd66053c20faa87d1a11f39a7fbe4a6c2f009801370308fc4ad8");
+        TestGroestl512("abc",
+                       "70e1c68c60df3b655339d67dc291cc3f1dde4ef343f11b23fdd44957693815a7"
+                       "5a8339c682fc28322513fd1f283c18e53cff2b264e06bf83a2f0ac8c1f6fbff6");
+        TestGroestl512("The quick brown fox jumps over the lazy dog",
+                       "badc1f70ccd69e0cf3760c3f93884289da84ec13c70b3d12a53a7a8a4a513f99"
+                       "715d46288f55e1dbf926e6d084a0538e4eebfc91cf2b21452921ccde9131718d");
+        // An 80 byte header, and lengths around the point where padding needs a second block
+        TestGroestl512(std::vector<unsigned char>(counting.begin(), counting.begin() + 80),
+                       "a41bd139d3da523aa700ce9dea78ca3c7c4b66e38e6769becbcd8fed37813fbc"
+                       "5c2e6b1b9b9147e3e7e801e8e5231a1586f9ba99ecf6565ffb77ee5e792447bc");
+        TestGroestl512(std::vector<unsigned char>(counting.begin(), counting.begin() + 119),
+                       "b37602eb3cb6226e83ce18695d15f19f7e01afff69f4a76103afb789d073a757"
+                       "fc6d97242e80ee92e0953d8617174375ae5227581c1630098e3048bc5bfdfc5a");
+        TestGroestl512(std::vector<unsigned char>(counting.begin(), counting.begin() + 120),
+                       "5cfc13a05459f11cab784846d953da0b7c3eda4855db918da20993665b7e7260"
+                       "cb3711782f402c04b49a03f70414246d56217e97e261cef8f0c225fd124cb971");
+        TestGroestl512(std::vector<unsigned char>(counting.begin(), counting.begin() + 128),
+                       "70b56b15a86cd65b19f4afe78f7b408b72287947cc0d28ba4189573fbe033cf9"
+                       "a3298127b460778feecca5794407539acc267b27732e4fbc21bc96fcf9f2f17a");
+        TestGroestl512(counting,
+                       "159204e1be4611568dc593c231cbb19a16d9b61b7ad1b4d60eba5e38ee71e533"
+                       "b8f8cfdd59ebd3208be0a7c885037d8ac4d58f440171bf92e2b370d2a91434f9");
+    }
+
+    BOOST_AUTO_TEST_CASE(groestl512_matches_sph_test)
+    {
+        BOOST_TEST_MESSAGE("Running groestl512 Matches Sph Test");
+
+        // Whatever implementation was selected at startup has to agree with
+        // the reference code on random input of random length
+        FastRandomContext ctx(true);
+        for (int i = 0; i < 1000; i++) {
+            std::vector<unsigned char> data = ctx.randbytes(ctx.randrange(1000));
+            unsigned char hash[GROESTL512_OUTPUT_SIZE];
+            unsigned char expected[GROESTL512_OUTPUT_SIZE];
+
+            Groestl512(data.data(), data.size(), hash);
+
+            sph_groestl512_context ctx_groestl;
+            sph_groestl512_init(&ctx_groestl);
+            sph_groestl512(&ctx_groestl, data.data(), data.size());
+            sph_groestl512_close(&ctx_groestl, expected);
+
+            BOOST_CHECK(memcmp(hash, expected, sizeof(hash)) == 0);
+        }
+    }
+
     BOOST_AUTO_TEST_CASE(hmac_sha256_testvectors_test)
     {
         BOOST_TEST_MESSAGE("Running hmac sha256 TestVectors Test");
@@ -129,6 +129,42 @@ BOOST_FIXTURE_TEST_SUITE(dbwrapper_tests, BasicTestingSetup)
         }
     }
 
+// Test that iterators on a snapshot do not see later writes
+    BOOST_AUTO_TEST_CASE(dbwrapper_snapshot_test)
+    {
+        BOOST_TEST_MESSAGE("Running dbWrapper Snapshot Test");
+
+        fs::path ph = fs::temp_directory_path() / fs::unique_path();
+        CDBWrapper dbw(ph, (1 << 20), true, false, false);
+
+        char key = 'j';
+        uint256 in = InsecureRand256();
+        BOOST_CHECK(dbw.Write(key, in));
+
+        CDBSnapshot snapshot(dbw);
+
+        char key2 = 'k';
+        BOOST_CHECK(dbw.Write(key2, InsecureRand256()));
+        BOOST_CHECK(dbw.Write(key, InsecureRand256()));
+
+        std::unique_ptr<CDBIterator> it(dbw.NewIterator(snapshot));
+        it->Seek(key);
+
+        char key_res;
+        uint256 val_res;
+        BOOST_CHECK(it->GetKey(key_res));
+        BOOST_CHECK(it->GetValue(val_res));
+        BOOST_CHECK_EQUAL(key_res, key);
+        BOOST_CHECK_EQUAL(val_res.ToString(), in.ToString());
+
+        it->Next();
+        BOOST_CHECK_EQUAL(it->Valid(), false);
+
+        std::unique_ptr<CDBIterator> itNow(dbw.NewIterator());
+        itNow->Seek(key2);
+        BOOST_CHECK(itNow->Valid() && itNow->GetKey(key_res) && key_res == key2);
+    }
+
 // Test that we do not obfuscation if there is existing data.
     BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate_test)
     {
@@ -8,6 +8,8 @@
 #include "utilstrencodings.h"
 #include "test/test_alphacon.h"
 #include "consensus/merkle.h"
+#include "primitives/block.h"
+#include "streams.h"
 
 #include <vector>
 #include<iostream>
@@ -156,4 +158,59 @@ BOOST_FIXTURE_TEST_SUITE(hash_tests, BasicTestingSetup)
         }
     }
 
+    static uint256 SerializedBlockHash(const CBlockHeader& header)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << header;
+        return groestlhash(ss.begin(), ss.end());
+    }
+
+    BOOST_AUTO_TEST_CASE(block_hash_cache_test)
+    {
+        BOOST_TEST_MESSAGE("Running Block Hash Cache Test");
+
+        CBlock block;
+        block.nVersion = 4;
+        block.hashPrevBlock = InsecureRand256();
+        block.hashMerkleRoot = InsecureRand256();
+        block.nTime = 1550000000;
+        block.nBits = 0x1e0fffff;
+        block.nNonce = 1;
+
+        uint256 hash = block.GetBlockHash();
+        BOOST_CHECK(hash == SerializedBlockHash(block));
+        BOOST_CHECK(block.GetBlockHash() == hash);
+
+        // Changing any header field in place has to give a new hash
+        block.nNonce++;
+        BOOST_CHECK(block.GetBlockHash() != hash);
+        BOOST_CHECK(block.GetBlockHash() == SerializedBlockHash(block));
+        block.nNonce--;
+        BOOST_CHECK(block.GetBlockHash() == hash);
+        block.hashMerkleRoot = InsecureRand256();
+        BOOST_CHECK(block.GetBlockHash() == SerializedBlockHash(block));
+
+        // Copies and headers taken from the block agree with it
+        CBlock copy = block;
+        BOOST_CHECK(copy.GetBlockHash() == block.GetBlockHash());
+        CBlockHeader header = block.GetBlockHeader();
+        BOOST_CHECK(header.GetBlockHash() == block.GetBlockHash());
+        header.nTime++;
+        BOOST_CHECK(header.GetBlockHash() != block.GetBlockHash());
+        header = block;
+        BOOST_CHECK(header.GetBlockHash() == block.GetBlockHash());
+
+        // Deserializing over a header that already has a hash cached
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << header;
+        CBlockHeader target = block.GetBlockHeader();
+        target.nNonce = 7;
+        BOOST_CHECK(target.GetBlockHash() != header.GetBlockHash());
+        ss >> target;
+        BOOST_CHECK(target.GetBlockHash() == header.GetBlockHash());
+
+        block.SetNull();
+        BOOST_CHECK(block.GetBlockHash() == SerializedBlockHash(block));
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "coins.h"
 #include "policy/policy.h"
 #include "txmempool.h"
 #include "util.h"
@@ -598,4 +599,56 @@ BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
         SetMockTime(0);
     }
 
+    BOOST_AUTO_TEST_CASE(mempool_address_index_test)
+    {
+        CTxMemPool pool;
+        TestMemPoolEntryHelper entry;
+        CCoinsView coinsDummy;
+        CCoinsViewCache view(&coinsDummy);
+
+        uint160 hashFrom = uint160(ParseHex("0101010101010101010101010101010101010101"));
+        uint160 hashTo = uint160(ParseHex("0202020202020202020202020202020202020202"));
+        CScript scriptFrom = CScript() << OP_DUP << OP_HASH160 << ToByteVector(hashFrom) << OP_EQUALVERIFY << OP_CHECKSIG;
+        CScript scriptTo = CScript() << OP_DUP << OP_HASH160 << ToByteVector(hashTo) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+        std::vector<CTransaction> vtx;
+        for (int i = 0; i < 20; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+            view.AddCoin(tx.vin[0].prevout, Coin(CTxOut(10 * COIN, scriptFrom), 1, false, false, 0), false);
+            tx.vout.resize(1);
+            tx.vout[0] = CTxOut(9 * COIN, scriptTo);
+            vtx.push_back(CTransaction(tx));
+
+            CTxMemPoolEntry txEntry = entry.FromTx(tx);
+            LOCK(pool.cs);
+            pool.addUnchecked(tx.GetHash(), txEntry);
+            pool.addAddressIndex(txEntry, view);
+            pool.addSpentIndex(txEntry, view);
+        }
+
+        std::vector<std::pair<uint160, int> > addresses(1, std::make_pair(hashFrom, 1));
+        std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > results;
+        BOOST_CHECK(pool.getAddressIndex(addresses, ALP, results));
+        BOOST_CHECK_EQUAL(results.size(), 20U);
+        for (const auto& result : results) {
+            BOOST_CHECK(result.first.addressBytes == hashFrom);
+            BOOST_CHECK_EQUAL(result.second.amount, -10 * COIN);
+        }
+
+        CSpentIndexKey key(vtx[0].vin[0].prevout.hash, 0);
+        CSpentIndexValue value;
+        BOOST_CHECK(pool.getSpentIndex(key, value));
+        BOOST_CHECK(value.txid == vtx[0].GetHash());
+
+        // Entries leave the indexes with their transaction
+        pool.removeRecursive(vtx[0]);
+        BOOST_CHECK(!pool.getSpentIndex(key, value));
+        addresses[0].first = hashTo;
+        results.clear();
+        BOOST_CHECK(pool.getAddressIndex(addresses, results));
+        BOOST_CHECK_EQUAL(results.size(), 19U);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
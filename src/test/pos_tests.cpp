@@ -0,0 +1,150 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "chainparams.h"
+#include "pos.h"
+#include "random.h"
+#include "test/test_alphacon.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pos_tests, BasicTestingSetup)
+
+    /* CStakeKernelSearch must agree with CheckStakeKernelHash on every kernel */
+    BOOST_AUTO_TEST_CASE(kernel_search_matches_kernel_hash_test)
+    {
+        BOOST_TEST_MESSAGE("Running Kernel Search Matches Kernel Hash Test");
+
+        const Consensus::Params& params = Params().GetConsensus();
+        CBlockIndex tip;
+        tip.nHeight = 100000;
+        tip.nTime = 1560000000;
+
+        // From targets nothing meets up to targets everything meets, and values
+        // large enough to overflow the scaled target
+        const unsigned int vBits[] = {0x03000001, 0x1d00ffff, 0x1f00ffff, 0x207fffff, 0x2100ffff};
+        const CAmount vValues[] = {1, COIN, 1000000 * COIN, MAX_MONEY, std::numeric_limits<CAmount>::max()};
+
+        int nHits = 0;
+        for (int i = 0; i < 200; i++) {
+            tip.nStakeModifier = InsecureRand256();
+            COutPoint prevout(InsecureRand256(), InsecureRand32() % 8);
+            uint32_t nTimeBlock = tip.nTime + (InsecureRand32() % 1000) * (STAKE_TIMESTAMP_MASK + 1);
+            for (unsigned int nBits : vBits) {
+                CStakeKernelSearch kernelSearch(&tip, nBits, params);
+                for (CAmount nValue : vValues) {
+                    CStakeCache stake(tip.nTime - 86400, nValue, 1);
+                    bool fExpected = CheckStakeKernelHash(&tip, nBits, nValue, prevout, nTimeBlock, stake.nTime);
+                    BOOST_CHECK_EQUAL(kernelSearch.Check(prevout, stake, nTimeBlock), fExpected);
+                    BOOST_CHECK_EQUAL(kernelSearch.FindTime(prevout, stake, {nTimeBlock - 16, nTimeBlock}) != 0,
+                                      fExpected || CheckStakeKernelHash(&tip, nBits, nValue, prevout, nTimeBlock - 16, stake.nTime));
+                    nHits += fExpected;
+                }
+            }
+        }
+        BOOST_CHECK(nHits > 0);
+    }
+
+    /* Immature prevouts never meet the target, whatever their hash */
+    BOOST_AUTO_TEST_CASE(kernel_search_maturity_test)
+    {
+        BOOST_TEST_MESSAGE("Running Kernel Search Maturity Test");
+
+        const Consensus::Params& params = Params().GetConsensus();
+        CBlockIndex tip;
+        tip.nHeight = 100000;
+        tip.nStakeModifier = InsecureRand256();
+
+        CStakeKernelSearch kernelSearch(&tip, 0x2100ffff, params);
+        COutPoint prevout(InsecureRand256(), 0);
+        int nHeightFrom = tip.nHeight + 1 - params.nStakeMaturity;
+        BOOST_CHECK(kernelSearch.Check(prevout, CStakeCache(0, COIN, nHeightFrom), 0));
+        BOOST_CHECK(!kernelSearch.Check(prevout, CStakeCache(0, COIN, nHeightFrom + 1), 0));
+
+        std::vector<std::pair<COutPoint, CStakeCache> > vKernels;
+        vKernels.emplace_back(prevout, CStakeCache(0, COIN, nHeightFrom + 1));
+        vKernels.emplace_back(prevout, CStakeCache(0, COIN, nHeightFrom));
+        BOOST_CHECK_EQUAL(kernelSearch.Find(vKernels, 0), 1);
+        BOOST_CHECK_EQUAL(kernelSearch.Find(vKernels, 0, 2), -1);
+    }
+
+    /* A cached kernel input is only used while it matches the prevout at the tip */
+    BOOST_AUTO_TEST_CASE(stake_cache_chain_test)
+    {
+        BOOST_TEST_MESSAGE("Running Stake Cache Chain Test");
+
+        std::vector<CBlockIndex> vBlocks(100);
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            vBlocks[i].nHeight = i;
+            vBlocks[i].pprev = i ? &vBlocks[i - 1] : nullptr;
+            vBlocks[i].BuildSkip();
+        }
+        const CBlockIndex* pindexPrev = &vBlocks.back();
+
+        CCoinsView coinsDummy;
+        CCoinsViewCache view(&coinsDummy);
+        COutPoint prevout(InsecureRand256(), 0);
+        CStakeCache stake(1560000000, COIN, 50);
+        BOOST_CHECK(!CheckStakeCache(pindexPrev, prevout, stake, view));
+
+        view.AddCoin(prevout, Coin(CTxOut(COIN, CScript() << OP_TRUE), 50, false, false, stake.nTime), false);
+        BOOST_CHECK(CheckStakeCache(pindexPrev, prevout, stake, view));
+
+        // Confirmed again at another height, or above the tip after a reorg
+        BOOST_CHECK(!CheckStakeCache(pindexPrev, prevout, CStakeCache(stake.nTime, COIN, 40), view));
+        BOOST_CHECK(!CheckStakeCache(&vBlocks[30], prevout, stake, view));
+
+        // Spent in the meantime
+        view.SpendCoin(prevout);
+        BOOST_CHECK(!CheckStakeCache(pindexPrev, prevout, stake, view));
+    }
+
+    /* Every outpoint belongs to exactly one stake worker, and one worker at a time gets to submit a block */
+    BOOST_AUTO_TEST_CASE(stake_shard_test)
+    {
+        BOOST_TEST_MESSAGE("Running Stake Shard Test");
+
+        const unsigned int nCount = 4;
+        std::atomic<bool> fKernelFound{false};
+        std::vector<CStakeShard> vShards;
+        for (unsigned int i = 0; i < nCount; i++)
+            vShards.emplace_back(i, nCount, &fKernelFound);
+
+        std::vector<int> vHits(nCount, 0);
+        for (int i = 0; i < 1000; i++) {
+            COutPoint prevout(InsecureRand256(), InsecureRand32() % 8);
+            int nContains = 0;
+            for (const CStakeShard& shard : vShards) {
+                if (shard.Contains(prevout)) {
+                    nContains++;
+                    BOOST_CHECK_EQUAL(CStakeShard::IndexOf(prevout, nCount), shard.nIndex);
+                    vHits[shard.nIndex]++;
+                }
+            }
+            BOOST_CHECK_EQUAL(nContains, 1);
+            BOOST_CHECK(CStakeShard(0, 1, nullptr).Contains(prevout));
+        }
+        for (int nHits : vHits)
+            BOOST_CHECK(nHits > 0);
+
+        BOOST_CHECK(!vShards[1].IsKernelFound());
+        BOOST_CHECK(vShards[1].ClaimKernel());
+        BOOST_CHECK(vShards[2].IsKernelFound());
+        BOOST_CHECK(!vShards[2].ClaimKernel());
+        BOOST_CHECK(!vShards[1].ClaimKernel());
+
+        // A block that is not accepted gives the others another go
+        vShards[1].ReleaseKernel();
+        BOOST_CHECK(!vShards[2].IsKernelFound());
+        BOOST_CHECK(vShards[2].ClaimKernel());
+
+        // Without a shared flag a worker always gets to submit
+        CStakeShard single(0, 1, nullptr);
+        BOOST_CHECK(single.ClaimKernel());
+        BOOST_CHECK(single.ClaimKernel());
+        BOOST_CHECK(!single.IsKernelFound());
+    }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,179 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "chainparamsbase.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "snapshot.h"
+#include "tokens/tokendb.h"
+#include "tokens/tokens.h"
+#include "util.h"
+#include "validation.h"
+#include "test/test_alphacon.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(snapshot_tests, TestingSetup)
+
+static std::pair<COutPoint, Coin> RandomCoin()
+{
+    CScript script;
+    script << OP_DUP << OP_HASH160 << ToByteVector(InsecureRand256()) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return std::make_pair(COutPoint(InsecureRand256(), InsecureRandRange(10)), Coin(CTxOut(InsecureRandRange(100 * COIN), script), InsecureRandRange(100000), InsecureRandBool(), InsecureRandBool(), InsecureRand32()));
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_format_test)
+{
+    CSnapshotMetadata metadata;
+    metadata.hashBlock = InsecureRand256();
+    metadata.nHeight = 1234;
+    metadata.nChainTx = 5678;
+    metadata.nStakeModifier = InsecureRand256();
+    metadata.fTokenIndex = true;
+
+    // Enough coins to need more than one chunk
+    std::vector<std::pair<COutPoint, Coin> > vCoins;
+    for (int i = 0; i < 30000; i++)
+        vCoins.push_back(RandomCoin());
+    std::vector<CDatabasedTokenData> vTokens;
+    for (int i = 0; i < 50; i++)
+        vTokens.push_back(CDatabasedTokenData(CNewToken("TOKEN" + std::to_string(i), i * COIN), i, InsecureRand256()));
+    std::vector<std::pair<std::pair<std::string, std::string>, CAmount> > vQuantities;
+    for (int i = 0; i < 100; i++)
+        vQuantities.push_back(std::make_pair(std::make_pair("TOKEN" + std::to_string(i % 50), "address" + std::to_string(i)), CAmount(i + 1)));
+
+    fs::path path = GetDataDir() / "snapshot.dat";
+    CSnapshotStats stats;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        CSnapshotWriter writer(file, Params().MessageStart(), metadata);
+        for (const auto& coin : vCoins)
+            writer.Add(SNAPSHOT_COINS, coin);
+        for (const auto& token : vTokens)
+            writer.Add(SNAPSHOT_TOKENS, token);
+        for (const auto& quantity : vQuantities)
+            writer.Add(SNAPSHOT_TOKEN_QUANTITIES, quantity);
+        stats = writer.Finish();
+    }
+    BOOST_CHECK_EQUAL(stats.nCoins, vCoins.size());
+    BOOST_CHECK_EQUAL(stats.nTokens, vTokens.size());
+    BOOST_CHECK_EQUAL(stats.nTokenQuantities, vQuantities.size());
+
+    // Every record comes back in order
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        CSnapshotReader reader(file, Params().MessageStart());
+        BOOST_CHECK(reader.metadata.hashBlock == metadata.hashBlock);
+        BOOST_CHECK_EQUAL(reader.metadata.nHeight, metadata.nHeight);
+        BOOST_CHECK_EQUAL(reader.metadata.nChainTx, metadata.nChainTx);
+        BOOST_CHECK(reader.metadata.nStakeModifier == metadata.nStakeModifier);
+
+        size_t nCoins = 0, nTokens = 0, nQuantities = 0, nChunks = 0;
+        while (reader.NextChunk()) {
+            nChunks++;
+            for (uint32_t i = 0; i < reader.GetChunkRecords(); i++) {
+                if (reader.GetChunkType() == SNAPSHOT_COINS) {
+                    std::pair<COutPoint, Coin> coin;
+                    reader.GetChunk() >> coin;
+                    BOOST_CHECK(coin.first == vCoins[nCoins].first);
+                    BOOST_CHECK(coin.second.out == vCoins[nCoins].second.out);
+                    BOOST_CHECK_EQUAL(coin.second.nHeight, vCoins[nCoins].second.nHeight);
+                    BOOST_CHECK_EQUAL(coin.second.fCoinBase, vCoins[nCoins].second.fCoinBase);
+                    BOOST_CHECK_EQUAL(coin.second.fCoinStake, vCoins[nCoins].second.fCoinStake);
+                    BOOST_CHECK_EQUAL(coin.second.nTime, vCoins[nCoins].second.nTime);
+                    nCoins++;
+                } else if (reader.GetChunkType() == SNAPSHOT_TOKENS) {
+                    CDatabasedTokenData data;
+                    reader.GetChunk() >> data;
+                    BOOST_CHECK_EQUAL(data.token.strName, vTokens[nTokens].token.strName);
+                    BOOST_CHECK_EQUAL(data.token.nAmount, vTokens[nTokens].token.nAmount);
+                    BOOST_CHECK(data.blockHash == vTokens[nTokens].blockHash);
+                    nTokens++;
+                } else {
+                    std::pair<std::pair<std::string, std::string>, CAmount> quantity;
+                    reader.GetChunk() >> quantity;
+                    BOOST_CHECK(quantity == vQuantities[nQuantities]);
+                    nQuantities++;
+                }
+            }
+            BOOST_CHECK(reader.GetChunk().empty());
+        }
+        BOOST_CHECK(nChunks > 3);
+        BOOST_CHECK_EQUAL(nCoins, vCoins.size());
+        BOOST_CHECK_EQUAL(nTokens, vTokens.size());
+        BOOST_CHECK_EQUAL(nQuantities, vQuantities.size());
+        BOOST_CHECK(reader.GetStats().hashSnapshot == stats.hashSnapshot);
+    }
+
+    // A file for another network is refused
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK_THROW(CSnapshotReader(file, CreateChainParams(CBaseChainParams::TESTNET)->MessageStart()), std::runtime_error);
+    }
+
+    // A changed byte anywhere in the records is caught by the chunk checksum
+    std::vector<char> vchFile(fs::file_size(path));
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        file.read(vchFile.data(), vchFile.size());
+    }
+    fs::path pathDamaged = GetDataDir() / "damaged.dat";
+    for (int i = 0; i < 10; i++) {
+        std::vector<char> vchDamaged = vchFile;
+        vchDamaged[200 + InsecureRandRange(vchFile.size() - 400)] ^= 0x10;
+        {
+            CAutoFile file(fsbridge::fopen(pathDamaged, "wb"), SER_DISK, CLIENT_VERSION);
+            file.write(vchDamaged.data(), vchDamaged.size());
+        }
+
+        CAutoFile file(fsbridge::fopen(pathDamaged, "rb"), SER_DISK, CLIENT_VERSION);
+        CSnapshotReader reader(file, Params().MessageStart());
+        BOOST_CHECK_THROW(while (reader.NextChunk()) {}, std::exception);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_dump_test)
+{
+    CTokensDB db(1 << 20, true);
+    CShardedLRUCache<std::string, CDatabasedTokenData> tokenDataCache(10);
+    TokenGlobalsGuard guard;
+    ptokensdb = &db;
+    ptokensCache = &tokenDataCache;
+    fTokenIndex = true;
+
+    for (int i = 0; i < 100; i++) {
+        auto coin = RandomCoin();
+        pcoinsTip->AddCoin(coin.first, std::move(coin.second), false);
+    }
+    BOOST_CHECK(db.WriteTokenData(CNewToken("AAA", 100 * COIN), 1, InsecureRand256()));
+    BOOST_CHECK(db.WriteTokenData(CNewToken("BBB", 200 * COIN), 2, InsecureRand256()));
+    BOOST_CHECK(db.WriteTokenAddressQuantity("AAA", "addr1", 60 * COIN));
+    BOOST_CHECK(db.WriteTokenAddressQuantity("AAA", "addr2", 40 * COIN));
+    BOOST_CHECK(db.WriteTokenAddressQuantity("BBB", "addr1", 200 * COIN));
+
+    fs::path path = GetDataDir() / "utxo.dat";
+    CSnapshotMetadata metadata;
+    CSnapshotStats stats;
+    std::string strError;
+    BOOST_CHECK(DumpSnapshot(path, metadata, stats, strError));
+    BOOST_CHECK(metadata.hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(stats.nCoins, 100U);
+    BOOST_CHECK_EQUAL(stats.nTokens, 2U);
+    BOOST_CHECK_EQUAL(stats.nTokenQuantities, 3U);
+    BOOST_CHECK(!fs::exists(path.string() + ".incomplete"));
+
+    // The same state gives the same hash, and an existing file isn't overwritten
+    CSnapshotStats stats2;
+    BOOST_CHECK(DumpSnapshot(GetDataDir() / "utxo2.dat", metadata, stats2, strError));
+    BOOST_CHECK(stats2.hashSnapshot == stats.hashSnapshot);
+    BOOST_CHECK(!DumpSnapshot(path, metadata, stats2, strError));
+
+    // A snapshot of the genesis block has nothing to load, and nothing gets written
+    BOOST_CHECK(!LoadSnapshot(path, false, metadata, stats2, strError));
+    bool fSnapshotLoading = false;
+    BOOST_CHECK(!pblocktree->ReadFlag("snapshotloading", fSnapshotLoading) || !fSnapshotLoading);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include "chainparams.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "crypto/groestl512.h"
 #include "crypto/sha256.h"
 #include "fs.h"
 #include "key.h"
@@ -35,6 +36,7 @@ extern void noui_connect();
 BasicTestingSetup::BasicTestingSetup(const std::string &chainName)
 {
     SHA256AutoDetect();
+    Groestl512AutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
@@ -90,6 +92,8 @@ TestingSetup::TestingSetup(const std::string &chainName) : BasicTestingSetup(cha
     nScriptCheckThreads = 3;
     for (int i = 0; i < nScriptCheckThreads - 1; i++)
         threadGroup.create_thread(&ThreadScriptCheck);
+    for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        threadGroup.create_thread(&ThreadTokenCheck);
     g_connman = std::unique_ptr<CConnman>(new CConnman(0x1337, 0x1337)); // Deterministic randomness for tests.
     connman = g_connman.get();
     peerLogic.reset(new PeerLogicValidation(connman));
@@ -169,6 +173,21 @@ CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CTransaction &txn)
                            spendsCoinbase, sigOpCost, lp);
 }
 
+TokenGlobalsGuard::TokenGlobalsGuard() :
+        ptokensOld(ptokens), ptokensdbOld(ptokensdb), ptokensCacheOld(ptokensCache),
+        fTokenIndexOld(fTokenIndex), fTokenRichIndexOld(fTokenRichIndex)
+{
+}
+
+TokenGlobalsGuard::~TokenGlobalsGuard()
+{
+    ptokens = ptokensOld;
+    ptokensdb = ptokensdbOld;
+    ptokensCache = ptokensCacheOld;
+    fTokenIndex = fTokenIndexOld;
+    fTokenRichIndex = fTokenRichIndexOld;
+}
+
 /**
  * @returns a real block (0000000000013b8ab2cd513b0261a14096412195a72a0c4827d229dcc7e0f7af)
  *      with 9 txs.
@@ -159,6 +159,24 @@ struct TestMemPoolEntryHelper
     }
 };
 
+class CTokensCache;
+class CTokensDB;
+class CDatabasedTokenData;
+template<typename cache_key_t, typename cache_value_t> class CShardedLRUCache;
+
+/** Puts the token globals a test changes back when it goes out of scope */
+struct TokenGlobalsGuard
+{
+    CTokensCache* ptokensOld;
+    CTokensDB* ptokensdbOld;
+    CShardedLRUCache<std::string, CDatabasedTokenData>* ptokensCacheOld;
+    bool fTokenIndexOld;
+    bool fTokenRichIndexOld;
+
+    TokenGlobalsGuard();
+    ~TokenGlobalsGuard();
+};
+
 CBlock getBlock13b8a();
 
 #endif
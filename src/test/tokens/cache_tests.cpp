@@ -1,8 +1,13 @@
 
 #include "tokens/tokens.h"
+#include "tokens/tokendb.h"
+#include "validation.h"
 #include <boost/test/unit_test.hpp>
 #include <test/test_alphacon.h>
 
+#include <atomic>
+#include <thread>
+
 BOOST_FIXTURE_TEST_SUITE(cache_tests, BasicTestingSetup)
 
 
@@ -37,5 +42,471 @@ BOOST_AUTO_TEST_CASE(cache_test)
 
 }
 
+BOOST_AUTO_TEST_CASE(sharded_cache_test)
+{
+    BOOST_TEST_MESSAGE("Running Sharded Cache Test");
+
+    // Small caches use a single shard, so eviction follows the exact LRU order
+    CShardedLRUCache<std::string, int> cache(3);
+    cache.Put("A", 1);
+    cache.Put("B", 2);
+    cache.Put("C", 3);
+
+    int value = 0;
+    BOOST_CHECK(cache.Get("A", value) && value == 1);
+    cache.Put("D", 4);
+    BOOST_CHECK(!cache.Exists("B"));
+    BOOST_CHECK(cache.Exists("A") && cache.Exists("C") && cache.Exists("D"));
+
+    // Erase moves the last entry into the freed slot, the order has to survive that
+    cache.Erase("A");
+    BOOST_CHECK_EQUAL(cache.Size(), 2U);
+    cache.Put("E", 5);
+    cache.Put("C", 30);
+    cache.Put("F", 6);
+    BOOST_CHECK(!cache.Exists("D"));
+    BOOST_CHECK(cache.Get("C", value) && value == 30);
+    BOOST_CHECK(cache.Get("E", value) && value == 5);
+    BOOST_CHECK(cache.Get("F", value) && value == 6);
+
+    CShardedLRUCache<std::string, int>::Stats stats;
+    cache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nShards, 1U);
+    BOOST_CHECK_EQUAL(stats.nEntries, 3U);
+    BOOST_CHECK_EQUAL(stats.nHits, 7U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 2U);
+
+    // Bigger caches are sharded and never hold more than their max size
+    CShardedLRUCache<std::string, int> bigCache(2500);
+    for (int i = 0; i < 10000; i++)
+        bigCache.Put("TOKEN" + std::to_string(i), i);
+    bigCache.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nShards, 16U);
+    BOOST_CHECK_EQUAL(stats.nEntries, 2500U);
+    BOOST_CHECK_EQUAL(stats.nEvictions, 7500U);
+    BOOST_CHECK(bigCache.Get("TOKEN9999", value) && value == 9999);
+    BOOST_CHECK(!bigCache.Exists("TOKEN0"));
+
+    // Lookups and updates from several threads at once
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&bigCache, t]() {
+            int value;
+            for (int i = 0; i < 20000; i++) {
+                std::string key = "TOKEN" + std::to_string((i * 7 + t) % 5000);
+                if (i % 3 == 0)
+                    bigCache.Put(key, i);
+                else if (i % 101 == 0)
+                    bigCache.Erase(key);
+                else
+                    bigCache.Get(key, value);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    BOOST_CHECK(bigCache.Size() <= 2500);
+    bigCache.Clear();
+    BOOST_CHECK_EQUAL(bigCache.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(token_dir_reads_through_cache_test)
+{
+    BOOST_TEST_MESSAGE("Running Token Dir Reads Through Cache Test");
+
+    CTokensDB db(1 << 20, true, true);
+    CNewToken tokenA("AAA", 5 * COIN);
+    CNewToken tokenB("BBB", 7 * COIN);
+    CNewToken tokenC("CCC", 10 * COIN);
+    BOOST_CHECK(db.WriteTokenData(tokenA, 1, uint256()));
+    BOOST_CHECK(db.WriteTokenData(tokenB, 1, uint256()));
+    BOOST_CHECK(db.WriteTokenAddressQuantity("AAA", "addr1", 5 * COIN));
+    BOOST_CHECK(db.WriteAddressTokenQuantity("addr1", "AAA", 5 * COIN));
+    BOOST_CHECK(db.WriteTokenAddressQuantity("BBB", "addr2", 7 * COIN));
+    BOOST_CHECK(db.WriteAddressTokenQuantity("addr2", "BBB", 7 * COIN));
+
+    // Issue CCC to addr1 and undo the issue of BBB, without flushing
+    CTokensCache cache;
+    cache.setNewTokensToAdd.insert(CTokenCacheNewToken(tokenC, "addr1", 2, uint256()));
+    cache.setNewTokensToRemove.insert(CTokenCacheNewToken(tokenB, "addr2", 1, uint256()));
+
+    TokenGlobalsGuard guard;
+    ptokens = &cache;
+    fTokenIndex = true;
+
+    std::vector<CDatabasedTokenData> tokens;
+    BOOST_CHECK(db.TokenDir(tokens));
+    BOOST_CHECK_EQUAL(tokens.size(), 2);
+    if (tokens.size() == 2) {
+        BOOST_CHECK_EQUAL(tokens[0].token.strName, "AAA");
+        BOOST_CHECK_EQUAL(tokens[1].token.strName, "CCC");
+        BOOST_CHECK_EQUAL(tokens[1].nHeight, 2);
+    }
+
+    tokens.clear();
+    BOOST_CHECK(db.TokenDir(tokens, "*", 10, -1));
+    BOOST_CHECK(tokens.size() == 1 && tokens[0].token.strName == "CCC");
+
+    std::vector<std::pair<std::string, CAmount> > vecTokenAmount;
+    int nTotal = 0;
+    BOOST_CHECK(db.AddressDir(vecTokenAmount, nTotal, true, "addr1", 10, 0));
+    BOOST_CHECK_EQUAL(nTotal, 2);
+    BOOST_CHECK(db.AddressDir(vecTokenAmount, nTotal, false, "addr1", 10, 0));
+    BOOST_CHECK(vecTokenAmount.size() == 2 && vecTokenAmount[1] == std::make_pair(std::string("CCC"), 10 * COIN));
+
+    vecTokenAmount.clear();
+    BOOST_CHECK(db.TokenAddressDir(vecTokenAmount, nTotal, true, "BBB", 10, 0));
+    BOOST_CHECK_EQUAL(nTotal, 0);
+    BOOST_CHECK(db.AddressDir(vecTokenAmount, nTotal, false, "addr2", 10, 0));
+    BOOST_CHECK(vecTokenAmount.empty());
+
+    // Reading did not write anything
+    CNewToken token;
+    int nHeight;
+    uint256 blockHash;
+    BOOST_CHECK(!db.ReadTokenData("CCC", token, nHeight, blockHash));
+    BOOST_CHECK(db.ReadTokenData("BBB", token, nHeight, blockHash));
+
+    // Flushing the cache writes what was read through it
+    CShardedLRUCache<std::string, CDatabasedTokenData> tokenDataCache(10);
+    ptokensdb = &db;
+    ptokensCache = &tokenDataCache;
+
+    BOOST_CHECK(cache.DumpCacheToDatabase());
+    BOOST_CHECK(cache.setNewTokensToAdd.empty());
+    BOOST_CHECK(tokenDataCache.Exists("CCC"));
+
+    tokens.clear();
+    BOOST_CHECK(db.TokenDir(tokens));
+    BOOST_CHECK(tokens.size() == 2 && tokens[0].token.strName == "AAA" && tokens[1].token.strName == "CCC");
+    BOOST_CHECK(db.ReadTokenData("CCC", token, nHeight, blockHash));
+    BOOST_CHECK(!db.ReadTokenData("BBB", token, nHeight, blockHash));
+
+    CAmount quantity;
+    BOOST_CHECK(db.ReadAddressTokenQuantity("addr1", "CCC", quantity));
+    BOOST_CHECK_EQUAL(quantity, 10 * COIN);
+    BOOST_CHECK(!db.ReadTokenAddressQuantity("BBB", "addr2", quantity));
+    BOOST_CHECK(!db.ReadAddressTokenQuantity("addr2", "BBB", quantity));
+}
+
+BOOST_AUTO_TEST_CASE(token_dir_pages_test)
+{
+    BOOST_TEST_MESSAGE("Running Token Dir Pages Test");
+
+    CTokensCache cache;
+    TokenGlobalsGuard guard;
+    ptokens = &cache;
+    fTokenIndex = true;
+
+    // Loading an empty database starts the holder counts
+    CTokensDB db(1 << 20, true, true);
+    BOOST_CHECK(db.LoadTokens());
+
+    CTokensDBChanges changes;
+    for (std::string name : {"AB", "ABC", "ABD", "ABCD", "B", "XAB"})
+        changes.mapTokenData[name] = CDatabasedTokenData(CNewToken(name, COIN), 1, uint256());
+    for (std::string address : {"a1", "a2", "a3", "a4", "a5"})
+        changes.mapTokenAddressQuantity[std::make_pair("ABC", address)] = COIN;
+    changes.mapTokenAddressQuantity[std::make_pair("AB", "a1")] = COIN;
+    size_t nBatchSize;
+    BOOST_CHECK(db.WriteDatabaseChanges(changes, false, nBatchSize));
+
+    // Names sort by length first, the prefix search still finds all of them
+    std::vector<CDatabasedTokenData> tokens;
+    BOOST_CHECK(db.TokenDir(tokens, "AB*", 10, 0));
+    BOOST_CHECK_EQUAL(tokens.size(), 4);
+    if (tokens.size() == 4) {
+        BOOST_CHECK_EQUAL(tokens[0].token.strName, "AB");
+        BOOST_CHECK_EQUAL(tokens[1].token.strName, "ABC");
+        BOOST_CHECK_EQUAL(tokens[2].token.strName, "ABD");
+        BOOST_CHECK_EQUAL(tokens[3].token.strName, "ABCD");
+    }
+
+    tokens.clear();
+    BOOST_CHECK(db.TokenDir(tokens, "AB*", 10, std::string("ABC")));
+    BOOST_CHECK(tokens.size() == 2 && tokens[0].token.strName == "ABD" && tokens[1].token.strName == "ABCD");
+
+    tokens.clear();
+    BOOST_CHECK(db.TokenDir(tokens, "AB*", 1, -1));
+    BOOST_CHECK(tokens.size() == 1 && tokens[0].token.strName == "ABCD");
+
+    int nTotal = 0;
+    std::vector<std::pair<std::string, CAmount> > vecAddressAmount;
+    BOOST_CHECK(db.TokenAddressDir(vecAddressAmount, nTotal, true, "ABC", 10, 0));
+    BOOST_CHECK_EQUAL(nTotal, 5);
+    BOOST_CHECK(db.AddressDir(vecAddressAmount, nTotal, true, "a1", 10, 0));
+    BOOST_CHECK_EQUAL(nTotal, 2);
+
+    // Page through the holders two at a time
+    std::vector<std::string> vAddresses;
+    std::string after;
+    do {
+        vecAddressAmount.clear();
+        BOOST_CHECK(db.TokenAddressDir(vecAddressAmount, "ABC", 2, after));
+        for (const auto& pair : vecAddressAmount)
+            vAddresses.push_back(pair.first);
+        if (!vecAddressAmount.empty())
+            after = vecAddressAmount.back().first;
+    } while (vecAddressAmount.size() == 2);
+    BOOST_CHECK(vAddresses == std::vector<std::string>({"a1", "a2", "a3", "a4", "a5"}));
+
+    // Counts include changes that are not flushed, and follow the ones that are
+    ptokensdb = &db;
+    BOOST_CHECK(GetBestTokenAddressAmount(cache, "ABC", "a3"));
+    cache.mapTokensAddressAmount.at(std::make_pair("ABC", "a3")) = 0;
+    cache.vSpentTokens.push_back(CTokenCacheSpendToken("ABC", "a3", COIN));
+    cache.InvalidateDatabaseChanges();
+    BOOST_CHECK(db.TokenAddressDir(vecAddressAmount, nTotal, true, "ABC", 10, 0));
+    BOOST_CHECK_EQUAL(nTotal, 4);
+
+    changes = CTokensDBChanges();
+    cache.GetDatabaseChanges(changes);
+    BOOST_CHECK(db.WriteDatabaseChanges(changes, false, nBatchSize));
+    cache.ClearDirtyCache();
+    BOOST_CHECK(db.TokenAddressDir(vecAddressAmount, nTotal, true, "ABC", 10, 0));
+    BOOST_CHECK_EQUAL(nTotal, 4);
+    BOOST_CHECK(db.AddressDir(vecAddressAmount, nTotal, true, "a3", 10, 0));
+    BOOST_CHECK_EQUAL(nTotal, 0);
+}
+
+BOOST_AUTO_TEST_CASE(token_rich_index_test)
+{
+    BOOST_TEST_MESSAGE("Running Token Rich Index Test");
+
+    CTokensCache cache;
+    TokenGlobalsGuard guard;
+    ptokens = &cache;
+    fTokenIndex = true;
+
+    // Quantities written before the index is turned on get indexed when it is
+    CTokensDB db(1 << 20, true, true);
+    BOOST_CHECK(db.LoadTokens());
+    std::vector<std::pair<std::string, CAmount> > vecAddressAmount;
+    BOOST_CHECK(!db.TopTokenAddresses(vecAddressAmount, "ABC", 10));
+
+    CTokensDBChanges changes;
+    for (int i = 0; i < 20; i++)
+        changes.mapTokenAddressQuantity[std::make_pair("ABC", "a" + std::to_string(i))] = (i % 10 + 1) * COIN;
+    changes.mapTokenAddressQuantity[std::make_pair("AB", "a0")] = 1000 * COIN;
+    changes.mapTokenAddressQuantity[std::make_pair("ABD", "a0")] = 1000 * COIN;
+    size_t nBatchSize;
+    BOOST_CHECK(db.WriteDatabaseChanges(changes, false, nBatchSize));
+
+    fTokenRichIndex = true;
+    BOOST_CHECK(db.LoadTokens());
+
+    // Biggest first, equal quantities by address
+    BOOST_CHECK(db.TopTokenAddresses(vecAddressAmount, "ABC", 3));
+    std::vector<std::pair<std::string, CAmount> > vecExpected = {{"a19", 10 * COIN}, {"a9", 10 * COIN}, {"a18", 9 * COIN}};
+    BOOST_CHECK(vecAddressAmount == vecExpected);
+
+    vecAddressAmount.clear();
+    BOOST_CHECK(db.TopTokenAddresses(vecAddressAmount, "ABC", 100));
+    BOOST_CHECK_EQUAL(vecAddressAmount.size(), 20);
+    BOOST_CHECK(vecAddressAmount.back() == std::make_pair(std::string("a10"), COIN));
+
+    // Unflushed quantities take the place of the indexed ones
+    ptokensdb = &db;
+    BOOST_CHECK(GetBestTokenAddressAmount(cache, "ABC", "a19"));
+    cache.mapTokensAddressAmount.at(std::make_pair("ABC", "a19")) = 0;
+    cache.vSpentTokens.push_back(CTokenCacheSpendToken("ABC", "a19", 10 * COIN));
+    BOOST_CHECK(GetBestTokenAddressAmount(cache, "ABC", "a1"));
+    cache.mapTokensAddressAmount.at(std::make_pair("ABC", "a1")) = 50 * COIN;
+    cache.vSpentTokens.push_back(CTokenCacheSpendToken("ABC", "a1", COIN));
+    cache.InvalidateDatabaseChanges();
+    vecAddressAmount.clear();
+    BOOST_CHECK(db.TopTokenAddresses(vecAddressAmount, "ABC", 2));
+    vecExpected = {{"a1", 50 * COIN}, {"a9", 10 * COIN}};
+    BOOST_CHECK(vecAddressAmount == vecExpected);
+
+    // and so do flushed ones
+    changes = CTokensDBChanges();
+    cache.GetDatabaseChanges(changes);
+    BOOST_CHECK(db.WriteDatabaseChanges(changes, false, nBatchSize));
+    cache.ClearDirtyCache();
+    vecAddressAmount.clear();
+    BOOST_CHECK(db.TopTokenAddresses(vecAddressAmount, "ABC", 100));
+    BOOST_CHECK_EQUAL(vecAddressAmount.size(), 19);
+    BOOST_CHECK(vecAddressAmount.front() == std::make_pair(std::string("a1"), 50 * COIN));
+    for (const auto& pair : vecAddressAmount)
+        BOOST_CHECK(pair.first != "a19");
+
+    // Turning the index off drops it
+    fTokenRichIndex = false;
+    BOOST_CHECK(db.LoadTokens());
+    BOOST_CHECK(!db.TopTokenAddresses(vecAddressAmount, "ABC", 10));
+}
+
+BOOST_AUTO_TEST_CASE(token_name_filter_test)
+{
+    BOOST_TEST_MESSAGE("Running Token Name Filter Test");
+
+    CTokenNameFilter filter;
+    filter.Reset(10000, 1000);
+    for (int i = 0; i < 10000; i++)
+        filter.Insert("TOKEN" + std::to_string(i));
+    BOOST_CHECK(!filter.IsFull());
+
+    // Never a false negative, and about the asked for rate of false positives
+    for (int i = 0; i < 10000; i++)
+        BOOST_CHECK(filter.MayContain("TOKEN" + std::to_string(i)));
+    int nFalsePositives = 0;
+    for (int i = 0; i < 100000; i++)
+        nFalsePositives += filter.MayContain("OTHER" + std::to_string(i));
+    BOOST_CHECK(nFalsePositives < 300);
+
+    CTokenNameFilter::Stats stats;
+    filter.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nNames, 10000);
+    BOOST_CHECK_EQUAL(stats.nCapacity, 10000);
+    BOOST_CHECK_EQUAL(stats.nRate, 1000);
+    BOOST_CHECK_EQUAL(stats.nHashFuncs, 10);
+    BOOST_CHECK_EQUAL(stats.nPassed, 10000 + nFalsePositives);
+    BOOST_CHECK_EQUAL(stats.nRejected, 100000 - nFalsePositives);
+    // About 14.4 bits for each name
+    BOOST_CHECK(stats.nMemoryUsage >= 17000 && stats.nMemoryUsage < 20000);
+
+    filter.Insert("ONEMORE");
+    BOOST_CHECK(filter.IsFull());
+
+    // Swapping in a rebuilt filter keeps the lookup counts
+    CTokenNameFilter rebuilt;
+    rebuilt.Reset(20000, 1000);
+    rebuilt.Insert("ONEMORE");
+    filter.Swap(rebuilt);
+    BOOST_CHECK(filter.MayContain("ONEMORE"));
+    BOOST_CHECK(!filter.IsFull());
+    filter.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.nNames, 1);
+    BOOST_CHECK_EQUAL(stats.nPassed, 10000 + nFalsePositives + 1);
+    // A name stays found while rebuilt filters, each with its own salt, are swapped in
+    std::atomic<bool> fStop(false);
+    std::atomic<int> nMissed(0);
+    std::thread reader([&]() {
+        while (!fStop)
+            nMissed += !filter.MayContain("ONEMORE");
+    });
+    for (int i = 0; i < 1000; i++) {
+        CTokenNameFilter next;
+        next.Reset(100, 1000);
+        next.Insert("ONEMORE");
+        filter.Swap(next);
+    }
+    fStop = true;
+    reader.join();
+    BOOST_CHECK_EQUAL(nMissed, 0);
+}
+
+BOOST_AUTO_TEST_CASE(token_db_name_filter_test)
+{
+    BOOST_TEST_MESSAGE("Running Token DB Name Filter Test");
+
+    CTokensCache cache;
+    CShardedLRUCache<std::string, CDatabasedTokenData> tokenDataCache(10);
+    TokenGlobalsGuard guard;
+    ptokens = &cache;
+    ptokensCache = &tokenDataCache;
+
+    CTokensDB db(1 << 20, true, true);
+    CTokensDBChanges changes;
+    changes.mapTokenData["AAA"] = CDatabasedTokenData(CNewToken("AAA", COIN), 1, uint256());
+    size_t nBatchSize;
+    BOOST_CHECK(db.WriteDatabaseChanges(changes, false, nBatchSize));
+
+    CTokenNameFilter::Stats stats;
+    BOOST_CHECK(!db.GetNameFilterStats(stats));
+    BOOST_CHECK(db.LoadTokens());
+    BOOST_CHECK(db.GetNameFilterStats(stats));
+    BOOST_CHECK_EQUAL(stats.nNames, 1);
+
+    CNewToken token;
+    int nHeight;
+    uint256 blockHash;
+    BOOST_CHECK(db.ReadTokenData("AAA", token, nHeight, blockHash));
+    BOOST_CHECK(!db.ReadTokenData("BBB", token, nHeight, blockHash));
+    db.GetNameFilterStats(stats);
+    BOOST_CHECK_EQUAL(stats.nPassed + stats.nRejected, 2);
+
+    // Tokens written later are found too, and erased ones aren't
+    changes = CTokensDBChanges();
+    changes.mapTokenData["BBB"] = CDatabasedTokenData(CNewToken("BBB", COIN), 2, uint256());
+    changes.mapTokenData["AAA"] = CDatabasedTokenData();
+    BOOST_CHECK(db.WriteDatabaseChanges(changes, false, nBatchSize));
+    BOOST_CHECK(db.WriteTokenData(CNewToken("CCC", COIN), 3, uint256()));
+    BOOST_CHECK(!db.ReadTokenData("AAA", token, nHeight, blockHash));
+    BOOST_CHECK(db.ReadTokenData("BBB", token, nHeight, blockHash));
+    BOOST_CHECK(db.ReadTokenData("CCC", token, nHeight, blockHash));
+    BOOST_CHECK_EQUAL(token.strName, "CCC");
+}
+
+BOOST_AUTO_TEST_CASE(token_address_amount_map_test)
+{
+    BOOST_TEST_MESSAGE("Running Token Address Amount Map Test");
+
+    // Mirror every change in a std::map, the old type of mapTokensAddressAmount
+    CTokenAddressAmountMap balances;
+    std::map<std::pair<std::string, std::string>, CAmount> reference;
+
+    for (int i = 0; i < 20000; i++) {
+        auto pair = std::make_pair("TOKEN" + std::to_string(InsecureRandRange(300)), "address" + std::to_string(InsecureRandRange(200)));
+        switch (InsecureRandRange(4)) {
+            case 0:
+                BOOST_CHECK_EQUAL(balances.insert(std::make_pair(pair, CAmount(i))), reference.insert(std::make_pair(pair, CAmount(i))).second);
+                break;
+            case 1:
+                balances[pair] += i;
+                reference[pair] += i;
+                break;
+            case 2:
+                BOOST_CHECK_EQUAL(balances.count(pair), reference.count(pair));
+                if (reference.count(pair))
+                    BOOST_CHECK_EQUAL(balances.at(pair), reference.at(pair));
+                else
+                    BOOST_CHECK_THROW(balances.at(pair), std::out_of_range);
+                break;
+            default:
+                if (reference.count(pair)) {
+                    balances.at(pair) -= 1;
+                    reference.at(pair) -= 1;
+                }
+        }
+    }
+
+    BOOST_CHECK_EQUAL(balances.size(), reference.size());
+    BOOST_CHECK(!balances.Find("TOKEN1", "nowhere"));
+    BOOST_CHECK(!balances.Find("NOTOKEN", "address1"));
+
+    // Iteration visits every balance exactly once, and a copy has the same balances
+    CTokenAddressAmountMap copy = balances;
+    std::map<std::pair<std::string, std::string>, CAmount> visited;
+    for (const auto& entry : balances)
+        BOOST_CHECK(visited.insert(std::make_pair(std::make_pair(balances.GetName(entry), balances.GetAddress(entry)), entry.nAmount)).second);
+    BOOST_CHECK(visited == reference);
+    for (const auto& item : reference)
+        BOOST_CHECK_EQUAL(copy.at(item.first), item.second);
+
+    // Names and addresses are stored once however many balances they have
+    size_t nUsage = balances.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > 0);
+    BOOST_CHECK(nUsage < balances.size() * 64);
+
+    balances.clear();
+    BOOST_CHECK(balances.empty());
+    BOOST_CHECK(!balances.count(reference.begin()->first));
+    BOOST_CHECK(balances.DynamicMemoryUsage() < nUsage);
+    BOOST_CHECK_EQUAL(copy.size(), reference.size());
+    // Inserted balances are the ones loaded from the database unless told otherwise
+    CTokenAddressAmountMap loaded;
+    loaded.insert(std::make_pair(std::make_pair("AAA", "a1"), 5 * COIN));
+    loaded.insert(std::make_pair(std::make_pair("AAA", "a2"), 7 * COIN), 0);
+    loaded[std::make_pair("AAA", "a3")] = COIN;
+    loaded.at(std::make_pair("AAA", "a1")) = 0;
+    BOOST_CHECK_EQUAL(loaded.GetStored("AAA", "a1"), 5 * COIN);
+    BOOST_CHECK_EQUAL(loaded.GetStored("AAA", "a2"), 0);
+    BOOST_CHECK_EQUAL(loaded.GetStored("AAA", "a3"), CTokenAddressAmountMap::STORED_UNKNOWN);
+    BOOST_CHECK_EQUAL(loaded.GetStored("AAA", "a4"), CTokenAddressAmountMap::STORED_UNKNOWN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
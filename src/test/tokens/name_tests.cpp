@@ -0,0 +1,249 @@
+// Copyright (c) 2019 The Alphacon Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <tokens/tokens.h>
+
+#include <test/test_alphacon.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <regex>
+
+/**
+ * The regular expression based token name checks that tokens.cpp used before
+ * the names were checked by hand. The hand written checks have to give the
+ * same result, token type and error for every name.
+ */
+namespace regex_reference {
+
+static const auto MAX_NAME_LENGTH = 31;
+static const auto MAX_CHANNEL_NAME_LENGTH = 12;
+
+static const std::regex ROOT_NAME_CHARACTERS("^[A-Z0-9._]{3,}$");
+static const std::regex SUB_NAME_CHARACTERS("^[A-Z0-9._]+$");
+static const std::regex UNIQUE_TAG_CHARACTERS("^[-A-Za-z0-9@$%&*()[\\]{}_.?:]+$");
+static const std::regex CHANNEL_TAG_CHARACTERS("^[A-Z0-9._]+$");
+static const std::regex VOTE_TAG_CHARACTERS("^[A-Z0-9._]+$");
+
+static const std::regex DOUBLE_PUNCTUATION("^.*[._]{2,}.*$");
+static const std::regex LEADING_PUNCTUATION("^[._].*$");
+static const std::regex TRAILING_PUNCTUATION("^.*[._]$");
+
+static const std::regex UNIQUE_INDICATOR(R"(^[^^~#!]+#[^~#!\/]+$)");
+static const std::regex CHANNEL_INDICATOR(R"(^[^^~#!]+~[^~#!\/]+$)");
+static const std::regex OWNER_INDICATOR(R"(^[^^~#!]+!$)");
+static const std::regex VOTE_INDICATOR(R"(^[^^~#!]+\^[^~#!\/]+$)");
+
+static const std::regex PROTECTED_NAMES("^ALP$|^ALPHACON$|^ALPCOIN$|^ALPHACOIN$|^ALPHACHAIN$");
+
+static bool IsRootNameValid(const std::string& name)
+{
+    return std::regex_match(name, ROOT_NAME_CHARACTERS)
+        && !std::regex_match(name, DOUBLE_PUNCTUATION)
+        && !std::regex_match(name, LEADING_PUNCTUATION)
+        && !std::regex_match(name, TRAILING_PUNCTUATION)
+        && !std::regex_match(name, PROTECTED_NAMES);
+}
+
+static bool IsSubNameValid(const std::string& name)
+{
+    return std::regex_match(name, SUB_NAME_CHARACTERS)
+        && !std::regex_match(name, DOUBLE_PUNCTUATION)
+        && !std::regex_match(name, LEADING_PUNCTUATION)
+        && !std::regex_match(name, TRAILING_PUNCTUATION);
+}
+
+static bool IsUniqueTagValid(const std::string& tag)
+{
+    return std::regex_match(tag, UNIQUE_TAG_CHARACTERS);
+}
+
+static bool IsVoteTagValid(const std::string& tag)
+{
+    return std::regex_match(tag, VOTE_TAG_CHARACTERS);
+}
+
+static bool IsChannelTagValid(const std::string& tag)
+{
+    return std::regex_match(tag, CHANNEL_TAG_CHARACTERS)
+        && !std::regex_match(tag, DOUBLE_PUNCTUATION)
+        && !std::regex_match(tag, LEADING_PUNCTUATION)
+        && !std::regex_match(tag, TRAILING_PUNCTUATION);
+}
+
+static bool IsNameValidBeforeTag(const std::string& name)
+{
+    std::vector<std::string> parts;
+    boost::split(parts, name, boost::is_any_of("/"));
+
+    if (!IsRootNameValid(parts.front())) return false;
+
+    for (unsigned long i = 1; i < parts.size(); i++) {
+        if (!IsSubNameValid(parts[i])) return false;
+    }
+    return true;
+}
+
+static bool IsTokenNameASubtoken(const std::string& name)
+{
+    std::vector<std::string> parts;
+    boost::split(parts, name, boost::is_any_of("/"));
+
+    if (!IsRootNameValid(parts.front())) return false;
+
+    return parts.size() > 1;
+}
+
+static bool IsTypeCheckNameValid(const TokenType type, const std::string& name, std::string& error)
+{
+    if (type == TokenType::UNIQUE) {
+        if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
+        std::vector<std::string> parts;
+        boost::split(parts, name, boost::is_any_of("#"));
+        bool valid = IsNameValidBeforeTag(parts.front()) && IsUniqueTagValid(parts.back());
+        if (!valid) { error = "Unique name contains invalid characters (Valid characters are: A-Z a-z 0-9 @ $ % & * ( ) [ ] { } _ . ? : -)";  return false; }
+        return true;
+    } else if (type == TokenType::MSGCHANNEL) {
+        if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
+        std::vector<std::string> parts;
+        boost::split(parts, name, boost::is_any_of("~"));
+        bool valid = IsNameValidBeforeTag(parts.front()) && IsChannelTagValid(parts.back());
+        if (parts.back().size() > MAX_CHANNEL_NAME_LENGTH) { error = "Channel name is greater than max length of " + std::to_string(MAX_CHANNEL_NAME_LENGTH); return false; }
+        if (!valid) { error = "Message Channel name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
+        return true;
+    } else if (type == TokenType::OWNER) {
+        if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
+        bool valid = IsNameValidBeforeTag(name.substr(0, name.size() - 1));
+        if (!valid) { error = "Owner name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
+        return true;
+    } else if (type == TokenType::VOTE) {
+        if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
+        std::vector<std::string> parts;
+        boost::split(parts, name, boost::is_any_of("^"));
+        bool valid = IsNameValidBeforeTag(parts.front()) && IsVoteTagValid(parts.back());
+        if (!valid) { error = "Vote name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
+        return true;
+    } else {
+        if (name.size() > MAX_NAME_LENGTH - 1) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH - 1); return false; }
+        if (!IsTokenNameASubtoken(name) && name.size() < MIN_TOKEN_LENGTH) { error = "Name must be contain " + std::to_string(MIN_TOKEN_LENGTH) + " characters"; return false; }
+        bool valid = IsNameValidBeforeTag(name);
+        if (!valid && IsTokenNameASubtoken(name) && name.size() < 3) { error = "Name must have at least 3 characters (Valid characters are: A-Z 0-9 _ .)";  return false; }
+        if (!valid) { error = "Name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
+        return true;
+    }
+}
+
+static bool IsTokenNameValid(const std::string& name, TokenType& tokenType, std::string& error)
+{
+    tokenType = TokenType::INVALID;
+    TokenType type;
+    if (std::regex_match(name, UNIQUE_INDICATOR))
+        type = TokenType::UNIQUE;
+    else if (std::regex_match(name, CHANNEL_INDICATOR))
+        type = TokenType::MSGCHANNEL;
+    else if (std::regex_match(name, OWNER_INDICATOR))
+        type = TokenType::OWNER;
+    else if (std::regex_match(name, VOTE_INDICATOR))
+        type = TokenType::VOTE;
+    else
+        type = IsTokenNameASubtoken(name) ? TokenType::SUB : TokenType::ROOT;
+
+    bool ret = regex_reference::IsTypeCheckNameValid(type, name, error);
+    if (ret)
+        tokenType = type;
+    return ret;
+}
+
+static bool IsTokenNameAnOwner(const std::string& name)
+{
+    TokenType type;
+    std::string error;
+    return regex_reference::IsTokenNameValid(name, type, error) && std::regex_match(name, OWNER_INDICATOR);
+}
+
+} // namespace regex_reference
+
+// Characters that take part in some rule, plus a few that never do
+static const std::string NAME_ALPHABET = std::string("ABCLPZ09._/#~^!az-@$ \n") + '\0';
+
+static const std::vector<std::string> NAME_SEEDS = {
+    "ABC", "MAX_TOKEN_IS_30_CHARACTERS_LNG", "ABC/SUB", "ABC/SUB/SUB2", "ABC#TAG", "ABC/SUB#tag[1]",
+    "ABC~CHANNEL", "ABC/SUB~CHANNEL", "ABC!", "ABC/SUB!", "ABC^VOTE", "ABC^X^Y", "ALP", "ALPHACON",
+    "A.B", "A_B.C", "ABC#", "#ABC", "ABC!!", "ABC/", "ABC//SUB", "AB/CD",
+};
+
+static char RandomNameCharacter()
+{
+    return NAME_ALPHABET[InsecureRandRange(NAME_ALPHABET.size())];
+}
+
+static std::string MutateName(std::string name)
+{
+    int nMutations = 1 + InsecureRandRange(3);
+    for (int i = 0; i < nMutations; i++) {
+        size_t nPos = InsecureRandRange(name.size() + 1);
+        switch (InsecureRandRange(3)) {
+            case 0: name.insert(nPos, 1, RandomNameCharacter()); break;
+            case 1: if (nPos < name.size()) name[nPos] = RandomNameCharacter(); break;
+            case 2: if (nPos < name.size()) name.erase(nPos, 1); break;
+        }
+    }
+    return name;
+}
+
+static void CheckSameAsReference(const std::string& name)
+{
+    TokenType type, typeExpected;
+    std::string error, errorExpected;
+    bool ret = IsTokenNameValid(name, type, error);
+    bool retExpected = regex_reference::IsTokenNameValid(name, typeExpected, errorExpected);
+
+    BOOST_CHECK_MESSAGE(ret == retExpected && type == typeExpected && error == errorExpected,
+                        "name \"" << name << "\": " << ret << "/" << (int)type << " \"" << error << "\", expected "
+                        << retExpected << "/" << (int)typeExpected << " \"" << errorExpected << "\"");
+    BOOST_CHECK_EQUAL(IsTokenNameAnOwner(name), regex_reference::IsTokenNameAnOwner(name));
+    BOOST_CHECK_EQUAL(IsUniqueTagValid(name), regex_reference::IsUniqueTagValid(name));
+
+    // Check the name as every type too, not only the one it was classified as
+    for (TokenType typeCheck : {TokenType::ROOT, TokenType::SUB, TokenType::UNIQUE, TokenType::OWNER, TokenType::MSGCHANNEL, TokenType::VOTE}) {
+        error.clear();
+        errorExpected.clear();
+        BOOST_CHECK_EQUAL(IsTypeCheckNameValid(typeCheck, name, error), regex_reference::IsTypeCheckNameValid(typeCheck, name, errorExpected));
+        BOOST_CHECK_EQUAL(error, errorExpected);
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(name_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(name_seeds_match_regex_test)
+{
+    BOOST_TEST_MESSAGE("Running Name Seeds Match Regex Test");
+
+    for (const auto& name : NAME_SEEDS)
+        CheckSameAsReference(name);
+
+    CheckSameAsReference("");
+    CheckSameAsReference(std::string("ABC\0D", 5));
+    CheckSameAsReference("ABC\n");
+    CheckSameAsReference("ABC#TAG\n");
+}
+
+BOOST_AUTO_TEST_CASE(name_fuzz_match_regex_test)
+{
+    BOOST_TEST_MESSAGE("Running Name Fuzz Match Regex Test");
+
+    for (int i = 0; i < 10000; i++) {
+        std::string name;
+        size_t nLength = InsecureRandRange(36);
+        for (size_t j = 0; j < nLength; j++)
+            name += RandomNameCharacter();
+        CheckSameAsReference(name);
+    }
+
+    for (int i = 0; i < 10000; i++)
+        CheckSameAsReference(MutateName(NAME_SEEDS[InsecureRandRange(NAME_SEEDS.size())]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -13,7 +13,13 @@
 #include <script/standard.h>
 #include <base58.h>
 #include <consensus/validation.h>
+#include <core_memusage.h>
 #include <consensus/tx_verify.h>
+#include <checkqueue.h>
+#include <validation.h>
+#include <wallet/wallet.h>
+
+#include <boost/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(token_tx_tests, BasicTestingSetup)
 
@@ -471,4 +477,190 @@ BOOST_FIXTURE_TEST_SUITE(token_tx_tests, BasicTestingSetup)
         BOOST_CHECK_MESSAGE(!token.IsValid(error, cache, false, false), "Test13: " + error);
     }
 
+    BOOST_AUTO_TEST_CASE(token_tx_parsed_outputs_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token TX Parsed Outputs Test");
+
+        SelectParams(CBaseChainParams::MAIN);
+
+        CScript scriptBurn = GetScriptForDestination(DecodeDestination(Params().GlobalBurnAddress()));
+
+        CScript scriptTransfer = scriptBurn;
+        CTokenTransfer("ALPHACON", 1000, 0).ConstructTransaction(scriptTransfer);
+
+        CNewToken newToken("ALPHACON", 1000 * COIN, 8, 1, 0, "");
+        CScript scriptNew = scriptBurn;
+        newToken.ConstructTransaction(scriptNew);
+        CScript scriptOwner = scriptBurn;
+        newToken.ConstructOwnerTransaction(scriptOwner);
+
+        CScript scriptUnique = scriptBurn;
+        CNewToken("TOKEN#TAG", 1 * COIN, 0, 0, 0, "").ConstructTransaction(scriptUnique);
+
+        CScript scriptReissue = scriptBurn;
+        CReissueToken("ALPHACON", 10 * COIN, 8, 1, "").ConstructTransaction(scriptReissue);
+
+        // A transfer marker followed by a payload too short to deserialize
+        std::vector<unsigned char> vchBroken = {ALP_A, ALP_L, ALP_P, ALP_T, 0xfd};
+        CScript scriptBroken = scriptBurn;
+        scriptBroken << OP_ALP_TOKEN << vchBroken << OP_DROP;
+
+        CMutableTransaction mutableTx;
+        for (const CScript& script : {scriptBurn, scriptTransfer, scriptNew, scriptOwner, scriptUnique, scriptReissue, scriptBroken})
+            mutableTx.vout.emplace_back(CTxOut(0, script));
+        CTransaction tx(mutableTx);
+
+        // The memory usage counts the token outputs, whether they were read before or not
+        size_t nUsage = RecursiveDynamicUsage(tx);
+        BOOST_CHECK(&tx.GetTokenOutputs() == &tx.GetTokenOutputs());
+        BOOST_CHECK_EQUAL(RecursiveDynamicUsage(tx), nUsage);
+        BOOST_CHECK(tx.TokenOutputsDynamicUsage() >= tx.GetTokenOutputs().vOutputs.size() * sizeof(CTxTokenOutputs::value_type));
+
+        // Only the token outputs are kept
+        BOOST_CHECK_EQUAL(tx.GetTokenOutputs().vOutputs.size(), tx.vout.size() - 1);
+        BOOST_CHECK(!tx.GetTokenOutputs().Get(0));
+        BOOST_CHECK(!tx.GetTokenOutputs().Get(tx.vout.size()));
+
+        // Every indexed accessor has to agree with reading the script itself
+        for (size_t i = 0; i < tx.vout.size(); i++) {
+            const CScript& script = tx.vout[i].scriptPubKey;
+            std::string strScriptAddress, strTxAddress;
+
+            CTokenTransfer scriptTransferData, txTransferData;
+            bool fScript = TransferTokenFromScript(script, scriptTransferData, strScriptAddress);
+            BOOST_CHECK_EQUAL(fScript, TransferTokenFromTransaction(tx, i, txTransferData, strTxAddress));
+            if (fScript) {
+                BOOST_CHECK_EQUAL(scriptTransferData.strName, txTransferData.strName);
+                BOOST_CHECK_EQUAL(scriptTransferData.nAmount, txTransferData.nAmount);
+                BOOST_CHECK_EQUAL(strScriptAddress, strTxAddress);
+            }
+
+            CNewToken scriptToken, txToken;
+            fScript = TokenFromScript(script, scriptToken, strScriptAddress);
+            BOOST_CHECK_EQUAL(fScript, TokenFromTransaction(tx, i, txToken, strTxAddress));
+            if (fScript) {
+                BOOST_CHECK_EQUAL(scriptToken.strName, txToken.strName);
+                BOOST_CHECK_EQUAL(scriptToken.nAmount, txToken.nAmount);
+                BOOST_CHECK_EQUAL(strScriptAddress, strTxAddress);
+            }
+
+            std::string scriptOwnerName, txOwnerName;
+            fScript = OwnerTokenFromScript(script, scriptOwnerName, strScriptAddress);
+            BOOST_CHECK_EQUAL(fScript, OwnerFromTransaction(tx, i, txOwnerName, strTxAddress));
+            if (fScript) {
+                BOOST_CHECK_EQUAL(scriptOwnerName, txOwnerName);
+                BOOST_CHECK_EQUAL(strScriptAddress, strTxAddress);
+            }
+
+            CReissueToken scriptReissueData, txReissueData;
+            fScript = ReissueTokenFromScript(script, scriptReissueData, strScriptAddress);
+            BOOST_CHECK_EQUAL(fScript, ReissueTokenFromTransaction(tx, i, txReissueData, strTxAddress));
+            if (fScript) {
+                BOOST_CHECK_EQUAL(scriptReissueData.strName, txReissueData.strName);
+                BOOST_CHECK_EQUAL(scriptReissueData.nAmount, txReissueData.nAmount);
+                BOOST_CHECK_EQUAL(strScriptAddress, strTxAddress);
+            }
+
+            BOOST_CHECK_EQUAL(IsScriptNewUniqueToken(script), IsNewUniqueTokenOutput(tx, i));
+
+            CTokenOutputEntry scriptEntry, txEntry;
+            fScript = GetTokenData(script, scriptEntry);
+            BOOST_CHECK_EQUAL(fScript, GetTokenData(tx, i, txEntry));
+            if (fScript) {
+                BOOST_CHECK_EQUAL(scriptEntry.type, txEntry.type);
+                BOOST_CHECK_EQUAL(scriptEntry.tokenName, txEntry.tokenName);
+                BOOST_CHECK_EQUAL(scriptEntry.nAmount, txEntry.nAmount);
+                BOOST_CHECK(scriptEntry.destination == txEntry.destination);
+            }
+
+            uint160 scriptHash, txHash;
+            std::string scriptName, txName;
+            CAmount scriptAmount = 0, txAmount = 0;
+            fScript = ParseTokenScript(script, scriptHash, scriptName, scriptAmount);
+            BOOST_CHECK_EQUAL(fScript, ParseTokenOutput(tx, i, txHash, txName, txAmount));
+            if (fScript) {
+                BOOST_CHECK(scriptHash == txHash);
+                BOOST_CHECK_EQUAL(scriptName, txName);
+                BOOST_CHECK_EQUAL(scriptAmount, txAmount);
+            }
+        }
+
+        BOOST_CHECK(IsNewUniqueTokenOutput(tx, 4));
+        BOOST_CHECK(!tx.GetTokenOutputs().Get(6)->fValid);
+
+        // A copy made after the outputs were read shares them
+        CTransaction txCopy(tx);
+        BOOST_CHECK(&txCopy.GetTokenOutputs() == &tx.GetTokenOutputs());
+
+        CMutableTransaction plainTx;
+        plainTx.vout.emplace_back(CTxOut(COIN, scriptBurn));
+        BOOST_CHECK(CTransaction(plainTx).GetTokenOutputs().vOutputs.empty());
+    }
+
+    BOOST_AUTO_TEST_CASE(token_tx_check_queue_test)
+    {
+        BOOST_TEST_MESSAGE("Running Token TX Check Queue Test");
+
+        SelectParams(CBaseChainParams::MAIN);
+
+        CScript scriptBurn = GetScriptForDestination(DecodeDestination(Params().GlobalBurnAddress()));
+
+        // Owner tokens, so that the checks don't need a token database
+        std::vector<CScript> vScripts;
+        for (int i = 0; i < 4; i++) {
+            CScript script = scriptBurn;
+            CTokenTransfer("TOKEN" + std::to_string(i) + "!", OWNER_TOKEN_AMOUNT, 0).ConstructTransaction(script);
+            vScripts.push_back(script);
+        }
+
+        CCoinsView view;
+        CCoinsViewCache coins(&view);
+
+        // Every third transaction drops the token it spends, and every fifth one moves it to a different token
+        std::vector<CTransaction> vTx;
+        for (int i = 0; i < 200; i++) {
+            COutPoint outpoint(InsecureRand256(), 0);
+            coins.AddCoin(outpoint, Coin(CTxOut(0, vScripts[i % 4]), 10, 0, 0, 0), true);
+
+            CMutableTransaction mutTx;
+            mutTx.vin.emplace_back(CTxIn(outpoint));
+            if (i % 3 != 0)
+                mutTx.vout.emplace_back(CTxOut(0, vScripts[(i + (i % 5 == 0)) % 4]));
+            mutTx.vout.emplace_back(CTxOut(COIN, scriptBurn));
+            vTx.emplace_back(mutTx);
+        }
+
+        // The queued checks agree with CheckTxTokens on every transaction
+        std::vector<CValidationState> vStates(vTx.size());
+        {
+            CCheckQueue<CTokenCheck> queue(16);
+            boost::thread_group threadGroup;
+            for (int i = 0; i < 3; i++)
+                threadGroup.create_thread(boost::bind(&CCheckQueue<CTokenCheck>::Thread, boost::ref(queue)));
+
+            CCheckQueueControl<CTokenCheck> control(&queue);
+            for (size_t i = 0; i < vTx.size(); i++) {
+                std::vector<Coin> vTokenCoins;
+                for (const CTxIn& txin : vTx[i].vin)
+                    vTokenCoins.push_back(coins.AccessCoin(txin.prevout));
+                std::vector<CTokenCheck> vChecks;
+                vChecks.emplace_back(vTx[i], std::move(vTokenCoins), 100000, 100, &vStates[i]);
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+
+            threadGroup.interrupt_all();
+            threadGroup.join_all();
+        }
+
+        for (size_t i = 0; i < vTx.size(); i++) {
+            CValidationState state;
+            std::vector<std::pair<std::string, uint256>> vReissueTokens;
+            bool fValid = Consensus::CheckTxTokens(vTx[i], state, coins, 100000, 100, vReissueTokens);
+            BOOST_CHECK_EQUAL(fValid, i % 3 != 0 && i % 5 != 0);
+            BOOST_CHECK_EQUAL(vStates[i].IsValid(), fValid);
+            BOOST_CHECK_EQUAL(vStates[i].GetRejectReason(), state.GetRejectReason());
+        }
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
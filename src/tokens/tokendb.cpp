@@ -11,6 +11,11 @@
 #include "tokens.h"
 #include "validation.h"
 
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <set>
+
 #include <boost/thread.hpp>
 
 static const char TOKEN_FLAG = 'T';
@@ -19,15 +24,65 @@ static const char ADDRESS_TOKEN_QUANTITY_FLAG = 'C';
 static const char MY_TOKEN_FLAG = 'M';
 static const char BLOCK_TOKEN_UNDO_DATA = 'U';
 static const char MEMPOOL_REISSUED_TX = 'Z';
+static const char TOKEN_HOLDER_COUNT_FLAG = 'H';
+static const char ADDRESS_TOKEN_COUNT_FLAG = 'A';
+static const char HOLDER_COUNTS_BUILT_FLAG = 'h';
+static const char TOKEN_RICH_FLAG = 'R';
+static const char RICH_INDEX_BUILT_FLAG = 'r';
+
+static const size_t MAX_CACHED_COUNTS = 50000;
 
 static size_t MAX_DATABASE_RESULTS = 50000;
 
-CTokensDB::CTokensDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "tokens", nCacheSize, fMemory, fWipe) {
+//! The token name filter is sized for at least this many names, and twice the names there are
+static const size_t MIN_TOKEN_NAME_FILTER_CAPACITY = 100000;
+
+//! Write the rich list index in batches of about this size while it is built or erased
+static const size_t RICH_INDEX_BATCH_SIZE = 16 << 20;
+
+/**
+ * Key of the rich list index: the token name, then the quantity, stored so
+ * that the biggest holders come first, then the address.
+ */
+struct CTokenRichKey
+{
+    std::string tokenName;
+    CAmount quantity;
+    std::string address;
+
+    CTokenRichKey() : quantity(0) {}
+    CTokenRichKey(const std::string& tokenNameIn, const CAmount quantityIn, const std::string& addressIn) :
+        tokenName(tokenNameIn), quantity(quantityIn), address(addressIn) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ::Serialize(s, tokenName);
+        uint64_t nInverted = ~(uint64_t)quantity;
+        ser_writedata32be(s, nInverted >> 32);
+        ser_writedata32be(s, nInverted & 0xffffffff);
+        ::Serialize(s, address);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        ::Unserialize(s, tokenName);
+        uint64_t nInverted = (uint64_t)ser_readdata32be(s) << 32;
+        nInverted |= ser_readdata32be(s);
+        quantity = (CAmount)~nInverted;
+        ::Unserialize(s, address);
+    }
+};
+
+CTokensDB::CTokensDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "tokens", nCacheSize, fMemory, fWipe), fHolderCounts(false), fRichIndex(false), fNameFilter(false), countCache(MAX_CACHED_COUNTS) {
 }
 
 bool CTokensDB::WriteTokenData(const CNewToken &token, const int nHeight, const uint256& blockHash)
 {
     CDatabasedTokenData data(token, nHeight, blockHash);
+    if (fNameFilter)
+        nameFilter.Insert(token.strName);
     return Write(std::make_pair(TOKEN_FLAG, token.strName), data);
 }
 
@@ -40,8 +95,240 @@ bool CTokensDB::WriteAddressTokenQuantity(const std::string &address, const std:
     return Write(std::make_pair(ADDRESS_TOKEN_QUANTITY_FLAG, std::make_pair(address, tokenName)), quantity);
 }
 
+bool CTokensDB::WriteDatabaseChanges(const CTokensDBChanges& changes, bool fSync, size_t& nBatchSize)
+{
+    CDBBatch batch(*this);
+
+    for (const auto& item : changes.mapTokenData) {
+        if (item.second.token.IsNull()) {
+            batch.Erase(std::make_pair(TOKEN_FLAG, item.first));
+        } else {
+            // Into the filter before the database, so a reader never misses the token
+            if (fNameFilter)
+                nameFilter.Insert(item.first);
+            batch.Write(std::make_pair(TOKEN_FLAG, item.first), item.second);
+        }
+    }
+
+    // Changes to the number of addresses holding each token, and of tokens held by each address
+    std::map<std::string, int> mapTokenHolderDelta;
+    std::map<std::string, int> mapAddressTokenDelta;
+
+    for (const auto& item : changes.mapTokenAddressQuantity) {
+        const std::string& tokenName = item.first.first;
+        const std::string& address = item.first.second;
+
+        // A token cache knows what the database has, changes made some other way may not
+        CAmount nOldQuantity = 0;
+        bool fOldQuantity;
+        auto itStored = changes.mapTokenAddressStored.find(item.first);
+        if (itStored != changes.mapTokenAddressStored.end()) {
+            nOldQuantity = itStored->second;
+            fOldQuantity = nOldQuantity != 0;
+        } else {
+            fOldQuantity = (fHolderCounts || fRichIndex) && Read(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, item.first), nOldQuantity);
+        }
+
+        if (fHolderCounts) {
+            int nDelta = (item.second != 0) - fOldQuantity;
+            if (nDelta) {
+                mapTokenHolderDelta[tokenName] += nDelta;
+                mapAddressTokenDelta[address] += nDelta;
+            }
+        }
+
+        if (fRichIndex && nOldQuantity != item.second) {
+            if (fOldQuantity)
+                batch.Erase(std::make_pair(TOKEN_RICH_FLAG, CTokenRichKey(tokenName, nOldQuantity, address)));
+            if (item.second != 0)
+                batch.Write(std::make_pair(TOKEN_RICH_FLAG, CTokenRichKey(tokenName, item.second, address)), '\0');
+        }
+
+        if (item.second == 0) {
+            batch.Erase(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, address)));
+            batch.Erase(std::make_pair(ADDRESS_TOKEN_QUANTITY_FLAG, std::make_pair(address, tokenName)));
+        } else {
+            batch.Write(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, address)), item.second);
+            batch.Write(std::make_pair(ADDRESS_TOKEN_QUANTITY_FLAG, std::make_pair(address, tokenName)), item.second);
+        }
+    }
+
+    std::vector<std::pair<std::string, int> > vCounts;
+    WriteCountDeltas(batch, TOKEN_HOLDER_COUNT_FLAG, mapTokenHolderDelta, vCounts);
+    WriteCountDeltas(batch, ADDRESS_TOKEN_COUNT_FLAG, mapAddressTokenDelta, vCounts);
+
+    nBatchSize = batch.SizeEstimate();
+    if (!WriteBatch(batch, fSync))
+        return false;
+
+    for (const auto& item : vCounts)
+        countCache.Put(item.first, item.second);
+
+    // A failed rebuild leaves the old filter, which still has every name
+    if (fNameFilter && nameFilter.IsFull())
+        BuildNameFilter();
+
+    return true;
+}
+
+void CTokensDB::WriteCountDeltas(CDBBatch& batch, const char flag, const std::map<std::string, int>& mapDelta, std::vector<std::pair<std::string, int> >& vCounts)
+{
+    for (const auto& item : mapDelta) {
+        std::string strKey = flag + item.first;
+        int nCount = 0;
+        if (countCache.Exists(strKey))
+            nCount = countCache.Get(strKey);
+        else
+            Read(std::make_pair(flag, item.first), nCount);
+        nCount = std::max(nCount + item.second, 0);
+        if (nCount > 0)
+            batch.Write(std::make_pair(flag, item.first), nCount);
+        else
+            batch.Erase(std::make_pair(flag, item.first));
+        vCounts.emplace_back(strKey, nCount);
+    }
+}
+
+bool CTokensDB::BuildHolderCounts()
+{
+    std::map<std::string, int> mapTokenHolders;
+    std::map<std::string, int> mapAddressTokens;
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(std::string(), std::string())));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::pair<std::string, std::string> > key; // <Token Name, Address> -> Quantity
+        if (!pcursor->GetKey(key) || key.first != TOKEN_ADDRESS_QUANTITY_FLAG)
+            break;
+        mapTokenHolders[key.second.first]++;
+        mapAddressTokens[key.second.second]++;
+        pcursor->Next();
+    }
+
+    CDBBatch batch(*this);
+    for (const auto& item : mapTokenHolders)
+        batch.Write(std::make_pair(TOKEN_HOLDER_COUNT_FLAG, item.first), item.second);
+    for (const auto& item : mapAddressTokens)
+        batch.Write(std::make_pair(ADDRESS_TOKEN_COUNT_FLAG, item.first), item.second);
+    batch.Write(HOLDER_COUNTS_BUILT_FLAG, true);
+    if (!WriteBatch(batch, true))
+        return error("%s: failed to write token holder counts", __func__);
+    countCache.Clear();
+
+    LogPrintf("Counted the holders of %u tokens and the tokens of %u addresses\n", mapTokenHolders.size(), mapAddressTokens.size());
+    fHolderCounts = true;
+    return true;
+}
+
+bool CTokensDB::BuildRichIndex()
+{
+    LogPrintf("Building the token rich list index...\n");
+
+    CDBBatch batch(*this);
+    size_t nEntries = 0;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(std::string(), std::string())));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::pair<std::string, std::string> > key; // <Token Name, Address> -> Quantity
+        if (!pcursor->GetKey(key) || key.first != TOKEN_ADDRESS_QUANTITY_FLAG)
+            break;
+        CAmount quantity;
+        if (!pcursor->GetValue(quantity))
+            return error("%s: failed to read token address quantity", __func__);
+        batch.Write(std::make_pair(TOKEN_RICH_FLAG, CTokenRichKey(key.second.first, quantity, key.second.second)), '\0');
+        nEntries++;
+
+        if (batch.SizeEstimate() > RICH_INDEX_BATCH_SIZE) {
+            if (!WriteBatch(batch))
+                return error("%s: failed to write token rich list index", __func__);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+
+    batch.Write(RICH_INDEX_BUILT_FLAG, true);
+    if (!WriteBatch(batch, true))
+        return error("%s: failed to write token rich list index", __func__);
+
+    LogPrintf("Indexed %u token holders by quantity\n", nEntries);
+    return true;
+}
+
+bool CTokensDB::EraseRichIndex()
+{
+    CDBBatch batch(*this);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(TOKEN_RICH_FLAG);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTokenRichKey> key;
+        if (!pcursor->GetKey(key) || key.first != TOKEN_RICH_FLAG)
+            break;
+        batch.Erase(key);
+
+        if (batch.SizeEstimate() > RICH_INDEX_BATCH_SIZE) {
+            if (!WriteBatch(batch))
+                return error("%s: failed to erase token rich list index", __func__);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+
+    batch.Erase(RICH_INDEX_BUILT_FLAG);
+    if (!WriteBatch(batch, true))
+        return error("%s: failed to erase token rich list index", __func__);
+
+    LogPrintf("Removed the token rich list index\n");
+    return true;
+}
+
+bool CTokensDB::BuildNameFilter()
+{
+    // Count the names first, so the filter can be sized for them
+    size_t nNames = 0;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    for (pcursor->Seek(std::make_pair(TOKEN_FLAG, std::string())); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::string> key;
+        if (!pcursor->GetKey(key) || key.first != TOKEN_FLAG)
+            break;
+        nNames++;
+    }
+
+    // Tokens are only written under cs_main, as is this, so none go missing between the scan and the swap
+    CTokenNameFilter filter;
+    filter.Reset(std::max(2 * nNames, MIN_TOKEN_NAME_FILTER_CAPACITY), nTokenNameFilterRate);
+    for (pcursor->Seek(std::make_pair(TOKEN_FLAG, std::string())); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::string> key;
+        if (!pcursor->GetKey(key) || key.first != TOKEN_FLAG)
+            break;
+        filter.Insert(key.second);
+    }
+    nameFilter.Swap(filter);
+    fNameFilter = true;
+
+    CTokenNameFilter::Stats stats;
+    nameFilter.GetStats(stats);
+    LogPrintf("Filled the token name filter with %u names (%u kB, room for %u)\n", stats.nNames, stats.nMemoryUsage >> 10, stats.nCapacity);
+    return true;
+}
+
+bool CTokensDB::GetNameFilterStats(CTokenNameFilter::Stats& stats) const
+{
+    if (!fNameFilter)
+        return false;
+    nameFilter.GetStats(stats);
+    return true;
+}
+
 bool CTokensDB::ReadTokenData(const std::string& strName, CNewToken& token, int& nHeight, uint256& blockHash)
 {
+    // Most names that aren't in the database don't get past the filter
+    if (fNameFilter && !nameFilter.MayContain(strName))
+        return false;
 
     CDatabasedTokenData data;
     bool ret =  Read(std::make_pair(TOKEN_FLAG, strName), data);
@@ -119,6 +406,9 @@ bool CTokensDB::ReadReissuedMempoolState()
 
 bool CTokensDB::LoadTokens()
 {
+    if (nTokenNameFilterRate > 0 && !BuildNameFilter())
+        return false;
+
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(TOKEN_FLAG, std::string()));
@@ -135,7 +425,7 @@ bool CTokensDB::LoadTokens()
 
                 // Loaded enough from database to have in memory.
                 // No need to load everything if it is just going to be removed from the cache
-                if (ptokensCache->Size() == (ptokensCache->MaxSize() / 2))
+                if (ptokensCache->Size() >= (ptokensCache->MaxSize() / 2))
                     break;
             } else {
                 return error("%s: failed to read token", __func__);
@@ -169,226 +459,479 @@ bool CTokensDB::LoadTokens()
                 break;
             }
         }
+
+        // Older databases don't have the holder counts yet
+        if (!Read(HOLDER_COUNTS_BUILT_FLAG, fHolderCounts) && !BuildHolderCounts())
+            return false;
+
+        // The rich list index is built when -tokenrichindex is first turned
+        // on, and dropped when it is turned off so it can't go stale
+        bool fRichIndexBuilt = false;
+        Read(RICH_INDEX_BUILT_FLAG, fRichIndexBuilt);
+        if (fTokenRichIndex && !fRichIndexBuilt && !BuildRichIndex())
+            return false;
+        if (!fTokenRichIndex && fRichIndexBuilt && !EraseRichIndex())
+            return false;
+        fRichIndex = fTokenRichIndex;
     }
 
     return true;
 }
 
-bool CTokensDB::TokenDir(std::vector<CDatabasedTokenData>& tokens, const std::string filter, const size_t count, const long start)
-{
-    FlushStateToDisk();
+namespace {
 
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(TOKEN_FLAG, std::string()));
-
-    auto prefix = filter;
-    bool wildcard = prefix.back() == '*';
-    if (wildcard)
-        prefix.pop_back();
+/** Serialized database key, which sorts the same way the database does */
+template <typename K>
+std::string DBKeyString(const K& key)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << key;
+    return ssKey.str();
+}
 
-    size_t skip = 0;
-    if (start >= 0) {
-        skip = start;
+/** Contiguous part of the database, from its first key for as long as fnInRange holds */
+template <typename K>
+struct CTokensDirRange
+{
+    K keyFirst;
+    std::function<bool(const K&)> fnInRange;
+
+    CTokensDirRange(const K& keyFirstIn, std::function<bool(const K&)> fnInRangeIn) : keyFirst(keyFirstIn), fnInRange(fnInRangeIn) {}
+};
+
+/**
+ * Walks one key range of a database snapshot in database order, with
+ * changes that are not written to it yet applied on top.
+ */
+template <typename K, typename V>
+class CTokensDirCursor
+{
+public:
+    // Serialized Key -> < Key, Value >
+    typedef std::map<std::string, std::pair<K, V> > Changes;
+
+    CTokensDirCursor(CDBIterator* pcursorIn, const K& keySeek, std::function<bool(const K&)> fnInRangeIn, std::function<bool(const V&)> fnErasedIn, const Changes& changesIn)
+        : pcursor(pcursorIn), fnInRange(fnInRangeIn), fnErased(fnErasedIn), changes(changesIn), fFailed(false)
+    {
+        pcursor->Seek(keySeek);
+        itChange = changes.lower_bound(DBKeyString(keySeek));
     }
-    else {
-        // compute table size for backwards offset
-        long table_size = 0;
-        while (pcursor->Valid()) {
+
+    //! Move to the next entry. Returns false at the end of the range or if a value couldn't be read
+    bool Next(K& key, V& value)
+    {
+        while (true) {
             boost::this_thread::interruption_point();
 
-            std::pair<char, std::string> key;
-            if (pcursor->GetKey(key) && key.first == TOKEN_FLAG) {
-                if (prefix == "" ||
-                    (wildcard && key.second.find(prefix) == 0) ||
-                    (!wildcard && key.second == prefix)) {
-                    table_size += 1;
+            bool fDatabase = pcursor->Valid() && pcursor->GetKey(keyDatabase) && fnInRange(keyDatabase);
+            bool fChange = itChange != changes.end() && fnInRange(itChange->second.first);
+            if (!fDatabase && !fChange)
+                return false;
+
+            // Below zero the database entry comes first, at zero the change replaces it
+            int nCompare = 1;
+            if (fDatabase)
+                nCompare = fChange ? DBKeyString(keyDatabase).compare(itChange->first) : -1;
+
+            if (nCompare < 0) {
+                if (!pcursor->GetValue(value)) {
+                    fFailed = true;
+                    return false;
                 }
+                key = keyDatabase;
+                pcursor->Next();
+                return true;
+            }
+
+            if (nCompare == 0)
+                pcursor->Next();
+
+            const std::pair<K, V>& change = (itChange++)->second;
+            if (!fnErased(change.second)) {
+                key = change.first;
+                value = change.second;
+                return true;
             }
-            pcursor->Next();
         }
-        skip = table_size + start;
-        pcursor->SeekToFirst();
     }
 
+    bool Failed() const { return fFailed; }
+
+private:
+    CDBIterator* pcursor;
+    std::function<bool(const K&)> fnInRange;
+    std::function<bool(const V&)> fnErased;
+    const Changes& changes;
+    typename Changes::const_iterator itChange;
+    K keyDatabase;
+    bool fFailed;
+};
+
+/**
+ * Walk the entries of the ranges that match, in database order, starting
+ * after pkeyAfter if given. fnVisit returns false to stop early.
+ */
+template <typename K, typename V>
+bool WalkTokensDir(CDBWrapper& db, const CDBSnapshot& snapshot, const std::vector<CTokensDirRange<K> >& vRanges,
+                   std::function<bool(const K&)> fnMatches, std::function<bool(const V&)> fnErased,
+                   const typename CTokensDirCursor<K, V>::Changes& changes, const K* pkeyAfter,
+                   std::function<bool(const K&, const V&)> fnVisit)
+{
+    std::string strAfter;
+    if (pkeyAfter)
+        strAfter = DBKeyString(*pkeyAfter);
+
+    K key;
+    V value;
+    for (const CTokensDirRange<K>& range : vRanges) {
+        // Ranges are in database order, so the ones before the key to start after can be skipped
+        bool fSeekAfter = pkeyAfter && DBKeyString(range.keyFirst) <= strAfter;
+        if (fSeekAfter && !range.fnInRange(*pkeyAfter))
+            continue;
+
+        std::unique_ptr<CDBIterator> pcursor(db.NewIterator(snapshot));
+        CTokensDirCursor<K, V> cursor(pcursor.get(), fSeekAfter ? *pkeyAfter : range.keyFirst, range.fnInRange, fnErased, changes);
+        while (cursor.Next(key, value)) {
+            if (fSeekAfter && DBKeyString(key) <= strAfter)
+                continue;
+            if (fnMatches(key) && !fnVisit(key, value))
+                return true;
+        }
+        if (cursor.Failed())
+            return false;
+    }
 
-    size_t loaded = 0;
-    size_t offset = 0;
+    return true;
+}
 
-    // Load tokens
-    while (pcursor->Valid() && loaded < count) {
-        boost::this_thread::interruption_point();
+/**
+ * Read a page of the matching entries. The page either starts after
+ * pkeyAfter, or at start, counting back from the end if start is negative.
+ * nTotal is the number of matching entries if fTotalKnown, otherwise it
+ * gets counted when needed.
+ */
+template <typename K, typename V>
+bool ReadTokensDir(CDBWrapper& db, const CDBSnapshot& snapshot, const std::vector<CTokensDirRange<K> >& vRanges,
+                   std::function<bool(const K&)> fnMatches, std::function<bool(const V&)> fnErased,
+                   const typename CTokensDirCursor<K, V>::Changes& changes, const bool fGetTotal, size_t& nTotal, const bool fTotalKnown,
+                   const size_t count, const long start, const K* pkeyAfter, std::function<void(const K&, const V&)> fnAdd)
+{
+    if (!fTotalKnown && (fGetTotal || (start < 0 && !pkeyAfter))) {
+        nTotal = 0;
+        if (!WalkTokensDir<K, V>(db, snapshot, vRanges, fnMatches, fnErased, changes, nullptr,
+                [&nTotal](const K& key, const V& value) { nTotal++; return true; }))
+            return false;
+    }
 
-        std::pair<char, std::string> key;
-        if (pcursor->GetKey(key) && key.first == TOKEN_FLAG) {
-            if (prefix == "" ||
-                    (wildcard && key.second.find(prefix) == 0) ||
-                    (!wildcard && key.second == prefix)) {
+    if (fGetTotal)
+        return true;
+
+    size_t skip = 0;
+    if (pkeyAfter) {
+        skip = 0;
+    } else if (start >= 0) {
+        skip = start;
+    } else if ((size_t)-start < nTotal) {
+        skip = nTotal + start;
+    }
+
+    if (count == 0)
+        return true;
+
+    size_t loaded = 0;
+    size_t offset = 0;
+    return WalkTokensDir<K, V>(db, snapshot, vRanges, fnMatches, fnErased, changes, pkeyAfter,
+            [&](const K& key, const V& value) {
                 if (offset < skip) {
                     offset += 1;
+                    return true;
                 }
-                else {
-                    CDatabasedTokenData data;
-                    if (pcursor->GetValue(data)) {
-                        tokens.push_back(data);
-                        loaded += 1;
-                    } else {
-                        return error("%s: failed to read token", __func__);
-                    }
-                }
-            }
-            pcursor->Next();
-        } else {
-            break;
-        }
+                fnAdd(key, value);
+                return ++loaded < count;
+            });
+}
+
+bool IsErasedTokenData(const CDatabasedTokenData& data) { return data.token.IsNull(); }
+bool IsErasedQuantity(const CAmount& quantity) { return quantity == 0; }
+bool MatchesAll(const std::pair<char, std::pair<std::string, std::string> >& key) { return true; }
+
+}
+
+std::unique_ptr<CDBSnapshot> CTokensDB::GetSnapshot(std::shared_ptr<const CTokensDBChanges>& changes)
+{
+    // Together they show the database as it is going to be after the next flush
+    std::unique_ptr<CDBSnapshot> snapshot;
+    if (ptokens) {
+        changes = ptokens->GetDatabaseChanges(*this, snapshot);
+    } else {
+        changes = std::make_shared<const CTokensDBChanges>();
+        snapshot.reset(new CDBSnapshot(*this));
     }
+    return snapshot;
+}
 
-    return true;
+bool CTokensDB::TokenDir(std::vector<CDatabasedTokenData>& tokens, const std::string filter, const size_t count, const long start)
+{
+    return TokenDir(tokens, filter, count, start, nullptr);
 }
 
-bool CTokensDB::AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, int& totalEntries, const bool& fGetTotal, const std::string& address, const size_t count, const long start)
+bool CTokensDB::TokenDir(std::vector<CDatabasedTokenData>& tokens, const std::string filter, const size_t count, const std::string& after)
 {
-    FlushStateToDisk();
+    return TokenDir(tokens, filter, count, 0, &after);
+}
 
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(ADDRESS_TOKEN_QUANTITY_FLAG, std::make_pair(address, std::string())));
+bool CTokensDB::TokenDir(std::vector<CDatabasedTokenData>& tokens, const std::string filter, const size_t count, const long start, const std::string* pafter)
+{
+    std::shared_ptr<const CTokensDBChanges> pchanges;
+    std::unique_ptr<CDBSnapshot> snapshot = GetSnapshot(pchanges);
+    const CTokensDBChanges& changes = *pchanges;
 
-    if (fGetTotal) {
-        totalEntries = 0;
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
+    auto prefix = filter;
+    bool wildcard = prefix.back() == '*';
+    if (wildcard)
+        prefix.pop_back();
 
-            std::pair<char, std::pair<std::string, std::string> > key;
-            if (pcursor->GetKey(key) && key.first == ADDRESS_TOKEN_QUANTITY_FLAG && key.second.first == address) {
-                totalEntries++;
-            }
-            pcursor->Next();
+    typedef std::pair<char, std::string> Key;
+    std::function<bool(const Key&)> fnMatches = [&prefix, wildcard](const Key& key) {
+        return prefix == "" ||
+               (wildcard && key.second.find(prefix) == 0) ||
+               (!wildcard && key.second == prefix);
+    };
+
+    // Names are stored after their length, so the names with a prefix are
+    // together for each length but not overall
+    std::vector<CTokensDirRange<Key> > vRanges;
+    if (prefix == "") {
+        vRanges.emplace_back(std::make_pair(TOKEN_FLAG, std::string()), [](const Key& key) { return key.first == TOKEN_FLAG; });
+    } else if (!wildcard) {
+        vRanges.emplace_back(std::make_pair(TOKEN_FLAG, prefix), [&prefix](const Key& key) { return key.first == TOKEN_FLAG && key.second == prefix; });
+    } else {
+        for (size_t nLength = prefix.size(); nLength <= MAX_TOKEN_LENGTH; nLength++) {
+            vRanges.emplace_back(std::make_pair(TOKEN_FLAG, prefix + std::string(nLength - prefix.size(), '\0')), [&prefix, nLength](const Key& key) {
+                return key.first == TOKEN_FLAG && key.second.size() == nLength && key.second.compare(0, prefix.size(), prefix) == 0;
+            });
         }
-        return true;
     }
 
-    size_t skip = 0;
-    if (start >= 0) {
-        skip = start;
+    CTokensDirCursor<Key, CDatabasedTokenData>::Changes dirChanges;
+    for (const auto& item : changes.mapTokenData) {
+        Key key = std::make_pair(TOKEN_FLAG, item.first);
+        dirChanges.emplace(DBKeyString(key), std::make_pair(key, item.second));
     }
-    else {
-        // compute table size for backwards offset
-        long table_size = 0;
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
 
-            std::pair<char, std::pair<std::string, std::string> > key;
-            if (pcursor->GetKey(key) && key.first == ADDRESS_TOKEN_QUANTITY_FLAG && key.second.first == address) {
-                table_size += 1;
-            }
-            pcursor->Next();
-        }
-        skip = table_size + start;
-        pcursor->SeekToFirst();
-    }
+    Key keyAfter;
+    if (pafter)
+        keyAfter = std::make_pair(TOKEN_FLAG, *pafter);
 
-    size_t loaded = 0;
-    size_t offset = 0;
+    size_t nTotal = 0;
+    bool ret = ReadTokensDir<Key, CDatabasedTokenData>(*this, *snapshot, vRanges, fnMatches, IsErasedTokenData, dirChanges,
+            false, nTotal, false, count, start, pafter ? &keyAfter : nullptr,
+            [&tokens](const Key& key, const CDatabasedTokenData& data) { tokens.push_back(data); });
 
-    // Load tokens
-    while (pcursor->Valid() && loaded < count && loaded < MAX_DATABASE_RESULTS) {
-        boost::this_thread::interruption_point();
+    if (!ret)
+        return error("%s: failed to read token", __func__);
 
-        std::pair<char, std::pair<std::string, std::string> > key;
-        if (pcursor->GetKey(key) && key.first == ADDRESS_TOKEN_QUANTITY_FLAG && key.second.first == address) {
-                if (offset < skip) {
-                    offset += 1;
-                }
-                else {
-                    CAmount amount;
-                    if (pcursor->GetValue(amount)) {
-                        vecTokenAmount.emplace_back(std::make_pair(key.second.second, amount));
-                        loaded += 1;
-                    } else {
-                        return error("%s: failed to Address Token Quanity", __func__);
-                    }
-                }
-            pcursor->Next();
-        } else {
-            break;
-        }
+    return true;
+}
+
+bool CTokensDB::AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, int& totalEntries, const bool& fGetTotal, const std::string& address, const size_t count, const long start)
+{
+    return AddressDir(vecTokenAmount, totalEntries, fGetTotal, address, count, start, nullptr);
+}
+
+bool CTokensDB::AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, const std::string& address, const size_t count, const std::string& after)
+{
+    int totalEntries;
+    return AddressDir(vecTokenAmount, totalEntries, false, address, count, 0, &after);
+}
+
+bool CTokensDB::AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, int& totalEntries, const bool fGetTotal, const std::string& address, const size_t count, const long start, const std::string* pafter)
+{
+    std::shared_ptr<const CTokensDBChanges> pchanges;
+    std::unique_ptr<CDBSnapshot> snapshot = GetSnapshot(pchanges);
+    const CTokensDBChanges& changes = *pchanges;
+
+    typedef std::pair<char, std::pair<std::string, std::string> > Key; // < Address, Token Name >
+    CTokensDirCursor<Key, CAmount>::Changes dirChanges;
+    for (const auto& item : changes.mapTokenAddressQuantity) {
+        if (item.first.second != address)
+            continue;
+        Key key = std::make_pair(ADDRESS_TOKEN_QUANTITY_FLAG, std::make_pair(address, item.first.first));
+        dirChanges.emplace(DBKeyString(key), std::make_pair(key, item.second));
     }
 
+    size_t nTotal = 0;
+    bool fTotalKnown = fHolderCounts && (fGetTotal || start < 0);
+    if (fTotalKnown)
+        nTotal = GetCount(*snapshot, ADDRESS_TOKEN_COUNT_FLAG, address, changes.mapAddressTokenDelta);
+
+    std::vector<CTokensDirRange<Key> > vRanges;
+    vRanges.emplace_back(std::make_pair(ADDRESS_TOKEN_QUANTITY_FLAG, std::make_pair(address, std::string())),
+            [&address](const Key& key) { return key.first == ADDRESS_TOKEN_QUANTITY_FLAG && key.second.first == address; });
+
+    Key keyAfter;
+    if (pafter)
+        keyAfter = std::make_pair(ADDRESS_TOKEN_QUANTITY_FLAG, std::make_pair(address, *pafter));
+
+    bool ret = ReadTokensDir<Key, CAmount>(*this, *snapshot, vRanges, MatchesAll, IsErasedQuantity, dirChanges,
+            fGetTotal, nTotal, fTotalKnown, std::min(count, MAX_DATABASE_RESULTS), start, pafter ? &keyAfter : nullptr,
+            [&vecTokenAmount](const Key& key, const CAmount& amount) { vecTokenAmount.emplace_back(std::make_pair(key.second.second, amount)); });
+
+    if (!ret)
+        return error("%s: failed to Address Token Quanity", __func__);
+
+    if (fGetTotal)
+        totalEntries = nTotal;
+
     return true;
 }
 
 // Can get to total count of addresses that belong to a certain token_name, or get you the list of all address that belong to a certain token_name
 bool CTokensDB::TokenAddressDir(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, int& totalEntries, const bool& fGetTotal, const std::string& tokenName, const size_t count, const long start)
 {
-    FlushStateToDisk();
-
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, std::string())));
+    return TokenAddressDir(vecAddressAmount, totalEntries, fGetTotal, tokenName, count, start, nullptr);
+}
 
-    if (fGetTotal) {
-        totalEntries = 0;
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
+bool CTokensDB::TokenAddressDir(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, const std::string& tokenName, const size_t count, const std::string& after)
+{
+    int totalEntries;
+    return TokenAddressDir(vecAddressAmount, totalEntries, false, tokenName, count, 0, &after);
+}
 
-            std::pair<char, std::pair<std::string, std::string> > key;
-            if (pcursor->GetKey(key) && key.first == TOKEN_ADDRESS_QUANTITY_FLAG && key.second.first == tokenName) {
-                totalEntries += 1;
-            }
-            pcursor->Next();
-        }
-        return true;
+bool CTokensDB::TokenAddressDir(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, int& totalEntries, const bool fGetTotal, const std::string& tokenName, const size_t count, const long start, const std::string* pafter)
+{
+    std::shared_ptr<const CTokensDBChanges> pchanges;
+    std::unique_ptr<CDBSnapshot> snapshot = GetSnapshot(pchanges);
+    const CTokensDBChanges& changes = *pchanges;
+
+    typedef std::pair<char, std::pair<std::string, std::string> > Key; // < Token Name, Address >
+    CTokensDirCursor<Key, CAmount>::Changes dirChanges;
+    for (auto it = changes.mapTokenAddressQuantity.lower_bound(std::make_pair(tokenName, std::string()));
+            it != changes.mapTokenAddressQuantity.end() && it->first.first == tokenName; ++it) {
+        Key key = std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, it->first);
+        dirChanges.emplace(DBKeyString(key), std::make_pair(key, it->second));
     }
 
-    size_t skip = 0;
-    if (start >= 0) {
-        skip = start;
+    size_t nTotal = 0;
+    bool fTotalKnown = fHolderCounts && (fGetTotal || start < 0);
+    if (fTotalKnown)
+        nTotal = GetCount(*snapshot, TOKEN_HOLDER_COUNT_FLAG, tokenName, changes.mapTokenHolderDelta);
+
+    std::vector<CTokensDirRange<Key> > vRanges;
+    vRanges.emplace_back(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, std::string())),
+            [&tokenName](const Key& key) { return key.first == TOKEN_ADDRESS_QUANTITY_FLAG && key.second.first == tokenName; });
+
+    Key keyAfter;
+    if (pafter)
+        keyAfter = std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(tokenName, *pafter));
+
+    bool ret = ReadTokensDir<Key, CAmount>(*this, *snapshot, vRanges, MatchesAll, IsErasedQuantity, dirChanges,
+            fGetTotal, nTotal, fTotalKnown, std::min(count, MAX_DATABASE_RESULTS), start, pafter ? &keyAfter : nullptr,
+            [&vecAddressAmount](const Key& key, const CAmount& amount) { vecAddressAmount.emplace_back(std::make_pair(key.second.second, amount)); });
+
+    if (!ret)
+        return error("%s: failed to Token Address Quanity", __func__);
+
+    if (fGetTotal)
+        totalEntries = nTotal;
+
+    return true;
+}
+
+size_t CTokensDB::GetCount(const CDBSnapshot& snapshot, const char flag, const std::string& name, const std::map<std::string, int>& mapDelta)
+{
+    int nCount = 0;
+    Read(std::make_pair(flag, name), nCount, snapshot);
+
+    // Unflushed changes can add or remove entries
+    auto it = mapDelta.find(name);
+    if (it != mapDelta.end())
+        nCount += it->second;
+
+    return std::max(nCount, 0);
+}
+
+bool CTokensDB::TopTokenAddresses(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, const std::string& tokenName, const size_t count)
+{
+    if (!fRichIndex)
+        return error("%s: the token rich list index is not enabled", __func__);
+
+    std::shared_ptr<const CTokensDBChanges> pchanges;
+    std::unique_ptr<CDBSnapshot> snapshot = GetSnapshot(pchanges);
+    const CTokensDBChanges& changes = *pchanges;
+
+    // Quantities that are not flushed yet replace what the index has for their address
+    std::set<std::string> setChanged;
+    std::vector<std::pair<std::string, CAmount> > vecChanged;
+    for (auto it = changes.mapTokenAddressQuantity.lower_bound(std::make_pair(tokenName, std::string()));
+            it != changes.mapTokenAddressQuantity.end() && it->first.first == tokenName; ++it) {
+        setChanged.insert(it->first.second);
+        if (it->second != 0)
+            vecChanged.emplace_back(it->first.second, it->second);
     }
-    else {
-        // compute table size for backwards offset
-        long table_size = 0;
-        while (pcursor->Valid()) {
-            boost::this_thread::interruption_point();
 
-            std::pair<char, std::pair<std::string, std::string> > key;
-            if (pcursor->GetKey(key) && key.first == TOKEN_ADDRESS_QUANTITY_FLAG && key.second.first == tokenName) {
-                table_size += 1;
-            }
-            pcursor->Next();
-        }
-        skip = table_size + start;
-        pcursor->SeekToFirst();
+    size_t nMax = std::min(count, MAX_DATABASE_RESULTS);
+    std::vector<std::pair<std::string, CAmount> > vecResult;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator(*snapshot));
+    pcursor->Seek(std::make_pair(TOKEN_RICH_FLAG, CTokenRichKey(tokenName, std::numeric_limits<CAmount>::max(), std::string())));
+    while (pcursor->Valid() && vecResult.size() < nMax) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTokenRichKey> key;
+        if (!pcursor->GetKey(key) || key.first != TOKEN_RICH_FLAG || key.second.tokenName != tokenName)
+            break;
+        if (!setChanged.count(key.second.address))
+            vecResult.emplace_back(key.second.address, key.second.quantity);
+        pcursor->Next();
     }
 
-    size_t loaded = 0;
-    size_t offset = 0;
+    vecResult.insert(vecResult.end(), vecChanged.begin(), vecChanged.end());
+    std::sort(vecResult.begin(), vecResult.end(), [](const std::pair<std::string, CAmount>& a, const std::pair<std::string, CAmount>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    if (vecResult.size() > nMax)
+        vecResult.resize(nMax);
 
-    // Load tokens
-    while (pcursor->Valid() && loaded < count && loaded < MAX_DATABASE_RESULTS) {
-        boost::this_thread::interruption_point();
+    vecAddressAmount.insert(vecAddressAmount.end(), vecResult.begin(), vecResult.end());
+    return true;
+}
 
-        std::pair<char, std::pair<std::string, std::string> > key;
-        if (pcursor->GetKey(key) && key.first == TOKEN_ADDRESS_QUANTITY_FLAG && key.second.first == tokenName) {
-            if (offset < skip) {
-                offset += 1;
-            }
-            else {
-                CAmount amount;
-                if (pcursor->GetValue(amount)) {
-                    vecAddressAmount.emplace_back(std::make_pair(key.second.second, amount));
-                    loaded += 1;
-                } else {
-                    return error("%s: failed to Token Address Quanity", __func__);
-                }
-            }
-            pcursor->Next();
-        } else {
+bool CTokensDB::ForEachToken(const CDBSnapshot& snapshot, std::function<void(const CDatabasedTokenData&)> fn)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator(snapshot));
+    pcursor->Seek(std::make_pair(TOKEN_FLAG, std::string()));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::string> key;
+        if (!pcursor->GetKey(key) || key.first != TOKEN_FLAG)
             break;
-        }
+        CDatabasedTokenData data;
+        if (!pcursor->GetValue(data))
+            return error("%s: failed to read token %s", __func__, key.second);
+        fn(data);
+        pcursor->Next();
     }
+    return true;
+}
 
+bool CTokensDB::ForEachTokenAddressQuantity(const CDBSnapshot& snapshot, std::function<void(const std::string&, const std::string&, const CAmount&)> fn)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator(snapshot));
+    pcursor->Seek(std::make_pair(TOKEN_ADDRESS_QUANTITY_FLAG, std::make_pair(std::string(), std::string())));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, std::pair<std::string, std::string> > key; // <Token Name, Address> -> Quantity
+        if (!pcursor->GetKey(key) || key.first != TOKEN_ADDRESS_QUANTITY_FLAG)
+            break;
+        CAmount quantity;
+        if (!pcursor->GetValue(quantity))
+            return error("%s: failed to read the quantity of %s held by %s", __func__, key.second.first, key.second.second);
+        fn(key.second.first, key.second.second, quantity);
+        pcursor->Next();
+    }
     return true;
 }
 
 bool CTokensDB::TokenDir(std::vector<CDatabasedTokenData>& tokens)
 {
     return CTokensDB::TokenDir(tokens, "*", MAX_SIZE, 0);
-}
\ No newline at end of file
+}
@@ -8,7 +8,11 @@
 
 #include "fs.h"
 #include "serialize.h"
+#include "tokentypes.h"
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
 #include <map>
 #include <dbwrapper.h>
@@ -36,6 +40,23 @@ struct CBlockTokenUndo
     }
 };
 
+/** Token database entries that a token cache has changed but not yet written */
+struct CTokensDBChanges
+{
+    // Token Name -> Token Data, with a null token where the token gets erased
+    std::map<std::string, CDatabasedTokenData> mapTokenData;
+
+    // < Token Name, Address > -> Quantity, zero where the entry gets erased
+    std::map<std::pair<std::string, std::string>, CAmount> mapTokenAddressQuantity;
+
+    // < Token Name, Address > -> Quantity the database has now, zero if none, for the same entries
+    std::map<std::pair<std::string, std::string>, CAmount> mapTokenAddressStored;
+
+    // Change in the number of addresses holding each token, and of tokens held by each address
+    std::map<std::string, int> mapTokenHolderDelta;
+    std::map<std::string, int> mapAddressTokenDelta;
+};
+
 /** Access to the block database (blocks/index/) */
 class CTokensDB : public CDBWrapper
 {
@@ -51,6 +72,7 @@ public:
     bool WriteAddressTokenQuantity( const std::string& address, const std::string& tokenName, const CAmount& quantity);
     bool WriteBlockUndoTokenData(const uint256& blockhash, const std::vector<std::pair<std::string, CBlockTokenUndo> >& tokenUndoData);
     bool WriteReissuedMempoolState();
+    bool WriteDatabaseChanges(const CTokensDBChanges& changes, bool fSync, size_t& nBatchSize);
 
     // Read from database functions
     bool ReadTokenData(const std::string& strName, CNewToken& token, int& nHeight, uint256& blockHash);
@@ -72,6 +94,50 @@ public:
 
     bool AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, int& totalEntries, const bool& fGetTotal, const std::string& address, const size_t count, const long start);
     bool TokenAddressDir(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, int& totalEntries, const bool& fGetTotal, const std::string& tokenName, const size_t count, const long start);
+
+    // Pages that continue after the last token name or address of the previous page
+    bool TokenDir(std::vector<CDatabasedTokenData>& tokens, const std::string filter, const size_t count, const std::string& after);
+    bool AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, const std::string& address, const size_t count, const std::string& after);
+    bool TokenAddressDir(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, const std::string& tokenName, const size_t count, const std::string& after);
+
+    // Size and use of the token name filter, false if there is none
+    bool GetNameFilterStats(CTokenNameFilter::Stats& stats) const;
+
+    // The biggest holders of a token, most first, from the -tokenrichindex index
+    bool TopTokenAddresses(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, const std::string& tokenName, const size_t count);
+
+    // Every token, and every token address quantity, as they were when the snapshot was taken
+    bool ForEachToken(const CDBSnapshot& snapshot, std::function<void(const CDatabasedTokenData&)> fn);
+    bool ForEachTokenAddressQuantity(const CDBSnapshot& snapshot, std::function<void(const std::string&, const std::string&, const CAmount&)> fn);
+
+private:
+    //! Whether the number of holders of each token and tokens of each address are kept
+    bool fHolderCounts;
+
+    //! Whether the holders of each token are also kept sorted by quantity
+    bool fRichIndex;
+
+    //! Names of all the tokens in the database, checked before reading one
+    CTokenNameFilter nameFilter;
+    std::atomic<bool> fNameFilter;
+
+    //! Holder and token counts last written, keyed by flag and name. Only used by
+    //! WriteDatabaseChanges, which is called under cs_main
+    CLRUCache<std::string, int> countCache;
+
+    bool BuildHolderCounts();
+    bool BuildNameFilter();
+    bool BuildRichIndex();
+    bool EraseRichIndex();
+    void WriteCountDeltas(CDBBatch& batch, const char flag, const std::map<std::string, int>& mapDelta, std::vector<std::pair<std::string, int> >& vCounts);
+
+    //! Snapshot of the database together with the changes in ptokens that are not flushed to it yet
+    std::unique_ptr<CDBSnapshot> GetSnapshot(std::shared_ptr<const CTokensDBChanges>& changes);
+    size_t GetCount(const CDBSnapshot& snapshot, const char flag, const std::string& name, const std::map<std::string, int>& mapDelta);
+
+    bool TokenDir(std::vector<CDatabasedTokenData>& tokens, const std::string filter, const size_t count, const long start, const std::string* pafter);
+    bool AddressDir(std::vector<std::pair<std::string, CAmount> >& vecTokenAmount, int& totalEntries, const bool fGetTotal, const std::string& address, const size_t count, const long start, const std::string* pafter);
+    bool TokenAddressDir(std::vector<std::pair<std::string, CAmount> >& vecAddressAmount, int& totalEntries, const bool fGetTotal, const std::string& tokenName, const size_t count, const long start, const std::string* pafter);
 };
 
 
@@ -3,7 +3,6 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-#include <regex>
 #include <script/script.h>
 #include <version.h>
 #include <streams.h>
@@ -37,136 +36,209 @@ std::map<std::string, uint256> mapReissuedTokens;
 static const auto MAX_NAME_LENGTH = 31;
 static const auto MAX_CHANNEL_NAME_LENGTH = 12;
 
-// min lengths are expressed by quantifiers
-static const std::regex ROOT_NAME_CHARACTERS("^[A-Z0-9._]{3,}$");
-static const std::regex SUB_NAME_CHARACTERS("^[A-Z0-9._]+$");
-static const std::regex UNIQUE_TAG_CHARACTERS("^[-A-Za-z0-9@$%&*()[\\]{}_.?:]+$");
-static const std::regex CHANNEL_TAG_CHARACTERS("^[A-Z0-9._]+$");
-static const std::regex VOTE_TAG_CHARACTERS("^[A-Z0-9._]+$");
-
-static const std::regex DOUBLE_PUNCTUATION("^.*[._]{2,}.*$");
-static const std::regex LEADING_PUNCTUATION("^[._].*$");
-static const std::regex TRAILING_PUNCTUATION("^.*[._]$");
-
 static const std::string SUB_NAME_DELIMITER = "/";
 static const std::string UNIQUE_TAG_DELIMITER = "#";
 static const std::string CHANNEL_TAG_DELIMITER = "~";
 static const std::string VOTE_TAG_DELIMITER = "^";
 
-static const std::regex UNIQUE_INDICATOR(R"(^[^^~#!]+#[^~#!\/]+$)");
-static const std::regex CHANNEL_INDICATOR(R"(^[^^~#!]+~[^~#!\/]+$)");
-static const std::regex OWNER_INDICATOR(R"(^[^^~#!]+!$)");
-static const std::regex VOTE_INDICATOR(R"(^[^^~#!]+\^[^~#!\/]+$)");
-
-static const std::regex PROTECTED_NAMES("^ALP$|^ALPHACON$|^ALPCOIN$|^ALPHACOIN$|^ALPHACHAIN$");
+static const char* const PROTECTED_NAMES[] = {"ALP", "ALPHACON", "ALPCOIN", "ALPHACOIN", "ALPHACHAIN"};
 
-bool IsRootNameValid(const std::string& name)
+/**
+ * Token names are checked one character at a time over [begin, end) ranges of
+ * the name, so that validating a name never allocates. These give the same
+ * answers as the regular expressions the rules were first written with:
+ *
+ *   root name      ^[A-Z0-9._]{3,}$, not a protected name
+ *   sub name       ^[A-Z0-9._]+$
+ *   channel tag    ^[A-Z0-9._]+$
+ *   vote tag       ^[A-Z0-9._]+$
+ *   unique tag     ^[-A-Za-z0-9@$%&*()[\]{}_.?:]+$
+ *
+ * Root and sub names and channel tags may not start or end with '.' or '_',
+ * nor have two of them in a row.
+ */
+static inline bool IsNameCharacter(char c)
 {
-    return std::regex_match(name, ROOT_NAME_CHARACTERS)
-        && !std::regex_match(name, DOUBLE_PUNCTUATION)
-        && !std::regex_match(name, LEADING_PUNCTUATION)
-        && !std::regex_match(name, TRAILING_PUNCTUATION)
-        && !std::regex_match(name, PROTECTED_NAMES);
+    return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '_';
 }
 
-bool IsSubNameValid(const std::string& name)
+static inline bool IsNamePunctuation(char c)
 {
-    return std::regex_match(name, SUB_NAME_CHARACTERS)
-        && !std::regex_match(name, DOUBLE_PUNCTUATION)
-        && !std::regex_match(name, LEADING_PUNCTUATION)
-        && !std::regex_match(name, TRAILING_PUNCTUATION);
+    return c == '.' || c == '_';
 }
 
-bool IsUniqueTagValid(const std::string& tag)
+static inline bool IsUniqueTagCharacter(char c)
 {
-    return std::regex_match(tag, UNIQUE_TAG_CHARACTERS);
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+        return true;
+
+    switch (c) {
+        case '-': case '@': case '$': case '%': case '&': case '*': case '(': case ')':
+        case '[': case ']': case '{': case '}': case '_': case '.': case '?': case ':':
+            return true;
+        default:
+            return false;
+    }
 }
 
-bool IsVoteTagValid(const std::string& tag)
+static bool IsPunctuatedNameValid(const char* begin, const char* end, size_t nMinLength)
 {
-    return std::regex_match(tag, VOTE_TAG_CHARACTERS);
+    if (begin == end || (size_t)(end - begin) < nMinLength)
+        return false;
+    if (IsNamePunctuation(*begin) || IsNamePunctuation(*(end - 1)))
+        return false;
+
+    bool fPrevPunctuation = false;
+    for (const char* p = begin; p != end; ++p) {
+        if (!IsNameCharacter(*p))
+            return false;
+        bool fPunctuation = IsNamePunctuation(*p);
+        if (fPunctuation && fPrevPunctuation)
+            return false;
+        fPrevPunctuation = fPunctuation;
+    }
+    return true;
 }
 
-bool IsChannelTagValid(const std::string& tag)
+static bool IsProtectedName(const char* begin, const char* end)
 {
-    return std::regex_match(tag, CHANNEL_TAG_CHARACTERS)
-        && !std::regex_match(tag, DOUBLE_PUNCTUATION)
-        && !std::regex_match(tag, LEADING_PUNCTUATION)
-        && !std::regex_match(tag, TRAILING_PUNCTUATION);
+    size_t nSize = end - begin;
+    for (const char* pszProtected : PROTECTED_NAMES) {
+        if (strlen(pszProtected) == nSize && memcmp(pszProtected, begin, nSize) == 0)
+            return true;
+    }
+    return false;
 }
 
-bool IsNameValidBeforeTag(const std::string& name)
+static bool IsRootNameValid(const char* begin, const char* end)
 {
-    std::vector<std::string> parts;
-    boost::split(parts, name, boost::is_any_of(SUB_NAME_DELIMITER));
+    return IsPunctuatedNameValid(begin, end, 3) && !IsProtectedName(begin, end);
+}
 
-    if (!IsRootNameValid(parts.front())) return false;
+static bool IsUniqueTagValid(const char* begin, const char* end)
+{
+    if (begin == end)
+        return false;
+    for (const char* p = begin; p != end; ++p) {
+        if (!IsUniqueTagCharacter(*p))
+            return false;
+    }
+    return true;
+}
 
-    if (parts.size() > 1)
-    {
-        for (unsigned long i = 1; i < parts.size(); i++)
-        {
-            if (!IsSubNameValid(parts[i])) return false;
-        }
+static bool IsVoteTagValid(const char* begin, const char* end)
+{
+    if (begin == end)
+        return false;
+    for (const char* p = begin; p != end; ++p) {
+        if (!IsNameCharacter(*p))
+            return false;
     }
+    return true;
+}
+
+static bool IsNameValidBeforeTag(const char* begin, const char* end)
+{
+    const char* pdelim = std::find(begin, end, SUB_NAME_DELIMITER[0]);
+    if (!IsRootNameValid(begin, pdelim))
+        return false;
 
+    while (pdelim != end) {
+        begin = pdelim + 1;
+        pdelim = std::find(begin, end, SUB_NAME_DELIMITER[0]);
+        if (!IsPunctuatedNameValid(begin, pdelim, 1))
+            return false;
+    }
     return true;
 }
 
-bool IsTokenNameASubtoken(const std::string& name)
+static bool IsTokenNameASubtoken(const char* begin, const char* end)
+{
+    const char* pdelim = std::find(begin, end, SUB_NAME_DELIMITER[0]);
+    return IsRootNameValid(begin, pdelim) && pdelim != end;
+}
+
+/**
+ * Returns the tag delimiter ('#', '~', '^') or owner indicator ('!') that
+ * decides how the name is checked, or 0 for a root or sub token name. The
+ * first of these characters in the name decides; a tagged name needs a
+ * non-empty tag free of '~', '#', '!' and '/', and an owner name has to end
+ * on its '!'.
+ */
+static char GetTokenNameIndicator(const std::string& name)
 {
-    std::vector<std::string> parts;
-    boost::split(parts, name, boost::is_any_of(SUB_NAME_DELIMITER));
+    size_t nPos = name.find_first_of("^~#!");
+    if (nPos == std::string::npos || nPos == 0)
+        return 0;
 
-    if (!IsRootNameValid(parts.front())) return false;
+    char cIndicator = name[nPos];
+    if (cIndicator == '!')
+        return nPos == name.size() - 1 ? cIndicator : 0;
 
-    return parts.size() > 1;
+    if (nPos == name.size() - 1 || name.find_first_of("~#!/", nPos + 1) != std::string::npos)
+        return 0;
+    return cIndicator;
 }
 
-bool IsTokenNameValid(const std::string& name, TokenType& tokenType, std::string& error)
+/** The parts before the first and after the last delimiter, the whole name for both if there is none */
+static void SplitTaggedName(const std::string& name, const std::string& delimiter, const char*& pNameEnd, const char*& pTagBegin)
 {
-    tokenType = TokenType::INVALID;
-    if (std::regex_match(name, UNIQUE_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(TokenType::UNIQUE, name, error);
-        if (ret)
-            tokenType = TokenType::UNIQUE;
+    const char* begin = name.data();
+    size_t nFirst = name.find(delimiter);
+    size_t nLast = name.rfind(delimiter);
+    pNameEnd = nFirst == std::string::npos ? begin + name.size() : begin + nFirst;
+    pTagBegin = nLast == std::string::npos ? begin : begin + nLast + 1;
+}
 
-        return ret;
-    }
-    else if (std::regex_match(name, CHANNEL_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(TokenType::MSGCHANNEL, name, error);
-        if (ret)
-            tokenType = TokenType::MSGCHANNEL;
+bool IsRootNameValid(const std::string& name)
+{
+    return IsRootNameValid(name.data(), name.data() + name.size());
+}
 
-        return ret;
-    }
-    else if (std::regex_match(name, OWNER_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(TokenType::OWNER, name, error);
-        if (ret)
-            tokenType = TokenType::OWNER;
+bool IsSubNameValid(const std::string& name)
+{
+    return IsPunctuatedNameValid(name.data(), name.data() + name.size(), 1);
+}
 
-        return ret;
-    }
-    else if (std::regex_match(name, VOTE_INDICATOR))
-    {
-        bool ret = IsTypeCheckNameValid(TokenType::VOTE, name, error);
-        if (ret)
-            tokenType = TokenType::VOTE;
+bool IsUniqueTagValid(const std::string& tag)
+{
+    return IsUniqueTagValid(tag.data(), tag.data() + tag.size());
+}
 
-        return ret;
-    }
-    else
-    {
-        auto type = IsTokenNameASubtoken(name) ? TokenType::SUB : TokenType::ROOT;
-        bool ret = IsTypeCheckNameValid(type, name, error);
-        if (ret)
-            tokenType = type;
+bool IsVoteTagValid(const std::string& tag)
+{
+    return IsVoteTagValid(tag.data(), tag.data() + tag.size());
+}
+
+bool IsChannelTagValid(const std::string& tag)
+{
+    return IsPunctuatedNameValid(tag.data(), tag.data() + tag.size(), 1);
+}
+
+bool IsNameValidBeforeTag(const std::string& name)
+{
+    return IsNameValidBeforeTag(name.data(), name.data() + name.size());
+}
+
+bool IsTokenNameASubtoken(const std::string& name)
+{
+    return IsTokenNameASubtoken(name.data(), name.data() + name.size());
+}
 
-        return ret;
+bool IsTokenNameValid(const std::string& name, TokenType& tokenType, std::string& error)
+{
+    TokenType type;
+    switch (GetTokenNameIndicator(name)) {
+        case '#': type = TokenType::UNIQUE; break;
+        case '~': type = TokenType::MSGCHANNEL; break;
+        case '!': type = TokenType::OWNER; break;
+        case '^': type = TokenType::VOTE; break;
+        default: type = IsTokenNameASubtoken(name) ? TokenType::SUB : TokenType::ROOT;
     }
+
+    bool ret = IsTypeCheckNameValid(type, name, error);
+    tokenType = ret ? type : TokenType::INVALID;
+    return ret;
 }
 
 bool IsTokenNameValid(const std::string& name)
@@ -184,44 +256,47 @@ bool IsTokenNameValid(const std::string& name, TokenType& tokenType)
 
 bool IsTokenNameAnOwner(const std::string& name)
 {
-    return IsTokenNameValid(name) && std::regex_match(name, OWNER_INDICATOR);
+    return IsTokenNameValid(name) && GetTokenNameIndicator(name) == '!';
 }
 
 // TODO get the string translated below
 bool IsTypeCheckNameValid(const TokenType type, const std::string& name, std::string& error)
 {
+    const char* pNameBegin = name.data();
+    const char* pNameEnd;
+    const char* pTagBegin;
+    const char* pTagEnd = name.data() + name.size();
+
     if (type == TokenType::UNIQUE) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        std::vector<std::string> parts;
-        boost::split(parts, name, boost::is_any_of(UNIQUE_TAG_DELIMITER));
-        bool valid = IsNameValidBeforeTag(parts.front()) && IsUniqueTagValid(parts.back());
+        SplitTaggedName(name, UNIQUE_TAG_DELIMITER, pNameEnd, pTagBegin);
+        bool valid = IsNameValidBeforeTag(pNameBegin, pNameEnd) && IsUniqueTagValid(pTagBegin, pTagEnd);
         if (!valid) { error = "Unique name contains invalid characters (Valid characters are: A-Z a-z 0-9 @ $ % & * ( ) [ ] { } _ . ? : -)";  return false; }
         return true;
     } else if (type == TokenType::MSGCHANNEL) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        std::vector<std::string> parts;
-        boost::split(parts, name, boost::is_any_of(CHANNEL_TAG_DELIMITER));
-        bool valid = IsNameValidBeforeTag(parts.front()) && IsChannelTagValid(parts.back());
-        if (parts.back().size() > MAX_CHANNEL_NAME_LENGTH) { error = "Channel name is greater than max length of " + std::to_string(MAX_CHANNEL_NAME_LENGTH); return false; }
+        SplitTaggedName(name, CHANNEL_TAG_DELIMITER, pNameEnd, pTagBegin);
+        bool valid = IsNameValidBeforeTag(pNameBegin, pNameEnd) && IsPunctuatedNameValid(pTagBegin, pTagEnd, 1);
+        if (pTagEnd - pTagBegin > MAX_CHANNEL_NAME_LENGTH) { error = "Channel name is greater than max length of " + std::to_string(MAX_CHANNEL_NAME_LENGTH); return false; }
         if (!valid) { error = "Message Channel name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
         return true;
     } else if (type == TokenType::OWNER) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        bool valid = IsNameValidBeforeTag(name.substr(0, name.size() - 1));
+        bool valid = IsNameValidBeforeTag(pNameBegin, name.empty() ? pTagEnd : pTagEnd - 1);
         if (!valid) { error = "Owner name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
         return true;
     } else if (type == TokenType::VOTE) {
         if (name.size() > MAX_NAME_LENGTH) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH); return false; }
-        std::vector<std::string> parts;
-        boost::split(parts, name, boost::is_any_of(VOTE_TAG_DELIMITER));
-        bool valid = IsNameValidBeforeTag(parts.front()) && IsVoteTagValid(parts.back());
+        SplitTaggedName(name, VOTE_TAG_DELIMITER, pNameEnd, pTagBegin);
+        bool valid = IsNameValidBeforeTag(pNameBegin, pNameEnd) && IsVoteTagValid(pTagBegin, pTagEnd);
         if (!valid) { error = "Vote name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
         return true;
     } else {
         if (name.size() > MAX_NAME_LENGTH - 1) { error = "Name is greater than max length of " + std::to_string(MAX_NAME_LENGTH - 1); return false; }  //Tokens and sub-tokens need to leave one extra char for OWNER indicator
-        if (!IsTokenNameASubtoken(name) && name.size() < MIN_TOKEN_LENGTH) { error = "Name must be contain " + std::to_string(MIN_TOKEN_LENGTH) + " characters"; return false; }
-        bool valid = IsNameValidBeforeTag(name);
-        if (!valid && IsTokenNameASubtoken(name) && name.size() < 3) { error = "Name must have at least 3 characters (Valid characters are: A-Z 0-9 _ .)";  return false; }
+        bool fSubtoken = IsTokenNameASubtoken(pNameBegin, pTagEnd);
+        if (!fSubtoken && name.size() < MIN_TOKEN_LENGTH) { error = "Name must be contain " + std::to_string(MIN_TOKEN_LENGTH) + " characters"; return false; }
+        bool valid = IsNameValidBeforeTag(pNameBegin, pTagEnd);
+        if (!valid && fSubtoken && name.size() < 3) { error = "Name must have at least 3 characters (Valid characters are: A-Z 0-9 _ .)";  return false; }
         if (!valid) { error = "Name contains invalid characters (Valid characters are: A-Z 0-9 _ .) (special characters can't be the first or last characters)";  return false; }
         return true;
     }
@@ -460,10 +535,8 @@ bool TokenFromTransaction(const CTransaction& tx, CNewToken& token, std::string&
     if (!tx.IsNewToken())
         return false;
 
-    // Get the scriptPubKey from the last tx in vout
-    CScript scriptPubKey = tx.vout[tx.vout.size() - 1].scriptPubKey;
-
-    return TokenFromScript(scriptPubKey, token, strAddress);
+    // The token data is in the last tx in vout
+    return TokenFromTransaction(tx, tx.vout.size() - 1, token, strAddress);
 }
 
 bool ReissueTokenFromTransaction(const CTransaction& tx, CReissueToken& reissue, std::string& strAddress)
@@ -472,10 +545,8 @@ bool ReissueTokenFromTransaction(const CTransaction& tx, CReissueToken& reissue,
     if (!tx.IsReissueToken())
         return false;
 
-    // Get the scriptPubKey from the last tx in vout
-    CScript scriptPubKey = tx.vout[tx.vout.size() - 1].scriptPubKey;
-
-    return ReissueTokenFromScript(scriptPubKey, reissue, strAddress);
+    // The reissue data is in the last tx in vout
+    return ReissueTokenFromTransaction(tx, tx.vout.size() - 1, reissue, strAddress);
 }
 
 bool UniqueTokenFromTransaction(const CTransaction& tx, CNewToken& token, std::string& strAddress)
@@ -484,10 +555,8 @@ bool UniqueTokenFromTransaction(const CTransaction& tx, CNewToken& token, std::s
     if (!tx.IsNewUniqueToken())
         return false;
 
-    // Get the scriptPubKey from the last tx in vout
-    CScript scriptPubKey = tx.vout[tx.vout.size() - 1].scriptPubKey;
-
-    return TokenFromScript(scriptPubKey, token, strAddress);
+    // The token data is in the last tx in vout
+    return TokenFromTransaction(tx, tx.vout.size() - 1, token, strAddress);
 }
 
 bool IsNewOwnerTxValid(const CTransaction& tx, const std::string& tokenName, const std::string& address, std::string& errorMsg)
@@ -526,10 +595,8 @@ bool OwnerFromTransaction(const CTransaction& tx, std::string& ownerName, std::s
     if (!tx.IsNewToken())
         return false;
 
-    // Get the scriptPubKey from the last tx in vout
-    CScript scriptPubKey = tx.vout[tx.vout.size() - 2].scriptPubKey;
-
-    return OwnerTokenFromScript(scriptPubKey, ownerName, strAddress);
+    // The owner data is in the second to last tx in vout
+    return OwnerFromTransaction(tx, tx.vout.size() - 2, ownerName, strAddress);
 }
 
 bool TransferTokenFromScript(const CScript& scriptPubKey, CTokenTransfer& tokenTransfer, std::string& strAddress)
@@ -632,6 +699,114 @@ bool ReissueTokenFromScript(const CScript& scriptPubKey, CReissueToken& reissue,
     return true;
 }
 
+static bool ReadTokenOutput(const CScript& scriptPubKey, CTxTokenOutput& output)
+{
+    int nType = 0;
+    bool fIsOwner = false;
+    if (!scriptPubKey.IsTokenScript(nType, fIsOwner))
+        return false;
+
+    output.type = txnouttype(nType);
+    output.fIsOwner = fIsOwner;
+    if (output.type == TX_NEW_TOKEN && !fIsOwner)
+        output.fValid = TokenFromScript(scriptPubKey, output.token, output.strAddress);
+    else if (output.type == TX_NEW_TOKEN)
+        output.fValid = OwnerTokenFromScript(scriptPubKey, output.ownerName, output.strAddress);
+    else if (output.type == TX_TRANSFER_TOKEN)
+        output.fValid = TransferTokenFromScript(scriptPubKey, output.transfer, output.strAddress);
+    else if (output.type == TX_REISSUE_TOKEN)
+        output.fValid = ReissueTokenFromScript(scriptPubKey, output.reissue, output.strAddress);
+
+    return true;
+}
+
+const CTxTokenOutputs& CTransaction::GetTokenOutputs() const
+{
+    std::shared_ptr<const CTxTokenOutputs> outputs = std::atomic_load(&tokenOutputs);
+    if (outputs)
+        return *outputs;
+
+    std::shared_ptr<CTxTokenOutputs> read = std::make_shared<CTxTokenOutputs>();
+    for (size_t i = 0; i < vout.size(); i++) {
+        CTxTokenOutput output;
+        if (ReadTokenOutput(vout[i].scriptPubKey, output))
+            read->vOutputs.emplace_back(i, std::move(output));
+    }
+    read->vOutputs.shrink_to_fit();
+
+    // If another thread got here first, use what it stored so that references stay valid
+    std::shared_ptr<const CTxTokenOutputs> expected;
+    outputs = read;
+    if (!std::atomic_compare_exchange_strong(&tokenOutputs, &expected, outputs))
+        outputs = expected;
+    return *outputs;
+}
+
+size_t CTransaction::TokenOutputsDynamicUsage() const
+{
+    const CTxTokenOutputs& outputs = GetTokenOutputs();
+    return memusage::DynamicUsage(std::atomic_load(&tokenOutputs)) + outputs.DynamicMemoryUsage();
+}
+
+// These give the same results as calling the *FromScript functions on tx.vout[nOut],
+// including what is left in the out parameters when the payload can't be read
+bool TokenFromTransaction(const CTransaction& tx, size_t nOut, CNewToken& token, std::string& strAddress)
+{
+    const CTxTokenOutput* output = tx.GetTokenOutputs().Get(nOut);
+    if (!output || output->type != TX_NEW_TOKEN || output->fIsOwner)
+        return false;
+
+    token = output->token;
+    strAddress = output->strAddress;
+    return output->fValid;
+}
+
+bool OwnerFromTransaction(const CTransaction& tx, size_t nOut, std::string& ownerName, std::string& strAddress)
+{
+    const CTxTokenOutput* output = tx.GetTokenOutputs().Get(nOut);
+    if (!output || output->type != TX_NEW_TOKEN || !output->fIsOwner)
+        return false;
+
+    ownerName = output->ownerName;
+    strAddress = output->strAddress;
+    return output->fValid;
+}
+
+bool TransferTokenFromTransaction(const CTransaction& tx, size_t nOut, CTokenTransfer& transfer, std::string& strAddress)
+{
+    const CTxTokenOutput* output = tx.GetTokenOutputs().Get(nOut);
+    if (!output || output->type != TX_TRANSFER_TOKEN)
+        return false;
+
+    transfer = output->transfer;
+    strAddress = output->strAddress;
+    return output->fValid;
+}
+
+bool ReissueTokenFromTransaction(const CTransaction& tx, size_t nOut, CReissueToken& reissue, std::string& strAddress)
+{
+    const CTxTokenOutput* output = tx.GetTokenOutputs().Get(nOut);
+    if (!output || output->type != TX_REISSUE_TOKEN)
+        return false;
+
+    reissue = output->reissue;
+    strAddress = output->strAddress;
+    return output->fValid;
+}
+
+bool IsNewUniqueTokenOutput(const CTransaction& tx, size_t nOut)
+{
+    const CTxTokenOutput* output = tx.GetTokenOutputs().Get(nOut);
+    if (!output || output->type != TX_NEW_TOKEN || output->fIsOwner || !output->fValid)
+        return false;
+
+    TokenType tokenType;
+    if (!IsTokenNameValid(output->token.strName, tokenType))
+        return false;
+
+    return TokenType::UNIQUE == tokenType;
+}
+
 //! Call VerifyNewToken if this function returns true
 bool CTransaction::IsNewToken() const
 {
@@ -644,7 +819,7 @@ bool CTransaction::IsNewToken() const
         return false;
 
     // Don't overlap with IsNewUniqueToken()
-    if (IsScriptNewUniqueToken(vout[vout.size() - 1].scriptPubKey))
+    if (IsNewUniqueTokenOutput(*this, vout.size() - 1))
         return false;
 
     return true;
@@ -674,7 +849,7 @@ bool CTransaction::VerifyNewToken(std::string& strError) const
     // Get the token type
     CNewToken token;
     std::string address;
-    if (!TokenFromScript(vout[vout.size() - 1].scriptPubKey, token, address)) {
+    if (!TokenFromTransaction(*this, vout.size() - 1, token, address)) {
         strError = "bad-txns-issue-serialzation-failed";
         return error("%s : Failed to get new token from transaction: %s", __func__, this->GetHash().GetHex());
     }
@@ -683,7 +858,7 @@ bool CTransaction::VerifyNewToken(std::string& strError) const
     IsTokenNameValid(token.strName, tokenType);
 
     std::string strOwnerName;
-    if (!OwnerTokenFromScript(vout[vout.size() - 2].scriptPubKey, strOwnerName, address)) {
+    if (!OwnerFromTransaction(*this, vout.size() - 2, strOwnerName, address)) {
         strError = "bad-txns-issue-owner-serialzation-failed";
         return false;
     }
@@ -729,7 +904,7 @@ bool CTransaction::IsNewUniqueToken() const
     if (!CheckIssueDataTx(vout[vout.size() - 1]))
         return false;
 
-    if (!IsScriptNewUniqueToken(vout[vout.size() - 1].scriptPubKey))
+    if (!IsNewUniqueTokenOutput(*this, vout.size() - 1))
         return false;
 
     return true;
@@ -749,11 +924,11 @@ bool CTransaction::VerifyNewUniqueToken(std::string& strError) const
     std::string tokenRoot = "";
     int tokenOutpointCount = 0;
 
-    for (auto out : vout) {
-        if (IsScriptNewUniqueToken(out.scriptPubKey)) {
+    for (size_t i = 0; i < vout.size(); i++) {
+        if (IsNewUniqueTokenOutput(*this, i)) {
             CNewToken token;
             std::string address;
-            if (!TokenFromScript(out.scriptPubKey, token, address)) {
+            if (!TokenFromTransaction(*this, i, token, address)) {
                 strError = "bad-txns-issue-unique-token-from-script";
                 return false;
             }
@@ -797,10 +972,10 @@ bool CTransaction::VerifyNewUniqueToken(std::string& strError) const
 
     // check for owner change outpoint that matches root
     bool fOwnerOutFound = false;
-    for (auto out : vout) {
+    for (size_t i = 0; i < vout.size(); i++) {
         CTokenTransfer transfer;
         std::string transferAddress;
-        if (TransferTokenFromScript(out.scriptPubKey, transfer, transferAddress)) {
+        if (TransferTokenFromTransaction(*this, i, transfer, transferAddress)) {
             if (tokenRoot + OWNER_TAG == transfer.strName) {
                 fOwnerOutFound = true;
                 break;
@@ -854,17 +1029,17 @@ bool CTransaction::VerifyReissueToken(std::string& strError) const
 
     CReissueToken reissue;
     std::string address;
-    if (!ReissueTokenFromScript(vout[vout.size() - 1].scriptPubKey, reissue, address)) {
+    if (!ReissueTokenFromTransaction(*this, vout.size() - 1, reissue, address)) {
         strError  = "bad-txns-reissue-serialization-failed";
         return false;
     }
 
     // Check that there is an token transfer, this will be the owner token change
     bool fOwnerOutFound = false;
-    for (auto out : vout) {
+    for (size_t i = 0; i < vout.size(); i++) {
         CTokenTransfer transfer;
         std::string transferAddress;
-        if (TransferTokenFromScript(out.scriptPubKey, transfer, transferAddress)) {
+        if (TransferTokenFromTransaction(*this, i, transfer, transferAddress)) {
             if (reissue.strName + OWNER_TAG == transfer.strName) {
                 fOwnerOutFound = true;
                 break;
@@ -1251,8 +1426,12 @@ bool CTokensCache::RemoveNewToken(const CNewToken& token, const std::string addr
 
     setNewTokensToRemove.insert(newToken);
 
-    if (fTokenIndex)
-        mapTokensAddressAmount[std::make_pair(token.strName, address)] = 0;
+    if (fTokenIndex) {
+        auto pair = std::make_pair(token.strName, address);
+        if (!GetBestTokenAddressAmount(*this, token.strName, address))
+            mapTokensAddressAmount.insert(std::make_pair(pair, 0));
+        mapTokensAddressAmount.at(pair) = 0;
+    }
 
     return true;
 }
@@ -1272,7 +1451,10 @@ bool CTokensCache::AddNewToken(const CNewToken& token, const std::string address
 
     if (fTokenIndex) {
         // Insert the token into the assests address amount map
-        mapTokensAddressAmount[std::make_pair(token.strName, address)] = token.nAmount;
+        auto pair = std::make_pair(token.strName, address);
+        if (!GetBestTokenAddressAmount(*this, token.strName, address))
+            mapTokensAddressAmount.insert(std::make_pair(pair, 0));
+        mapTokensAddressAmount.at(pair) = token.nAmount;
     }
 
     return true;
@@ -1399,7 +1581,10 @@ bool CTokensCache::AddOwnerToken(const std::string& tokensName, const std::strin
 
     if (fTokenIndex) {
         // Insert the token into the assests address amount map
-        mapTokensAddressAmount[std::make_pair(tokensName, address)] = OWNER_TOKEN_AMOUNT;
+        auto pair = std::make_pair(tokensName, address);
+        if (!GetBestTokenAddressAmount(*this, tokensName, address))
+            mapTokensAddressAmount.insert(std::make_pair(pair, 0));
+        mapTokensAddressAmount.at(pair) = OWNER_TOKEN_AMOUNT;
     }
 
     return true;
@@ -1417,7 +1602,9 @@ bool CTokensCache::RemoveOwnerToken(const std::string& tokensName, const std::st
 
     if (fTokenIndex) {
         auto pair = std::make_pair(tokensName, address);
-        mapTokensAddressAmount[pair] = 0;
+        if (!GetBestTokenAddressAmount(*this, tokensName, address))
+            mapTokensAddressAmount.insert(std::make_pair(pair, 0));
+        mapTokensAddressAmount.at(pair) = 0;
     }
 
     return true;
@@ -1438,339 +1625,158 @@ bool CTokensCache::RemoveTransfer(const CTokenTransfer &transfer, const std::str
     return true;
 }
 
-bool CTokensCache::DumpCacheToDatabase()
+bool CTokensCache::DumpCacheToDatabase(bool fSync)
 {
     try {
-        bool dirty = false;
-        std::string message;
-
-        // Remove new tokens from the database
-        for (auto newToken : setNewTokensToRemove) {
-            ptokensCache->Erase(newToken.token.strName);
-            if (!ptokensdb->EraseTokenData(newToken.token.strName)) {
-                dirty = true;
-                message = "_Failed Erasing New Token Data from database";
-            }
+        int64_t nTimeStart = GetTimeMicros();
 
-            if (dirty) {
-                return error("%s : %s", __func__, message);
-            }
-
-            if (fTokenIndex) {
-                if (!ptokensdb->EraseTokenAddressQuantity(newToken.token.strName, newToken.address)) {
-                    dirty = true;
-                    message = "_Failed Erasing Address Balance from database";
-                }
+        CTokensDBChanges changes;
+        GetDatabaseChanges(changes);
 
-                if (!ptokensdb->EraseAddressTokenQuantity(newToken.address, newToken.token.strName)) {
-                    dirty = true;
-                    message = "_Failed Erasing New Token Address Balance from AddressToken database";
-                }
-            }
+        // Readers take the shared changes and a database snapshot together under cs_changes
+        LOCK(cs_changes);
+        size_t nBatchSize = 0;
+        if (!ptokensdb->WriteDatabaseChanges(changes, fSync, nBatchSize))
+            return error("%s : %s", __func__, "_Failed Writing the token cache to database");
 
-            if (dirty) {
-                return error("%s : %s", __func__, message);
-            }
+        // Keep the tokens that were just written in the token data cache
+        for (const auto& item : changes.mapTokenData) {
+            if (item.second.token.IsNull())
+                ptokensCache->Erase(item.first);
+            else
+                ptokensCache->Put(item.first, item.second);
         }
 
-        // Add the new tokens to the database
-        for (auto newToken : setNewTokensToAdd) {
-            ptokensCache->Put(newToken.token.strName, CDatabasedTokenData(newToken.token, newToken.blockHeight, newToken.blockHash));
-            if (!ptokensdb->WriteTokenData(newToken.token, newToken.blockHeight, newToken.blockHash)) {
-                dirty = true;
-                message = "_Failed Writing New Token Data to database";
-            }
-
-            if (dirty) {
-                return error("%s : %s", __func__, message);
-            }
+        LogPrint(BCLog::BENCH, "%s: wrote %u tokens and %u address quantities (%.2fkB) in %.2fms\n", __func__,
+                 changes.mapTokenData.size(), changes.mapTokenAddressQuantity.size(), nBatchSize * (1.0 / 1024),
+                 (GetTimeMicros() - nTimeStart) * 0.001);
 
-            if (fTokenIndex) {
-                if (!ptokensdb->WriteTokenAddressQuantity(newToken.token.strName, newToken.address,
-                                                          newToken.token.nAmount)) {
-                    dirty = true;
-                    message = "_Failed Writing Address Balance to database";
-                }
+        ClearDirtyCache();
 
-                if (!ptokensdb->WriteAddressTokenQuantity(newToken.address, newToken.token.strName,
-                                                          newToken.token.nAmount)) {
-                    dirty = true;
-                    message = "_Failed Writing Address Balance to database";
-                }
-            }
+        return true;
+    } catch (const std::runtime_error& e) {
+        return error("%s : %s ", __func__, std::string("System error while flushing tokens: ") + e.what());
+    }
+}
 
-            if (dirty) {
-                return error("%s : %s", __func__, message);
-            }
+std::shared_ptr<const CTokensDBChanges> CTokensCache::GetDatabaseChanges(const CDBWrapper& db, std::unique_ptr<CDBSnapshot>& snapshot)
+{
+    {
+        LOCK(cs_changes);
+        if (pchanges) {
+            snapshot.reset(new CDBSnapshot(db));
+            return pchanges;
         }
+    }
 
-        if (fTokenIndex) {
-            // Remove the new owners from database
-            for (auto ownerToken : setNewOwnerTokensToRemove) {
-                if (!ptokensdb->EraseTokenAddressQuantity(ownerToken.tokenName, ownerToken.address)) {
-                    dirty = true;
-                    message = "_Failed Erasing Owner Address Balance from database";
-                }
-
-                if (!ptokensdb->EraseAddressTokenQuantity(ownerToken.address, ownerToken.tokenName)) {
-                    dirty = true;
-                    message = "_Failed Erasing New Owner Address Balance from AddressToken database";
-                }
-
-                if (dirty) {
-                    return error("%s : %s", __func__, message);
-                }
-            }
-
-            // Add the new owners to database
-            for (auto ownerToken : setNewOwnerTokensToAdd) {
-                auto pair = std::make_pair(ownerToken.tokenName, ownerToken.address);
-                if (mapTokensAddressAmount.count(pair) && mapTokensAddressAmount.at(pair) > 0) {
-                    if (!ptokensdb->WriteTokenAddressQuantity(ownerToken.tokenName, ownerToken.address,
-                                                              mapTokensAddressAmount.at(pair))) {
-                        dirty = true;
-                        message = "_Failed Writing Owner Address Balance to database";
-                    }
-
-                    if (!ptokensdb->WriteAddressTokenQuantity(ownerToken.address, ownerToken.tokenName,
-                                                              mapTokensAddressAmount.at(pair))) {
-                        dirty = true;
-                        message = "_Failed Writing Address Balance to database";
-                    }
-
-                    if (dirty) {
-                        return error("%s : %s", __func__, message);
-                    }
-                }
-            }
+    // The dirty entries only change under cs_main
+    LOCK2(cs_main, cs_changes);
+    if (!pchanges) {
+        std::shared_ptr<CTokensDBChanges> changes = std::make_shared<CTokensDBChanges>();
+        GetDatabaseChanges(*changes);
+        pchanges = changes;
+    }
+    snapshot.reset(new CDBSnapshot(db));
+    return pchanges;
+}
 
-            // Undo the transfering by updating the balances in the database
-
-            for (auto undoTransfer : setNewTransferTokensToRemove) {
-                auto pair = std::make_pair(undoTransfer.transfer.strName, undoTransfer.address);
-                if (mapTokensAddressAmount.count(pair)) {
-                    if (mapTokensAddressAmount.at(pair) == 0) {
-                        if (!ptokensdb->EraseTokenAddressQuantity(undoTransfer.transfer.strName,
-                                                                  undoTransfer.address)) {
-                            dirty = true;
-                            message = "_Failed Erasing Address Quantity from database";
-                        }
-
-                        if (!ptokensdb->EraseAddressTokenQuantity(undoTransfer.address,
-                                                                  undoTransfer.transfer.strName)) {
-                            dirty = true;
-                            message = "_Failed Erasing UndoTransfer Address Balance from AddressToken database";
-                        }
-
-                        if (dirty) {
-                            return error("%s : %s", __func__, message);
-                        }
-                    } else {
-                        if (!ptokensdb->WriteTokenAddressQuantity(undoTransfer.transfer.strName,
-                                                                  undoTransfer.address,
-                                                                  mapTokensAddressAmount.at(pair))) {
-                            dirty = true;
-                            message = "_Failed Writing updated Address Quantity to database when undoing transfers";
-                        }
-
-                        if (!ptokensdb->WriteAddressTokenQuantity(undoTransfer.address,
-                                                                  undoTransfer.transfer.strName,
-                                                                  mapTokensAddressAmount.at(pair))) {
-                            dirty = true;
-                            message = "_Failed Writing Address Balance to database";
-                        }
-
-                        if (dirty) {
-                            return error("%s : %s", __func__, message);
-                        }
-                    }
-                }
-            }
+void CTokensCache::GetDatabaseChanges(CTokensDBChanges& changes) const
+{
+    // Later changes to an entry replace earlier ones, so the order matters here
+    auto setQuantity = [&changes](const std::string& tokenName, const std::string& address, const CAmount& quantity) {
+        changes.mapTokenAddressQuantity[std::make_pair(tokenName, address)] = quantity;
+    };
 
+    for (auto newToken : setNewTokensToRemove) {
+        changes.mapTokenData[newToken.token.strName] = CDatabasedTokenData();
+        if (fTokenIndex)
+            setQuantity(newToken.token.strName, newToken.address, 0);
+    }
 
-            // Save the new transfers by updating the quantity in the database
-            for (auto newTransfer : setNewTransferTokensToAdd) {
-                auto pair = std::make_pair(newTransfer.transfer.strName, newTransfer.address);
-                // During init and reindex it disconnects and verifies blocks, can create a state where vNewTransfer will contain transfers that have already been spent. So if they aren't in the map, we can skip them.
-                if (mapTokensAddressAmount.count(pair)) {
-                    if (!ptokensdb->WriteTokenAddressQuantity(newTransfer.transfer.strName, newTransfer.address,
-                                                              mapTokensAddressAmount.at(pair))) {
-                        dirty = true;
-                        message = "_Failed Writing new address quantity to database";
-                    }
+    for (auto newToken : setNewTokensToAdd) {
+        changes.mapTokenData[newToken.token.strName] = CDatabasedTokenData(newToken.token, newToken.blockHeight, newToken.blockHash);
+        if (fTokenIndex)
+            setQuantity(newToken.token.strName, newToken.address, newToken.token.nAmount);
+    }
 
-                    if (!ptokensdb->WriteAddressTokenQuantity(newTransfer.address, newTransfer.transfer.strName,
-                                                              mapTokensAddressAmount.at(pair))) {
-                        dirty = true;
-                        message = "_Failed Writing Address Balance to database";
-                    }
+    if (fTokenIndex) {
+        for (auto ownerToken : setNewOwnerTokensToRemove)
+            setQuantity(ownerToken.tokenName, ownerToken.address, 0);
 
-                    if (dirty) {
-                        return error("%s : %s", __func__, message);
-                    }
-                }
-            }
+        for (auto ownerToken : setNewOwnerTokensToAdd) {
+            auto pair = std::make_pair(ownerToken.tokenName, ownerToken.address);
+            if (mapTokensAddressAmount.count(pair) && mapTokensAddressAmount.at(pair) > 0)
+                setQuantity(pair.first, pair.second, mapTokensAddressAmount.at(pair));
         }
 
-        for (auto newReissue : setNewReissueToAdd) {
-            auto reissue_name = newReissue.reissue.strName;
-            auto pair = make_pair(reissue_name, newReissue.address);
-            if (mapReissuedTokenData.count(reissue_name)) {
-                if(!ptokensdb->WriteTokenData(mapReissuedTokenData.at(reissue_name), newReissue.blockHeight, newReissue.blockHash)) {
-                    dirty = true;
-                    message = "_Failed Writing reissue token data to database";
-                }
-
-                if (dirty) {
-                    return error("%s : %s", __func__, message);
-                }
-
-                ptokensCache->Erase(reissue_name);
-
-                if (fTokenIndex) {
-                    if (mapTokensAddressAmount.count(pair) && mapTokensAddressAmount.at(pair) > 0) {
-                        if (!ptokensdb->WriteTokenAddressQuantity(pair.first, pair.second,
-                                                                  mapTokensAddressAmount.at(pair))) {
-                            dirty = true;
-                            message = "_Failed Writing reissue token quantity to the address quantity database";
-                        }
-
-                        if (!ptokensdb->WriteAddressTokenQuantity(pair.second, pair.first,
-                                                                  mapTokensAddressAmount.at(pair))) {
-                            dirty = true;
-                            message = "_Failed Writing Address Balance to database";
-                        }
-
-                        if (dirty) {
-                            return error("%s, %s", __func__, message);
-                        }
-                    }
-                }
-            }
+        for (auto undoTransfer : setNewTransferTokensToRemove) {
+            auto pair = std::make_pair(undoTransfer.transfer.strName, undoTransfer.address);
+            if (mapTokensAddressAmount.count(pair))
+                setQuantity(pair.first, pair.second, mapTokensAddressAmount.at(pair));
         }
 
-        for (auto undoReissue : setNewReissueToRemove) {
-            // In the case the the issue and reissue are both being removed
-            // we can skip this call because the removal of the issue should remove all data pertaining the to token
-            // Fixes the issue where the reissue data will write over the removed token meta data that was removed above
-            CNewToken token(undoReissue.reissue.strName, 0);
-            CTokenCacheNewToken testNewTokenCache(token, "", 0 , uint256());
-            if (setNewTokensToRemove.count(testNewTokenCache)) {
-                continue;
-            }
-
-            auto reissue_name = undoReissue.reissue.strName;
-            if (mapReissuedTokenData.count(reissue_name)) {
-                if(!ptokensdb->WriteTokenData(mapReissuedTokenData.at(reissue_name), undoReissue.blockHeight, undoReissue.blockHash)) {
-                    dirty = true;
-                    message = "_Failed Writing undo reissue token data to database";
-                }
+        for (auto newTransfer : setNewTransferTokensToAdd) {
+            auto pair = std::make_pair(newTransfer.transfer.strName, newTransfer.address);
+            if (mapTokensAddressAmount.count(pair))
+                setQuantity(pair.first, pair.second, mapTokensAddressAmount.at(pair));
+        }
+    }
 
-                if (fTokenIndex) {
-                    auto pair = make_pair(undoReissue.reissue.strName, undoReissue.address);
-                    if (mapTokensAddressAmount.count(pair)) {
-                        if (mapTokensAddressAmount.at(pair) == 0) {
-                            if (!ptokensdb->EraseTokenAddressQuantity(reissue_name, undoReissue.address)) {
-                                dirty = true;
-                                message = "_Failed Erasing Address Balance from database";
-                            }
-
-                            if (!ptokensdb->EraseAddressTokenQuantity(undoReissue.address, reissue_name)) {
-                                dirty = true;
-                                message = "_Failed Erasing UndoReissue Balance from AddressToken database";
-                            }
-                        } else {
-                            if (!ptokensdb->WriteTokenAddressQuantity(reissue_name, undoReissue.address,
-                                                                      mapTokensAddressAmount.at(pair))) {
-                                dirty = true;
-                                message = "_Failed Writing the undo of reissue of token from database";
-                            }
-
-                            if (!ptokensdb->WriteAddressTokenQuantity(undoReissue.address, reissue_name,
-                                                                      mapTokensAddressAmount.at(pair))) {
-                                dirty = true;
-                                message = "_Failed Writing Address Balance to database";
-                            }
-                        }
-                    }
-                }
+    for (auto newReissue : setNewReissueToAdd) {
+        auto reissue_name = newReissue.reissue.strName;
+        auto pair = make_pair(reissue_name, newReissue.address);
+        if (mapReissuedTokenData.count(reissue_name)) {
+            changes.mapTokenData[reissue_name] = CDatabasedTokenData(mapReissuedTokenData.at(reissue_name), newReissue.blockHeight, newReissue.blockHash);
+            if (fTokenIndex && mapTokensAddressAmount.count(pair) && mapTokensAddressAmount.at(pair) > 0)
+                setQuantity(pair.first, pair.second, mapTokensAddressAmount.at(pair));
+        }
+    }
 
-                if (dirty) {
-                    return error("%s : %s", __func__, message);
-                }
+    for (auto undoReissue : setNewReissueToRemove) {
+        CNewToken token(undoReissue.reissue.strName, 0);
+        CTokenCacheNewToken testNewTokenCache(token, "", 0 , uint256());
+        if (setNewTokensToRemove.count(testNewTokenCache)) {
+            continue;
+        }
 
-                ptokensCache->Erase(reissue_name);
-            }
+        auto reissue_name = undoReissue.reissue.strName;
+        if (mapReissuedTokenData.count(reissue_name)) {
+            changes.mapTokenData[reissue_name] = CDatabasedTokenData(mapReissuedTokenData.at(reissue_name), undoReissue.blockHeight, undoReissue.blockHash);
+            auto pair = make_pair(reissue_name, undoReissue.address);
+            if (fTokenIndex && mapTokensAddressAmount.count(pair))
+                setQuantity(pair.first, pair.second, mapTokensAddressAmount.at(pair));
         }
+    }
 
-        if (fTokenIndex) {
-            // Undo the token spends by updating there balance in the database
-            for (auto undoSpend : vUndoTokenAmount) {
-                auto pair = std::make_pair(undoSpend.tokenName, undoSpend.address);
-                if (mapTokensAddressAmount.count(pair)) {
-                    if (!ptokensdb->WriteTokenAddressQuantity(undoSpend.tokenName, undoSpend.address,
-                                                              mapTokensAddressAmount.at(pair))) {
-                        dirty = true;
-                        message = "_Failed Writing updated Address Quantity to database when undoing spends";
-                    }
+    if (fTokenIndex) {
+        for (auto undoSpend : vUndoTokenAmount) {
+            auto pair = std::make_pair(undoSpend.tokenName, undoSpend.address);
+            if (mapTokensAddressAmount.count(pair))
+                setQuantity(pair.first, pair.second, mapTokensAddressAmount.at(pair));
+        }
 
-                    if (!ptokensdb->WriteAddressTokenQuantity(undoSpend.address, undoSpend.tokenName,
-                                                              mapTokensAddressAmount.at(pair))) {
-                        dirty = true;
-                        message = "_Failed Writing Address Balance to database";
-                    }
+        for (auto spentToken : vSpentTokens) {
+            auto pair = make_pair(spentToken.tokenName, spentToken.address);
+            if (mapTokensAddressAmount.count(pair))
+                setQuantity(pair.first, pair.second, mapTokensAddressAmount.at(pair));
+        }
 
-                    if (dirty) {
-                        return error("%s : %s", __func__, message);
-                    }
-                }
+        // What the database has for each changed quantity, so that writing them and counting
+        // the holders doesn't have to read it. Only a pair added without loading it is read here
+        for (const auto& item : changes.mapTokenAddressQuantity) {
+            CAmount nStored = mapTokensAddressAmount.GetStored(item.first.first, item.first.second);
+            if (nStored == CTokenAddressAmountMap::STORED_UNKNOWN) {
+                CAmount nDBAmount;
+                nStored = ptokensdb && ptokensdb->ReadTokenAddressQuantity(item.first.first, item.first.second, nDBAmount) ? nDBAmount : 0;
             }
+            changes.mapTokenAddressStored[item.first] = nStored;
 
-
-            // Save the tokens that have been spent by erasing the quantity in the database
-            for (auto spentToken : vSpentTokens) {
-                auto pair = make_pair(spentToken.tokenName, spentToken.address);
-                if (mapTokensAddressAmount.count(pair)) {
-                    if (mapTokensAddressAmount.at(pair) == 0) {
-                        if (!ptokensdb->EraseTokenAddressQuantity(spentToken.tokenName, spentToken.address)) {
-                            dirty = true;
-                            message = "_Failed Erasing a Spent Token, from database";
-                        }
-
-                        if (!ptokensdb->EraseAddressTokenQuantity(spentToken.address, spentToken.tokenName)) {
-                            dirty = true;
-                            message = "_Failed Erasing a Spent Token from AddressToken database";
-                        }
-
-                        if (dirty) {
-                            return error("%s : %s", __func__, message);
-                        }
-                    } else {
-                        if (!ptokensdb->WriteTokenAddressQuantity(spentToken.tokenName, spentToken.address,
-                                                                  mapTokensAddressAmount.at(pair))) {
-                            dirty = true;
-                            message = "_Failed Erasing a Spent Token, from database";
-                        }
-
-                        if (!ptokensdb->WriteAddressTokenQuantity(spentToken.address, spentToken.tokenName,
-                                                                  mapTokensAddressAmount.at(pair))) {
-                            dirty = true;
-                            message = "_Failed Writing Address Balance to database";
-                        }
-
-                        if (dirty) {
-                            return error("%s : %s", __func__, message);
-                        }
-                    }
-                }
+            int nDelta = (item.second != 0) - (nStored != 0);
+            if (nDelta) {
+                changes.mapTokenHolderDelta[item.first.first] += nDelta;
+                changes.mapAddressTokenDelta[item.first.second] += nDelta;
             }
         }
-
-        ClearDirtyCache();
-
-        return true;
-    } catch (const std::runtime_error& e) {
-        return error("%s : %s ", __func__, std::string("System error while flushing tokens: ") + e.what());
     }
 }
 
@@ -1795,8 +1801,12 @@ bool CTokensCache::Flush()
             ptokens->setNewTokensToRemove.insert(item);
         }
 
-        for (auto &item : mapTokensAddressAmount)
-            ptokens->mapTokensAddressAmount[item.first] = item.second;
+        // ptokens keeps what the database had when it first loaded the pair
+        for (const auto& entry : mapTokensAddressAmount) {
+            auto pair = std::make_pair(mapTokensAddressAmount.GetName(entry), mapTokensAddressAmount.GetAddress(entry));
+            if (!ptokens->mapTokensAddressAmount.insert(std::make_pair(pair, entry.nAmount), entry.nStored))
+                ptokens->mapTokensAddressAmount.at(pair) = entry.nAmount;
+        }
 
         for (auto &item : mapReissuedTokenData)
             ptokens->mapReissuedTokenData[item.first] = item.second;
@@ -1845,6 +1855,8 @@ bool CTokensCache::Flush()
             ptokens->vUndoTokenAmount.emplace_back(item);
         }
 
+        ptokens->InvalidateDatabaseChanges();
+
         return true;
 
     } catch (const std::runtime_error& e) {
@@ -1855,8 +1867,8 @@ bool CTokensCache::Flush()
 //! Get the amount of memory the cache is using
 size_t CTokensCache::DynamicMemoryUsage() const
 {
-    // TODO make sure this is accurate
-    return memusage::DynamicUsage(mapTokensAddressAmount) + memusage::DynamicUsage(mapReissuedTokenData);
+    // TODO make sure this is accurate for mapReissuedTokenData
+    return mapTokensAddressAmount.DynamicMemoryUsage() + memusage::DynamicUsage(mapReissuedTokenData);
 }
 
 //! Get an estimated size of the cache in bytes that will be needed inorder to save to database
@@ -2003,7 +2015,7 @@ bool CheckReissueBurnTx(const CTxOut& txOut)
 bool CheckIssueDataTx(const CTxOut& txOut)
 {
     // Verify 'ALPq' is in the transaction
-    CScript scriptPubKey = txOut.scriptPubKey;
+    const CScript& scriptPubKey = txOut.scriptPubKey;
 
     int nStartingIndex = 0;
     return IsScriptNewToken(scriptPubKey, nStartingIndex);
@@ -2012,7 +2024,7 @@ bool CheckIssueDataTx(const CTxOut& txOut)
 bool CheckReissueDataTx(const CTxOut& txOut)
 {
     // Verify 'ALPr' is in the transaction
-    CScript scriptPubKey = txOut.scriptPubKey;
+    const CScript& scriptPubKey = txOut.scriptPubKey;
 
     return IsScriptReissueToken(scriptPubKey);
 }
@@ -2020,7 +2032,7 @@ bool CheckReissueDataTx(const CTxOut& txOut)
 bool CheckOwnerDataTx(const CTxOut& txOut)
 {
     // Verify 'ALPq' is in the transaction
-    CScript scriptPubKey = txOut.scriptPubKey;
+    const CScript& scriptPubKey = txOut.scriptPubKey;
 
     return IsScriptOwnerToken(scriptPubKey);
 }
@@ -2245,9 +2257,8 @@ bool CTokensCache::GetTokenMetaDataIfExists(const std::string &name, CNewToken &
 
     // Check the cache, if it doesn't exist in the cache. Try and read it from database
     if (ptokensCache) {
-        if (ptokensCache->Exists(name)) {
-            CDatabasedTokenData data;
-            data = ptokensCache->Get(name);
+        CDatabasedTokenData data;
+        if (ptokensCache->Get(name, data)) {
             token = data.token;
             nHeight = data.nHeight;
             blockHash = data.blockHash;
@@ -2349,6 +2360,33 @@ bool GetTokenData(const CScript& script, CTokenOutputEntry& data)
     return false;
 }
 
+bool GetTokenData(const CTransaction& tx, size_t nOut, CTokenOutputEntry& data)
+{
+    const CTxTokenOutput* output = tx.GetTokenOutputs().Get(nOut);
+    if (!output || !output->fValid)
+        return false;
+
+    data.type = output->type;
+    data.destination = DecodeDestination(output->strAddress);
+    data.nTokenLockTime = 0;
+    if (output->type == TX_NEW_TOKEN && !output->fIsOwner) {
+        data.nAmount = output->token.nAmount;
+        data.tokenName = output->token.strName;
+    } else if (output->type == TX_TRANSFER_TOKEN) {
+        data.nAmount = output->transfer.nAmount;
+        data.tokenName = output->transfer.strName;
+        data.nTokenLockTime = output->transfer.nTokenLockTime;
+    } else if (output->type == TX_NEW_TOKEN) {
+        data.nAmount = OWNER_TOKEN_AMOUNT;
+        data.tokenName = output->ownerName;
+    } else {
+        data.nAmount = output->reissue.nAmount;
+        data.tokenName = output->reissue.strName;
+    }
+
+    return true;
+}
+
 void GetAllAdministrativeTokens(CWallet *pwallet, std::vector<std::string> &names, int nMinConf)
 {
     if(!pwallet)
@@ -2457,15 +2495,16 @@ std::string GetBurnAddress(const TokenType type)
 bool GetBestTokenAddressAmount(CTokensCache& cache, const std::string& tokenName, const std::string& address)
 {
     if (fTokenIndex) {
-        auto pair = make_pair(tokenName, address);
-
         // If the caches map has the pair, return true because the map already contains the best dirty amount
-        if (cache.mapTokensAddressAmount.count(pair))
+        if (cache.mapTokensAddressAmount.Find(tokenName, address))
             return true;
 
+        auto pair = make_pair(tokenName, address);
+
         // If the caches map has the pair, return true because the map already contains the best dirty amount
-        if (ptokens->mapTokensAddressAmount.count(pair)) {
-            cache.mapTokensAddressAmount[pair] = ptokens->mapTokensAddressAmount.at(pair);
+        const CAmount* pAmount = ptokens->mapTokensAddressAmount.Find(tokenName, address);
+        if (pAmount) {
+            cache.mapTokensAddressAmount.insert(make_pair(pair, *pAmount), ptokens->mapTokensAddressAmount.GetStored(tokenName, address));
             return true;
         }
 
@@ -2917,7 +2956,7 @@ void GetTxOutTokenTypes(const std::vector<CTxOut>& vout, int& issues, int& reiss
     }
 }
 
-bool ParseTokenScript(CScript scriptPubKey, uint160 &hashBytes, std::string &tokenName, CAmount &tokenAmount) {
+bool ParseTokenScript(const CScript& scriptPubKey, uint160 &hashBytes, std::string &tokenName, CAmount &tokenAmount) {
     int nType;
     bool fIsOwner;
     int _nStartingPoint;
@@ -2972,4 +3011,33 @@ bool ParseTokenScript(CScript scriptPubKey, uint160 &hashBytes, std::string &tok
         return true;
     }
     return false;
+}
+
+bool ParseTokenOutput(const CTransaction& tx, size_t nOut, uint160 &hashBytes, std::string &tokenName, CAmount &tokenAmount) {
+    const CTxTokenOutput* output = tx.GetTokenOutputs().Get(nOut);
+    if (!output)
+        return false;
+
+    if (!output->fValid) {
+        LogPrintf("%s : Couldn't get token from script: %s", __func__, HexStr(tx.vout[nOut].scriptPubKey));
+        return false;
+    }
+
+    if (output->type == TX_NEW_TOKEN && output->fIsOwner) {
+        tokenName = output->ownerName;
+        tokenAmount = OWNER_TOKEN_AMOUNT;
+    } else if (output->type == TX_NEW_TOKEN) {
+        tokenName = output->token.strName;
+        tokenAmount = output->token.nAmount;
+    } else if (output->type == TX_REISSUE_TOKEN) {
+        tokenName = output->reissue.strName;
+        tokenAmount = output->reissue.nAmount;
+    } else {
+        tokenName = output->transfer.strName;
+        tokenAmount = output->transfer.nAmount;
+    }
+
+    const CScript& scriptPubKey = tx.vout[nOut].scriptPubKey;
+    hashBytes = uint160(std::vector <unsigned char>(scriptPubKey.begin()+3, scriptPubKey.begin()+23));
+    return true;
 }
\ No newline at end of file
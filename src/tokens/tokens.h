@@ -16,6 +16,7 @@
 #include <map>
 #include <unordered_map>
 #include <list>
+#include <memory>
 
 #define ALP_A 97
 #define ALP_L 108
@@ -54,6 +55,9 @@ struct CTokenOutputEntry;
 class CCoinControl;
 struct CBlockTokenUndo;
 class COutput;
+struct CTokensDBChanges;
+class CDBWrapper;
+class CDBSnapshot;
 
 // 2500 * 82 Bytes == 205 KB (kilobytes) of memory
 #define MAX_CACHE_TOKENS_SIZE 2500
@@ -65,7 +69,7 @@ extern std::map<std::string, uint256> mapReissuedTokens;
 
 class CTokens {
 public:
-    std::map<std::pair<std::string, std::string>, CAmount> mapTokensAddressAmount; // pair < Token Name , Address > -> Quantity of tokens in the address
+    CTokenAddressAmountMap mapTokensAddressAmount; // pair < Token Name , Address > -> Quantity of tokens in the address
 
     // Dirty, Gets wiped once flushed to database
     std::map<std::string, CNewToken> mapReissuedTokenData; // Token Name -> New Token Data
@@ -97,6 +101,10 @@ private:
     bool AddBackSpentToken(const Coin& coin, const std::string& tokenName, const std::string& address, const CAmount& nAmount, const COutPoint& out);
     void AddToTokenBalance(const std::string& strName, const std::string& address, const CAmount& nAmount);
     bool UndoTransfer(const CTokenTransfer& transfer, const std::string& address, const COutPoint& outToRemove);
+
+    //! GetDatabaseChanges of this cache, built when first asked for after the cache changed
+    CCriticalSection cs_changes;
+    std::shared_ptr<const CTokensDBChanges> pchanges;
 public :
     //! These are memory only containers that show dirty entries that will be databased when flushed
     std::vector<CTokenCacheUndoTokenAmount> vUndoTokenAmount;
@@ -209,8 +217,21 @@ public :
     //! Flush all new cache entries into the ptokens global cache
     bool Flush();
 
-    //! Write token cache data to database
-    bool DumpCacheToDatabase();
+    //! Write token cache data to database, in a single batch
+    bool DumpCacheToDatabase(bool fSync = false);
+
+    //! Get the database entries DumpCacheToDatabase writes, as they are after it
+    void GetDatabaseChanges(CTokensDBChanges& changes) const;
+
+    //! GetDatabaseChanges, with a snapshot of db taken before they get written to it. The changes are
+    //! shared between readers and built again only after the cache changed
+    std::shared_ptr<const CTokensDBChanges> GetDatabaseChanges(const CDBWrapper& db, std::unique_ptr<CDBSnapshot>& snapshot);
+
+    //! Drop the shared database changes, must be called after changing the dirty entries
+    void InvalidateDatabaseChanges() {
+        LOCK(cs_changes);
+        pchanges.reset();
+    }
 
     void ClearDirtyCache() {
 
@@ -231,6 +252,8 @@ public :
 
         mapReissuedTokenData.clear();
         mapTokensAddressAmount.clear();
+
+        InvalidateDatabaseChanges();
     }
 
    std::string CacheToString() const {
@@ -271,6 +294,13 @@ bool OwnerFromTransaction(const CTransaction& tx, std::string& ownerName, std::s
 bool ReissueTokenFromTransaction(const CTransaction& tx, CReissueToken& reissue, std::string& strAddress);
 bool UniqueTokenFromTransaction(const CTransaction& tx, CNewToken& token, std::string& strAddress);
 
+/** Same as the *FromScript functions on tx.vout[nOut], but read from tx.GetTokenOutputs() */
+bool TokenFromTransaction(const CTransaction& tx, size_t nOut, CNewToken& token, std::string& strAddress);
+bool OwnerFromTransaction(const CTransaction& tx, size_t nOut, std::string& ownerName, std::string& strAddress);
+bool TransferTokenFromTransaction(const CTransaction& tx, size_t nOut, CTokenTransfer& transfer, std::string& strAddress);
+bool ReissueTokenFromTransaction(const CTransaction& tx, size_t nOut, CReissueToken& reissue, std::string& strAddress);
+bool IsNewUniqueTokenOutput(const CTransaction& tx, size_t nOut);
+
 bool TransferTokenFromScript(const CScript& scriptPubKey, CTokenTransfer& tokenTransfer, std::string& strAddress);
 bool TokenFromScript(const CScript& scriptPubKey, CNewToken& token, std::string& strAddress);
 bool OwnerTokenFromScript(const CScript& scriptPubKey, std::string& tokenName, std::string& strAddress);
@@ -309,6 +339,7 @@ bool GetTokenInfoFromCoin(const Coin& coin, std::string& strName, CAmount& nAmou
 bool GetTokenInfoFromScript(const CScript& scriptPubKey, std::string& strName, CAmount& nAmount, uint32_t& nTokenLockTime);
 
 bool GetTokenData(const CScript& script, CTokenOutputEntry& data);
+bool GetTokenData(const CTransaction& tx, size_t nOut, CTokenOutputEntry& data);
 
 bool GetBestTokenAddressAmount(CTokensCache& cache, const std::string& tokenName, const std::string& address);
 
@@ -328,5 +359,6 @@ bool CreateTransferTokenTransaction(CWallet* pwallet, const CCoinControl& coinCo
 bool SendTokenTransaction(CWallet* pwallet, CWalletTx& transaction, CReserveKey& reserveKey, std::pair<int, std::string>& error, std::string& txid);
 
 /** Helper method for extracting address bytes, token name and amount from an token script */
-bool ParseTokenScript(CScript scriptPubKey, uint160 &hashBytes, std::string &tokenName, CAmount &tokenAmount);
+bool ParseTokenScript(const CScript& scriptPubKey, uint160 &hashBytes, std::string &tokenName, CAmount &tokenAmount);
+bool ParseTokenOutput(const CTransaction& tx, size_t nOut, uint160 &hashBytes, std::string &tokenName, CAmount &tokenAmount);
 #endif //ALPHACONCOIN_TOKEN_PROTOCOL_H
@@ -4,6 +4,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "tokentypes.h"
+#include "hash.h"
+#include "random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
 
 int IntFromTokenType(TokenType type) {
     return (int)type;
@@ -11,4 +18,309 @@ int IntFromTokenType(TokenType type) {
 
 TokenType TokenTypeFromInt(int nType) {
     return (TokenType)nType;
-}
\ No newline at end of file
+}
+
+// Both slot tables start at this size and double when more than 3/4 full
+static const size_t MIN_TOKEN_AMOUNT_SLOTS = 16;
+
+static bool IsTableFull(size_t nUsed, size_t nSlots)
+{
+    return (nUsed + 1) * 4 > nSlots * 3;
+}
+
+const uint32_t CTokenAddressAmountMap::EMPTY_SLOT;
+const CAmount CTokenAddressAmountMap::STORED_UNKNOWN;
+
+CTokenAddressAmountMap::CTokenAddressAmountMap() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+    clear();
+}
+
+void CTokenAddressAmountMap::clear()
+{
+    // Swap the vectors out so the memory is given back, the map is cleared after a flush
+    std::vector<char>().swap(vchStrings);
+    std::vector<uint32_t>(1, 0).swap(vStringOffsets);
+    std::vector<uint32_t>(MIN_TOKEN_AMOUNT_SLOTS, EMPTY_SLOT).swap(vStringSlots);
+    std::vector<Entry>().swap(vEntries);
+    std::vector<uint32_t>(MIN_TOKEN_AMOUNT_SLOTS, EMPTY_SLOT).swap(vEntrySlots);
+}
+
+std::string CTokenAddressAmountMap::GetString(uint32_t nId) const
+{
+    return std::string(vchStrings.data() + vStringOffsets[nId], vStringOffsets[nId + 1] - vStringOffsets[nId]);
+}
+
+size_t CTokenAddressAmountMap::HashString(const char* pch, size_t nSize) const
+{
+    return CSipHasher(k0, k1).Write((const unsigned char*)pch, nSize).Finalize();
+}
+
+size_t CTokenAddressAmountMap::HashEntry(uint32_t nName, uint32_t nAddress)
+{
+    // Ids are handed out in order, a multiplicative hash spreads them well enough
+    uint64_t nKey = ((uint64_t)nName << 32 | nAddress) * 0x9E3779B97F4A7C15ULL;
+    return nKey ^ (nKey >> 32);
+}
+
+bool CTokenAddressAmountMap::FindString(const std::string& str, uint32_t& nId) const
+{
+    size_t nMask = vStringSlots.size() - 1;
+    for (size_t i = HashString(str.data(), str.size()) & nMask; vStringSlots[i] != EMPTY_SLOT; i = (i + 1) & nMask) {
+        uint32_t nSlotId = vStringSlots[i];
+        size_t nSize = vStringOffsets[nSlotId + 1] - vStringOffsets[nSlotId];
+        if (nSize == str.size() && memcmp(vchStrings.data() + vStringOffsets[nSlotId], str.data(), nSize) == 0) {
+            nId = nSlotId;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t CTokenAddressAmountMap::InternString(const std::string& str)
+{
+    uint32_t nId;
+    if (FindString(str, nId))
+        return nId;
+
+    nId = vStringOffsets.size() - 1;
+    if (IsTableFull(nId, vStringSlots.size()))
+        ResizeStringSlots(vStringSlots.size() * 2);
+
+    vchStrings.insert(vchStrings.end(), str.begin(), str.end());
+    vStringOffsets.push_back(vchStrings.size());
+
+    size_t nMask = vStringSlots.size() - 1;
+    size_t i = HashString(str.data(), str.size()) & nMask;
+    while (vStringSlots[i] != EMPTY_SLOT)
+        i = (i + 1) & nMask;
+    vStringSlots[i] = nId;
+
+    return nId;
+}
+
+void CTokenAddressAmountMap::ResizeStringSlots(size_t nSlots)
+{
+    std::vector<uint32_t>(nSlots, EMPTY_SLOT).swap(vStringSlots);
+    size_t nMask = nSlots - 1;
+    for (uint32_t nId = 0; nId + 1 < vStringOffsets.size(); nId++) {
+        size_t i = HashString(vchStrings.data() + vStringOffsets[nId], vStringOffsets[nId + 1] - vStringOffsets[nId]) & nMask;
+        while (vStringSlots[i] != EMPTY_SLOT)
+            i = (i + 1) & nMask;
+        vStringSlots[i] = nId;
+    }
+}
+
+uint32_t CTokenAddressAmountMap::FindEntry(uint32_t nName, uint32_t nAddress) const
+{
+    size_t nMask = vEntrySlots.size() - 1;
+    for (size_t i = HashEntry(nName, nAddress) & nMask; vEntrySlots[i] != EMPTY_SLOT; i = (i + 1) & nMask) {
+        const Entry& entry = vEntries[vEntrySlots[i]];
+        if (entry.nName == nName && entry.nAddress == nAddress)
+            return vEntrySlots[i];
+    }
+    return EMPTY_SLOT;
+}
+
+void CTokenAddressAmountMap::ResizeEntrySlots(size_t nSlots)
+{
+    std::vector<uint32_t>(nSlots, EMPTY_SLOT).swap(vEntrySlots);
+    size_t nMask = nSlots - 1;
+    for (uint32_t n = 0; n < vEntries.size(); n++) {
+        size_t i = HashEntry(vEntries[n].nName, vEntries[n].nAddress) & nMask;
+        while (vEntrySlots[i] != EMPTY_SLOT)
+            i = (i + 1) & nMask;
+        vEntrySlots[i] = n;
+    }
+}
+
+// Returns the balance already in the map if there is one
+CAmount& CTokenAddressAmountMap::InsertEntry(const key_type& key, CAmount nAmount, CAmount nStored)
+{
+    Entry entry;
+    entry.nName = InternString(key.first);
+    entry.nAddress = InternString(key.second);
+    entry.nAmount = nAmount;
+    entry.nStored = nStored;
+
+    uint32_t nIndex = FindEntry(entry.nName, entry.nAddress);
+    if (nIndex != EMPTY_SLOT)
+        return vEntries[nIndex].nAmount;
+
+    if (IsTableFull(vEntries.size(), vEntrySlots.size()))
+        ResizeEntrySlots(vEntrySlots.size() * 2);
+
+    size_t nMask = vEntrySlots.size() - 1;
+    size_t i = HashEntry(entry.nName, entry.nAddress) & nMask;
+    while (vEntrySlots[i] != EMPTY_SLOT)
+        i = (i + 1) & nMask;
+    vEntrySlots[i] = vEntries.size();
+    vEntries.push_back(entry);
+
+    return vEntries.back().nAmount;
+}
+
+CAmount* CTokenAddressAmountMap::Find(const std::string& strName, const std::string& strAddress)
+{
+    return const_cast<CAmount*>(static_cast<const CTokenAddressAmountMap*>(this)->Find(strName, strAddress));
+}
+
+const CAmount* CTokenAddressAmountMap::Find(const std::string& strName, const std::string& strAddress) const
+{
+    // A name or address that was never interned can't have a balance
+    uint32_t nName, nAddress;
+    if (!FindString(strName, nName) || !FindString(strAddress, nAddress))
+        return nullptr;
+
+    uint32_t nIndex = FindEntry(nName, nAddress);
+    if (nIndex == EMPTY_SLOT)
+        return nullptr;
+    return &vEntries[nIndex].nAmount;
+}
+
+CAmount CTokenAddressAmountMap::GetStored(const std::string& strName, const std::string& strAddress) const
+{
+    uint32_t nName, nAddress;
+    if (!FindString(strName, nName) || !FindString(strAddress, nAddress))
+        return STORED_UNKNOWN;
+
+    uint32_t nIndex = FindEntry(nName, nAddress);
+    if (nIndex == EMPTY_SLOT)
+        return STORED_UNKNOWN;
+    return vEntries[nIndex].nStored;
+}
+
+CAmount& CTokenAddressAmountMap::at(const key_type& key)
+{
+    CAmount* pAmount = Find(key.first, key.second);
+    if (!pAmount)
+        throw std::out_of_range("CTokenAddressAmountMap::at");
+    return *pAmount;
+}
+
+const CAmount& CTokenAddressAmountMap::at(const key_type& key) const
+{
+    const CAmount* pAmount = Find(key.first, key.second);
+    if (!pAmount)
+        throw std::out_of_range("CTokenAddressAmountMap::at");
+    return *pAmount;
+}
+
+CAmount& CTokenAddressAmountMap::operator[](const key_type& key)
+{
+    return InsertEntry(key, 0, STORED_UNKNOWN);
+}
+
+bool CTokenAddressAmountMap::insert(const std::pair<key_type, CAmount>& value)
+{
+    return insert(value, value.second);
+}
+
+bool CTokenAddressAmountMap::insert(const std::pair<key_type, CAmount>& value, CAmount nStored)
+{
+    size_t nSize = vEntries.size();
+    InsertEntry(value.first, value.second, nStored);
+    return vEntries.size() != nSize;
+}
+
+size_t CTokenAddressAmountMap::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vchStrings) + memusage::DynamicUsage(vStringOffsets) + memusage::DynamicUsage(vStringSlots) +
+           memusage::DynamicUsage(vEntries) + memusage::DynamicUsage(vEntrySlots);
+}
+
+// Strings short enough to be kept in the object itself allocate nothing
+static size_t StringUsage(const std::string& str)
+{
+    return str.capacity() >= sizeof(std::string) ? memusage::MallocUsage(str.capacity() + 1) : 0;
+}
+
+size_t CTxTokenOutputs::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(vOutputs);
+    for (const auto& item : vOutputs) {
+        const CTxTokenOutput& output = item.second;
+        nUsage += StringUsage(output.strAddress) + StringUsage(output.ownerName) +
+                  StringUsage(output.token.strName) + StringUsage(output.token.strIPFSHash) +
+                  StringUsage(output.transfer.strName) +
+                  StringUsage(output.reissue.strName) + StringUsage(output.reissue.strIPFSHash);
+    }
+    return nUsage;
+}
+
+CTokenNameFilter::CTokenNameFilter() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+    Reset(0, 1);
+}
+
+void CTokenNameFilter::Reset(size_t nCapacityIn, unsigned int nRateIn)
+{
+    LOCK(cs);
+    nCapacity = nCapacityIn;
+    nRate = std::max(nRateIn, 1u);
+    nNames = 0;
+    nRejected = 0;
+    nPassed = 0;
+
+    // The usual sizing, ln(rate) / ln(2)^2 bits and ln(rate) / ln(2) hash functions for each name
+    double dLogRate = std::log((double)nRate);
+    size_t nBits = std::max((size_t)std::ceil(nCapacity * dLogRate / (M_LN2 * M_LN2)), (size_t)64);
+    std::vector<uint64_t>((nBits + 63) / 64, 0).swap(vBits);
+    nHashFuncs = std::min(std::max((unsigned int)std::round(dLogRate / M_LN2), 1u), 32u);
+}
+
+void CTokenNameFilter::Insert(const std::string& name)
+{
+    // Hashed under the lock, as Swap changes the salt
+    LOCK(cs);
+    uint64_t nHash = CSipHasher(k0, k1).Write((const unsigned char*)name.data(), name.size()).Finalize();
+    // Two halves of one hash make the rest, as in Kirsch and Mitzenmacher
+    uint64_t nBits = vBits.size() * 64;
+    uint64_t h1 = nHash & 0xffffffff, h2 = (nHash >> 32) | 1;
+    for (unsigned int i = 0; i < nHashFuncs; i++) {
+        uint64_t nBit = (h1 + i * h2) % nBits;
+        vBits[nBit >> 6] |= (uint64_t)1 << (nBit & 63);
+    }
+    nNames++;
+}
+
+bool CTokenNameFilter::MayContain(const std::string& name)
+{
+    LOCK(cs);
+    uint64_t nHash = CSipHasher(k0, k1).Write((const unsigned char*)name.data(), name.size()).Finalize();
+    uint64_t nBits = vBits.size() * 64;
+    uint64_t h1 = nHash & 0xffffffff, h2 = (nHash >> 32) | 1;
+    for (unsigned int i = 0; i < nHashFuncs; i++) {
+        uint64_t nBit = (h1 + i * h2) % nBits;
+        if (!(vBits[nBit >> 6] & ((uint64_t)1 << (nBit & 63)))) {
+            nRejected++;
+            return false;
+        }
+    }
+    nPassed++;
+    return true;
+}
+
+bool CTokenNameFilter::IsFull() const
+{
+    LOCK(cs);
+    return nNames > nCapacity;
+}
+
+void CTokenNameFilter::Swap(CTokenNameFilter& other)
+{
+    LOCK(cs);
+    std::swap(k0, other.k0);
+    std::swap(k1, other.k1);
+    vBits.swap(other.vBits);
+    std::swap(nHashFuncs, other.nHashFuncs);
+    std::swap(nNames, other.nNames);
+    std::swap(nCapacity, other.nCapacity);
+    std::swap(nRate, other.nRate);
+}
+
+void CTokenNameFilter::GetStats(Stats& stats) const
+{
+    LOCK(cs);
+    stats = Stats{memusage::DynamicUsage(vBits), nNames, nCapacity, nRate, nHashFuncs, nRejected, nPassed};
+}
@@ -6,13 +6,19 @@
 #ifndef ALPHACONCOIN_NEWTOKEN_H
 #define ALPHACONCOIN_NEWTOKEN_H
 
+#include <algorithm>
 #include <string>
 #include <sstream>
 #include <list>
 #include <unordered_map>
+#include <vector>
+#include <memory>
+#include <limits>
 #include "amount.h"
 #include "script/standard.h"
 #include "primitives/transaction.h"
+#include "memusage.h"
+#include "sync.h"
 
 #define MAX_UNIT 8
 #define MIN_UNIT 0
@@ -345,6 +351,184 @@ struct CTokenCacheSpendToken
     }
 };
 
+/** The payload of a token output, as read by the *FromScript functions */
+struct CTxTokenOutput
+{
+    txnouttype type; // TX_NONSTANDARD if the output isn't a token script
+    bool fIsOwner;
+    bool fValid; // whether the payload could be read
+    std::string strAddress;
+    CNewToken token;
+    CTokenTransfer transfer;
+    CReissueToken reissue;
+    std::string ownerName;
+
+    CTxTokenOutput() : type(TX_NONSTANDARD), fIsOwner(false), fValid(false) {}
+};
+
+/** The token outputs of a transaction by output index, see CTransaction::GetTokenOutputs */
+struct CTxTokenOutputs
+{
+    typedef std::pair<uint32_t, CTxTokenOutput> value_type;
+
+    // Only the outputs that are token scripts, in output order
+    std::vector<value_type> vOutputs;
+
+    const CTxTokenOutput* Get(size_t n) const
+    {
+        auto it = std::lower_bound(vOutputs.begin(), vOutputs.end(), n,
+                [](const value_type& item, size_t n) { return item.first < n; });
+        if (it == vOutputs.end() || it->first != n)
+            return nullptr;
+        return &it->second;
+    }
+
+    size_t DynamicMemoryUsage() const;
+};
+
+/**
+ * Token balances by (token name, address). Every name and address is stored
+ * once, in one character buffer, and referred to by a 32 bit id. Balances are
+ * kept in a vector in insertion order and found through an open addressing
+ * table of indexes into it, so a lookup probes a few flat arrays instead of
+ * walking a tree of string pairs, and all the memory used is in a handful of
+ * vectors. Balances are only ever removed all at once, by clear().
+ *
+ * References returned by at() and operator[] are invalidated by the next
+ * insertion, like those of a vector.
+ */
+class CTokenAddressAmountMap
+{
+public:
+    typedef std::pair<std::string, std::string> key_type;
+
+    struct Entry
+    {
+        uint32_t nName;
+        uint32_t nAddress;
+        CAmount nAmount;
+        // Quantity in the token database when the pair was loaded, 0 if it had none
+        CAmount nStored;
+    };
+
+    // nStored of a pair that was added without loading it
+    static const CAmount STORED_UNKNOWN = -1;
+
+    typedef std::vector<Entry>::const_iterator const_iterator;
+
+    CTokenAddressAmountMap();
+
+    size_t size() const { return vEntries.size(); }
+    bool empty() const { return vEntries.empty(); }
+    void clear();
+
+    size_t count(const key_type& key) const { return Find(key.first, key.second) ? 1 : 0; }
+    // Throws std::out_of_range if the pair isn't in the map, like std::map::at
+    CAmount& at(const key_type& key);
+    const CAmount& at(const key_type& key) const;
+    // Adds the pair with a zero balance if it isn't in the map yet
+    CAmount& operator[](const key_type& key);
+    // Adds the pair if it isn't in the map yet, returns whether it did. The balance is the one
+    // loaded from the database unless nStored tells otherwise
+    bool insert(const std::pair<key_type, CAmount>& value);
+    bool insert(const std::pair<key_type, CAmount>& value, CAmount nStored);
+
+    // nullptr if the pair isn't in the map
+    CAmount* Find(const std::string& strName, const std::string& strAddress);
+    const CAmount* Find(const std::string& strName, const std::string& strAddress) const;
+    // nStored of the pair, STORED_UNKNOWN if it isn't in the map
+    CAmount GetStored(const std::string& strName, const std::string& strAddress) const;
+
+    const_iterator begin() const { return vEntries.begin(); }
+    const_iterator end() const { return vEntries.end(); }
+    std::string GetName(const Entry& entry) const { return GetString(entry.nName); }
+    std::string GetAddress(const Entry& entry) const { return GetString(entry.nAddress); }
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    static const uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();
+
+    // Salt of the string hash, so that names can't be picked to collide
+    uint64_t k0, k1;
+
+    // String i is vchStrings[vStringOffsets[i], vStringOffsets[i + 1])
+    std::vector<char> vchStrings;
+    std::vector<uint32_t> vStringOffsets;
+    // Open addressing table of string ids
+    std::vector<uint32_t> vStringSlots;
+
+    std::vector<Entry> vEntries;
+    // Open addressing table of indexes into vEntries
+    std::vector<uint32_t> vEntrySlots;
+
+    std::string GetString(uint32_t nId) const;
+    size_t HashString(const char* pch, size_t nSize) const;
+    static size_t HashEntry(uint32_t nName, uint32_t nAddress);
+    bool FindString(const std::string& str, uint32_t& nId) const;
+    uint32_t InternString(const std::string& str);
+    // Index of the entry in vEntries, or EMPTY_SLOT
+    uint32_t FindEntry(uint32_t nName, uint32_t nAddress) const;
+    CAmount& InsertEntry(const key_type& key, CAmount nAmount, CAmount nStored);
+    void ResizeStringSlots(size_t nSlots);
+    void ResizeEntrySlots(size_t nSlots);
+};
+
+/**
+ * Bloom filter over token names, used in front of the token database so that
+ * a lookup of a token that doesn't exist can usually be answered without
+ * reading it. Names are only ever added: a name that is removed from the
+ * database stays in the filter until the next Reset(), which at worst costs a
+ * false positive. The filter is sized for a number of names when it is reset,
+ * and once more than that have been added IsFull() tells that its false
+ * positive rate is going up and it should be rebuilt bigger.
+ */
+class CTokenNameFilter
+{
+public:
+    struct Stats
+    {
+        size_t nMemoryUsage;
+        size_t nNames;
+        size_t nCapacity;
+        unsigned int nRate;
+        unsigned int nHashFuncs;
+        uint64_t nRejected;
+        uint64_t nPassed;
+    };
+
+    CTokenNameFilter();
+
+    CTokenNameFilter(const CTokenNameFilter&) = delete;
+    CTokenNameFilter& operator=(const CTokenNameFilter&) = delete;
+
+    //! Empty the filter and size it for nCapacity names, with a false positive rate of 1 in nRate
+    void Reset(size_t nCapacity, unsigned int nRate);
+    void Insert(const std::string& name);
+    //! False if the name was never inserted, true if it may have been
+    bool MayContain(const std::string& name);
+    bool IsFull() const;
+
+    //! Take over the names of other, which must not be in use by any other thread. The lookup counts stay
+    void Swap(CTokenNameFilter& other);
+
+    void GetStats(Stats& stats) const;
+
+private:
+    mutable CCriticalSection cs;
+
+    // Salt of the name hash, so that names can't be picked to collide
+    uint64_t k0, k1;
+
+    std::vector<uint64_t> vBits;
+    unsigned int nHashFuncs;
+    size_t nNames;
+    size_t nCapacity;
+    unsigned int nRate;
+    uint64_t nRejected;
+    uint64_t nPassed;
+};
+
 // Least Recently Used Cache
 template<typename cache_key_t, typename cache_value_t>
 class CLRUCache
@@ -463,4 +647,243 @@ private:
     size_t maxSize;
 };
 
+/**
+ * Least Recently Used Cache that can be used from several threads at once.
+ * Keys are spread over shards by hash and every shard has its own lock and
+ * its own recency order, so lookups of different keys rarely wait on each
+ * other. The entries of a shard are kept in one vector and linked by index.
+ * Values are copied out under the lock, never handed out by reference.
+ */
+template<typename cache_key_t, typename cache_value_t>
+class CShardedLRUCache
+{
+public:
+    struct Stats
+    {
+        size_t nEntries;
+        size_t nMaxEntries;
+        size_t nShards;
+        size_t nMemoryUsage;
+        uint64_t nHits;
+        uint64_t nMisses;
+        uint64_t nEvictions;
+    };
+
+    explicit CShardedLRUCache(size_t max_size) : maxSize(max_size)
+    {
+        // Small caches are not split up, so that entries are only evicted when the whole cache is full
+        nShards = maxSize / MIN_SHARD_SIZE;
+        if (nShards > MAX_SHARDS)
+            nShards = MAX_SHARDS;
+        if (nShards == 0)
+            nShards = 1;
+        shards.reset(new Shard[nShards]);
+        for (size_t i = 0; i < nShards; i++)
+            shards[i].maxSize = maxSize / nShards + (i < maxSize % nShards ? 1 : 0);
+    }
+
+    CShardedLRUCache(const CShardedLRUCache&) = delete;
+    CShardedLRUCache& operator=(const CShardedLRUCache&) = delete;
+
+    void Put(const cache_key_t& key, const cache_value_t& value)
+    {
+        Shard& shard = GetShard(key);
+        LOCK(shard.cs);
+        if (shard.maxSize == 0)
+            return;
+
+        auto it = shard.mapIndex.find(key);
+        if (it != shard.mapIndex.end()) {
+            shard.vNodes[it->second].value = value;
+            MoveToFront(shard, it->second);
+            return;
+        }
+
+        uint32_t nIndex;
+        if (shard.vNodes.size() < shard.maxSize) {
+            nIndex = shard.vNodes.size();
+            shard.vNodes.push_back(Node{key, value, NO_NODE, NO_NODE});
+        } else {
+            // Reuse the least recently used entry of the shard
+            nIndex = shard.nTail;
+            Unlink(shard, nIndex);
+            shard.mapIndex.erase(shard.vNodes[nIndex].key);
+            shard.vNodes[nIndex].key = key;
+            shard.vNodes[nIndex].value = value;
+            shard.nEvictions++;
+        }
+        LinkFront(shard, nIndex);
+        shard.mapIndex.emplace(key, nIndex);
+    }
+
+    void Erase(const cache_key_t& key)
+    {
+        Shard& shard = GetShard(key);
+        LOCK(shard.cs);
+        auto it = shard.mapIndex.find(key);
+        if (it == shard.mapIndex.end())
+            return;
+
+        uint32_t nIndex = it->second;
+        Unlink(shard, nIndex);
+        shard.mapIndex.erase(it);
+
+        // Keep the vector dense by moving its last entry into the hole
+        uint32_t nLast = shard.vNodes.size() - 1;
+        if (nIndex != nLast) {
+            Node& node = shard.vNodes[nIndex];
+            node = std::move(shard.vNodes[nLast]);
+            if (node.nPrev != NO_NODE)
+                shard.vNodes[node.nPrev].nNext = nIndex;
+            else
+                shard.nHead = nIndex;
+            if (node.nNext != NO_NODE)
+                shard.vNodes[node.nNext].nPrev = nIndex;
+            else
+                shard.nTail = nIndex;
+            shard.mapIndex[node.key] = nIndex;
+        }
+        shard.vNodes.pop_back();
+    }
+
+    /** Copies the value for key into value and marks it as recently used */
+    bool Get(const cache_key_t& key, cache_value_t& value)
+    {
+        Shard& shard = GetShard(key);
+        LOCK(shard.cs);
+        auto it = shard.mapIndex.find(key);
+        if (it == shard.mapIndex.end()) {
+            shard.nMisses++;
+            return false;
+        }
+        shard.nHits++;
+        MoveToFront(shard, it->second);
+        value = shard.vNodes[it->second].value;
+        return true;
+    }
+
+    /** Like Get, without copying the value out */
+    bool Exists(const cache_key_t& key)
+    {
+        Shard& shard = GetShard(key);
+        LOCK(shard.cs);
+        auto it = shard.mapIndex.find(key);
+        if (it == shard.mapIndex.end()) {
+            shard.nMisses++;
+            return false;
+        }
+        shard.nHits++;
+        MoveToFront(shard, it->second);
+        return true;
+    }
+
+    size_t Size() const
+    {
+        size_t nSize = 0;
+        for (size_t i = 0; i < nShards; i++) {
+            LOCK(shards[i].cs);
+            nSize += shards[i].vNodes.size();
+        }
+        return nSize;
+    }
+
+    size_t MaxSize() const
+    {
+        return maxSize;
+    }
+
+    void Clear()
+    {
+        for (size_t i = 0; i < nShards; i++) {
+            LOCK(shards[i].cs);
+            shards[i].vNodes.clear();
+            shards[i].mapIndex.clear();
+            shards[i].nHead = shards[i].nTail = NO_NODE;
+        }
+    }
+
+    void GetStats(Stats& stats) const
+    {
+        stats = Stats{0, maxSize, nShards, 0, 0, 0, 0};
+        for (size_t i = 0; i < nShards; i++) {
+            const Shard& shard = shards[i];
+            LOCK(shard.cs);
+            stats.nEntries += shard.vNodes.size();
+            stats.nMemoryUsage += memusage::DynamicUsage(shard.vNodes) + memusage::DynamicUsage(shard.mapIndex);
+            stats.nHits += shard.nHits;
+            stats.nMisses += shard.nMisses;
+            stats.nEvictions += shard.nEvictions;
+        }
+    }
+
+private:
+    static const size_t MAX_SHARDS = 16;
+    static const size_t MIN_SHARD_SIZE = 64;
+    static const uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+    struct Node
+    {
+        cache_key_t key;
+        cache_value_t value;
+        uint32_t nPrev;
+        uint32_t nNext;
+    };
+
+    struct Shard
+    {
+        mutable CCriticalSection cs;
+        std::vector<Node> vNodes;
+        std::unordered_map<cache_key_t, uint32_t> mapIndex;
+        uint32_t nHead = NO_NODE;
+        uint32_t nTail = NO_NODE;
+        size_t maxSize = 0;
+        uint64_t nHits = 0;
+        uint64_t nMisses = 0;
+        uint64_t nEvictions = 0;
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    size_t nShards;
+    size_t maxSize;
+
+    Shard& GetShard(const cache_key_t& key)
+    {
+        return shards[std::hash<cache_key_t>()(key) % nShards];
+    }
+
+    static void Unlink(Shard& shard, uint32_t nIndex)
+    {
+        Node& node = shard.vNodes[nIndex];
+        if (node.nPrev != NO_NODE)
+            shard.vNodes[node.nPrev].nNext = node.nNext;
+        else
+            shard.nHead = node.nNext;
+        if (node.nNext != NO_NODE)
+            shard.vNodes[node.nNext].nPrev = node.nPrev;
+        else
+            shard.nTail = node.nPrev;
+        node.nPrev = node.nNext = NO_NODE;
+    }
+
+    static void LinkFront(Shard& shard, uint32_t nIndex)
+    {
+        Node& node = shard.vNodes[nIndex];
+        node.nPrev = NO_NODE;
+        node.nNext = shard.nHead;
+        if (shard.nHead != NO_NODE)
+            shard.vNodes[shard.nHead].nPrev = nIndex;
+        shard.nHead = nIndex;
+        if (shard.nTail == NO_NODE)
+            shard.nTail = nIndex;
+    }
+
+    static void MoveToFront(Shard& shard, uint32_t nIndex)
+    {
+        if (shard.nHead == nIndex)
+            return;
+        Unlink(shard, nIndex);
+        LinkFront(shard, nIndex);
+    }
+};
+
 #endif //ALPHACONCOIN_NEWTOKEN_H
@@ -18,7 +18,12 @@
 #include "init.h"
 #include "validation.h"
 
+#include <limits>
+#include <memory>
+#include <queue>
+#include <set>
 #include <stdint.h>
+#include <tuple>
 
 #include <boost/thread.hpp>
 
@@ -31,6 +36,10 @@ static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSBALANCEINDEX = 'g';
+static const char DB_INDEXBUILD = 'x';
+static const char DB_ADDRESSINDEXHEIGHT = 'y';
+static const char DB_INDEXSTART = 'v';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -156,7 +165,8 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, size_t maxFileSize) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, maxFileSize) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, size_t maxFileSize) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, maxFileSize), fAddressBalances(false), nAddressIndexHeight(-1), nAddressReplayHeight(std::numeric_limits<int>::max()) {
+    Read(DB_ADDRESSINDEXHEIGHT, nAddressIndexHeight);
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -339,31 +349,201 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect, bool fMayExist) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+    if (fAddressBalances)
+        UpdateAddressBalances(batch, vect, true, fMayExist);
+    int nHeight = nAddressIndexHeight;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
+        nHeight = std::max(nHeight, it->first.blockHeight);
+    }
+    if (nHeight > nAddressIndexHeight)
+        batch.Write(DB_ADDRESSINDEXHEIGHT, nHeight);
+    if (!WriteBatch(batch))
+        return false;
+    nAddressIndexHeight = nHeight;
+    return true;
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
+    if (fAddressBalances)
+        UpdateAddressBalances(batch, vect, false, false);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
     return WriteBatch(batch);
 }
 
+void CBlockTreeDB::UpdateAddressBalances(CDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fConnect, bool fMayExist) {
+    // Blocks are connected again after an unclean shutdown, and the address
+    // index was written before the chainstate was. Only entries that are
+    // actually added or removed change the balance, so that they count once.
+    // Blocks above what the index had at startup can't be replayed, and their
+    // entries aren't looked up.
+    std::map<std::tuple<unsigned int, uint160, std::string>, CAddressBalanceValue> mapDelta;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        bool fCheck = fMayExist || it->first.blockHeight <= nAddressReplayHeight;
+        if (fCheck && Exists(std::make_pair(DB_ADDRESSINDEX, it->first)) == fConnect)
+            continue;
+        CAmount nDelta = fConnect ? it->second : -it->second;
+        CAddressBalanceValue& delta = mapDelta[std::make_tuple(it->first.type, it->first.hashBytes, it->first.token)];
+        delta.balance += nDelta;
+        if (it->second > 0)
+            delta.received += nDelta;
+    }
+
+    for (const auto& item : mapDelta) {
+        CAddressBalanceKey key(std::get<0>(item.first), std::get<1>(item.first), std::get<2>(item.first));
+        CAddressBalanceValue value;
+        Read(std::make_pair(DB_ADDRESSBALANCEINDEX, key), value);
+        value.balance += item.second.balance;
+        value.received += item.second.received;
+        if (value.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSBALANCEINDEX, key));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSBALANCEINDEX, key), value);
+    }
+}
+
+bool CBlockTreeDB::ReadAddressBalance(uint160 addressHash, int type, std::string tokenName,
+                                      std::vector<std::pair<std::string, CAddressBalanceValue> > &balances) {
+    if (!tokenName.empty()) {
+        CAddressBalanceValue value;
+        if (Read(std::make_pair(DB_ADDRESSBALANCEINDEX, CAddressBalanceKey(type, addressHash, tokenName)), value))
+            balances.push_back(std::make_pair(tokenName, value));
+        return true;
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressBalanceKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSBALANCEINDEX && key.second.type == (unsigned int)type && key.second.hashBytes == addressHash) {
+            CAddressBalanceValue value;
+            if (!pcursor->GetValue(value))
+                return error("failed to get address balance value");
+            balances.push_back(std::make_pair(key.second.token, value));
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::SetAddressBalanceIndex(bool fEnabled) {
+    // An index written before its height was kept may have entries of any block
+    nAddressReplayHeight = Exists(DB_ADDRESSINDEXHEIGHT) ? nAddressIndexHeight : std::numeric_limits<int>::max();
+
+    bool fBuilt = false;
+    ReadFlag("addressbalanceindex", fBuilt);
+    if (fBuilt == fEnabled) {
+        fAddressBalances = fEnabled;
+        return true;
+    }
+
+    // Write in batches of about this size, the index can be large
+    static const size_t nMaxBatchSize = 16 << 20;
+
+    CDBBatch batch(*this);
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    size_t nBalances = 0;
+
+    if (fEnabled) {
+        LogPrintf("Building the address balance index...\n");
+
+        // The address index is sorted by address and token, so each balance is the sum of one run of entries
+        bool fHaveKey = false;
+        CAddressBalanceKey keyBalance;
+        CAddressBalanceValue value;
+        pcursor->Seek(DB_ADDRESSINDEX);
+        while (true) {
+            boost::this_thread::interruption_point();
+            std::pair<char, CAddressIndexKey> key;
+            bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+            if (fHaveKey && (!fValid || key.second.type != keyBalance.type || key.second.hashBytes != keyBalance.hashBytes || key.second.token != keyBalance.token)) {
+                if (!value.IsNull()) {
+                    batch.Write(std::make_pair(DB_ADDRESSBALANCEINDEX, keyBalance), value);
+                    nBalances++;
+                }
+                value.SetNull();
+                fHaveKey = false;
+            }
+            if (!fValid)
+                break;
+
+            CAmount nValue;
+            if (!pcursor->GetValue(nValue))
+                return error("failed to get address index value");
+            keyBalance = CAddressBalanceKey(key.second.type, key.second.hashBytes, key.second.token);
+            fHaveKey = true;
+            value.balance += nValue;
+            if (nValue > 0)
+                value.received += nValue;
+
+            if (batch.SizeEstimate() > nMaxBatchSize) {
+                if (!WriteBatch(batch))
+                    return error("failed to write address balance index");
+                batch.Clear();
+            }
+            pcursor->Next();
+        }
+        LogPrintf("Indexed the balances of %u addresses and tokens\n", nBalances);
+    } else {
+        pcursor->Seek(DB_ADDRESSBALANCEINDEX);
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<char, CAddressBalanceKey> key;
+            if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEINDEX)
+                break;
+            batch.Erase(key);
+
+            if (batch.SizeEstimate() > nMaxBatchSize) {
+                if (!WriteBatch(batch))
+                    return error("failed to erase address balance index");
+                batch.Clear();
+            }
+            pcursor->Next();
+        }
+        LogPrintf("Removed the address balance index\n");
+    }
+
+    batch.Write(std::make_pair(DB_FLAG, std::string("addressbalanceindex")), fEnabled ? '1' : '0');
+    if (!WriteBatch(batch, true))
+        return error("failed to write address balance index");
+
+    fAddressBalances = fEnabled;
+    return true;
+}
+
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type, std::string tokenName,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
 
+    return ForEachAddressIndex(addressHash, type, tokenName, start, end, nullptr,
+                               [&addressIndex](const CAddressIndexKey& key, const CAmount& nValue) {
+        addressIndex.push_back(std::make_pair(key, nValue));
+        return true;
+    });
+}
+
+bool CBlockTreeDB::ForEachAddressIndex(uint160 addressHash, int type, std::string tokenName, int start, int end,
+                                       const CAddressIndexKey* pafter, std::function<bool(const CAddressIndexKey&, const CAmount&)> fn) {
+
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (!tokenName.empty() && start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX,
-                                     CAddressIndexIteratorHeightKey(type, addressHash, tokenName, start)));
+    if (pafter) {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, *pafter));
+        std::pair<char,CAddressIndexKey> key;
+        if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second == *pafter)
+            pcursor->Next();
     } else if (!tokenName.empty()) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorTokenKey(type, addressHash, tokenName)));
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX,
+                                     CAddressIndexIteratorHeightKey(type, addressHash, tokenName, std::max(start, 0))));
     } else {
         pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
@@ -371,21 +551,31 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type, std::string t
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash
-                && (tokenName.empty() || key.second.token == tokenName)) {
-            if (end > 0 && key.second.blockHeight > end) {
-                break;
-            }
-            CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(std::make_pair(key.second, nValue));
-                pcursor->Next();
-            } else {
-                return error("failed to get address index value");
-            }
-        } else {
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.type != (unsigned int)type
+                || key.second.hashBytes != addressHash || (!tokenName.empty() && key.second.token != tokenName)) {
             break;
         }
+
+        // The entries of each token are sorted by height, so the ones outside the range are skipped with a seek
+        if (start > 0 && key.second.blockHeight < start) {
+            pcursor->Seek(std::make_pair(DB_ADDRESSINDEX,
+                                         CAddressIndexIteratorHeightKey(type, addressHash, key.second.token, start)));
+            continue;
+        }
+        if (end > 0 && key.second.blockHeight > end) {
+            if (!tokenName.empty())
+                break;
+            pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, key.second.token,
+                                                                                         std::numeric_limits<int>::max())));
+            continue;
+        }
+
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        if (!fn(key.second, nValue))
+            break;
+        pcursor->Next();
     }
 
     return true;
@@ -398,12 +588,145 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return CBlockTreeDB::ReadAddressIndex(addressHash, type, "", addressIndex, start, end);
 }
 
+bool CBlockTreeDB::ForEachAddressIndex(const std::vector<std::pair<uint160, int> >& addresses, std::string tokenName, int start, int end,
+                                       const CAddressIndexKey* pafter, std::function<bool(const CAddressIndexKey&, const CAmount&)> fn) {
+
+    // One stream for each address and token, the entries of each are sorted by height. The first entry of
+    // every stream is found with one shared cursor, and a stream gets a cursor of its own only once that entry
+    // is visited, so that a page of a few entries doesn't open one for each token of each address. They all
+    // read the same snapshot, as the streams would otherwise see the index at different times
+    CDBSnapshot snapshot(*this);
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator(snapshot));
+
+    struct AddressIndexStream {
+        std::unique_ptr<CDBIterator> pcursor;
+        CAddressIndexKey key;
+        CAmount nValue;
+    };
+    std::vector<AddressIndexStream> vStreams;
+    int nSeekHeight = std::max(start, pafter ? pafter->blockHeight : 0);
+
+    // Move a cursor to the next entry in the range of a stream, false when the stream has none left
+    auto next = [&](CDBIterator& cursor, unsigned int type, const uint160& hashBytes, const std::string& token, AddressIndexStream& stream) {
+        while (cursor.Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<char,CAddressIndexKey> key;
+            if (!cursor.GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.type != type
+                    || key.second.hashBytes != hashBytes || key.second.token != token
+                    || (end > 0 && key.second.blockHeight > end)) {
+                return false;
+            }
+            if (pafter && !AddressIndexMergeLess(*pafter, key.second)) {
+                cursor.Next();
+                continue;
+            }
+            if (!cursor.GetValue(stream.nValue))
+                throw std::runtime_error("failed to get address index value");
+            stream.key = key.second;
+            return true;
+        }
+        return false;
+    };
+
+    auto greater = [&vStreams](size_t a, size_t b) { return AddressIndexMergeLess(vStreams[b].key, vStreams[a].key); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> queue(greater);
+
+    try {
+        // Seek to the first entry in the range of a token, and queue its stream when there is one
+        auto first = [&](const std::pair<uint160, int>& address, const std::string& token) {
+            pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(address.second, address.first, token, nSeekHeight)));
+            AddressIndexStream stream;
+            if (next(*pcursor, address.second, address.first, token, stream)) {
+                vStreams.push_back(std::move(stream));
+                queue.push(vStreams.size() - 1);
+            }
+        };
+
+        std::set<std::pair<uint160, int> > setAddresses(addresses.begin(), addresses.end());
+        for (const std::pair<uint160, int>& address : setAddresses) {
+            if (!tokenName.empty()) {
+                first(address, tokenName);
+                continue;
+            }
+
+            // Skip from one token of the address to the next
+            pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(address.second, address.first)));
+            while (pcursor->Valid()) {
+                boost::this_thread::interruption_point();
+                std::pair<char,CAddressIndexKey> key;
+                if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.type != (unsigned int)address.second
+                        || key.second.hashBytes != address.first) {
+                    break;
+                }
+                std::string token = key.second.token;
+                first(address, token);
+                pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(address.second, address.first, token,
+                                                                                             std::numeric_limits<int>::max())));
+            }
+        }
+
+        while (!queue.empty()) {
+            size_t i = queue.top();
+            queue.pop();
+            AddressIndexStream& stream = vStreams[i];
+            if (!fn(stream.key, stream.nValue))
+                break;
+            if (!stream.pcursor) {
+                stream.pcursor.reset(NewIterator(snapshot));
+                stream.pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, stream.key));
+            }
+            stream.pcursor->Next();
+            // The key is overwritten by next, so the stream is matched against a copy
+            CAddressIndexKey key = stream.key;
+            if (next(*stream.pcursor, key.type, key.hashBytes, key.token, stream))
+                queue.push(i);
+        }
+    } catch (const std::runtime_error& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadIndexBuildHeight(const std::string &name, int &nHeight) {
+    return Read(std::make_pair(DB_INDEXBUILD, name), nHeight);
+}
+
+bool CBlockTreeDB::WriteIndexBuildHeight(const std::string &name, int nHeight) {
+    return Write(std::make_pair(DB_INDEXBUILD, name), nHeight);
+}
+
+bool CBlockTreeDB::EraseIndexBuildHeight(const std::string &name) {
+    return Erase(std::make_pair(DB_INDEXBUILD, name));
+}
+
+bool CBlockTreeDB::ReadIndexStartHeight(const std::string &name, int &nHeight) {
+    return Read(std::make_pair(DB_INDEXSTART, name), nHeight);
+}
+
+bool CBlockTreeDB::WriteIndexStartHeight(const std::string &name, int nHeight) {
+    return Write(std::make_pair(DB_INDEXSTART, name), nHeight);
+}
+
+bool CBlockTreeDB::EraseIndexStartHeight(const std::string &name) {
+    return Erase(std::make_pair(DB_INDEXSTART, name));
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch(*this);
     batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteTimestampIndex(const std::vector<std::pair<uint256, unsigned int> > &vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<uint256, unsigned int> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        batch.Write(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(it->second, it->first)), 0);
+        batch.Write(std::make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(it->first)), CTimestampBlockIndexValue(it->second));
+    }
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
@@ -16,6 +16,7 @@
 #include "spentindex.h"
 #include "timestampindex.h"
 
+#include <functional>
 #include <map>
 #include <string>
 #include <utility>
@@ -134,7 +135,8 @@ public:
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
-    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    //! fMayExist when some of the entries may be in the index already, as when the background build catches up with ConnectBlock
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fMayExist = false);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type, std::string tokenName,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
@@ -142,13 +144,46 @@ public:
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    //! Visit the address index entries of an address in the order of the index, from height start to end (0 for
+    //! no limit), beginning after pafter when it is given. Stops at the first entry fn returns false for
+    bool ForEachAddressIndex(uint160 addressHash, int type, std::string tokenName, int start, int end,
+                             const CAddressIndexKey* pafter, std::function<bool(const CAddressIndexKey&, const CAmount&)> fn);
+    //! The same for several addresses at once, merged in the order of AddressIndexMergeLess, so by height and
+    //! with the entries of one transaction next to each other. Without a token name, every token is merged too
+    bool ForEachAddressIndex(const std::vector<std::pair<uint160, int> >& addresses, std::string tokenName, int start, int end,
+                             const CAddressIndexKey* pafter, std::function<bool(const CAddressIndexKey&, const CAmount&)> fn);
+    bool ReadAddressBalance(uint160 addressHash, int type, std::string tokenName,
+                            std::vector<std::pair<std::string, CAddressBalanceValue> > &balances);
+    //! Build or drop the address balance index, so that it matches fEnabled
+    bool SetAddressBalanceIndex(bool fEnabled);
+    //! Height of the next block an index that is built in the background needs, none once it is built
+    bool ReadIndexBuildHeight(const std::string &name, int &nHeight);
+    bool WriteIndexBuildHeight(const std::string &name, int nHeight);
+    bool EraseIndexBuildHeight(const std::string &name);
+    //! Height from which an index that was built without the data of some blocks has every block
+    bool ReadIndexStartHeight(const std::string &name, int &nHeight);
+    bool WriteIndexStartHeight(const std::string &name, int nHeight);
+    bool EraseIndexStartHeight(const std::string &name);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
+    //! Both timestamp index entries of each block, given by hash and logical timestamp, in one batch
+    bool WriteTimestampIndex(const std::vector<std::pair<uint256, unsigned int> > &vect);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+
+private:
+    //! Whether the balance of each address and token is kept next to the address index
+    bool fAddressBalances;
+
+    //! Highest block the address index has entries of, and what it was when the balance index was loaded.
+    //! Only blocks up to the latter can be connected or disconnected again after an unclean shutdown
+    int nAddressIndexHeight;
+    int nAddressReplayHeight;
+
+    void UpdateAddressBalances(CDBBatch& batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fConnect, bool fMayExist);
 };
 
 #endif // ALPHACON_TXDB_H
@@ -423,9 +423,9 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
 
 void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
 {
-    LOCK(cs);
+    AssertLockHeld(cs);
     const CTransaction& tx = entry.GetTx();
-    std::vector<CMempoolAddressDeltaKey> inserted;
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > inserted;
 
     uint256 txhash = tx.GetHash();
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
@@ -435,20 +435,17 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
             std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), ALP, txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(std::make_pair(key, delta));
-            inserted.push_back(key);
+            inserted.push_back(std::make_pair(key, delta));
         } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
             std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23);
             CMempoolAddressDeltaKey key(1, uint160(hashBytes), ALP, txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(std::make_pair(key, delta));
-            inserted.push_back(key);
+            inserted.push_back(std::make_pair(key, delta));
         } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
             uint160 hashBytes(Hash160(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.end()-1));
             CMempoolAddressDeltaKey key(1, hashBytes, ALP, txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(std::make_pair(key, delta));
-            inserted.push_back(key);
+            inserted.push_back(std::make_pair(key, delta));
         } else {
             /** TOKENS START */
             if (AreTokensDeployed()) {
@@ -458,8 +455,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
                 if (ParseTokenScript(prevout.scriptPubKey, hashBytes, tokenName, tokenAmount)) {
                     CMempoolAddressDeltaKey key(1, hashBytes, tokenName, txhash, j, 1);
                     CMempoolAddressDelta delta(entry.GetTime(), tokenAmount * -1, input.prevout.hash, input.prevout.n);
-                    mapAddress.insert(std::make_pair(key, delta));
-                    inserted.push_back(key);
+                    inserted.push_back(std::make_pair(key, delta));
                 }
             }
             /** TOKENS END */
@@ -471,52 +467,44 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
         if (out.scriptPubKey.IsPayToScriptHash()) {
             std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), ALP, txhash, k, 0);
-            mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            inserted.push_back(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
         } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
             std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-            std::pair<addressDeltaMap::iterator,bool> ret;
             CMempoolAddressDeltaKey key(1, uint160(hashBytes), ALP, txhash, k, 0);
-            mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            inserted.push_back(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
         } else if (out.scriptPubKey.IsPayToPublicKey()) {
             uint160 hashBytes(Hash160(out.scriptPubKey.begin()+1, out.scriptPubKey.end()-1));
-            std::pair<addressDeltaMap::iterator,bool> ret;
             CMempoolAddressDeltaKey key(1, hashBytes, ALP, txhash, k, 0);
-            mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            inserted.push_back(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
         } else {
             /** TOKENS START */
             if (AreTokensDeployed()) {
                 uint160 hashBytes;
                 std::string tokenName;
                 CAmount tokenAmount;
-                if (ParseTokenScript(out.scriptPubKey, hashBytes, tokenName, tokenAmount)) {
-                    std::pair<addressDeltaMap::iterator, bool> ret;
+                if (ParseTokenOutput(tx, k, hashBytes, tokenName, tokenAmount)) {
                     CMempoolAddressDeltaKey key(1, hashBytes, tokenName, txhash, k, 0);
-                    mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), tokenAmount)));
-                    inserted.push_back(key);
+                    inserted.push_back(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), tokenAmount)));
                 }
             }
             /** TOKENS END */
         }
     }
 
-    mapAddressInserted.insert(std::make_pair(txhash, inserted));
+    addressIndex.Add(txhash, inserted);
 }
 
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses, std::string tokenName,
                                  std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
 {
-    LOCK(cs);
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first,
-                                                                                       tokenName));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second
-                && (*ait).first.token == tokenName) {
-            results.push_back(*ait);
-            ait++;
-        }
+        addressIndex.ForEachFrom(CMempoolAddressDeltaKey((*it).second, (*it).first, tokenName),
+                                 [&](const CMempoolAddressDeltaKey& key, const CMempoolAddressDelta& delta) {
+            if (key.addressBytes != (*it).first || key.type != (*it).second || key.token != tokenName)
+                return false;
+            results.push_back(std::make_pair(key, delta));
+            return true;
+        });
     }
     return true;
 }
@@ -524,39 +512,30 @@ bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresse
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                                  std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
 {
-    LOCK(cs);
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
-            ait++;
-        }
+        addressIndex.ForEachFrom(CMempoolAddressDeltaKey((*it).second, (*it).first),
+                                 [&](const CMempoolAddressDeltaKey& key, const CMempoolAddressDelta& delta) {
+            if (key.addressBytes != (*it).first || key.type != (*it).second)
+                return false;
+            results.push_back(std::make_pair(key, delta));
+            return true;
+        });
     }
     return true;
 }
 
 bool CTxMemPool::removeAddressIndex(const uint256 txhash)
 {
-    LOCK(cs);
-    addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
-
-    if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
-        }
-        mapAddressInserted.erase(it);
-    }
-
+    AssertLockHeld(cs);
+    addressIndex.Remove(txhash);
     return true;
 }
 
 void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
 {
-    LOCK(cs);
-
+    AssertLockHeld(cs);
     const CTransaction& tx = entry.GetTx();
-    std::vector<CSpentIndexKey> inserted;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > inserted;
 
     uint256 txhash = tx.GetHash();
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
@@ -582,40 +561,22 @@ void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCac
         CSpentIndexKey key = CSpentIndexKey(input.prevout.hash, input.prevout.n);
         CSpentIndexValue value = CSpentIndexValue(txhash, j, -1, prevout.nValue, addressType, addressHash);
 
-        mapSpent.insert(std::make_pair(key, value));
-        inserted.push_back(key);
+        inserted.push_back(std::make_pair(key, value));
 
     }
 
-    mapSpentInserted.insert(std::make_pair(txhash, inserted));
+    spentIndex.Add(txhash, inserted);
 }
 
 bool CTxMemPool::getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 {
-    LOCK(cs);
-    mapSpentIndex::iterator it;
-
-    it = mapSpent.find(key);
-    if (it != mapSpent.end()) {
-        value = it->second;
-        return true;
-    }
-    return false;
+    return spentIndex.Get(key, value);
 }
 
 bool CTxMemPool::removeSpentIndex(const uint256 txhash)
 {
-    LOCK(cs);
-    mapSpentIndexInserted::iterator it = mapSpentInserted.find(txhash);
-
-    if (it != mapSpentInserted.end()) {
-        std::vector<CSpentIndexKey> keys = (*it).second;
-        for (std::vector<CSpentIndexKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapSpent.erase(*mit);
-        }
-        mapSpentInserted.erase(it);
-    }
-
+    AssertLockHeld(cs);
+    spentIndex.Remove(txhash);
     return true;
 }
 
@@ -9,6 +9,8 @@
 #ifndef ALPHACON_TXMEMPOOL_H
 #define ALPHACON_TXMEMPOOL_H
 
+#include <functional>
+#include <limits>
 #include <memory>
 #include <set>
 #include <map>
@@ -20,6 +22,7 @@
 #include "spentindex.h"
 #include "amount.h"
 #include "coins.h"
+#include "hash.h"
 #include "indirectmap.h"
 #include "policy/feerate.h"
 #include "primitives/transaction.h"
@@ -342,6 +345,139 @@ public:
     }
 };
 
+/**
+ * An index of the mempool transactions that is split into shards, each with
+ * its own lock. Looking entries up doesn't take the mempool lock, and only waits
+ * on a writer within one shard.
+ *
+ * An entry goes to the shard picked by ShardKey, a functor that maps the entries
+ * that are read together (the deltas of one address) to the same value. Each
+ * shard keeps its entries ordered by Compare. The keys added by a transaction are
+ * kept, by txid, in a second set of shards, so that they can be removed with it.
+ *
+ * Add and Remove take the lock of the txid shard and the lock of each entry
+ * shard in turn, so they must not run at the same time: a Remove that comes
+ * between the two would leave the entries behind. The mempool only calls them
+ * with its own lock held. A reader can see some of the entries of a transaction
+ * that is being added or removed.
+ */
+template<typename K, typename V, typename Compare, typename ShardKey>
+class CMempoolShardedIndex
+{
+public:
+    static const size_t SHARDS = 16;
+
+    CMempoolShardedIndex() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    CMempoolShardedIndex(const CMempoolShardedIndex&) = delete;
+    CMempoolShardedIndex& operator=(const CMempoolShardedIndex&) = delete;
+
+    void Add(const uint256& txhash, const std::vector<std::pair<K, V> >& entries)
+    {
+        {
+            TxShard& txShard = GetTxShard(txhash);
+            LOCK(txShard.cs);
+            std::vector<K>& keys = txShard.mapInserted[txhash];
+            if (!keys.empty())
+                return;
+            keys.reserve(entries.size());
+            for (const std::pair<K, V>& entry : entries)
+                keys.push_back(entry.first);
+        }
+        for (const std::pair<K, V>& entry : entries) {
+            Shard& shard = GetShard(entry.first);
+            LOCK(shard.cs);
+            shard.mapEntries.insert(entry);
+        }
+    }
+
+    void Remove(const uint256& txhash)
+    {
+        std::vector<K> keys;
+        {
+            TxShard& txShard = GetTxShard(txhash);
+            LOCK(txShard.cs);
+            auto it = txShard.mapInserted.find(txhash);
+            if (it == txShard.mapInserted.end())
+                return;
+            keys = std::move(it->second);
+            txShard.mapInserted.erase(it);
+        }
+        for (const K& key : keys) {
+            Shard& shard = GetShard(key);
+            LOCK(shard.cs);
+            shard.mapEntries.erase(key);
+        }
+    }
+
+    bool Get(const K& key, V& value) const
+    {
+        const Shard& shard = GetShard(key);
+        LOCK(shard.cs);
+        auto it = shard.mapEntries.find(key);
+        if (it == shard.mapEntries.end())
+            return false;
+        value = it->second;
+        return true;
+    }
+
+    //! Visit the entries of the shard of first in order, from first on, until fn returns false
+    void ForEachFrom(const K& first, std::function<bool(const K&, const V&)> fn) const
+    {
+        const Shard& shard = GetShard(first);
+        LOCK(shard.cs);
+        for (auto it = shard.mapEntries.lower_bound(first); it != shard.mapEntries.end(); it++) {
+            if (!fn(it->first, it->second))
+                break;
+        }
+    }
+
+    size_t Size() const
+    {
+        size_t nSize = 0;
+        for (const Shard& shard : shards) {
+            LOCK(shard.cs);
+            nSize += shard.mapEntries.size();
+        }
+        return nSize;
+    }
+
+private:
+    struct Shard
+    {
+        mutable CCriticalSection cs;
+        std::map<K, V, Compare> mapEntries;
+    };
+
+    struct TxShard
+    {
+        mutable CCriticalSection cs;
+        std::map<uint256, std::vector<K> > mapInserted;
+    };
+
+    //! Salt of the shard choice, so that entries can't be made to pile up in one shard
+    const uint64_t k0, k1;
+    SaltedTxidHasher txidHasher;
+
+    Shard shards[SHARDS];
+    TxShard txShards[SHARDS];
+
+    Shard& GetShard(const K& key) { return shards[CSipHasher(k0, k1).Write(ShardKey()(key)).Finalize() % SHARDS]; }
+    const Shard& GetShard(const K& key) const { return shards[CSipHasher(k0, k1).Write(ShardKey()(key)).Finalize() % SHARDS]; }
+    TxShard& GetTxShard(const uint256& txhash) { return txShards[txidHasher(txhash) % SHARDS]; }
+};
+
+/** The deltas of one address go to one shard, so that they can be read in one go */
+struct CMempoolAddressDeltaShardKey
+{
+    uint64_t operator()(const CMempoolAddressDeltaKey& key) const { return key.addressBytes.GetUint64(0) ^ key.type; }
+};
+
+struct CSpentIndexShardKey
+{
+    uint64_t operator()(const CSpentIndexKey& key) const { return key.txid.GetUint64(0) ^ key.outputIndex; }
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -495,17 +631,12 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
-    addressDeltaMap mapAddress;
-
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
-    addressDeltaMapInserted mapAddressInserted;
-
-    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
-    mapSpentIndex mapSpent;
+    // The address and spent indexes have their own locks, cs isn't needed to use them
+    typedef CMempoolShardedIndex<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare, CMempoolAddressDeltaShardKey> addressDeltaIndex;
+    addressDeltaIndex addressIndex;
 
-    typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
-    mapSpentIndexInserted mapSpentInserted;
+    typedef CMempoolShardedIndex<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare, CSpentIndexShardKey> spentOutputIndex;
+    spentOutputIndex spentIndex;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
@@ -84,11 +84,15 @@ std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
 bool fTokenIndex = false;
+bool fTokenRichIndex = DEFAULT_TOKENRICHINDEX;
+unsigned int nTokenNameFilterRate = DEFAULT_TOKEN_NAME_FILTER_RATE;
 bool fAddressIndex = false;
+bool fAddressBalanceIndex = DEFAULT_ADDRESSBALANCEINDEX;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
+bool fSnapshotChainstate = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
@@ -205,7 +209,7 @@ CTokensDB *ptokensdb = nullptr;
 CTokensCache *ptokens = nullptr;
 
 CTokensCache *tmpTokenCache = nullptr;
-CLRUCache<std::string, CDatabasedTokenData> *ptokensCache = nullptr;
+CShardedLRUCache<std::string, CDatabasedTokenData> *ptokensCache = nullptr;
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
@@ -938,10 +942,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         }
 
         if (AreTokensDeployed()) {
-            for (auto out : tx.vout) {
-                if (out.scriptPubKey.IsTokenScript()) {
+            for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                if (tx.vout[i].scriptPubKey.IsTokenScript()) {
                     CTokenOutputEntry data;
-                    if (!GetTokenData(out.scriptPubKey, data))
+                    if (!GetTokenData(tx, i, data))
                         continue;
                     if (data.type == TX_NEW_TOKEN && !IsTokenNameAnOwner(data.tokenName)) {
                         pool.mapTokenToHash[data.tokenName] = hash;
@@ -1055,6 +1059,42 @@ bool GetAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool ForEachAddressIndex(uint160 addressHash, int type, std::string tokenName, int start, int end,
+                         const CAddressIndexKey* pafter, std::function<bool(const CAddressIndexKey&, const CAmount&)> fn)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ForEachAddressIndex(addressHash, type, tokenName, start, end, pafter, fn))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool ForEachAddressIndex(const std::vector<std::pair<uint160, int> >& addresses, std::string tokenName, int start, int end,
+                         const CAddressIndexKey* pafter, std::function<bool(const CAddressIndexKey&, const CAmount&)> fn)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ForEachAddressIndex(addresses, tokenName, start, end, pafter, fn))
+        return error("unable to get txids for addresses");
+
+    return true;
+}
+
+bool GetAddressBalance(uint160 addressHash, int type, std::string tokenName,
+                       std::vector<std::pair<std::string, CAddressBalanceValue> > &balances)
+{
+    if (!fAddressIndex || !fAddressBalanceIndex)
+        return error("address balance index not enabled");
+
+    if (!pblocktree->ReadAddressBalance(addressHash, type, tokenName, balances))
+        return error("unable to get balances for address");
+
+    return true;
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type, std::string tokenName,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
@@ -1438,6 +1478,13 @@ bool CScriptCheck::operator()() {
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
 }
 
+bool CTokenCheck::operator()() {
+    // The queue stops running checks after the first one that fails. Carry on instead, so that every
+    // transaction gets its result and the caller can report the first failure in block order.
+    Consensus::CheckTxTokenTransfers(*ptx, *pstate, vTokenCoins, nSpendHeight, nSpendTime);
+    return true;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1775,7 +1822,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
                         CAmount tokenAmount;
                         uint160 hashBytes;
 
-                        if (ParseTokenScript(out.scriptPubKey, hashBytes, tokenName, tokenAmount)) {
+                        if (ParseTokenOutput(tx, k, hashBytes, tokenName, tokenAmount)) {
 //                            std::cout << "ConnectBlock(): pushing tokens onto addressIndex: " << "1" << ", " << hashBytes.GetHex() << ", " << tokenName << ", " << pindex->nHeight
 //                                      << ", " << i << ", " << hash.GetHex() << ", " << k << ", " << "true" << ", " << tokenAmount << std::endl;
 
@@ -1869,12 +1916,11 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
                     }
                 } else if (tx.IsNewUniqueToken()) {
                     for (int n = 0; n < (int)tx.vout.size(); n++) {
-                        auto out = tx.vout[n];
                         CNewToken token;
                         std::string strAddress;
 
-                        if (IsScriptNewUniqueToken(out.scriptPubKey)) {
-                            if (!TokenFromScript(out.scriptPubKey, token, strAddress)) {
+                        if (IsNewUniqueTokenOutput(tx, n)) {
+                            if (!TokenFromTransaction(tx, n, token, strAddress)) {
                                 error("%s : Failed to get unique token from transaction. TXID : %s, vout: %s", __func__,
                                       tx.GetHash().GetHex(), n);
                                 return DISCONNECT_FAILED;
@@ -1893,7 +1939,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
                 for (auto index : vTokenTxIndex) {
                     CTokenTransfer transfer;
                     std::string strAddress;
-                    if (!TransferTokenFromScript(tx.vout[index].scriptPubKey, transfer, strAddress)) {
+                    if (!TransferTokenFromTransaction(tx, index, transfer, strAddress)) {
                         error("%s : Failed to get transfer token from transaction. CTxOut : %s", __func__,
                               tx.vout[index].ToString());
                         return DISCONNECT_FAILED;
@@ -2040,6 +2086,13 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CTokenCheck> tokencheckqueue(128);
+
+void ThreadTokenCheck() {
+    RenameThread("alphacon-tokench");
+    tokencheckqueue.Thread();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2133,6 +2186,100 @@ static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
 
+//! Address type and hash of a script the address index knows, and with a token script the token name and amount.
+//! With ptx the script is output n of it, and the token is read from the outputs ptx has parsed already
+static bool GetIndexAddress(const CScript& script, int& type, uint160& hashBytes, std::string& tokenName, CAmount& nAmount,
+                            const CTransaction* ptx = nullptr, unsigned int n = 0)
+{
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+2, script.begin()+22));
+        type = 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin()+3, script.begin()+23));
+        type = 1;
+    } else if (script.IsPayToPublicKey()) {
+        hashBytes = Hash160(script.begin()+1, script.end()-1);
+        type = 1;
+    } else if (AreTokensDeployed() && (ptx ? ParseTokenOutput(*ptx, n, hashBytes, tokenName, nAmount)
+                                           : ParseTokenScript(script, hashBytes, tokenName, nAmount))) {
+        type = 1;
+    } else {
+        hashBytes.SetNull();
+        type = 0;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Add the address and spent index entries of transaction i of the block at nHeight. ConnectBlock and
+ * the background index build both use this, so that they write the same entries. prevout gives the
+ * output each input spends, and an output goes into the unspent index unless fUnspent returns false
+ * for it.
+ */
+static void GetTxIndexEntries(const CTransaction& tx, unsigned int i, int nHeight, bool fAddress, bool fSpent,
+                              const std::function<const CTxOut&(unsigned int)>& prevout,
+                              const std::function<bool(unsigned int)>& fUnspent,
+                              std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex,
+                              std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& addressUnspentIndex,
+                              std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& spentIndex)
+{
+    const uint256 txhash = tx.GetHash();
+
+    if (!tx.IsCoinBase()) {
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const CTxIn& input = tx.vin[j];
+            const CTxOut& spent = prevout(j);
+            int addressType;
+            uint160 hashBytes;
+            std::string tokenName;
+            CAmount tokenAmount = 0;
+            bool fKnown = GetIndexAddress(spent.scriptPubKey, addressType, hashBytes, tokenName, tokenAmount);
+
+            // record spending activity, and remove the output from the unspent index
+            if (fAddress && fKnown) {
+                if (!tokenName.empty()) {
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, tokenName, nHeight, i, txhash, j, true), tokenAmount * -1));
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, tokenName, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                } else {
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, j, true), spent.nValue * -1));
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                }
+            }
+
+            // add the spent index to determine the txid and input that spent an output
+            // and to find the amount and address from an input
+            if (fSpent)
+                spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, nHeight, spent.nValue, addressType, hashBytes)));
+        }
+    }
+
+    if (!fAddress)
+        return;
+
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut& out = tx.vout[k];
+        int addressType;
+        uint160 hashBytes;
+        std::string tokenName;
+        CAmount tokenAmount = 0;
+        if (!GetIndexAddress(out.scriptPubKey, addressType, hashBytes, tokenName, tokenAmount, &tx, k))
+            continue;
+
+        // record receiving activity, and the unspent output
+        bool fAddUnspent = !fUnspent || fUnspent(k);
+        if (!tokenName.empty()) {
+            addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, tokenName, nHeight, i, txhash, k, false), tokenAmount));
+            if (fAddUnspent)
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, tokenName, txhash, k), CAddressUnspentValue(tokenAmount, out.scriptPubKey, nHeight, tx.nTime)));
+        } else {
+            addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, k, false), out.nValue));
+            if (fAddUnspent)
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight, tx.nTime)));
+        }
+    }
+}
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
@@ -2239,6 +2386,13 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
+    // The token transfer checks of the transactions only read the token coins they spend and the token
+    // database as it was before this block, so they run on the token check threads while the cache
+    // changes below are still made one transaction after the other. Each writes to its own state, and
+    // the first failure in block order is the one reported.
+    std::vector<CValidationState> vTokenCheckStates(block.vtx.size());
+    CCheckQueueControl<CTokenCheck> tokenControl(nScriptCheckThreads && AreTokensDeployed() ? &tokencheckqueue : nullptr);
+
     std::vector<int> prevheights;
     CAmount nFees = 0;
     CAmount nActualStakeReward = 0;
@@ -2258,7 +2412,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
-        const uint256 txhash = tx.GetHash();
 
         nInputs += tx.vin.size();
 
@@ -2279,7 +2432,22 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
             if (AreTokensDeployed()) {
                 std::vector<std::pair<std::string, uint256>> vReissueTokens;
-                if (!Consensus::CheckTxTokens(tx, state, view, pindex->nHeight, pindex->nTime, vReissueTokens)) {
+                if (nScriptCheckThreads) {
+                    std::vector<Coin> vTokenCoins;
+                    for (const CTxIn& txin : tx.vin) {
+                        const Coin& coin = view.AccessCoin(txin.prevout);
+                        if (coin.IsToken())
+                            vTokenCoins.push_back(coin);
+                    }
+                    std::vector<CTokenCheck> vTokenChecks;
+                    vTokenChecks.emplace_back(tx, std::move(vTokenCoins), pindex->nHeight, pindex->nTime, &vTokenCheckStates[i]);
+                    tokenControl.Add(vTokenChecks);
+
+                    if (!Consensus::CheckTxTokenReissues(tx, state, vReissueTokens)) {
+                        return error("%s: Consensus::CheckTxTokenReissues: %s, %s", __func__, tx.GetHash().ToString(),
+                                     FormatStateMessage(state));
+                    }
+                } else if (!Consensus::CheckTxTokens(tx, state, view, pindex->nHeight, pindex->nTime, vReissueTokens)) {
                     return error("%s: Consensus::CheckTxTokens: %s, %s", __func__, tx.GetHash().ToString(),
                                  FormatStateMessage(state));
                 }
@@ -2298,72 +2466,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             //     return state.DoS(100, error("%s: contains a non-BIP68-final transaction", __func__),
             //                      REJECT_INVALID, "bad-txns-nonfinal");
             // }
-
-            if (fAddressIndex || fSpentIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.AccessCoin(tx.vin[j].prevout).out;
-                    uint160 hashBytes;
-                    int addressType;
-                    bool isToken = false;
-                    std::string tokenName;
-                    CAmount tokenAmount;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-                        hashBytes = uint160(std::vector <unsigned char>(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
-                        hashBytes = Hash160(prevout.scriptPubKey.begin() + 1, prevout.scriptPubKey.end() - 1);
-                        addressType = 1;
-                    } else {
-                        /** TOKENS START */
-                        if (AreTokensDeployed()) {
-                            hashBytes.SetNull();
-                            addressType = 0;
-
-                            if (ParseTokenScript(prevout.scriptPubKey, hashBytes, tokenName, tokenAmount)) {
-                                addressType = 1;
-                                isToken = true;
-                            }
-                        }
-                        /** TOKENS END */
-                    }
-
-                    if (fAddressIndex && addressType > 0) {
-                        /** TOKENS START */
-                        if (isToken) {
-//                            std::cout << "ConnectBlock(): pushing tokens onto addressIndex: " << "1" << ", " << hashBytes.GetHex() << ", " << tokenName << ", " << pindex->nHeight
-//                                      << ", " << i << ", " << txhash.GetHex() << ", " << j << ", " << "true" << ", " << tokenAmount * -1 << std::endl;
-
-                            // record spending activity
-                            addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, tokenName, pindex->nHeight, i, txhash, j, true), tokenAmount * -1));
-
-                            // remove address from unspent index
-                            addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, tokenName, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                        /** TOKENS END */
-                        } else {
-                            // record spending activity
-                            addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
-
-                            // remove address from unspent index
-                            addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                        }
-                    }
-                    /** TOKENS END */
-
-                    if (fSpentIndex) {
-                        // add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input
-                        spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
-                    }
-                }
-
-            }
         }
 
         // GetTransactionSigOpCost counts 3 types of sigops:
@@ -2440,13 +2542,13 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 if (!tx.VerifyNewUniqueToken(error))
                     return state.DoS(100, false, REJECT_INVALID, "bad-txns-issue-unique-token-failed-verify");
 
-                for (auto out : tx.vout)
+                for (unsigned int n = 0; n < tx.vout.size(); n++)
                 {
-                    if (IsScriptNewUniqueToken(out.scriptPubKey))
+                    if (IsNewUniqueTokenOutput(tx, n))
                     {
                         CNewToken token;
                         std::string strAddress;
-                        if (!TokenFromScript(out.scriptPubKey, token, strAddress))
+                        if (!TokenFromTransaction(tx, n, token, strAddress))
                             return state.DoS(100, false, REJECT_INVALID, "bad-txns-connect-block-issue-unique-token-serialization");
 
                         std::string strError = "";
@@ -2457,64 +2559,11 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             }
         }
         /** TOKENS END */
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight, tx.nTime)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight, tx.nTime)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKey()) {
-                    uint160 hashBytes(Hash160(out.scriptPubKey.begin() + 1, out.scriptPubKey.end() - 1));
-                    addressIndex.push_back(
-                            std::make_pair(CAddressIndexKey(1, hashBytes, pindex->nHeight, i, txhash, k, false),
-                                           out.nValue));
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, hashBytes, txhash, k),
-                                                                 CAddressUnspentValue(out.nValue, out.scriptPubKey,
-                                                                                      pindex->nHeight, tx.nTime)));
-                } else {
-                    /** TOKENS START */
-                    if (AreTokensDeployed()) {
-                        std::string tokenName;
-                        CAmount tokenAmount;
-                        uint160 hashBytes;
-
-                        if (ParseTokenScript(out.scriptPubKey, hashBytes, tokenName, tokenAmount)) {
-//                            std::cout << "ConnectBlock(): pushing tokens onto addressIndex: " << "1" << ", " << hashBytes.GetHex() << ", " << tokenName << ", " << pindex->nHeight
-//                                      << ", " << i << ", " << txhash.GetHex() << ", " << k << ", " << "true" << ", " << tokenAmount << std::endl;
-
-                            // record receiving activity
-                            addressIndex.push_back(std::make_pair(
-                                    CAddressIndexKey(1, hashBytes, tokenName, pindex->nHeight, i, txhash, k, false),
-                                    tokenAmount));
-
-                            // record unspent output
-                            addressUnspentIndex.push_back(
-                                    std::make_pair(CAddressUnspentKey(1, hashBytes, tokenName, txhash, k),
-                                                   CAddressUnspentValue(tokenAmount, out.scriptPubKey,
-                                                                        pindex->nHeight, tx.nTime)));
-                        }
-                    } else {
-                        continue;
-                    }
-                    /** TOKENS END */
-                }
-            }
+        // The outputs the transaction spends are still in the view until UpdateCoins below
+        if (fAddressIndex || fSpentIndex) {
+            GetTxIndexEntries(tx, i, pindex->nHeight, fAddressIndex, fSpentIndex,
+                              [&view, &tx](unsigned int j) -> const CTxOut& { return view.AccessCoin(tx.vin[j].prevout).out; },
+                              nullptr, addressIndex, addressUnspentIndex, spentIndex);
         }
 
         CTxUndo undoDummy;
@@ -2563,6 +2612,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     // if (!control.Wait())
         // return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+
+    tokenControl.Wait();
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        if (!vTokenCheckStates[i].IsValid()) {
+            state = vTokenCheckStates[i];
+            return error("%s: Consensus::CheckTxTokenTransfers: %s, %s", __func__, block.vtx[i]->GetHash().ToString(),
+                         FormatStateMessage(state));
+        }
+    }
     
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
@@ -2695,13 +2753,11 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         // Get the size of the memory used by the token cache.
         int64_t tokenDynamicSize = 0;
         int64_t tokenDirtyCacheSize = 0;
-        size_t tokenMapAmountSize = 0;
         if (AreTokensDeployed()) {
             auto currentActiveTokenCache = GetCurrentTokenCache();
             if (currentActiveTokenCache) {
                 tokenDynamicSize = currentActiveTokenCache->DynamicMemoryUsage();
                 tokenDirtyCacheSize = currentActiveTokenCache->GetCacheSizeV2();
-                tokenMapAmountSize = currentActiveTokenCache->mapTokensAddressAmount.size();
             }
         }
 
@@ -2712,7 +2768,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
         // The cache is over the limit, we have to write now.
-        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && (cacheSize > nTotalSpace || tokenMapAmountSize > 1000000);
+        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
@@ -2775,10 +2831,10 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             /** TOKENS START */
             // Flush the tokenstate
             if (AreTokensDeployed()) {
-                // Flush the tokenstate
+                // Synced as one batch, so a crash can't leave the token database half written
                 auto currentActiveTokenCache = GetCurrentTokenCache();
                 if (currentActiveTokenCache) {
-                    if (!currentActiveTokenCache->DumpCacheToDatabase())
+                    if (!currentActiveTokenCache->DumpCacheToDatabase(true))
                         return AbortNode(state, "Failed to write to token database");
                 }
             }
@@ -3991,12 +4047,12 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
         }
 
         if (tx->IsNewUniqueToken()) {
-            for (auto out : tx->vout) {
+            for (unsigned int n = 0; n < tx->vout.size(); n++) {
                 CNewToken token;
                 std::string strAddress;
 
-                if (IsScriptNewUniqueToken(out.scriptPubKey)) {
-                    if (!TokenFromScript(out.scriptPubKey, token, strAddress))
+                if (IsNewUniqueTokenOutput(*tx, n)) {
+                    if (!TokenFromTransaction(*tx, n, token, strAddress))
                         return state.DoS(100, false, REJECT_INVALID, "bad-txns-issue-unique-token");
                 }
             }
@@ -4606,6 +4662,11 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // Check whether the chainstate was loaded from a UTXO snapshot
+    pblocktree->ReadFlag("snapshotchainstate", fSnapshotChainstate);
+    if (fSnapshotChainstate)
+        LogPrintf("LoadBlockIndexDB(): Chainstate was loaded from a UTXO snapshot\n");
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -4661,6 +4722,71 @@ bool LoadChainTip(const CChainParams& chainparams)
     return true;
 }
 
+bool ActivateSnapshotTip(CBlockIndex* pindexBase, unsigned int nChainTx, const uint256& nStakeModifier)
+{
+    AssertLockHeld(cs_main);
+
+    // The blocks before the base were never downloaded. Like blocks whose
+    // data was pruned they keep their headers, and are counted as one
+    // transaction each so that the base gets the snapshot's nChainTx.
+    std::vector<CBlockIndex*> vBlocks;
+    for (CBlockIndex* pindex = pindexBase; pindex && !pindex->nChainTx; pindex = pindex->pprev) {
+        if (pindex->nStatus & BLOCK_FAILED_MASK)
+            return error("%s: block %s of the snapshot chain is marked invalid", __func__, pindex->GetBlockHash().ToString());
+        vBlocks.push_back(pindex);
+    }
+    if (vBlocks.empty() || !pindexBase->pprev)
+        return error("%s: block %s already has its transactions", __func__, pindexBase->GetBlockHash().ToString());
+
+    for (auto it = vBlocks.rbegin(); it != vBlocks.rend(); ++it) {
+        CBlockIndex* pindex = *it;
+        if (pindex == pindexBase) {
+            if (nChainTx <= pindex->pprev->nChainTx)
+                return error("%s: snapshot has %u transactions up to block %s, too few for its height", __func__, nChainTx, pindex->GetBlockHash().ToString());
+            pindex->nTx = nChainTx - pindex->pprev->nChainTx;
+            pindex->nStakeModifier = nStakeModifier;
+        } else if (!pindex->nTx) {
+            pindex->nTx = 1;
+        }
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+        setDirtyBlockIndex.insert(pindex);
+    }
+
+    // Blocks after the base that arrived before it can be connected on top of it now
+    std::deque<CBlockIndex*> queue;
+    queue.push_back(pindexBase);
+    while (!queue.empty()) {
+        CBlockIndex* pindex = queue.front();
+        queue.pop_front();
+        if (pindex != pindexBase)
+            pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        setBlockIndexCandidates.insert(pindex);
+        auto range = mapBlocksUnlinked.equal_range(pindex);
+        for (auto it = range.first; it != range.second; ++it)
+            queue.push_back(it->second);
+        mapBlocksUnlinked.erase(range.first, range.second);
+    }
+
+    fHavePruned = true;
+    fSnapshotChainstate = true;
+    if (!pblocktree->WriteFlag("prunedblockfiles", true) || !pblocktree->WriteFlag("snapshotchainstate", true))
+        return error("%s: failed to write the snapshot flags to the block tree", __func__);
+
+    mempool.clear();
+    chainActive.SetTip(pindexBase);
+    PruneBlockIndexCandidates();
+
+    LogPrintf("Loaded snapshot chain: hashBestChain=%s height=%d date=%s\n",
+        pindexBase->GetBlockHash().ToString(), pindexBase->nHeight,
+        DateTimeStrFormat("%Y-%m-%d %H:%M:%S", pindexBase->GetBlockTime()));
+    return true;
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0, false);
@@ -4704,8 +4830,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
+        if ((fPruneMode || fSnapshotChainstate) && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, or after a UTXO snapshot, only go back as far as we have data.
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
@@ -4876,7 +5002,7 @@ bool RewindBlockIndex(const CChainParams& params)
     CValidationState state;
     CBlockIndex* pindex = chainActive.Tip();
     while (chainActive.Height() >= nHeight) {
-        if (fPruneMode && !(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA)) {
+        if ((fPruneMode || fSnapshotChainstate) && !(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA)) {
             // If pruning, don't try rewinding past the HAVE_DATA point;
             // since older blocks can't be served anyway, there's
             // no need to walk further, and trying to DisconnectTip()
@@ -4978,6 +5104,231 @@ void UnloadBlockIndex()
     }
     mapBlockIndex.clear();
     fHavePruned = false;
+    fSnapshotChainstate = false;
+}
+
+void ThreadCheckBlockIndexHashes()
+{
+    // The block tree stores each block's hash next to its header, so startup
+    // never has to run groestl over the headers. This pass re-derives them
+    // off the critical path to catch a corrupted block tree.
+    RenameThread("alphacon-hashcheck");
+
+    // Entries are not modified or freed until shutdown, which interrupts this
+    // thread first, so the headers can be hashed without cs_main
+    std::vector<const CBlockIndex*> vIndex;
+    {
+        LOCK(cs_main);
+        vIndex.reserve(mapBlockIndex.size());
+        for (const BlockMap::value_type& entry : mapBlockIndex)
+            vIndex.push_back(entry.second);
+    }
+
+    int64_t nStart = GetTimeMillis();
+    std::atomic<size_t> nMismatch(0);
+    const size_t nThreads = std::max(GetNumCores(), 1);
+    auto checkSlice = [&vIndex, &nMismatch, nThreads](size_t nSlice) {
+        for (size_t i = nSlice; i < vIndex.size(); i += nThreads) {
+            if ((i / nThreads) % 1000 == 0)
+                boost::this_thread::interruption_point();
+            const CBlockIndex* pindex = vIndex[i];
+            if (pindex->GetBlockHeader().GetBlockHash() != pindex->GetBlockHash()) {
+                LogPrintf("ERROR: %s: block index entry at height %d does not match its header hash %s\n", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+                nMismatch++;
+            }
+        }
+    };
+
+    boost::thread_group workers;
+    for (size_t n = 1; n < nThreads; n++)
+        workers.create_thread(boost::bind<void>(checkSlice, n));
+    try {
+        checkSlice(0);
+        workers.join_all();
+    } catch (const boost::thread_interrupted&) {
+        workers.interrupt_all();
+        workers.join_all();
+        throw;
+    }
+
+    LogPrintf("%s: checked %u block index hashes in %dms, %u mismatched\n", __func__, vIndex.size(), GetTimeMillis() - nStart, nMismatch.load());
+    if (nMismatch > 0)
+        SetMiscWarning(_("Warning: The block database contains entries that do not match their block headers. Restart with -reindex to rebuild it."));
+}
+
+//! The indexes that can be turned on without a reindex, and are then built by ThreadIndexBuilder
+static const char* const BACKGROUND_INDEXES[] = {"addressindex", "spentindex", "timestampindex"};
+
+//! Blocks added to the indexes each time cs_main is taken
+static const int INDEX_BUILD_BLOCKS = 16;
+
+bool StartIndexBuild(const std::string& name)
+{
+    // The blocks connected from now on are indexed by ConnectBlock, the ones before by ThreadIndexBuilder,
+    // and a block that is indexed by both gets the same entries twice
+    if (!pblocktree->WriteIndexBuildHeight(name, 1) || !pblocktree->EraseIndexStartHeight(name) || !pblocktree->WriteFlag(name, true))
+        return error("%s: failed to start building %s", __func__, name);
+    LogPrintf("%s: %s turned on, building it in the background\n", __func__, name);
+    return true;
+}
+
+bool GetIndexBuildHeight(const std::string& name, int& nHeight)
+{
+    return pblocktree->ReadIndexBuildHeight(name, nHeight);
+}
+
+bool GetIndexStartHeight(const std::string& name, int& nHeight)
+{
+    return pblocktree->ReadIndexStartHeight(name, nHeight);
+}
+
+/**
+ * Add the entries of one block of the active chain to the indexes that still
+ * need it, with the same entries ConnectBlock adds. The unspent outputs are
+ * checked against the coins at the tip, so that outputs spent in the meantime
+ * are left out. nLogicalTS is the logical timestamp of the previous block, and
+ * of this one on return. Called with cs_main held.
+ */
+static bool BuildBlockIndexes(const CBlockIndex* pindex, bool fAddress, bool fSpent, bool fTimestamp,
+                              std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex,
+                              std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& addressUnspentIndex,
+                              std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& spentIndex,
+                              std::vector<std::pair<uint256, unsigned int> >& timestampIndex, unsigned int& nLogicalTS)
+{
+    AssertLockHeld(cs_main);
+
+    if (fTimestamp && !pblocktree->ReadTimestampBlockIndex(pindex->GetBlockHash(), nLogicalTS)) {
+        nLogicalTS = std::max(pindex->nTime, nLogicalTS + 1);
+        timestampIndex.push_back(std::make_pair(pindex->GetBlockHash(), nLogicalTS));
+    }
+
+    // Blocks below a UTXO snapshot, and pruned ones, are left out
+    if ((!fAddress && !fSpent) || (pindex->nStatus & BLOCK_HAVE_MASK) != BLOCK_HAVE_MASK)
+        return true;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+    CBlockUndo blockUndo;
+    if (!UndoReadFromDisk(blockUndo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()))
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: undo data of block %s doesn't match it", __func__, pindex->GetBlockHash().ToString());
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *(block.vtx[i]);
+        if (i > 0 && blockUndo.vtxundo[i-1].vprevout.size() != tx.vin.size())
+            return error("%s: undo data of transaction %s doesn't match it", __func__, tx.GetHash().ToString());
+
+        GetTxIndexEntries(tx, i, pindex->nHeight, fAddress, fSpent,
+                          [&blockUndo, i](unsigned int j) -> const CTxOut& { return blockUndo.vtxundo[i-1].vprevout[j].out; },
+                          [&tx](unsigned int k) { return pcoinsTip->HaveCoin(COutPoint(tx.GetHash(), k)); },
+                          addressIndex, addressUnspentIndex, spentIndex);
+    }
+
+    return true;
+}
+
+void ThreadIndexBuilder()
+{
+    RenameThread("alphacon-indexbuild");
+
+    int64_t nStart = GetTimeMillis();
+    while (true) {
+        boost::this_thread::interruption_point();
+        LOCK(cs_main);
+
+        // Each index continues from its own height, one that was turned on later starts over
+        std::map<std::string, int> mapHeights;
+        for (const char* name : BACKGROUND_INDEXES) {
+            int nHeight;
+            if (pblocktree->ReadIndexBuildHeight(name, nHeight))
+                mapHeights[name] = nHeight;
+        }
+        if (mapHeights.empty())
+            break;
+
+        int nHeight = std::numeric_limits<int>::max();
+        for (const auto& item : mapHeights)
+            nHeight = std::min(nHeight, item.second);
+        int nStop = std::min(chainActive.Height(), nHeight + INDEX_BUILD_BLOCKS - 1);
+
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+        std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+        std::vector<std::pair<uint256, unsigned int> > timestampIndex;
+        unsigned int nLogicalTS = 0;
+        bool fLogicalTS = false;
+        // The blocks without data each index leaves out, it only has every block from the one after the last
+        std::map<std::string, int> mapStartHeights;
+        for (int h = nHeight; h <= nStop; h++) {
+            const CBlockIndex* pindex = chainActive[h];
+            bool fAddress = mapHeights.count("addressindex") && mapHeights["addressindex"] <= h;
+            bool fSpent = mapHeights.count("spentindex") && mapHeights["spentindex"] <= h;
+            bool fTimestamp = mapHeights.count("timestampindex") && mapHeights["timestampindex"] <= h;
+            if (fTimestamp && !fLogicalTS) {
+                if (pindex->pprev)
+                    pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), nLogicalTS);
+                fLogicalTS = true;
+            }
+            if ((pindex->nStatus & BLOCK_HAVE_MASK) != BLOCK_HAVE_MASK) {
+                if (fAddress)
+                    mapStartHeights["addressindex"] = h + 1;
+                if (fSpent)
+                    mapStartHeights["spentindex"] = h + 1;
+            }
+            if (!BuildBlockIndexes(pindex, fAddress, fSpent, fTimestamp, addressIndex, addressUnspentIndex, spentIndex, timestampIndex, nLogicalTS)) {
+                LogPrintf("%s: stopped building the indexes at height %d, they will continue from there at the next start\n", __func__, h);
+                return;
+            }
+        }
+
+        if (!pblocktree->WriteAddressIndex(addressIndex, true) || !pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex) ||
+                !pblocktree->UpdateSpentIndex(spentIndex) || !pblocktree->WriteTimestampIndex(timestampIndex)) {
+            LogPrintf("%s: failed to write the indexes at height %d, they will continue from there at the next start\n", __func__, nHeight);
+            return;
+        }
+        for (const auto& item : mapStartHeights)
+            pblocktree->WriteIndexStartHeight(item.first, item.second);
+
+        // Blocks connected from here on are indexed by ConnectBlock
+        bool fDone = nStop >= chainActive.Height();
+        for (const auto& item : mapHeights) {
+            if (fDone) {
+                pblocktree->EraseIndexBuildHeight(item.first);
+                int nStartHeight;
+                if (pblocktree->ReadIndexStartHeight(item.first, nStartHeight))
+                    LogPrintf("%s: %s built up to height %d in %ds, it only has every block from height %d, the data of the ones below was left out\n", __func__, item.first, chainActive.Height(), (GetTimeMillis() - nStart) / 1000, nStartHeight);
+                else
+                    LogPrintf("%s: %s built up to height %d in %ds\n", __func__, item.first, chainActive.Height(), (GetTimeMillis() - nStart) / 1000);
+            } else if (item.second <= nStop) {
+                pblocktree->WriteIndexBuildHeight(item.first, nStop + 1);
+            }
+        }
+    }
+}
+
+bool CheckIndexCoverage(const std::string& name, int nStart, int nEnd, std::string& strError)
+{
+    LOCK(cs_main);
+
+    int nStartHeight = 0;
+    pblocktree->ReadIndexStartHeight(name, nStartHeight);
+    int nBuildHeight;
+    bool fBuilding = pblocktree->ReadIndexBuildHeight(name, nBuildHeight);
+
+    // While it is being built, the index also has the blocks connected since it was turned on, but they
+    // aren't known here
+    int nHave = fBuilding ? nBuildHeight - 1 : chainActive.Height();
+    nEnd = nEnd > 0 ? std::min(nEnd, chainActive.Height()) : chainActive.Height();
+    if (nStart >= nStartHeight && nEnd <= nHave)
+        return true;
+
+    if (fBuilding)
+        strError = strprintf("%s is being built, so far it has every block from height %d to %d", name, nStartHeight, nHave);
+    else
+        strError = strprintf("%s only has every block from height %d, the data of the blocks below wasn't available when it was built", name, nStartHeight);
+    return false;
 }
 
 bool LoadBlockIndex(const CChainParams& chainparams)
@@ -27,6 +27,7 @@
 
 #include <algorithm>
 #include <exception>
+#include <functional>
 #include <map>
 #include <set>
 #include <stdint.h>
@@ -146,9 +147,15 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Default for -checkblockhashes */
+static const bool DEFAULT_CHECK_BLOCK_HASHES = false;
 static const bool DEFAULT_TXINDEX = true;
 static const bool DEFAULT_TOKENINDEX = true;
+static const bool DEFAULT_TOKENRICHINDEX = false;
+/** Default for -tokennamefilter, the token name filter is wrong for 1 in this many names that don't exist */
+static const unsigned int DEFAULT_TOKEN_NAME_FILTER_RATE = 10000;
 static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_ADDRESSBALANCEINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
 /** Default for -dbmaxfilesize , in MB */
@@ -194,7 +201,10 @@ extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fTokenIndex;
+extern bool fTokenRichIndex;
+extern unsigned int nTokenNameFilterRate;
 extern bool fAddressIndex;
+extern bool fAddressBalanceIndex;
 extern bool fSpentIndex;
 extern bool fTimestampIndex;
 extern bool fIsBareMultisigStd;
@@ -227,6 +237,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 extern bool fHavePruned;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
+/** True if the chainstate was loaded from a UTXO snapshot, so the blocks before its base have no data. */
+extern bool fSnapshotChainstate;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
@@ -293,10 +305,26 @@ bool LoadGenesisBlock(const CChainParams& chainparams);
 bool LoadBlockIndex(const CChainParams& chainparams);
 /** Update the chain tip based on database information. */
 bool LoadChainTip(const CChainParams& chainparams);
+/** Make the block a UTXO snapshot was taken at the tip, once the snapshot is in the coins and token databases. */
+bool ActivateSnapshotTip(CBlockIndex* pindexBase, unsigned int nChainTx, const uint256& nStakeModifier);
 /** Unload database information */
 void UnloadBlockIndex();
+/** Recompute the header hash of every loaded block index entry and compare it with the stored one */
+void ThreadCheckBlockIndexHashes();
+/** Add the blocks connected before -addressindex, -spentindex or -timestampindex was turned on to the index */
+void ThreadIndexBuilder();
+/** Turn on an index ("addressindex", "spentindex" or "timestampindex") and have ThreadIndexBuilder add the blocks connected so far */
+bool StartIndexBuild(const std::string& name);
+/** Whether an index is still being built, and the height below which it has every block of the active chain */
+bool GetIndexBuildHeight(const std::string& name, int& nHeight);
+/** Whether an index was built without the blocks that had no data, and the height from which it has every block */
+bool GetIndexStartHeight(const std::string& name, int& nHeight);
+/** Whether an index has every block of the active chain from height nStart to nEnd (0 for the tip), and otherwise which ones it has */
+bool CheckIndexCoverage(const std::string& name, int nStart, int nEnd, std::string& strError);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the token checking thread */
+void ThreadTokenCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 bool IsInitialSyncSpeedUp();
@@ -419,6 +447,36 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the token transfer checks of one transaction.
+ * Holds copies of the token coins it spends, so that it doesn't need the
+ * coins view, and writes its result to a state owned by the caller.
+ */
+class CTokenCheck
+{
+private:
+    const CTransaction *ptx;
+    std::vector<Coin> vTokenCoins;
+    int nSpendHeight;
+    int64_t nSpendTime;
+    CValidationState *pstate;
+
+public:
+    CTokenCheck(): ptx(nullptr), nSpendHeight(0), nSpendTime(0), pstate(nullptr) {}
+    CTokenCheck(const CTransaction& txIn, std::vector<Coin>&& vTokenCoinsIn, int nSpendHeightIn, int64_t nSpendTimeIn, CValidationState* pstateIn) :
+        ptx(&txIn), vTokenCoins(std::move(vTokenCoinsIn)), nSpendHeight(nSpendHeightIn), nSpendTime(nSpendTimeIn), pstate(pstateIn) { }
+
+    bool operator()();
+
+    void swap(CTokenCheck &check) {
+        std::swap(ptx, check.ptx);
+        vTokenCoins.swap(check.vTokenCoins);
+        std::swap(nSpendHeight, check.nSpendHeight);
+        std::swap(nSpendTime, check.nSpendTime);
+        std::swap(pstate, check.pstate);
+    }
+};
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
@@ -431,6 +489,12 @@ bool GetAddressIndex(uint160 addressHash, int type, std::string tokenName,
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
+bool ForEachAddressIndex(uint160 addressHash, int type, std::string tokenName, int start, int end,
+                         const CAddressIndexKey* pafter, std::function<bool(const CAddressIndexKey&, const CAmount&)> fn);
+bool ForEachAddressIndex(const std::vector<std::pair<uint160, int> >& addresses, std::string tokenName, int start, int end,
+                         const CAddressIndexKey* pafter, std::function<bool(const CAddressIndexKey&, const CAmount&)> fn);
+bool GetAddressBalance(uint160 addressHash, int type, std::string tokenName,
+                       std::vector<std::pair<std::string, CAddressBalanceValue> > &balances);
 bool GetAddressUnspent(uint160 addressHash, int type, std::string tokenName,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
 bool GetAddressUnspent(uint160 addressHash, int type,
@@ -500,8 +564,8 @@ extern CBlockTreeDB *pblocktree;
 extern CTokensDB *ptokensdb;
 /** Global variable that point to the active tokens (protexted by cs_main) */
 extern CTokensCache *ptokens;
-/** Global variable that point to the tokens LRU Cache (protexted by cs_main) */
-extern CLRUCache<std::string, CDatabasedTokenData> *ptokensCache;
+/** Global variable that point to the tokens LRU Cache (has its own locks, cs_main isn't needed) */
+extern CShardedLRUCache<std::string, CDatabasedTokenData> *ptokensCache;
 /** TOKENS END */
 
 /**
@@ -550,6 +550,88 @@ BOOST_FIXTURE_TEST_SUITE(wallet_tests, WalletTestingSetup)
         BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(), 5000 * COIN);
     }
 
+// Check that the staking candidate index only returns mature outputs and
+// follows coin locking without a wallet rescan.
+    BOOST_FIXTURE_TEST_CASE(stake_candidates_test, TestChain100Setup)
+    {
+        BOOST_TEST_MESSAGE("Running Stake Candidates Test");
+
+        CWallet wallet;
+        LOCK2(cs_main, wallet.cs_wallet);
+        wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+        for (size_t i = 0; i < coinbaseTxns.size(); i++) {
+            CWalletTx wtx(&wallet, MakeTransactionRef(coinbaseTxns[i]));
+            wtx.SetMerkleBranch(chainActive[i + 1], 0);
+            wallet.AddToWallet(wtx);
+        }
+
+        // Coinbase outputs need both stake and coinbase maturity
+        const Consensus::Params& consensusParams = Params().GetConsensus();
+        int nMinDepth = std::max(std::max(1, consensusParams.nStakeMaturity), consensusParams.nCoinbaseMaturity + 1);
+        size_t nExpected = 0;
+        for (size_t i = 0; i < coinbaseTxns.size(); i++) {
+            if (chainActive.Height() - (int)i >= nMinDepth)
+                nExpected++;
+        }
+
+        std::vector<COutput> vCoins;
+        wallet.AvailableCoinsForStaking(vCoins);
+        BOOST_CHECK_EQUAL(vCoins.size(), nExpected);
+        for (const COutput& output : vCoins)
+            BOOST_CHECK(output.nDepth >= nMinDepth);
+
+        if (nExpected == 0)
+            return;
+
+        COutPoint locked(coinbaseTxns.front().GetHash(), 0);
+        wallet.LockCoin(locked);
+        wallet.AvailableCoinsForStaking(vCoins);
+        BOOST_CHECK_EQUAL(vCoins.size(), nExpected - 1);
+
+        wallet.UnlockCoin(locked);
+        wallet.AvailableCoinsForStaking(vCoins);
+        BOOST_CHECK_EQUAL(vCoins.size(), nExpected);
+    }
+
+// Check that the kernel pre-check finds a kernel among the mature staking
+// candidates of each stake worker, and none when the target is out of reach.
+    BOOST_FIXTURE_TEST_CASE(stake_kernel_test, TestChain100Setup)
+    {
+        BOOST_TEST_MESSAGE("Running Stake Kernel Test");
+
+        CWallet wallet;
+        LOCK2(cs_main, wallet.cs_wallet);
+        wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+        for (size_t i = 0; i < coinbaseTxns.size(); i++) {
+            CWalletTx wtx(&wallet, MakeTransactionRef(coinbaseTxns[i]));
+            wtx.SetMerkleBranch(chainActive[i + 1], 0);
+            wallet.AddToWallet(wtx);
+        }
+
+        // Any hash meets the easy target, none meets the hard one
+        const unsigned int nBitsEasy = 0x2100ffff;
+        const unsigned int nBitsHard = 0x03000001;
+        const uint32_t nTimeBlock = (chainActive.Tip()->nTime + 16) & ~STAKE_TIMESTAMP_MASK;
+        const unsigned int nShards = 4;
+        int nMaxHeightFrom = chainActive.Height() + 1 - Params().GetConsensus().nStakeMaturity;
+
+        std::vector<bool> vShardMature(nShards, false);
+        for (size_t i = 0; i < coinbaseTxns.size(); i++) {
+            COutPoint prevout(coinbaseTxns[i].GetHash(), 0);
+            if ((int)i + 1 <= nMaxHeightFrom)
+                vShardMature[CStakeShard::IndexOf(prevout, nShards)] = true;
+        }
+        bool fAnyMature = std::find(vShardMature.begin(), vShardMature.end(), true) != vShardMature.end();
+
+        BOOST_CHECK_EQUAL(wallet.HaveStakeKernel(nBitsEasy, nTimeBlock), fAnyMature);
+        BOOST_CHECK(!wallet.HaveStakeKernel(nBitsHard, nTimeBlock));
+        for (unsigned int i = 0; i < nShards; i++) {
+            CStakeShard shard(i, nShards, nullptr);
+            BOOST_CHECK_EQUAL(wallet.HaveStakeKernel(nBitsEasy, nTimeBlock, &shard), vShardMature[i]);
+            BOOST_CHECK(!wallet.HaveStakeKernel(nBitsHard, nTimeBlock, &shard));
+        }
+    }
+
     static int64_t AddTx(CWallet &wallet, uint32_t lockTime, int64_t mockTime, int64_t blockTime)
     {
         CMutableTransaction tx;
@@ -717,4 +799,42 @@ BOOST_FIXTURE_TEST_SUITE(wallet_tests, WalletTestingSetup)
         BOOST_CHECK_EQUAL(list.begin()->second.size(), 2L);
     }
 
+// Check that a stake worker still holding the coins of its block template
+// skips a selected coin that was zapped from the wallet in the meantime.
+    BOOST_FIXTURE_TEST_CASE(stake_coins_zap_test, ListCoinsTestingSetup)
+    {
+        BOOST_TEST_MESSAGE("Running Stake Coins Zap Test");
+
+        LOCK2(cs_main, wallet->cs_wallet);
+
+        // Any hash meets the easy target
+        const unsigned int nBitsEasy = 0x2100ffff;
+        const uint32_t nTimeBlock = (chainActive.Tip()->nTime + 16) & ~STAKE_TIMESTAMP_MASK;
+
+        CStakeCoins coins;
+        BOOST_REQUIRE(wallet->SelectCoinsForStaking(coins, 1));
+        BOOST_REQUIRE_EQUAL(coins.vSlices.size(), 1U);
+        BOOST_REQUIRE_EQUAL(coins.vSlices[0].vKernels.size(), 1U);
+        const COutPoint prevout = coins.vSlices[0].vKernels[0].first;
+        BOOST_CHECK(coins.setCoins.count(prevout));
+
+        std::atomic<bool> fKernelFound(false);
+        CStakeShard shard(0, 1, &fKernelFound, &coins);
+        CMutableTransaction txCoinStake;
+        CKey key;
+        BOOST_CHECK(wallet->CreateCoinStake(*wallet, nBitsEasy, 0, nTimeBlock, txCoinStake, key, &shard));
+        BOOST_REQUIRE(!txCoinStake.vin.empty());
+        BOOST_CHECK(txCoinStake.vin[0].prevout == prevout);
+
+        std::vector<uint256> vHashIn{prevout.hash}, vHashOut;
+        BOOST_CHECK_EQUAL(wallet->ZapSelectTx(vHashIn, vHashOut), DB_LOAD_OK);
+        BOOST_REQUIRE_EQUAL(vHashOut.size(), 1U);
+        BOOST_CHECK(wallet->mapWallet.count(prevout.hash) == 0);
+
+        // The shard still points at the coins selected before the zap
+        CMutableTransaction txStale;
+        BOOST_CHECK(!wallet->CreateCoinStake(*wallet, nBitsEasy, 0, nTimeBlock, txStale, key, &shard));
+        BOOST_CHECK(txStale.vin.empty());
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
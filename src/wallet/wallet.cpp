@@ -963,6 +963,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 
     // Break debit/credit balance caches:
     wtx.MarkDirty();
+    MarkStakeDirty(wtx);
 
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -1116,6 +1117,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.setAbandoned();
             wtx.MarkDirty();
+            MarkStakeDirty(wtx);
             walletdb.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
@@ -1181,6 +1183,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
+            MarkStakeDirty(wtx);
             walletdb.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1286,7 +1289,7 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter, CTokenO
                 if (IsMine(prev.tx->vout[txin.prevout.n]) & filter) {
                     // if token get that tokens data from the scriptPubKey
                     if (prev.tx->vout[txin.prevout.n].scriptPubKey.IsTokenScript())
-                        GetTokenData(prev.tx->vout[txin.prevout.n].scriptPubKey, tokenData);
+                        GetTokenData(*prev.tx, txin.prevout.n, tokenData);
 
                     return prev.tx->vout[txin.prevout.n].nValue;
                 }
@@ -1583,7 +1586,7 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
             if (txout.scriptPubKey.IsTokenScript()) {
                 CTokenOutputEntry tokenoutput;
                 tokenoutput.vout = i;
-                GetTokenData(txout.scriptPubKey, tokenoutput);
+                GetTokenData(*tx, i, tokenoutput);
 
                 // The only token type we send is transfer_token. We need to skip all other types for the sent category
                 if (nDebit > 0 && tokenoutput.type == TX_TRANSFER_TOKEN)
@@ -2343,23 +2346,23 @@ void CWallet::AvailableCoinsAll(std::vector<COutput>& vCoins, std::map<std::stri
                 if (fGetTokens && AreTokensDeployed() && isTokenScript) {
                     uint32_t nTokenLockTime = 0;
                     if ( nType == TX_TRANSFER_TOKEN) {
-                        if (TransferTokenFromScript(pcoin->tx->vout[i].scriptPubKey, tokenTransfer, address)) {
+                        if (TransferTokenFromTransaction(*pcoin->tx, i, tokenTransfer, address)) {
                             strTokenName = tokenTransfer.strName;
                             fWasTransferTokenOutPoint = true;
                             nTokenLockTime = tokenTransfer.nTokenLockTime;
                         }
                     } else if ( nType == TX_NEW_TOKEN && !fIsOwner) {
-                        if (TokenFromScript(pcoin->tx->vout[i].scriptPubKey, token, address)) {
+                        if (TokenFromTransaction(*pcoin->tx, i, token, address)) {
                             strTokenName = token.strName;
                             fWasNewTokenOutPoint = true;
                         }
                     } else if ( nType == TX_NEW_TOKEN && fIsOwner) {
-                        if (OwnerTokenFromScript(pcoin->tx->vout[i].scriptPubKey, ownerName, address)) {
+                        if (OwnerFromTransaction(*pcoin->tx, i, ownerName, address)) {
                             strTokenName = ownerName;
                             fWasOwnerTokenOutPoint = true;
                         }
                     } else if ( nType == TX_REISSUE_TOKEN) {
-                        if (ReissueTokenFromScript(pcoin->tx->vout[i].scriptPubKey, reissue, address)) {
+                        if (ReissueTokenFromTransaction(*pcoin->tx, i, reissue, address)) {
                             strTokenName = reissue.strName;
                             fWasReissueTokenOutPoint = true;
                         }
@@ -2499,39 +2502,142 @@ std::map<CTxDestination, std::vector<COutput>> CWallet::ListTokens() const
 
 /** TOKENS END */
 
+void CWallet::MarkStakeDirty(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet); // setStakeDirty
+    setStakeDirty.insert(wtx.GetHash());
+
+    // Spending a coin takes it out of the staking set
+    if (!wtx.IsCoinBase()) {
+        for (const CTxIn& txin : wtx.tx->vin)
+            setStakeDirty.insert(txin.prevout.hash);
+    }
+}
+
+void CWallet::EraseStakeCandidate(const COutPoint& outpoint) const
+{
+    auto it = mapStakeCandidates.find(outpoint);
+    if (it == mapStakeCandidates.end())
+        return;
+
+    auto bucket = mapStakeBuckets.find(it->second);
+    if (bucket != mapStakeBuckets.end()) {
+        bucket->second.erase(outpoint);
+        if (bucket->second.empty())
+            mapStakeBuckets.erase(bucket);
+    }
+    mapStakeCandidates.erase(it);
+    stakeCache.erase(outpoint);
+}
+
+void CWallet::UpdateStakeCandidate(const CWalletTx& wtx, unsigned int n) const
+{
+    const COutPoint outpoint(wtx.GetHash(), n);
+    EraseStakeCandidate(outpoint);
+
+    const CTxOut& txout = wtx.tx->vout[n];
+    if (txout.nValue <= 0 || txout.scriptPubKey.IsTokenScript())
+        return;
+
+    if (IsMine(txout) == ISMINE_NO || IsSpent(outpoint.hash, n) || IsLockedCoin(outpoint.hash, n))
+        return;
+
+    const CBlockIndex* pindex;
+    if (wtx.GetDepthInMainChain(pindex) < 1)
+        return;
+
+    // Height of the tip at which the output becomes stakeable, see the
+    // nStakeMaturity and GetBlocksToMaturity() checks in AvailableCoinsForStaking
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    int nMinDepth = std::max(1, consensusParams.nStakeMaturity);
+    if (wtx.IsCoinBase() || wtx.IsCoinStake())
+        nMinDepth = std::max(nMinDepth, consensusParams.nCoinbaseMaturity + 1);
+    int nEligibleHeight = pindex->nHeight + nMinDepth - 1;
+
+    mapStakeCandidates.emplace(outpoint, nEligibleHeight);
+    mapStakeBuckets[nEligibleHeight].insert(outpoint);
+    stakeCache.emplace(outpoint, CStakeCache(wtx.tx->nTime, txout.nValue, pindex->nHeight));
+}
+
+void CWallet::UpdateStakeCandidates() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (!fStakeCandidatesLoaded) {
+        mapStakeCandidates.clear();
+        mapStakeBuckets.clear();
+        stakeCache.clear();
+        setStakeDirty.clear();
+        for (const std::pair<const uint256, CWalletTx>& item : mapWallet) {
+            for (unsigned int i = 0; i < item.second.tx->vout.size(); i++)
+                UpdateStakeCandidate(item.second, i);
+        }
+        fStakeCandidatesLoaded = true;
+        LogPrint(BCLog::COINSTAKE, "%s: indexed %u staking candidates\n", __func__, mapStakeCandidates.size());
+        return;
+    }
+
+    for (const uint256& hash : setStakeDirty) {
+        auto it = mapWallet.find(hash);
+        if (it == mapWallet.end()) {
+            // Not (or no longer) a wallet transaction, drop whatever we had for it
+            auto candidate = mapStakeCandidates.lower_bound(COutPoint(hash, 0));
+            while (candidate != mapStakeCandidates.end() && candidate->first.hash == hash)
+                EraseStakeCandidate((candidate++)->first);
+            continue;
+        }
+        for (unsigned int i = 0; i < it->second.tx->vout.size(); i++)
+            UpdateStakeCandidate(it->second, i);
+    }
+    setStakeDirty.clear();
+}
+
 void CWallet::AvailableCoinsForStaking(std::vector<COutput>& vCoins) const
 {
+    int64_t nTimeStart = GetTimeMicros();
     vCoins.clear();
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateStakeCandidates();
+
+        // Only visit the buckets that have reached maturity at the current tip
+        const int nHeight = chainActive.Height();
+        for (auto bucket = mapStakeBuckets.begin(); bucket != mapStakeBuckets.end() && bucket->first <= nHeight; ++bucket)
         {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
-            int nDepth = pcoin->GetDepthInMainChain();
+            for (const COutPoint& outpoint : bucket->second)
+            {
+                std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(outpoint.hash);
+                if (it == mapWallet.end())
+                    continue;
 
-            if (nDepth < 1)
-                continue;
+                // The index is refreshed from wallet notifications, which can
+                // lag behind chainActive, so re-check the cheap live conditions
+                const CWalletTx* pcoin = &(*it).second;
+                int nDepth = pcoin->GetDepthInMainChain();
 
-            if (nDepth < Params().GetConsensus().nStakeMaturity)
-                continue;
+                if (nDepth < 1)
+                    continue;
 
-            if (pcoin->GetBlocksToMaturity() > 0)
-                continue;
+                if (nDepth < Params().GetConsensus().nStakeMaturity)
+                    continue;
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-                isminetype mine = IsMine(pcoin->tx->vout[i]);
-                bool isTokenScript = pcoin->tx->vout[i].scriptPubKey.IsTokenScript();
+                if (pcoin->GetBlocksToMaturity() > 0)
+                    continue;
+
+                if (IsSpent(outpoint.hash, outpoint.n))
+                    continue;
+
+                isminetype mine = IsMine(pcoin->tx->vout[outpoint.n]);
                 bool solvable = (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO;
                 bool spendable = ((mine & ISMINE_SPENDABLE) != ISMINE_NO) || (((mine & ISMINE_WATCH_ONLY) != ISMINE_NO) && solvable);
-                if (!isTokenScript && !(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, i) && (pcoin->tx->vout[i].nValue > 0)) {
-                        vCoins.push_back(COutput(pcoin, i, nDepth, spendable, solvable, pcoin->IsTrusted()));
-                    }
+                vCoins.push_back(COutput(pcoin, outpoint.n, nDepth, spendable, solvable, pcoin->IsTrusted()));
             }
         }
     }
+
+    stakeStats.nAvailableCoinsMicros += GetTimeMicros() - nTimeStart;
 }
 
 bool CWallet::SelectCoinsForStaking(CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
@@ -2573,7 +2679,38 @@ bool CWallet::SelectCoinsForStaking(CAmount& nTargetValue, std::set<std::pair<co
     return true;
 }
 
-bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key)
+bool CWallet::SelectCoinsForStaking(CStakeCoins& coins, unsigned int nShards) const
+{
+    coins = CStakeCoins();
+    coins.nBalance = GetBalance();
+    if (coins.nBalance <= nReserveBalance)
+        return false;
+
+    // Select coins with suitable depth
+    CAmount nTargetValue = coins.nBalance - nReserveBalance;
+    CAmount nValueIn = 0;
+    std::set<std::pair<const CWalletTx*,unsigned int> > setCoins;
+
+    // Keep the wallet locked until the selected transactions are reduced to outpoints
+    LOCK2(cs_main, cs_wallet);
+    if (!SelectCoinsForStaking(nTargetValue, setCoins, nValueIn) || setCoins.empty())
+        return false;
+
+    // Copy the kernel inputs of the selected coins out of the staking index,
+    // so the search runs without holding cs_main or cs_wallet
+    coins.vSlices.resize(std::max(nShards, 1u));
+    for(const std::pair<const CWalletTx*,unsigned int> &pcoin : setCoins)
+    {
+        COutPoint prevout(pcoin.first->GetHash(), pcoin.second);
+        coins.setCoins.insert(prevout);
+        auto it = stakeCache.find(prevout);
+        if (it != stakeCache.end())
+            coins.vSlices[CStakeShard::IndexOf(prevout, coins.vSlices.size())].vKernels.emplace_back(prevout, it->second);
+    }
+    return true;
+}
+
+bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key, const CStakeShard* pshard)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
     arith_uint256 bnTargetPerCoinDay;
@@ -2588,129 +2725,154 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, con
     scriptEmpty.clear();
     txNew.vout.push_back(CTxOut(0, scriptEmpty));
 
-    // Choose coins to use
-    CAmount nBalance = GetBalance();
-
-    if (nBalance <= nReserveBalance)
+    // Choose coins to use, the stake workers share the ones selected for their block template
+    CStakeCoins coinsSelected;
+    const CStakeCoins* pcoins = pshard ? pshard->pcoins : nullptr;
+    if (!pcoins) {
+        if (!SelectCoinsForStaking(coinsSelected, pshard ? pshard->nCount : 1))
+            return false;
+        pcoins = &coinsSelected;
+    }
+    unsigned int nShard = pshard && pshard->nCount > 1 ? pshard->nIndex : 0;
+    if (nShard >= pcoins->vSlices.size())
         return false;
 
-    std::vector<const CWalletTx*> vwtxPrev;
-
-    std::set<std::pair<const CWalletTx*,unsigned int> > setCoins;
-    CAmount nValueIn = 0;
-
-    // Select coins with suitable depth
-    CAmount nTargetValue = nBalance - nReserveBalance;
-    if (!SelectCoinsForStaking(nTargetValue, setCoins, nValueIn))
-        return false;
+    const CAmount nBalance = pcoins->nBalance;
+    const std::set<COutPoint>& setCoins = pcoins->setCoins;
+    const std::vector<std::pair<COutPoint, CStakeCache> >& vKernels = pcoins->vSlices[nShard].vKernels;
 
-    if (setCoins.empty())
-        return false;
+    // The selected coins may have been removed from the wallet since they were
+    // selected, so keep a reference to each previous transaction while it is used
+    auto getPrevTx = [this](const COutPoint& prevout) -> CTransactionRef {
+        AssertLockHeld(cs_wallet);
+        auto mi = mapWallet.find(prevout.hash);
+        if (mi == mapWallet.end() || prevout.n >= mi->second.tx->vout.size())
+            return nullptr;
+        return mi->second.tx;
+    };
 
-    if(stakeCache.size() > setCoins.size() + 100){
-        //Determining if the cache is still valid is harder than just clearing it when it gets too big, so instead just clear it
-        //when it has more than 100 entries more than the actual setCoins.
-        stakeCache.clear();
-    }
+    std::vector<CTransactionRef> vwtxPrev;
 
     int64_t nCredit = 0;
     CScript scriptPubKeyKernel;
-    for(const std::pair<const CWalletTx*,unsigned int> &pcoin : setCoins)
+    CStakeKernelSearch kernelSearch(pindexPrev, nBits, Params().GetConsensus());
+    for(int nKernel = kernelSearch.Find(vKernels, nTimeBlock); nKernel >= 0; nKernel = kernelSearch.Find(vKernels, nTimeBlock, nKernel + 1))
     {
-        bool fKernelFound = false;
         boost::this_thread::interruption_point();
-        // Search backward in time from the given txNew timestamp
-        // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        if (CheckKernel(pindexPrev, nBits, nTimeBlock, prevoutStake, *pcoinsTip, stakeCache))
+        const COutPoint& prevoutStake = vKernels[nKernel].first;
+
+        // Another worker already found a kernel for this block
+        if (pshard && pshard->IsKernelFound())
+            return false;
+
         {
-            // Found a kernel
-            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : kernel found\n");
-            std::vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
-            {
-                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
-            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
+            // The staking index follows wallet notifications, which may lag
+            // behind the tip, so make sure the kernel still matches the chain
+            LOCK(cs_main);
+            if (chainActive.Tip() != pindexPrev)
+                return false;
+            if (!CheckStakeCache(pindexPrev, prevoutStake, vKernels[nKernel].second, *pcoinsTip))
+                continue;
+        }
+
+        CTransactionRef txKernel;
+        {
+            LOCK(cs_wallet);
+            txKernel = getPrevTx(prevoutStake);
+        }
+        if (!txKernel)
+            continue;
+
+        // Found a kernel
+        LogPrint(BCLog::COINSTAKE, "CreateCoinStake : kernel found\n");
+        std::vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = txKernel->vout[prevoutStake.n].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+        {
+            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to parse kernel\n");
+            break;
+        }
+        LogPrint(BCLog::COINSTAKE, "CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
+        {
+            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : no support for kernel type=%d\n", whichType);
+            break;  // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            // convert to pay to public key type
+            uint160 hash160(vSolutions[0]);
+            CKeyID pubKeyHash(hash160);
+            if (!keystore.GetKey(pubKeyHash, key))
             {
-                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break;  // only support pay to public key and pay to address
+                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                break;  // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
+            scriptPubKeyOut << key.GetPubKey().getvch() << OP_CHECKSIG;
+        }
+        if (whichType == TX_PUBKEY)
+        {
+            valtype& vchPubKey = vSolutions[0];
+            CPubKey pubKey(vchPubKey);
+            uint160 hash160(Hash160(vchPubKey));
+            CKeyID pubKeyHash(hash160);
+            if (!keystore.GetKey(pubKeyHash, key))
             {
-                // convert to pay to public key type
-                uint160 hash160(vSolutions[0]);
-                CKeyID pubKeyHash(hash160);
-                if (!keystore.GetKey(pubKeyHash, key))
-                {
-                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break;  // unable to find corresponding public key
-                }
-                scriptPubKeyOut << key.GetPubKey().getvch() << OP_CHECKSIG;
+                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                break;  // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEY)
-            {
-                valtype& vchPubKey = vSolutions[0];
-                CPubKey pubKey(vchPubKey);
-                uint160 hash160(Hash160(vchPubKey));
-                CKeyID pubKeyHash(hash160);
-                if (!keystore.GetKey(pubKeyHash, key))
-                {
-                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break;  // unable to find corresponding public key
-                }
 
-                if (key.GetPubKey() != pubKey)
-                {
-                    LogPrint(BCLog::COINSTAKE, "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
-                    break; // keys mismatch
-                }
-
-                scriptPubKeyOut = scriptPubKeyKernel;
+            if (key.GetPubKey() != pubKey)
+            {
+                LogPrint(BCLog::COINSTAKE, "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
+                break; // keys mismatch
             }
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
-
-            LogPrint(BCLog::COINSTAKE, "CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
+            scriptPubKeyOut = scriptPubKeyKernel;
         }
 
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        txNew.vin.push_back(CTxIn(prevoutStake));
+        nCredit += txKernel->vout[prevoutStake.n].nValue;
+        vwtxPrev.push_back(txKernel);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+
+        LogPrint(BCLog::COINSTAKE, "CreateCoinStake : added kernel type=%d\n", whichType);
+        break; // if kernel is found stop searching
     }
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
 
-    for(const std::pair<const CWalletTx*,unsigned int> &pcoin : setCoins)
     {
-        // Attempt to add more inputs
-        // Only add coins of the same key/address as kernel
-        if (txNew.vout.size() == 2 && ((pcoin.first->tx->vout[pcoin.second].scriptPubKey == scriptPubKeyKernel || pcoin.first->tx->vout[pcoin.second].scriptPubKey == txNew.vout[1].scriptPubKey))
-                && pcoin.first->GetHash() != txNew.vin[0].prevout.hash)
+        LOCK(cs_wallet);
+        for(const COutPoint &prevout : setCoins)
         {
-            // Stop adding more inputs if already too many inputs
-            if (txNew.vin.size() >= GetStakeMaxCombineInputs())
-                break;
-            // Stop adding inputs if reached reserve limit
-            if (nCredit + pcoin.first->tx->vout[pcoin.second].nValue > nBalance - nReserveBalance)
-                break;
-            // Do not add additional significant input
-            if (pcoin.first->tx->vout[pcoin.second].nValue >= GetStakeCombineThreshold())
+            CTransactionRef txPrev = getPrevTx(prevout);
+            if (!txPrev)
                 continue;
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
+            // Attempt to add more inputs
+            // Only add coins of the same key/address as kernel
+            const CTxOut& txout = txPrev->vout[prevout.n];
+            if (txNew.vout.size() == 2 && ((txout.scriptPubKey == scriptPubKeyKernel || txout.scriptPubKey == txNew.vout[1].scriptPubKey))
+                    && prevout.hash != txNew.vin[0].prevout.hash)
+            {
+                // Stop adding more inputs if already too many inputs
+                if (txNew.vin.size() >= GetStakeMaxCombineInputs())
+                    break;
+                // Stop adding inputs if reached reserve limit
+                if (nCredit + txout.nValue > nBalance - nReserveBalance)
+                    break;
+                // Do not add additional significant input
+                if (txout.nValue >= GetStakeCombineThreshold())
+                    continue;
+
+                txNew.vin.push_back(CTxIn(prevout));
+                nCredit += txout.nValue;
+                vwtxPrev.push_back(txPrev);
+            }
         }
     }
 
@@ -2749,9 +2911,9 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, con
 
     // Sign the input coins
     int nIn = 0;
-    for(const CWalletTx* pcoin : vwtxPrev)
+    for(const CTransactionRef& txPrev : vwtxPrev)
     {
-        if (!SignSignature(*this, *pcoin->tx, txNew, nIn++, SIGHASH_ALL))
+        if (!SignSignature(*this, *txPrev, txNew, nIn++, SIGHASH_ALL))
             return error("CreateCoinStake : failed to sign coinstake");
     }
 
@@ -2767,6 +2929,39 @@ bool CWallet::HaveAvailableCoinsForStaking() const
     return vCoins.size() > 0;
 }
 
+bool CWallet::HaveStakeKernel(unsigned int nBits, uint32_t nTimeBlock, const CStakeShard* pshard) const
+{
+    // The staking index holds every output CreateCoinStake could pick, so
+    // if none of them meets the target there is no point building a block
+    const CBlockIndex* pindexPrev;
+    {
+        LOCK2(cs_main, cs_wallet);
+        pindexPrev = chainActive.Tip();
+        UpdateStakeCandidates();
+    }
+
+    // Searched in place, only holding cs_wallet
+    int64_t nTimeStart = GetTimeMicros();
+    CStakeKernelSearch kernelSearch(pindexPrev, nBits, Params().GetConsensus());
+    uint64_t nChecked = 0;
+    bool fFound = false;
+    {
+        LOCK(cs_wallet);
+        for (const std::pair<const COutPoint, CStakeCache>& entry : stakeCache) {
+            if (pshard && !pshard->Contains(entry.first))
+                continue;
+            nChecked++;
+            if (kernelSearch.Check(entry.first, entry.second, nTimeBlock)) {
+                fFound = true;
+                break;
+            }
+        }
+    }
+    stakeStats.nKernelsChecked += nChecked;
+    stakeStats.nKernelMicros += GetTimeMicros() - nTimeStart;
+    return fFound;
+}
+
 std::map<CTxDestination, std::vector<COutput>> CWallet::ListCoins() const
 {
     // TODO: Add AssertLockHeld(cs_wallet) here.
@@ -4117,6 +4312,9 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
     for (uint256 hash : vHashOut)
         mapWallet.erase(hash);
 
+    // Rebuild the staking index from scratch on the next stake attempt
+    fStakeCandidatesLoaded = false;
+
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
         if (dbw->Rewrite("\x04pool"))
@@ -4658,17 +4856,21 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    setStakeDirty.insert(output.hash);
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    setStakeDirty.insert(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
+    for (const COutPoint& output : setLockedCoins)
+        setStakeDirty.insert(output.hash);
     setLockedCoins.clear();
 }
 
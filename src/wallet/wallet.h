@@ -680,6 +680,40 @@ private:
 };
 
 
+/** Counters kept by the stake threads of a wallet, reported by getstakinginfo */
+struct CStakeStats
+{
+    std::atomic<int64_t> nStartTime{0};
+    std::atomic<uint64_t> nKernelsChecked{0};
+    std::atomic<int64_t> nKernelMicros{0};
+    std::atomic<int64_t> nAvailableCoinsMicros{0};
+    std::atomic<uint64_t> nTemplates{0};
+    std::atomic<int64_t> nTemplateMicros{0};
+    std::atomic<uint64_t> nSignAttempts{0};
+    std::atomic<int64_t> nSignMicros{0};
+    std::atomic<uint64_t> nBlocksSigned{0};
+    std::atomic<uint64_t> nBlocksAccepted{0};
+    std::atomic<uint64_t> nBlocksOrphaned{0};
+    std::atomic<uint64_t> nBlocksExpired{0};
+};
+
+/**
+ * Coins selected for staking once per block template, with the kernel candidates of each stake worker.
+ * They are kept by outpoint because the template outlives changes to mapWallet, CreateCoinStake
+ * looks the transactions up again under cs_wallet.
+ */
+struct CStakeCoins
+{
+    struct Slice
+    {
+        std::vector<std::pair<COutPoint, CStakeCache> > vKernels;
+    };
+
+    CAmount nBalance = 0;
+    std::set<COutPoint> setCoins;
+    std::vector<Slice> vSlices;
+};
+
 /** 
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -757,7 +791,28 @@ private:
 
     std::unique_ptr<CWalletDBWrapper> dbw;
 
-    std::map<COutPoint, CStakeCache> stakeCache;
+    /**
+     * Index of outputs that can be used for staking: confirmed, unspent,
+     * unlocked, non-token outputs that are ours. Entries are bucketed by the
+     * chain height at which they reach stake maturity, so a stake attempt only
+     * walks the buckets at or below the current tip. The index is updated
+     * lazily from the set of wallet transactions touched since the last stake
+     * attempt instead of rescanning mapWallet every time. stakeCache holds
+     * the kernel inputs of every candidate and shares its invalidation, so
+     * the kernel search never has to consult the coins view.
+     */
+    mutable std::map<COutPoint, int> mapStakeCandidates;
+    mutable std::map<COutPoint, CStakeCache> stakeCache;
+    mutable std::map<int, std::set<COutPoint>> mapStakeBuckets;
+    mutable std::set<uint256> setStakeDirty;
+    mutable bool fStakeCandidatesLoaded = false;
+
+    /* Queue a wallet transaction, and the wallet transactions it spends, for staking index refresh. */
+    void MarkStakeDirty(const CWalletTx& wtx);
+    /* Bring mapStakeCandidates up to date. Requires cs_main and cs_wallet. */
+    void UpdateStakeCandidates() const;
+    void UpdateStakeCandidate(const CWalletTx& wtx, unsigned int n) const;
+    void EraseStakeCandidate(const COutPoint& outpoint) const;
 
     boost::thread_group* stakeThread = nullptr;
     void StakeCoins(bool fStake);
@@ -890,6 +945,8 @@ public:
     
     //! select coins for staking from the available coins for staking.
     bool SelectCoinsForStaking(CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    //! select coins for staking and split their kernel inputs between nShards stake workers, see CStakeShard
+    bool SelectCoinsForStaking(CStakeCoins& coins, unsigned int nShards) const;
 
     /**
      * populate vCoins with vector of available COutputs.
@@ -902,6 +959,8 @@ public:
 
     uint64_t GetStakeWeight() const;
     bool HaveAvailableCoinsForStaking() const;
+    //! whether any staking candidate meets the kernel target at nTimeBlock, without selecting coins or building a coinstake
+    bool HaveStakeKernel(unsigned int nBits, uint32_t nTimeBlock, const CStakeShard* pshard = nullptr) const;
 
     /**
      * Return list of available coins and locked coins grouped by non-change output address.
@@ -1051,7 +1110,7 @@ public:
      * selected by SelectCoins(); Also create the change output, when needed
      * @note passing nChangePosInOut as -1 will result in setting a random position
      */
-    bool CreateCoinStake(const CKeyStore &keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key);
+    bool CreateCoinStake(const CKeyStore &keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key, const CStakeShard* pshard = nullptr);
     bool CreateTransactionAll(const std::vector<CRecipient>& vecSend, CWalletTx& wtxNew, CReserveKey& reservekey, CAmount& nFeeRet, int& nChangePosInOut,
                            std::string& strFailReason, const CCoinControl& coin_control, bool fNewToken, const CNewToken& token, const CTxDestination dest, bool fTransferToken, bool fReissueToken, const CReissueToken& reissueToken, const TokenType& tokenType, bool sign = true);
 
@@ -1232,8 +1291,10 @@ public:
     /* Stop staking coins */
     void StopStake() { StakeCoins(false); }
 
-    int64_t m_last_coin_stake_search_time{0};
-    int64_t m_last_coin_stake_search_interval{0};
+    // Written by the first stake worker, read by getstakinginfo
+    std::atomic<int64_t> m_last_coin_stake_search_time{0};
+    std::atomic<int64_t> m_last_coin_stake_search_interval{0};
+    mutable CStakeStats stakeStats;
 };
 
 /** A key allocated from the key pool. */